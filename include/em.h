@@ -17,6 +17,7 @@
 
 #include <hmm.h>
 #include <tree_model.h>
+#include <squarem.h>
 
 //#define EM_CONVERGENCE_THRESHOLD 0.01
 #define EM_CONVERGENCE_THRESHOLD 0.1 /* TEMPORARY! */
@@ -35,6 +36,9 @@
     @param log_function Function to use for logging statistics
     @param emissions_alloc (Optional) Used for emission probabilities (must be large enough for longest sample)
     @param logf Log to save statistics to
+    @param squarem (Optional) If non-NULL, EM is accelerated by SQUAREM extrapolation of the parameters accessed by get_params and set_params (see squarem.h)
+    @param get_params (Required with squarem) Function to obtain the current parameters (those updated in the M step) as a vector of dimension squarem->dim
+    @param set_params (Required with squarem) Function to replace the current parameters, such that subsequent E steps make use of them
     @result Log likelihood of optimized model
     @note HMM and models must be initialized appropriately
     @note Must be one model for every state in the HMM
@@ -50,6 +54,9 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
                        void (*estimate_transitions)(HMM*, void*, double**),
                        int (*get_observation_index)(void*, int, int),
                        void (*log_function)(FILE*, double, HMM*, void*, int),
-                       double **emissions_alloc, FILE *logf);
+                       double **emissions_alloc, FILE *logf,
+                       Squarem *squarem,
+                       void (*get_params)(Vector*, HMM*, void*),
+                       void (*set_params)(Vector*, HMM*, void*));
 
 #endif
@@ -0,0 +1,104 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file fft.h
+    Self-contained radix-2 fast Fourier transform and FFT-based
+    convolution of real sequences, in one and two dimensions.  Used
+    to speed up convolution of large discrete probability
+    distributions (see prob_vector.h and prob_matrix.h).  Transform
+    lengths are always padded up to a power of two.
+    @ingroup base
+*/
+
+#ifndef FFT_H
+#define FFT_H
+
+/** Minimum number of multiply-adds required by a direct convolution
+    before an FFT is even considered.  Below this, the direct method
+    is both fast enough and exact. */
+#define FFT_MIN_DIRECT_OPS 250000
+
+/** Smallest value, relative to the largest element of the result,
+    that FFT convolution can be relied on to reproduce.  Round-off is
+    on the order of 1e-15 relative to the peak and accumulates over
+    repeated convolutions; values below this level (e.g., the far tail
+    of a distribution) are lost, so the direct method is used when
+    they matter. */
+#define FFT_MIN_REL_VALUE 1e-12
+
+/** Return smallest power of two greater than or equal to n
+    @param n Minimum length
+    @result Power of two >= n
+*/
+int fft_size(int n);
+
+/** In-place complex FFT.  Forward transform is unnormalized; inverse
+    transform (inverse != 0) includes the 1/n scale factor.
+    @param re Real parts (length n)
+    @param im Imaginary parts (length n)
+    @param n Length of transform; must be a power of two
+    @param inverse Whether to compute inverse transform
+*/
+void fft_complex(double *re, double *im, int n, int inverse);
+
+/** Linear convolution of two real sequences via FFT.  Computes c[x] =
+    sum_j a[j] * b[x-j] for 0 <= x < nc.  Both input sequences are
+    transformed together as a single complex sequence, so only two
+    transforms of the padded length are required.
+    @param a First sequence
+    @param na Length of a
+    @param b Second sequence
+    @param nb Length of b
+    @param c Output array of length nc (may not alias a or b)
+    @param nc Number of output elements to compute
+*/
+void fft_convolve(double *a, int na, double *b, int nb, double *c, int nc);
+
+/** Two-dimensional linear convolution of two real arrays via FFT.
+    Computes c[x][y] = sum_{j,k} a[j][k] * b[x-j][y-k] for 0 <= x <
+    crows, 0 <= y < ccols.
+    @param a First array (arows x acols)
+    @param b Second array (brows x bcols)
+    @param c Output array (crows x ccols; may not alias a or b)
+*/
+void fft_convolve_2d(double **a, int arows, int acols,
+                     double **b, int brows, int bcols,
+                     double **c, int crows, int ccols);
+
+/** n-fold convolution of a real sequence with itself via FFT.
+    Computes the first nc elements of a o a o ... o a (n times) using
+    a single forward and inverse transform.  The transform length is
+    large enough to hold the complete result or twice nc, whichever
+    is smaller; in the latter case any mass of the complete result
+    beyond the transform length wraps around, so the caller must
+    ensure it is negligible (e.g., by a central limit theorem bound
+    on nc).
+    @param a Input sequence
+    @param na Length of a
+    @param n Number of times to convolve
+    @param c Output array of length nc (may not alias a)
+    @param nc Number of output elements to compute
+*/
+void fft_convolve_power(double *a, int na, int n, double *c, int nc);
+
+/** Decide whether FFT convolution is expected to be cheaper than the
+    direct method.
+    @param direct_ops Approximate number of multiply-adds required by
+    direct convolution
+    @param n Total number of elements in padded transform (product of
+    padded dimensions in the 2-D case)
+    @param min_rel Smallest value of interest in the result, relative
+    to its largest element (e.g., the threshold below which the tail of
+    a probability distribution is discarded)
+    @result 1 if FFT is preferred, 0 otherwise (always 0 if min_rel <
+    FFT_MIN_REL_VALUE)
+*/
+int fft_preferred(double direct_ops, double n, double min_rel);
+
+#endif
@@ -66,6 +66,14 @@ typedef struct {
   Zvector *vec_scratch1_z, *vec_scratch2_z; /**< Scratch memory for complex number vector manipulation. */
   Vector *vec_scratch1_r, *vec_scratch2_r; /**< Scratch memory for real number vector manipulation. */
   double deriv2;                /**< second derivative for 1d case. */
+  int *block_tuples;            /**< Tuple indices of a block of columns
+                                   being fitted simultaneously (see
+                                   col_lrts); NULL if not in use. */
+  int block_size;               /**< Capacity of block_tuples. */
+  double *block_scratch;        /**< Scratch memory for block likelihood
+                                   computations. */
+  int *block_iscratch;          /**< Integer scratch memory for block
+                                   likelihood computations. */
 } ColFitData;
 
 /* data for grid of pre-computed Fisher Information Matrices */
@@ -164,6 +172,47 @@ double col_compute_log_likelihood(TreeModel *mod, MSA *msa, int tupleidx,
 double col_compute_likelihood(TreeModel *mod, MSA *msa, int tupleidx,
 		              double **scratch);
 
+/** Wrapper for likelihood function for use in simultaneous
+   estimation of scale factors for a block of column tuples; version
+   for use with opt_newton_1d_batch.  Evaluates the negative log
+   likelihood of tuple d->block_tuples[idx[k]] at scale x[k] for each
+   k, storing results in fx[k].
+  @param n Number of evaluations requested
+  @param idx Indices into d->block_tuples
+  @param x Scale factors at which to evaluate
+  @param[out] fx Negative log likelihoods
+  @param data Column Fit Data
+  @warning data must be able to cast to type ColFitData, and
+  col_init_block must have been called
+*/
+void col_likelihood_wrapper_1d_batch(int n, int *idx, double *x, double *fx,
+                                     void *data);
+
+/** Compute likelihoods for a block of column tuples using the
+   current substitution matrices of a tree model.
+
+   Equivalent to calling col_compute_likelihood for each tuple, but
+   partial likelihoods for all tuples are computed in a single pass
+   over the tree.
+  @param mod Substitution model, rates and its metadata
+  @param msa Sequence data and its metadata
+  @param tuples Indices of column tuples
+  @param ntuples Number of column tuples
+  @param scratch Pre-allocated scratch memory of at least
+  ((mod->tree->nnodes+1) * mod->rate_matrix->size + 2) * ntuples
+  doubles, or NULL
+  @param[out] lik Likelihood of each tuple
+*/
+void col_compute_likelihood_block(TreeModel *mod, MSA *msa, int *tuples,
+                                  int ntuples, double *scratch, double *lik);
+
+/** Allocate scratch memory for fitting scale factors to blocks of
+   column tuples simultaneously.
+   @param d Column Fit Data
+   @param block_size Maximum number of tuples per block
+*/
+void col_init_block(ColFitData *d, int block_size);
+
 /** \name Column Fit Data likelihood ratio test functions
  \{ */
 
@@ -36,4 +36,28 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
               opt_precision_type precision, int max_its, FILE *logf,
 	      FILE *error_file);
 
+/** Test whether exact gradients (see tm_compute_grad_exact) are
+    available for a model to be fitted with tm_fit.
+    @param mod Tree model, with parameters set up for fitting
+    @result TRUE if tm_compute_grad_exact can be used, FALSE otherwise
+*/
+int tm_exact_grad_supported(TreeModel *mod);
+
+/** Compute the exact gradient of minus the log likelihood of a tree
+    model (in bits, as computed by the objective function used by
+    tm_fit), using one inside/outside pass to obtain expected
+    substitution counts and eigendecomposition-based derivatives of
+    the substitution probability matrices.  Has the signature required
+    for the compute_grad argument of opt_bfgs.
+    @param grad Gradient (output; must be allocated)
+    @param params Current parameter values (mapped as by mod->param_map)
+    @param data Tree model, whose msa and category fields specify the
+    data, and whose tree_posteriors must be allocated with
+    expected_nsubst_tot
+    @param lb Lower bounds (ignored)
+    @param ub Upper bounds (ignored)
+*/
+void tm_compute_grad_exact(Vector *grad, Vector *params, void *data, 
+                           Vector *lb, Vector *ub);
+
 #endif
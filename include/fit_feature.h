@@ -153,7 +153,9 @@ void ff_grad_wrapper(Vector *grad, Vector *params, void *data,
  \{ */
 
 
-/** Calculate scores of full tree using feature fit data
+/** Calculate scores of full tree using feature fit data.  Per-column
+  derivatives are computed once per column tuple and summed over each
+  feature using compensated prefix sums over alignment positions.
   @param[in] mod Tree Model to perform likelihood test on  
   @param[in] msa Multiple Sequence Alignment sequence data.
   @param[out] feat_pvals (Optional) Computed p-values 
@@ -195,6 +197,47 @@ void ff_gerp(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode,
              double *feat_nneut, double *feat_nobs, double *feat_nrejected, 
              double *feat_nspec, FILE *logf);
 
+/** Approximate likelihood ratio tests for multiple features, by
+  summing column-by-column tests (see col_lrts).  Column statistics
+  are computed once per column tuple and each feature is summarized in
+  constant time using compensated prefix sums over alignment positions,
+  which is much faster than ff_lrts for large or overlapping feature
+  sets.
+  @param[in] mod Tree Model to perform likelihood ratio test on
+  @param[in] msa Multiple Sequence Alignment sequence data.
+  @param[in] gff Features to perform likelihood ratio tests for
+  @param[in] mode Which type of scoring to use
+  @param[out] feat_pvals (Optional) p-values, treating twice the summed
+  log likelihood ratio as chi-squared with one degree of freedom per
+  informative column (conservative for CON and ACC modes)
+  @param[out] feat_scales (Optional) mean column scale factor over
+  informative columns of each feature
+  @param[out] feat_llrs (Optional) summed column log likelihood ratios
+  @param logf (Optional) File to log column fitting progress
+  @note Assumes a 0th order model, leaf-to-sequence mapping 
+    already available, probability matrices computed, sufficient statistics available.
+*/
+void ff_lrts_colsum(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode, 
+                    double *feat_pvals, double *feat_scales, 
+                    double *feat_llrs, FILE *logf);
+
+/** Approximate GERP-like scores for multiple features, by summing
+   column-by-column scores (see col_gerp) using compensated prefix
+   sums over alignment positions.
+   @param[in] mod Tree Model to analyze
+   @param[in] msa Multiple Sequence Alignment sequence data
+   @param[in] gff Features to score
+   @param[in] mode What type of score to produce i.e. CON, ACC, NNEUT, CONACC
+   @param[out] feat_nneut (Optional) summed expected number of substitutions under neutrality
+   @param[out] feat_nobs (Optional) summed expected number of substitutions after re-scaling
+   @param[out] feat_nrejected (Optional) summed expected number of rejected substitutions
+   @param[out] feat_nspec (Optional) mean number of species with data per column
+   @param logf (Optional) File to log column fitting progress
+ */
+void ff_gerp_colsum(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode, 
+                    double *feat_nneut, double *feat_nobs, 
+                    double *feat_nrejected, double *feat_nspec, FILE *logf);
+
 /** \name Feature Fit Data check sufficient data to perform analysis functions
  \{ */
 
@@ -0,0 +1,61 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file gz_input.h
+    Transparent reading of gzip-compressed input.  Files opened for
+    reading with phast_fopen (see misc.h) are checked for the gzip
+    signature and, if compressed, are replaced by a stream that
+    delivers the decompressed data, so that all readers that accept a
+    FILE* (e.g., msa_new_from_file_define_format, maf_read, ss_read,
+    gff_read_set, tm_new_from_file) accept compressed files without
+    modification.
+
+    Files in BGZF format (the blocked gzip variant produced by bgzip,
+    consisting of independent gzip members of at most 64 KB each) are
+    decompressed in batches of blocks, with the blocks of each batch
+    decompressed in parallel using the number of threads set by
+    thr_set_nthreads (see parallel.h).  Ordinary gzip files are
+    decompressed serially.  Decompressed streams support seeking
+    (e.g., for fgetpos/fsetpos), but seeking backward beyond the
+    current batch requires decompressing again from the start of
+    the file, and is not possible when reading compressed data from
+    a pipe.  Decompressed streams are not memory-mapped (see
+    maf_scan.h) and cannot be indexed (see maf_index.h).
+
+    Requires zlib and a C library providing fopencookie (e.g., glibc);
+    PHAST must be compiled with PHAST_ZLIB defined.  Otherwise,
+    compressed input is detected but rejected with an error message.
+    @ingroup base
+*/
+
+#ifndef GZ_INPUT_H
+#define GZ_INPUT_H
+
+#include <stdio.h>
+
+/** Test whether a stream may be gzip-compressed, without consuming
+    any input.  Only the first byte of the gzip signature is examined
+    (only one character of pushback is guaranteed); gz_open_stream
+    checks the rest.
+    @param F Stream, positioned at its beginning
+    @result 1 if the stream may be gzip-compressed, 0 otherwise
+*/
+int gz_is_compressed(FILE *F);
+
+/** Create a stream that decompresses a gzip or BGZF stream.  The
+    compressed stream is owned by the new stream and is closed when
+    it is closed (unless it is stdin).  If the stream turns out not to
+    begin with the gzip signature, its contents are passed through
+    unchanged.
+    @param raw Compressed stream, positioned at its beginning
+    @result Stream of decompressed data
+*/
+FILE *gz_open_stream(FILE *raw);
+
+#endif
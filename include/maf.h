@@ -31,6 +31,7 @@
 #include "msa.h"
 #include "hashtable.h"
 #include "gff.h"
+#include "maf_scan.h"
 
 /** Hold data for a single block within a MAF file */
 typedef struct {
@@ -59,6 +60,12 @@ typedef struct {
 /** @name MAF File reading 
    \{ */
 /** Read subset of an Alignment from a MAF file; subset selected by sequence and feature names. 
+   If more than one thread is available (see parallel.h) and F is a
+   regular file, blocks are read by several threads, each building
+   its own tuple table, and the tables are merged at the end.  The
+   result is identical to that of sequential reading.  Reading is
+   always sequential if reverse_groups is non-NULL or if store_order
+   == TRUE and gap_strip_mode == NO_STRIP.
    @pre The MAF file must be sorted with respect to the reference sequence.  
    @param[in] F MAF file
    @param[in] REFSEQ (Optional) reference sequence.  If
@@ -445,6 +452,24 @@ int maf_read_block_addseq(FILE *f, MSA *mini_msa, Hashtable *name_hash,
 			  int *start_idx, int *length, int do_toupper,
 			  int skip_new_species);
 
+/** Add sequences from a MAF file to an existing MAF block, reading
+   from a MafScanner.  Same as maf_read_block_addseq, but lines are
+   scanned in place (without copying) when the file is memory-mapped.
+   @param[in] scan Scanner positioned within MAF data
+   @param[in,out] mini_msa MAF Block is stored here
+   @param[out] name_hash Hash table mapping sequence names to sequence indices (prefix of name wrt '.' character)
+   @param[out] start_idx stating coord of reference sequence
+   @param[out] length Length of reference sequence
+   @param[in] do_toupper Make sequences read in all upper case 
+   @param[in] skip_new_species If mini_msa already contains a given species, don't add it from MAF file
+   @note Allocates memory for sequences if they are NULL (as with first block)
+   @note Reads to next "a" line or EOF
+   @result 0 if successful, EOF if no more blocks available
+*/
+int maf_scan_block_addseq(MafScanner *scan, MSA *mini_msa, 
+                          Hashtable *name_hash, int *start_idx, int *length,
+                          int do_toupper, int skip_new_species);
+
 /** Get partial list of sequence names (roots of names only) and length of refseq.
    @param[in] F File containing MAF Block contents
    @param[out] names List of sequence names
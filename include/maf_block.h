@@ -24,6 +24,7 @@
 #include "stdio.h"
 #include "msa.h"
 #include "hashtable.h"
+#include "maf_scan.h"
 
 /** Holds per-species data for a Maf Block */
 typedef struct {
@@ -75,6 +76,17 @@ void mafBlock_print(FILE *outfile, MafBlock *block, int pretty_print);
 */
 MafBlock *mafBlock_read_next(FILE *mfile, Hashtable *specHash, int *numspec);
 
+/**  Read next block from a MafScanner.  Same as mafBlock_read_next,
+     but the file is scanned in place when it can be memory-mapped.
+     @param scan Scanner positioned within MAF data
+     @param specHash  (Optional) Any new species encountered added to this hash
+     @param numspec   (Optional) Number of species added to specHash
+     @result MafBlock read from MAF file, OR NULL if EOF
+     @warning If you use specHash, you also must use numspec.
+*/
+MafBlock *mafBlock_scan_next(MafScanner *scan, Hashtable *specHash, 
+                             int *numspec);
+
 /** Opens new MAF file for writing and prints minimal header for MAF.  
     @param fn File to write MAF to, NULL == stdout
     @param argc Number of comment lines (in argv below) to write to MAF 
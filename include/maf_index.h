@@ -0,0 +1,136 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file maf_index.h
+    Coordinate indexes for MAF files, allowing random access by
+    position in the reference sequence.  An index records, for every
+    block, the start and size of the reference (first) sequence and
+    the byte offset of the block's "a" line.  It is stored in a
+    sidecar file named by appending ".idx" to the name of the MAF
+    file, with the size and modification time of the MAF file so that
+    stale indexes can be detected.  Indexes can be used for seeking
+    only if the MAF file is sorted with respect to a single reference
+    sequence.
+
+    The sidecar file is plain text: a header line "##maf-index
+    version=2", a line "#size=<n> mtime=<n> sorted=<0|1> nblocks=<n>
+    refseq=<src>", one line "<start> <size> <offset>" per block, with
+    starts 0-based as in the MAF file, and a trailer line "##end".  The
+    block count and trailer allow truncated indexes to be detected;
+    such indexes, like stale ones, are rebuilt by maf_index_load.  The
+    sidecar file is replaced atomically (written to a temporary file
+    and renamed), so concurrent readers never see a partial index.
+    @ingroup msa
+*/
+
+#ifndef MAF_INDEX_H
+#define MAF_INDEX_H
+
+#include <stdio.h>
+
+/** Suffix appended to MAF filename to obtain name of index */
+#define MAF_INDEX_SUFFIX ".idx"
+
+/** Version of sidecar format written and accepted */
+#define MAF_INDEX_VERSION 2
+
+/** Coordinate index of a MAF file */
+typedef struct {
+  char *refseq;      /**< Source name (e.g., hg18.chr1) of reference
+                        sequence in first block */
+  int sorted;        /**< Whether all blocks have the same reference
+                        source and nondecreasing starts */
+  long file_size;    /**< Size of MAF file when indexed */
+  long file_mtime;   /**< Modification time of MAF file when indexed */
+  int nblocks;       /**< Number of blocks */
+  int *start;        /**< Start of each block in reference (0-based) */
+  int *size;         /**< Size of each block in reference */
+  long *offset;      /**< Byte offset of each block in file */
+  int *max_end;      /**< Largest end coordinate (start + size) of
+                        blocks up to and including each block */
+} MafIndex;
+
+/** Build an index by scanning a MAF file.
+    @param F MAF file, positioned at its beginning; must be seekable
+    @result New index (file_size and file_mtime are set from F)
+*/
+MafIndex *maf_index_build(FILE *F);
+
+/** Write an index in sidecar format.
+    @param F Output stream
+    @param idx Index to write
+*/
+void maf_index_write(FILE *F, MafIndex *idx);
+
+/** Read an index in sidecar format.  Dies if the index is malformed,
+    truncated, or of another version.
+    @param F Input stream
+    @result New index
+*/
+MafIndex *maf_index_read(FILE *F);
+
+/** Obtain the index for a MAF file.  The sidecar file is used if it
+    exists, is complete, and is up to date; otherwise, if build == TRUE,
+    a new index is built and an attempt is made to save it (failure to
+    save is not an error).
+    @param maf_fname Name of MAF file
+    @param build Whether to build the index if necessary
+    @result Index, or NULL if none is available (or if maf_fname is
+    not a regular file)
+*/
+MafIndex *maf_index_load(char *maf_fname, int build);
+
+/** Build an index for a MAF file and save it as a sidecar file,
+    replacing any existing index.  Dies if the index cannot be saved.
+    @param maf_fname Name of MAF file
+    @result New index
+*/
+MafIndex *maf_index_create(char *maf_fname);
+
+/** Return the name of the sidecar index file for a MAF file.
+    @param maf_fname Name of MAF file
+    @result Newly allocated filename
+*/
+char *maf_index_fname(char *maf_fname);
+
+/** Find the first block that can overlap a given position or any
+    later one.  Requires a sorted index.
+    @param idx Index
+    @param start Position in reference sequence (0-based)
+    @result Index of block, or idx->nblocks if there is none
+*/
+int maf_index_first_block(MafIndex *idx, int start);
+
+/** Find the end of the range of blocks that can overlap a given
+    position or any earlier one.  Requires a sorted index.
+    @param idx Index
+    @param end Position in reference sequence (0-based)
+    @result One more than the index of the last block starting at or
+    before end
+*/
+int maf_index_last_block(MafIndex *idx, int end);
+
+/** Position a MAF stream at the first block that can overlap a
+    given position or any later one (see maf_index_first_block).
+    Subsequent reads (e.g., by maf_read or mafBlock_read_next) will
+    begin with that block.  Requires a sorted index.
+    @param F MAF file described by idx
+    @param idx Index
+    @param start Position in reference sequence (0-based)
+    @result Index of block, or idx->nblocks if there is none (in
+    which case F is positioned at end of file)
+*/
+int maf_index_seek(FILE *F, MafIndex *idx, int start);
+
+/** Free an index.
+    @param idx Index to free
+*/
+void maf_index_free(MafIndex *idx);
+
+#endif
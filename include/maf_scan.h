@@ -0,0 +1,129 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file maf_scan.h
+    Fast line-oriented scanning of MAF files.  When the input is a
+    regular file it is memory-mapped and lines are returned in place,
+    without copying, with pages that have been scanned released
+    periodically; otherwise (e.g., pipes or stdin) it is read
+    through a large buffer that is refilled as needed.  Lines are
+    split into whitespace-delimited fields without allocating memory,
+    and sequence characters are validated and translated using a
+    256-entry lookup table.  Used by maf_read_cats_subset (see maf.h)
+    and mafBlock_scan_next (see maf_block.h).
+    @ingroup msa
+*/
+
+#ifndef MAF_SCAN_H
+#define MAF_SCAN_H
+
+#include <stdio.h>
+#include <msa.h>
+
+/** Maximum number of fields recognized on a MAF line */
+#define MAF_MAX_FIELDS 8
+
+/** Scanner over the remaining contents of a MAF stream */
+typedef struct {
+  FILE *F;           /**< Underlying stream */
+  char *buf;         /**< Mapped file or read buffer */
+  size_t len;        /**< Number of valid bytes in buf */
+  size_t pos;        /**< Offset in buf of next unread byte */
+  size_t alloc;      /**< Allocated size of buf (unmapped case only) */
+  size_t consumed;   /**< Bytes discarded from buf (unmapped case only) */
+  size_t released;   /**< Pages of the mapping before this offset have
+                        been released, so that memory use does not grow
+                        with the size of the file (mapped case only) */
+  int mapped;        /**< Whether buf is a memory mapping of the file */
+  int shared;        /**< Whether buf belongs to another scanner */
+  int eof;           /**< Whether underlying stream is exhausted */
+} MafScanner;
+
+/** A field of a MAF line, referring to memory owned by the scanner */
+typedef struct {
+  char *s;           /**< Start of field (not null-terminated) */
+  int len;           /**< Length of field */
+} MafField;
+
+/** Create a scanner for a MAF stream, starting at its current
+    position.  Regular files are memory-mapped when possible.
+    @param F Stream to read
+    @result New scanner
+*/
+MafScanner *mafScanner_new(FILE *F);
+
+/** Free a scanner.  If the file was memory-mapped, the stream is
+    repositioned just past the last line returned; otherwise its
+    position is unspecified.
+    @param scan Scanner to free
+*/
+void mafScanner_free(MafScanner *scan);
+
+/** Create a second scanner over the same memory-mapped file, with
+    its own position.  The copy must be freed before the original.
+    Scanners over the same file may be used concurrently by different
+    threads.
+    @param scan Scanner to copy; must be memory-mapped
+    @result New scanner, positioned at the same place as scan
+*/
+MafScanner *mafScanner_copy(MafScanner *scan);
+
+/** Return the current position of a scanner, as a byte offset from
+    the beginning of the file (if memory-mapped) or from the position
+    of the stream when the scanner was created (otherwise).
+    @param scan Scanner
+    @result Offset of next line to be returned
+*/
+size_t mafScanner_tell(MafScanner *scan);
+
+/** Move a memory-mapped scanner to a new position.
+    @param scan Scanner; must be memory-mapped
+    @param offset Byte offset from beginning of file, as returned by
+    mafScanner_tell
+*/
+void mafScanner_seek(MafScanner *scan, size_t offset);
+
+/** Return the next line of the stream, without its line terminator.
+    The line is not null-terminated and remains valid only until the
+    next call.
+    @param scan Scanner
+    @param[out] len Length of line
+    @result Pointer to start of line, or NULL at end of stream
+*/
+char *mafScanner_next_line(MafScanner *scan, int *len);
+
+/** Split a line into whitespace-delimited fields, without copying.
+    @param line Line to split
+    @param len Length of line
+    @param[out] fields Array of at least MAF_MAX_FIELDS elements;
+    only the first MAF_MAX_FIELDS fields are stored
+    @result Total number of fields on the line
+*/
+int maf_split_fields(char *line, int len, MafField *fields);
+
+/** Convert a field to a decimal integer (leading zeros do not imply
+    octal).
+    @param f Field to convert
+    @param[out] val Value of field
+    @result 0 on success, nonzero if the field is not an integer
+*/
+int maf_field_as_int(MafField *f, long *val);
+
+/** Build a table for translating sequence characters in MAF files
+    to alignment characters.  Characters are converted to upper case
+    (if do_toupper), '.' is converted to a missing-data character
+    unless it is in the alphabet, and unrecognized letters are
+    converted to 'N'.  Any other unrecognized character maps to 0.
+    @param msa Alignment defining alphabet and missing-data characters
+    @param do_toupper Whether to convert to upper case
+    @param[out] table Array of 256 elements indexed by unsigned char
+*/
+void maf_seq_char_table(MSA *msa, int do_toupper, char *table);
+
+#endif
@@ -202,6 +202,36 @@ void srandom(int seed);
  */
 void set_seed(int seed);
 
+#ifndef RPHAST
+/** Counter-based random number stream.  The n-th value of a stream
+    is a hash of its seed, its stream number, and n, so that values do
+    not depend on draws made from other streams or from random().
+    Independent computations (e.g., bootstrap replicates) can each be
+    given their own stream, and will then produce the same results
+    however they are distributed across threads.
+ */
+typedef struct {
+  unsigned long long key;       /**< Derived from seed and stream number */
+  unsigned long long counter;   /**< Number of values drawn so far */
+} RandStream;
+
+/** Initialize a random stream.
+    @param rs Stream to initialize
+    @param seed Seed shared by a family of streams
+    @param stream Number identifying this stream within the family
+ */
+void rand_stream_init(RandStream *rs, unsigned int seed, unsigned int stream);
+
+/** Return the next value of a random stream, uniform on (0, 1). */
+double rand_stream_unif(RandStream *rs);
+
+/** Draw subsequent values of unif_rand in the calling thread from the
+    given stream.  Pass NULL to revert to random().
+    @param rs Stream to use, or NULL
+ */
+void rand_stream_use(RandStream *rs);
+#endif
+
 /** \name Combination & Permutation functions
 \{ */
 
@@ -366,7 +396,11 @@ void phast_warning(const char *warnfmt, ...);
 void die(const char *warnfmt, ...);
 #define checkInterrupt()
 #define checkInterruptN(i,n)
-#define unif_rand(void) (1.0*random()/RAND_MAX)
+/** Return a draw from the uniform distribution on [0, 1].  Values
+    come from random() unless a random stream has been selected in
+    the calling thread (see rand_stream_use), in which case they come
+    from that stream and lie strictly between 0 and 1. */
+double unif_rand();
 #endif
 
 /** \name Program argument handling functions
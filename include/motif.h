@@ -20,6 +20,7 @@
 #include "msa.h"
 #include "vector.h"
 #include "tree_model.h"
+#include "squarem.h"
 
 /** Epsilon value for motifs */
 #define MTF_EPSILON 0.001
@@ -106,12 +107,15 @@ void mtf_free(Motif *m);
                      pseudocounts. If == 0 Do a deterministic
                      initialization based on a consensus sequence
    @param npseudocounts Number of Pseudo counts for consensus bases
+   @param squarem If TRUE, accelerate EM by SQUAREM extrapolation (see
+   squarem.h), and print a summary for each candidate to stderr.
+   Ignored with discriminative training
    @result List of Motif objects. 
 */
 List* mtf_find(void *data, int multiseq, int motif_size, int nmotifs, 
                TreeNode *tree, void *backgd, double *has_motif, double prior, 
                int nrestarts, List *init_list, int sample_parms, 
-               int npseudocounts);
+               int npseudocounts, int squarem);
 
 /** This is the function that is optimized in discriminative training;
    see Segal et al., RECOMB '02 */
@@ -133,6 +137,9 @@ double mtf_compute_conditional(Vector *params, void *data);
    @param get_observation_index Function to get observation index
    @param postprob (Optional) Array of size nsamples to be populated with Posterior probabilities that a motif appears
    @param bestposition (Optional) Array of size nsamples to be populated with starting position of the best instance of the motif
+   @param squarem (Optional) If non-NULL, EM is accelerated by SQUAREM extrapolation of the model parameters and the motif prior (see squarem.h).  The last of the squarem->dim parameters is the motif prior
+   @param get_params (Required with squarem) Function to obtain the parameters of the motif models (all but the first) as the first squarem->dim - 1 elements of a vector
+   @param set_params (Required with squarem) Function to replace the parameters of the motif models
    @result Maximized log likelihood.  
    @note This function can be used with phylogenetic models or ordinary multinomial models.  
    @note The first model is assumed to represent the background distribution and its parameter
@@ -145,7 +152,9 @@ double mtf_em(void *models, void *data, int nsamples,
               void (*estimate_state_models)(void**, int, void*, 
                                             double**, int),
               int (*get_observation_index)(void*, int, int),
-              double *postprob, int *bestposition);
+              double *postprob, int *bestposition, Squarem *squarem,
+              void (*get_params)(Vector*, void**, int, void*),
+              void (*set_params)(Vector*, void**, int, void*));
 
 /** Estimate a (multinomial) background model from a set of sequences.
    @param[in] s Set of sequences to estimate background model from
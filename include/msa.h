@@ -83,6 +83,10 @@ typedef enum {PHYLIP,           /**< PHYLIP format  */
               LAV,              /**< lav format, used by BLASTZ */
               MAF,              /**< Multiple Alignment Format (MAF)
 				    used by MULTIZ and TBA  */
+              BSS,              /**< Binary version of SS format
+                                   (see ss_write_binary).  On input,
+                                   equivalent to SS, which also
+                                   accepts binary files */
 	      UNKNOWN_FORMAT    /**< Format unknown */
 } msa_format_type; 
 
@@ -110,6 +114,34 @@ typedef struct {
   int msa_len;                  /**< length of alignment */
 } msa_coord_map;
 
+/** Approximate size in bytes of the column blocks used by
+    column-oriented operations (see MSA_ColBlock) */
+#define MSA_COLBLOCK_BYTES 262144
+
+/** Column-major copy of a range of alignment columns.  Sequences are
+    stored row by row in an MSA, so that scanning a column touches
+    one cache line per sequence; operations that visit alignments
+    column by column (e.g., computing sufficient statistics) instead
+    transpose a block of columns at a time, so that both the
+    transposition and the column scans proceed sequentially through
+    memory.  Each block also holds a fixed number of "context"
+    columns preceding its first column, so that tuples of columns
+    can be formed at the start of a block.  Context columns before
+    the start of the alignment are filled with gaps, as in
+    col_to_string. */
+typedef struct {
+  int nseqs;                    /**< Number of sequences */
+  int ncontext;                 /**< Number of context columns */
+  int max_cols;                 /**< Maximum number of columns in a
+                                   block, not counting context */
+  int start;                    /**< First column of current block */
+  int end;                      /**< Column after last column of
+                                   current block */
+  char *data;                   /**< Block data; the characters of
+                                   column col are at data[(col - start
+                                   + ncontext) * nseqs] */
+} MSA_ColBlock;
+
 
 /** \name MSA allocation functions
  \{ */
@@ -612,12 +644,49 @@ void msa_reorder_rows(MSA *msa, List *target_order);
  */
 char msa_get_char(MSA *msa, int seq, int pos);
 
+/** Create an (empty) column block for an alignment.
+    @param msa Alignment (determines number of sequences)
+    @param ncontext Number of context columns to keep before each
+    block; use tuple_size - 1 when forming column tuples
+    @param max_cols Maximum number of columns per block, or -1 to
+    choose a size based on #MSA_COLBLOCK_BYTES and the length of msa
+    @result New column block, with no columns loaded
+    @see MSA_ColBlock
+*/
+MSA_ColBlock *msa_colblock_new(MSA *msa, int ncontext, int max_cols);
+
+/** Load a block of columns, beginning at a given column, in
+    column-major order.  Loads min(max_cols, msa->length - start)
+    columns plus context.
+    @param cb Column block
+    @param msa Alignment, which must have explicit sequences
+    @param start First column to load
+*/
+void msa_colblock_load(MSA_ColBlock *cb, MSA *msa, int start);
+
+/** Free a column block.
+    @param cb Column block to free
+*/
+void msa_colblock_free(MSA_ColBlock *cb);
+
+/** Return a pointer to the characters of a column in a column block
+    (one per sequence, not NUL-terminated).
+    @param cb Column block
+    @param col Column index (in alignment coordinates); must satisfy
+    cb->start - cb->ncontext <= col < cb->end
+    @result Pointer to characters of column
+*/
+static PHAST_INLINE
+char *msa_colblock_col(MSA_ColBlock *cb, int col) {
+  return &cb->data[(size_t)(col - cb->start + cb->ncontext) * cb->nseqs];
+}
+
 /** \name MSA File Format functions 
    \{ */
 
 /** Translate format type into char*.
     @param format An msa format
-    @result A char* describing the format (either "SS", "MAF", "FASTA", "PHYLIP", "MPM", or "UNKNOWN")
+    @result A char* describing the format (either "SS", "BSS", "MAF", "FASTA", "PHYLIP", "MPM", or "UNKNOWN")
  */
 char *msa_format_to_str(msa_format_type format);
 
@@ -40,11 +40,36 @@ typedef enum {
 
 opt_precision_type get_precision(const char *prec);
 
+/* multidimensional optimization algorithm */
+typedef enum {
+  OPT_BFGS,                     /* opt_bfgs: dense inverse Hessian */
+  OPT_LBFGSB,                   /* opt_lbfgsb: limited-memory,
+                                   suitable for many parameters */
+  OPT_UNKNOWN_METHOD
+} opt_method_type;
+
+opt_method_type get_opt_method(const char *name);
+
 void opt_gradient(Vector *grad, double (*f)(Vector*, void*), 
                   Vector *params, void* data, opt_deriv_method method,
                   double reference_val, Vector *lower_bounds, 
                   Vector *upper_bounds, double deriv_epsilon);
 
+void opt_gradient_parallel(Vector *grad, double (*f)(Vector*, void*),
+                           Vector *params, void *data, void **copies,
+                           opt_deriv_method method, double reference_val,
+                           Vector *lower_bounds, Vector *upper_bounds,
+                           double deriv_epsilon);
+
+/* register functions that create and free independent copies of the
+   auxiliary data passed to an objective function; while registered,
+   opt_bfgs and opt_lbfgsb compute numerical gradients in parallel
+   (see parallel.h), evaluating the function on one copy per thread */
+void opt_register_clone_funcs(void *data, void *(*clone)(void *data),
+                              void (*free_clone)(void *copy));
+
+void opt_unregister_clone_funcs(void *data);
+
 int opt_bfgs(double (*f)(Vector*, void*), Vector *params, 
              void *data, double *retval, Vector *lower_bounds, 
              Vector *upper_bounds, FILE *logf,
@@ -53,6 +78,21 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
              opt_precision_type precision, Matrix *inv_Hessian,
 	     int *num_evals);
 
+int opt_lbfgsb(double (*f)(Vector*, void*), Vector *params,
+               void *data, double *retval, Vector *lower_bounds,
+               Vector *upper_bounds, FILE *logf,
+               void (*compute_grad)(Vector *grad, Vector *params,
+                                    void *data, Vector *lb, Vector *ub),
+               opt_precision_type precision, int *num_evals);
+
+int opt_minimize(opt_method_type method, double (*f)(Vector*, void*),
+                 Vector *params, void *data, double *retval,
+                 Vector *lower_bounds, Vector *upper_bounds, FILE *logf,
+                 void (*compute_grad)(Vector *grad, Vector *params,
+                                      void *data, Vector *lb, Vector *ub),
+                 opt_precision_type precision, Matrix *inv_Hessian,
+                 int *num_evals);
+
 void opt_lnsrch(Vector *xold, double fold, Vector *g, Vector *p, 
                 Vector *x, double *f, double stpmax, 
                 int *check_convergence, double (*func)(Vector*, void*), 
@@ -76,6 +116,11 @@ int opt_newton_1d(double (*f)(double, void*), double (*x), void *data,
                   double (*compute_deriv2)(double x, void *data, double lb, 
                                            double ub));
 
+int opt_newton_1d_batch(void (*f)(int n, int *idx, double *x, double *fx,
+                                  void *data),
+                        double *x, int nprobs, void *data, double *fx,
+                        int sigfigs, double lb, double ub);
+
 void opt_derivs_1d(double *deriv, double *deriv2, double x, double fx, 
                    double lb, double ub, double (*f)(double, void*), void *data,
                    double (*compute_deriv)(double x, void *data, double lb, 
@@ -0,0 +1,55 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file parallel.h
+    Simple support for running independent computations in parallel.
+    Library routines that can make use of multiple threads do so via
+    thr_foreach, with the number of threads controlled globally by
+    thr_set_nthreads (default 1).  If PHAST is compiled without
+    PHAST_PTHREADS (e.g., for Windows or RPHAST), all work is done
+    serially in the calling thread.
+
+    Callbacks passed to thr_foreach must only write to memory owned by
+    their own index or thread, and any shared data they read must be
+    fully initialized beforehand (beware of objects that are computed
+    lazily on first use, e.g., tr_postorder).
+
+    Calls do not nest: while threads started by thr_foreach are
+    running, thr_get_nthreads returns 1 and any further call to
+    thr_foreach (e.g., from within a callback) runs serially in the
+    calling thread.
+    @ingroup base
+*/
+
+#ifndef PHAST_PARALLEL_H
+#define PHAST_PARALLEL_H
+
+/** Set number of threads to be used by parallel routines.
+    @param n Number of threads (values less than 1 are treated as 1)
+*/
+void thr_set_nthreads(int n);
+
+/** Return number of threads to be used by parallel routines */
+int thr_get_nthreads();
+
+/** Call f(i, thread, data) for each i in 0, 1, ..., n-1, distributing
+    calls dynamically across threads.  The calling thread participates
+    and the function returns only when all calls have completed.  The
+    value of 'thread' passed to f is in [0, thr_get_nthreads()) and
+    identifies the executing thread, so it can be used to index
+    per-thread scratch space.  When a single thread is in use, calls
+    are made in order.
+    @param n Number of calls
+    @param f Function to call
+    @param data Arbitrary data passed through to f
+*/
+void thr_foreach(int n, void (*f)(int i, int thread, void *data),
+                 void *data);
+
+#endif
@@ -54,7 +54,8 @@ struct phastCons_struct {
     estim_rho,		/**< Whether to estimate the rho parameter */
     set_transitions,	/**< Whether user supplies mu, nu for transition information, otherwise estimated */
     viterbi,		/**< Whether to use Viterbi algorithm to predict discrete elements */
-    compute_likelihood; /**< Whether to compute the likelihood */
+    compute_likelihood, /**< Whether to compute the likelihood */
+    squarem;		/**< Whether to accelerate EM by SQUAREM extrapolation */
   int nrates,		/**< Number of rates for first tree model */
     nrates2,		/**< Number of rates for second tree model */
     refidx,		/**< Index of reference sequence */
@@ -94,6 +95,7 @@ struct phastCons_struct {
   TreeNode *extrapolate_tree;	/**< Root of tree used for extrapolation of larget set of species */
   CategoryMap *cm;		/**< Category Map */
   ListOfLists *results;		/**< Holds results of phast_cons analyses */
+  opt_method_type optimizer;	/**< Algorithm used to re-estimate tree models with --estimate-trees */
 };
 
 /** \name Main phastCons functions 
@@ -142,6 +144,11 @@ void setup_two_state(HMM **hmm, CategoryMap **cm, double mu, double nu);
    @param tau_1 (Optional) Approximately the inverse of the expected indel length in Non-Conserved state 
    @param rho (Optional) Rho parameter value
    @param gamma Gamma parameter
+   @param optimizer Algorithm used to re-estimate tree models
+   (OPT_BFGS or OPT_LBFGSB)
+   @param squarem Whether to accelerate EM by SQUAREM extrapolation
+   of the transition parameters and, if estimated, the tree models or
+   rho (see squarem.h).  Indel parameters are updated by ordinary EM
    @param logf File descriptor of where to save log info 
    @result Log Likelihood. */
 double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
@@ -149,7 +156,8 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
 		     double *mu, double *nu, 
                      double *alpha_0, double *beta_0, double *tau_0, 
                      double *alpha_1, double *beta_1, double *tau_1, 
-                     double *rho, double gamma, FILE *logf);
+                     double *rho, double gamma, opt_method_type optimizer,
+                     int squarem, FILE *logf);
 
 /** Re-estimate phylogenetic model based on expected counts (M step of EM) 
    @param models NOT USED
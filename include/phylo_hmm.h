@@ -42,6 +42,9 @@ typedef struct {
   double gamma;			/**< Target coverage for two-state
                                    rate-variation phylo-HMM */
   Matrix *H;                    /**< Inverse Hessian for BFGS  */
+  opt_method_type optimizer;    /**< Algorithm used to re-estimate
+                                   tree models (OPT_BFGS or
+                                   OPT_LBFGSB) */
 } EmData;
 
 /** Phylo HMM object */
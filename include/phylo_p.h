@@ -50,6 +50,8 @@ struct phyloP_struct {
   char *help, *mod_fname, *msa_fname;
   ListOfLists *results;
   int no_prune;
+  char *jp_cache_fname;
+  int column_sums;
 };
 
 struct phyloP_struct *phyloP_struct_new(int rphast);
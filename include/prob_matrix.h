@@ -180,10 +180,13 @@ Matrix *pm_convolve_many(Matrix **p, int *counts, int n, double epsilon);
     @param n Number of times to convolve distribution
     @param max_nrows Maximum number of rows of result matrix
     @param max_ncols maximum number of columns of result matrix
+    @param epsilon Smallest probability of interest; FFT convolution
+    is used only if it can resolve values this small
     @result Convolved matrix
     @note Dos not take counts, normalize, or trim dimension
 */
-Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols);
+Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols,
+                              double epsilon);
 
 /** Convolve distribution 'n' times. (Faster)
   @param p Probability Matrix
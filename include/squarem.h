@@ -0,0 +1,121 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file squarem.h
+    SQUAREM acceleration of EM algorithms (Varadhan and Roland,
+    Scand. J. Stat. 35:335-353, 2008).  After every two ordinary EM
+    updates x0 -> x1 -> x2, the parameters are moved to the
+    extrapolated point x0 + 2a r + a^2 v, where r = x1 - x0 and v =
+    (x2 - x1) - r, with step length a = |r|/|v| (scheme "S3",
+    restricted to be at least 1).  The next EM update, starting from
+    the extrapolated point, stabilizes it and begins a new cycle.
+
+    The accelerator is driven from an existing EM loop, which
+    alternates between computing the likelihood at the current
+    parameters (E step) and updating them (M step).  Call sqm_check
+    after each E step and sqm_update after each M step.  If an
+    extrapolated point has a lower likelihood than the last ordinary
+    EM iterate, it is rejected: sqm_check restores the ordinary
+    update x2, which must then be evaluated in place of the rejected
+    point, and the maximum step length is reduced.  The sequence of
+    accepted likelihoods is therefore nondecreasing, as with plain EM.
+
+    Parameters are represented as a vector of fixed dimension, and
+    extrapolated values are truncated to lie within optional bounds.
+    Parameters not included in the vector are simply updated by EM.
+    @ingroup base
+*/
+
+#ifndef SQUAREM_H
+#define SQUAREM_H
+
+#include <stdio.h>
+#include <vector.h>
+
+/** Initial value for maximum step length */
+#define SQM_STEP_MAX0 1
+/** Factor by which maximum step length is increased or decreased */
+#define SQM_MSTEP 4
+
+/** SQUAREM state */
+typedef struct {
+  int dim;                      /**< Number of parameters */
+  Vector *lower_bounds;         /**< Lower bounds (NULL if none) */
+  Vector *upper_bounds;         /**< Upper bounds (NULL if none) */
+  Vector *x0, *x1, *x2;         /**< EM iterates in current cycle */
+  int phase;                    /**< Position in cycle: 0 or 1
+                                   (number of EM updates made since
+                                   start of cycle), 2 (at
+                                   extrapolated point), or -1 (new
+                                   cycle begins at next sqm_check) */
+  double ll1;                   /**< Log likelihood at x1 */
+  double step;                  /**< Step length of last extrapolation */
+  double step_max;              /**< Current maximum step length */
+  int nextrap;                  /**< Number of accepted extrapolations */
+  int nreject;                  /**< Number of rejected extrapolations */
+  double nsaved;                /**< Estimated number of EM iterations
+                                   saved */
+} Squarem;
+
+/** Create a new SQUAREM object.
+    @param dim Number of parameters
+    @param lower_bounds Lower bounds for parameters, or NULL (copied)
+    @param upper_bounds Upper bounds for parameters, or NULL (copied)
+    @result New object
+*/
+Squarem *sqm_new(int dim, Vector *lower_bounds, Vector *upper_bounds);
+
+/** Free a SQUAREM object */
+void sqm_free(Squarem *sq);
+
+/** Start a new cycle, possibly with a new number of parameters and
+    new bounds.  Should be called whenever the EM update changes
+    (e.g., the precision of an inner optimization), so that
+    extrapolation is based only on consecutive updates of the same
+    kind.  The new cycle begins at the next call to sqm_check; a call
+    to sqm_update in between is ignored.  Accumulated statistics are
+    retained.
+    @param sq SQUAREM object
+    @param dim Number of parameters
+    @param lower_bounds Lower bounds for parameters, or NULL (copied)
+    @param upper_bounds Upper bounds for parameters, or NULL (copied)
+*/
+void sqm_restart(Squarem *sq, int dim, Vector *lower_bounds,
+                 Vector *upper_bounds);
+
+/** Record the log likelihood of the current parameters; call after
+    each E step.
+    @param sq SQUAREM object
+    @param params Current parameters.  If an extrapolated point is
+    rejected, they are replaced by the ordinary EM update
+    @param logl Log likelihood of params
+    @result TRUE if params were replaced.  The caller must then adopt
+    the new parameters and repeat the E step, skipping the M step
+    and the test for convergence
+*/
+int sqm_check(Squarem *sq, Vector *params, double logl);
+
+/** Record the result of an M step, and extrapolate if a cycle is
+    complete.
+    @param sq SQUAREM object
+    @param params Updated parameters.  At the end of a cycle, they
+    are replaced by the extrapolated point
+    @result TRUE if params were replaced, in which case the caller
+    must adopt the new parameters
+*/
+int sqm_update(Squarem *sq, Vector *params);
+
+/** Print a one-line summary of extrapolations and the estimated
+    number of EM iterations saved.
+    @param F Output stream
+    @param sq SQUAREM object
+*/
+void sqm_report(FILE *F, Squarem *sq);
+
+#endif
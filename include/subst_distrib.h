@@ -10,6 +10,7 @@
 #ifndef SUBST_DISTRIB
 #define SUBST_DISTRIB
 
+#include <stdint.h>
 #include <vector.h>
 #include <msa.h>
 #include <tree_model.h>
@@ -49,6 +50,13 @@ typedef struct {
 JumpProcess *sub_define_jump_process(TreeModel *mod, double epsilon, 
                                      double maxbranch);
 void sub_free_jump_process(JumpProcess *jp);
+uint64_t sub_jump_process_fingerprint(TreeModel *mod, double epsilon, 
+                                      double maxbranch);
+void sub_write_jump_process(JumpProcess *jp, double maxbranch, FILE *F);
+JumpProcess *sub_read_jump_process(FILE *F, TreeModel *mod, double epsilon,
+                                   double maxbranch);
+JumpProcess *sub_define_jump_process_cached(TreeModel *mod, double epsilon, 
+                                            double maxbranch, char *fname);
 Vector *sub_distrib_branch(JumpProcess *jp, double t);
 Matrix **sub_distrib_branch_conditional(JumpProcess *jp, double t);
 Vector *sub_prior_distrib_site(JumpProcess *jp);
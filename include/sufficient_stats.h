@@ -18,8 +18,26 @@
 #include "hashtable.h"
 #include "lists.h"
 #include "msa.h"
+#include "tuple_hash.h"
 #include "external_libs.h"
 
+/** First line of binary sufficient statistics files */
+#define SS_BINARY_MAGIC "##binary-ss version=1\n"
+
+/** Number of bytes occupied by SS_BINARY_MAGIC, including padding */
+#define SS_BINARY_MAGIC_LEN 24
+
+/** Number of integer fields in header of binary sufficient statistics
+    files */
+#define SS_BINARY_NFIELDS 12
+
+/** Byte-order mark in header of binary sufficient statistics files */
+#define SS_BINARY_BYTE_ORDER 0x01020304
+
+/** Maximum number of distinct characters allowed in packed column
+    tuples (see ss_pack_tuples) */
+#define SS_PACKED_NCHARS 16
+
 /** Sufficient Statistics object for an alignment. 
   @note For now, allow only one tuple_size per object */
 struct msa_ss_struct {
@@ -28,7 +46,14 @@ struct msa_ss_struct {
   int ntuples;                  /**< Number of distinct tuples */
   char **col_tuples;            /**< The actual column tuples;
                                    col_tuples[i] is string of length
-                                   ss->nseqs * tuple_size */
+                                   ss->nseqs * tuple_size.  NULL if
+                                   tuples are packed */
+  unsigned char *packed_tuples; /**< Column tuples in packed form (see
+                                   ss_pack_tuples), or NULL if
+                                   unpacked */
+  int packed_len;               /**< Number of bytes per packed tuple */
+  char packed_chars[SS_PACKED_NCHARS]; /**< Character represented by each
+                                   4-bit code in packed_tuples */
   int *tuple_idx;               /**< Defines order of column tuples in
                                    alignment; tuple_idx[i] is the
                                    index in col_tuples of the tuple
@@ -45,6 +70,25 @@ struct msa_ss_struct {
     @note Completes incomplete declaration from msa.h */
 typedef struct msa_ss_struct MSA_SS; 
 
+/** Sufficient statistics for a window sliding along an alignment.
+    Tuple counts for the current window are maintained incrementally
+    from the ordered sufficient statistics of the full alignment, so
+    that moving the window costs time proportional to the number of
+    columns entering and leaving it, and tuples are never rehashed.
+    @see ss_window_new */
+typedef struct {
+  MSA *msa;                     /**< Full alignment (with ordered
+                                   sufficient statistics) */
+  int beg, end;                 /**< Current window is [beg, end) */
+  double *counts;               /**< Count in window of each tuple of
+                                   msa */
+  double **cat_counts;          /**< Counts by category, or NULL if no
+                                   category labels */
+  int *do_cat;                  /**< do_cat[c] is TRUE if category c
+                                   is of interest, or NULL for all */
+  int *full_to_sub;             /**< Scratch space for ss_window_msa */
+} SS_Window;
+
 /** Set of multiple alignments, whose statistics are "pooled".
    @note Serves well as a training set for a combined phylogenetic and hidden
    Markov model.  
@@ -145,7 +189,7 @@ typedef struct {
 */
 void ss_from_msas(MSA *msa, int tuple_size, int store_order, 
                   List *cats_to_do, MSA *source_msa, 
-                  Hashtable *existing_hash, int idx_offset,
+                  TupleHash *existing_hash, int idx_offset,
 		  int non_overlapping);
 
 /** Pool multiple MSAs into a single object of type PooledMSA.  
@@ -215,13 +259,46 @@ void msa_read_AXT(MSA *msa, List *axt_fnames);
 */
 void ss_write(MSA *msa, FILE *F, int show_order);
 
-/** Read MSA from file as sufficient statistics.
+/** Read MSA from file as sufficient statistics.  Files in the binary
+    format written by ss_write_binary are recognized automatically.
     @param F File descriptor to read sufficient statistics from
     @param alphabet Alphabet of MSA being read in
     @result MSA reconstructed from sufficient statistics
 */
 MSA* ss_read(FILE *F, char *alphabet);
 
+/** Write MSA to file as sufficient statistics in binary format.
+    The file begins with the text line SS_BINARY_MAGIC (padded with
+    null characters to SS_BINARY_MAGIC_LEN bytes), followed by a
+    header of SS_BINARY_NFIELDS native integers (byte-order mark,
+    nseqs, tuple_size, ntuples, length, ncats, idx_offset, flags,
+    and the sizes in bytes of the names, alphabet and each tuple), a
+    table of SS_PACKED_NCHARS characters used to decode packed
+    tuples, and then the sequence names and alphabet (each
+    null-terminated), the column tuples (packed as by ss_pack_tuples
+    if possible), the counts and category counts as arrays of
+    doubles, and the tuple order as an array of integers.  Every
+    section begins at a multiple of 8 bytes, and the arrays are read
+    in bulk with fread rather than parsed as text.  Files are not
+    portable between machines of different byte order.
+    @param msa MSA to save as sufficient statistics (not modified;
+    tuples are packed in a temporary copy if they are not already
+    packed)
+    @param F File descriptor to save to
+    @param show_order Whether to save tuple order (if available)
+*/
+void ss_write_binary(MSA *msa, FILE *F, int show_order);
+
+/** Read MSA from file in the binary format written by
+    ss_write_binary.  Column tuples remain packed if they were packed
+    in the file.
+    @param F File descriptor to read from
+    @param alphabet Alphabet of MSA being read in (NULL to use
+    alphabet stored in the file)
+    @result MSA reconstructed from sufficient statistics
+*/
+MSA* ss_read_binary(FILE *F, char *alphabet);
+
 /** \} */
 
 /**  Update category count according to 'categories' attribute of MSA
@@ -274,6 +351,29 @@ void ss_free_pooled_msa(PooledMSA *pmsa);
 */
 void ss_compact(MSA_SS *ss);
 
+/** Store column tuples in packed form, with two characters per byte
+    in a single contiguous array, roughly halving their memory
+    requirements (more, counting allocation overhead for individual
+    strings).  Packing is possible only if no more than
+    SS_PACKED_NCHARS distinct characters appear in the tuples (e.g.,
+    DNA bases, gaps, missing-data characters and IUPAC ambiguity
+    codes).  Accessors such as ss_get_char_tuple, ss_get_char_pos and
+    msa_get_char decode packed tuples transparently; functions that
+    modify column tuples unpack them first (see ss_unpack_tuples).
+    Intended for long-lived, read-only sufficient statistics, such as
+    whole-chromosome alignments during scoring.
+    @param msa MSA containing Sufficient Statistics
+    @result 0 if tuples are packed (or were already), 1 if they
+    contain too many distinct characters to be packed
+*/
+int ss_pack_tuples(MSA *msa);
+
+/** Restore column tuples packed by ss_pack_tuples to ordinary
+    strings.  Does nothing if tuples are not packed.
+    @param msa MSA containing Sufficient Statistics
+*/
+void ss_unpack_tuples(MSA *msa);
+
 /** Create copy of MSA with different tuple size.
    @param orig_msa Original MSA to be copied from
    @param new_tuple_size Tuple size for the new MSA being returned
@@ -300,6 +400,38 @@ MSA* ss_alt_msa(MSA *orig_msa, int new_tuple_size, int store_order,
 MSA *ss_sub_alignment(MSA *msa, char **new_names, List *include_list, 
                       int start_col, int end_col);
 
+/** Create an object for sliding a window along an alignment.  The
+   window is initially empty.
+   @param msa Alignment, which must have ordered sufficient statistics
+   (tuples are unpacked if necessary).  Must not be altered while the
+   window object is in use
+   @param cats_to_do If non-NULL, list of categories of interest (see
+   ss_window_msa)
+   @result New window object
+*/
+SS_Window *ss_window_new(MSA *msa, List *cats_to_do);
+
+/** Free a window object (the alignment is not freed) */
+void ss_window_free(SS_Window *w);
+
+/** Move a window, updating tuple counts for the columns that leave
+   and enter it.
+   @param w Window object
+   @param start_col First column of new window
+   @param end_col Column after last column of new window
+*/
+void ss_window_set(SS_Window *w, int start_col, int end_col);
+
+/** Create a sub-alignment for the current position of a window.  The
+   result is equivalent to one obtained by ss_sub_alignment (with all
+   sequences), except that tuples are numbered in order of first
+   appearance in the window, considering columns in categories of
+   interest before all others.
+   @param w Window object
+   @result New alignment, with ordered sufficient statistics only
+*/
+MSA *ss_window_msa(SS_Window *w);
+
 /** \name Sufficient Statistics modification functions
 \{ */
 
@@ -386,13 +518,14 @@ void ss_reduce_tuple_size(MSA *msa, int new_tuple_size);
 /* Not found in implementation */
 void ss_add_seq(MSA *msa, int new_nseq);
 
-/** Retrieve tuple index from hash table using tuple as key
+/** Retrieve tuple index from hash table using tuple as key.
+  Trailing missing data is ignored (see tuple_hash.h).
   @param[in] coltuple_str Key used for hash table 
-  @param[in] tuple_hash Hash table of tuple indexes (integers)
+  @param[in] tuple_hash Hash table of tuple indexes
   @param[in] msa Alignment object
   @result -1 if not found, otherwise Value stored in tuple_hash at key coltuple_str
  */
-int ss_lookup_coltuple(char *coltuple_str, Hashtable *tuple_hash, MSA *msa);
+int ss_lookup_coltuple(char *coltuple_str, TupleHash *tuple_hash, MSA *msa);
 
 /** Add tuple index to hash table using tuple as key
   @param[in] coltuple_str Key used for hash table
@@ -400,7 +533,7 @@ int ss_lookup_coltuple(char *coltuple_str, Hashtable *tuple_hash, MSA *msa);
   @param[in] tuple_hash Hash table of tuple indices
   @param[in] msa Multiple Alignment object
  */
-void ss_add_coltuple(char *coltuple_str, void *val, Hashtable *tuple_hash, MSA *msa);
+void ss_add_coltuple(char *coltuple_str, void *val, TupleHash *tuple_hash, MSA *msa);
 
 /** Impose an artificial ordering on tuples if they aren't already ordered.
   @param msa Multiple Alignment to order
@@ -432,6 +565,32 @@ void col_to_string(char *str, MSA *msa, int col, int tuple_size) {
 	pos, msa->nseqs, tuple_size, msa->nseqs*tuple_size);
 }
 
+/** Produce a string representation of an alignment column tuple
+   from a column block.  Equivalent to col_to_string, but reads
+   consecutive memory locations.
+   @param[out] str Representation of alignment column (must be
+   allocated externally to size cb->nseqs * tuple_size + 1)
+   @param[in] cb Column block containing the column and at least
+   tuple_size - 1 context columns (see MSA_ColBlock)
+   @param[in] col Column index (last column of tuple)
+   @param[in] tuple_size Size of the tuples to be used in str
+ */
+static PHAST_INLINE
+void colblock_to_string(char *str, MSA_ColBlock *cb, int col, 
+                        int tuple_size) {
+  int col_offset, j;
+  char *c;
+  if (tuple_size == 1)
+    memcpy(str, msa_colblock_col(cb, col), cb->nseqs);
+  else 
+    for (col_offset = 0; col_offset < tuple_size; col_offset++) {
+      c = msa_colblock_col(cb, col - tuple_size + 1 + col_offset);
+      for (j = 0; j < cb->nseqs; j++) 
+        str[j * tuple_size + col_offset] = c[j];
+    }
+  str[cb->nseqs * tuple_size] = '\0';
+}
+
 /** Given a string representation of a column tuple, return the
    character corresponding to the specified sequence and column. 
   
@@ -469,6 +628,24 @@ void set_col_char_in_string(MSA *msa, char *str, int seqidx, int tuple_size, int
 /** \name Get character of tuple from alignment 
 \{ */
 
+/** Return a specific base from a packed column tuple (see
+   ss_pack_tuples).  Usually called indirectly, via ss_get_char_tuple
+   or ss_get_char_pos.
+   @param ss Sufficient statistics with packed tuples
+   @param tupleidx Index of tuple
+   @param seqidx Index of sequence
+   @param col_offset Column offset relative to last column in tuple
+   (see ss_get_char_tuple)
+   @result Base character
+*/
+static PHAST_INLINE
+char ss_packed_char(MSA_SS *ss, int tupleidx, int seqidx, int col_offset) {
+  int pos = ss->tuple_size*seqidx + ss->tuple_size - 1 + col_offset;
+  unsigned char byte = ss->packed_tuples[(size_t)tupleidx * ss->packed_len + 
+                                         (pos >> 1)];
+  return ss->packed_chars[(pos & 1) ? (byte >> 4) : (byte & 0xf)];
+}
+
 /** Return a specific base from alignment given sequence, tuple, and column offset of tuple
    @param msa Multiple Alignment
    @param tupleidx Index specifying which tuple to retrieve base from
@@ -481,6 +658,8 @@ void set_col_char_in_string(MSA *msa, char *str, int seqidx, int tuple_size, int
 static PHAST_INLINE
 char ss_get_char_tuple(MSA *msa, int tupleidx, int seqidx, 
                        int col_offset) {
+  if (msa->ss->packed_tuples != NULL)
+    return ss_packed_char(msa->ss, tupleidx, seqidx, col_offset);
   return col_string_to_char(msa, msa->ss->col_tuples[tupleidx], seqidx, 
                             msa->ss->tuple_size, col_offset);
 }
@@ -501,6 +680,9 @@ char ss_get_char_pos(MSA *msa, int position, int seqidx,
                      int col_offset) {
   if (msa->ss->tuple_idx == NULL)
     die("ERROR ss_get_char_pos: msa->ss->tuple_idx is NULL\n");
+  if (msa->ss->packed_tuples != NULL)
+    return ss_packed_char(msa->ss, msa->ss->tuple_idx[position], seqidx,
+                          col_offset);
   return col_string_to_char(msa, 
                             msa->ss->col_tuples[msa->ss->tuple_idx[position]], 
                             seqidx, msa->ss->tuple_size, col_offset);
@@ -518,8 +700,7 @@ void tuple_to_string_pretty(char *str, MSA *msa, int tupleidx) {
   int stridx = 0, offset, j;
   for (offset = -1 * (msa->ss->tuple_size-1); offset <= 0; offset++) {
     for (j = 0; j < msa->nseqs; j++) {
-      str[stridx++] = col_string_to_char(msa, msa->ss->col_tuples[tupleidx], 
-                                         j, msa->ss->tuple_size, offset);
+      str[stridx++] = ss_get_char_tuple(msa, tupleidx, j, offset);
     }
     if (offset < 0) str[stridx++] = ' ';
   }
@@ -543,8 +724,7 @@ void ss_get_tuple_of_chars(MSA *msa, int tupleidx, int seqidx,
   int offset;
   for (offset = -1 * (msa->ss->tuple_size-1); offset <= 0; offset++) {
     tuplestr[msa->ss->tuple_size + offset - 1] =
-      col_string_to_char(msa, msa->ss->col_tuples[tupleidx],
-                         seqidx, msa->ss->tuple_size, offset);
+      ss_get_char_tuple(msa, tupleidx, seqidx, offset);
   }
 }
 
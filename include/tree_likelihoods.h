@@ -102,6 +102,12 @@ struct tp_struct {
 typedef struct tp_struct TreePosteriors;
                                 /* see incomplete type in tree_model.h */
 
+/** Maximum number of blocks of tuples used by
+    tl_compute_log_likelihood_blocked; blocks are larger than
+    TM_TUPLE_BLOCK_SIZE when necessary, to bound the memory used for
+    private accumulators */
+#define TL_MAX_POST_BLOCKS 64
+
 #define NULL_LOG_LIKELIHOOD 1   /** Safe value for null when dealing with
                                    log likelihoods (should always be <= 0) FIXME? */
 
@@ -128,6 +134,54 @@ double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
 				 int cat,
                                  TreePosteriors *post);
 
+/** Compute the log likelihood contributed by a range of tuples.
+   Behaves like tl_compute_log_likelihood without column or tuple
+   scores, except that only tuples first_tuple through last_tuple - 1
+   are considered (quantities in post that are summed over tuples,
+   such as expected_nsubst_tot, are summed over the range only).
+   Calls for different ranges may run concurrently on the same model
+   and alignment, provided tl_prepare has been called first.
+   @param[in] mod Tree Model to compute likelihood for
+   @param[in] msa Multiple Alignment (must have sufficient statistics)
+   @param[in] cat Category to consider, or -1 for all
+   @param[out] post (Optional) Posterior probabilities, as for
+   tl_compute_log_likelihood
+   @param[in] first_tuple First tuple in range
+   @param[in] last_tuple One past the last tuple in range (if negative,
+   the range extends to the last tuple)
+   @result Log likelihood of the tuples in the range, weighted by count
+*/
+double tl_compute_log_likelihood_tuples(TreeModel *mod, MSA *msa, int cat,
+                                        TreePosteriors *post,
+                                        int first_tuple, int last_tuple);
+
+/** Set up everything that is otherwise computed on demand the first
+   time a tree model's likelihood is evaluated (sufficient statistics,
+   substitution matrices, leaf to sequence mapping, tree traversals),
+   so that the model can be used read-only from multiple threads.
+   @param mod Tree Model (substitution matrices must reflect its
+   current parameters)
+   @param msa Multiple Alignment to which the model will be applied
+*/
+void tl_prepare(TreeModel *mod, MSA *msa);
+
+/** Compute the log likelihood and the tuple-summed posterior
+   quantities in post (expected_nsubst_tot and rcat_expected_nsites),
+   processing blocks of tuples in parallel (see parallel.h).  Each
+   block accumulates into private arrays, which are then added together
+   in a fixed order, so results do not depend on the number of
+   threads.  Other attributes of post (indexed by tuple) are filled in
+   as by tl_compute_log_likelihood.  Used for the E step of EM.
+   @param[in] mod Tree Model (substitution matrices must reflect its
+   current parameters)
+   @param[in] msa Multiple Alignment
+   @param[in] cat Category to consider, or -1 for all
+   @param[out] post Posterior probabilities to compute (required)
+   @result Log likelihood of the alignment (or category)
+*/
+double tl_compute_log_likelihood_blocked(TreeModel *mod, MSA *msa, int cat,
+                                         TreePosteriors *post);
+
 /** Create a new TreePosteriors object.
     @param mod Tree Model of which the posterior probabilities are calculated
     @param msa Multiple Alignment
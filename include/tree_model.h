@@ -55,6 +55,16 @@
 /** Test of conversion */
 #define TM_EM_CONV(P) ( (P) == OPT_HIGH_PREC ? TM_EM_CONV_HIGH : ( (P) == OPT_MED_PREC ? TM_EM_CONV_MED : ( (P) == OPT_CRUDE_PREC ? TM_EM_CONV_CRUDE : TM_EM_CONV_LOW) ))
 
+/** In tm_fit_restarts, refine the best 1/TM_RESTART_REFINE_FRAC of
+    starting points after fitting at crude precision */
+#define TM_RESTART_REFINE_FRAC 4
+/** In tm_fit_restarts, refine at least this many starting points */
+#define TM_RESTART_MIN_REFINE 2
+/** Number of tuples per block when likelihoods are evaluated in
+    parallel over blocks of tuples.  Blocks do not depend on the number
+    of threads, so that sums over them are reproducible */
+#define TM_TUPLE_BLOCK_SIZE 1000
+
 #define BACKGD_STR "backgd"
 #define RATEMAT_STR "ratematrix"
 #define RATEVAR_STR "ratevar"
@@ -219,6 +229,21 @@ struct tm_struct {
 				 Normally 0, but 1 if TM_BRANCHLENS_NONE, or
 				 if TM_SCALE and alt_subst_mods!=NULL */
   int **iupac_inv_map;          /**< Inverse map for IUPAC ambiguity characters */
+  opt_method_type optimizer;    /**< Algorithm used by tm_fit and
+                                   tm_fit_multi (OPT_BFGS by default;
+                                   OPT_LBFGSB is preferable when
+                                   there are many free parameters) */
+  int squarem;                  /**< Whether to accelerate tm_fit_em
+                                   by SQUAREM extrapolation (see
+                                   squarem.h) */
+  Matrix *inv_hessian;          /**< If non-NULL, tm_fit (with BFGS)
+                                   uses this as its initial
+                                   approximation of the inverse
+                                   Hessian, and replaces it with the
+                                   final one; useful for warm-starting
+                                   a fit from a related one.  A matrix
+                                   of the wrong dimension is taken to
+                                   be the identity.  NULL by default */
 };
 
 typedef struct tm_struct TreeModel;
@@ -410,7 +435,7 @@ void tm_scale_params(TreeModel *mod, Vector *params, double scale_factor);
 
 /** \} */
 
-/** Fit a tree model to data using BFGS (multidimensional optimization algorithm)
+/** Fit a tree model to data using BFGS or L-BFGS-B, as specified by mod->optimizer.  Exact gradients are used when available (see tm_exact_grad_supported); otherwise gradients are computed numerically
    @param mod Tree Model containing desired tree topology to fit, substitution model, and (if appropriate) background frequencies
    @param params Initial values for optimization procedure
    @param cat MSA category
@@ -426,7 +451,36 @@ int tm_fit(TreeModel *mod, MSA *msa, Vector *params, int cat,
 	   FILE *error_file);
 
 
-/** Fit several tree models (which share parameters) to data using BFGS
+/** Fit a tree model as with tm_fit, but from several starting
+    points, to reduce the chance of stopping at a local optimum.
+    Besides the given parameters, nrestarts random starting points
+    are generated with tm_params_init_random (parameters that are not
+    estimated keep their given values).  The model is first fitted
+    from every starting point at crude precision, concurrently if
+    multiple threads are enabled (see parallel.h).  Only the most
+    promising ones (see TM_RESTART_REFINE_FRAC) are then refined at
+    the requested precision, and mod is finally fitted from the best
+    of these.
+   @param mod Tree Model to fit
+   @param msa Alignment
+   @param params Initial values for the first starting point; on
+   return, the estimates
+   @param cat MSA category
+   @param precision Precision for the final fits
+   @param nrestarts Number of random starting points
+   @param logf If non-NULL, the likelihood reached from each starting
+   point is written here, followed by the log of the final fit
+   @param quiet Whether to report progress to stderr
+   @param error_file As in tm_fit
+   @param optima If non-NULL, the log likelihoods of the refined fits
+   are appended to this list, in order of starting points
+   @returns 0 on success, 1 on failure of the final fit
+ */
+int tm_fit_restarts(TreeModel *mod, MSA *msa, Vector *params, int cat, 
+                    opt_precision_type precision, int nrestarts, 
+                    FILE *logf, int quiet, FILE *error_file, List *optima);
+
+/** Fit several tree models (which share parameters) to data using BFGS or L-BFGS-B, as specified by mod[0]->optimizer
     @param mod Array of tree models
     @param nmod Length of mod array
     @param msa Array of msas.  There should be one for each mod, or a single msa with nmod categories.  In that case mod[i] will apply to category i+1 (i in 0,...,nmod-1).
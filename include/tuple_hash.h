@@ -0,0 +1,93 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file tuple_hash.h
+    Hash tables mapping alignment column tuples to tuple indices, used
+    when computing sufficient statistics (see sufficient_stats.h).
+
+    Each character of a column tuple is encoded in a few bits (three
+    for DNA with the default gap and missing-data characters) and the
+    encoded tuple is packed into one or more 64-bit words.  Packed
+    keys are stored in an open-addressing table with linear probing,
+    so lookups require neither string hashing nor string
+    comparison.  Tuples containing characters outside the alphabet
+    (e.g., IUPAC ambiguity codes) are kept in an ordinary string hash
+    table instead.
+
+    As in earlier versions, keys are formed from column tuples with
+    trailing missing data removed (see ss_lookup_coltuple), so that a
+    tuple maps to the same entry regardless of whether sequences
+    consisting entirely of missing data have been added to the
+    alignment yet.  The width of packed keys grows as needed when
+    longer tuples are added.
+    @ingroup msa
+*/
+
+#ifndef TUPLE_HASH_H
+#define TUPLE_HASH_H
+
+#include <stdint.h>
+#include <hashtable.h>
+#include <msa.h>
+
+/** Hash table of column tuples */
+typedef struct {
+  int bits;                /**< Bits used to encode each character */
+  int chars_per_word;      /**< Characters packed into each 64-bit word */
+  int nwords;              /**< Current width of packed keys, in words */
+  char missing;            /**< Missing-data character used to trim keys */
+  unsigned char code[256]; /**< Code of each character; 0 if the
+                              character cannot be packed */
+  unsigned int size;       /**< Number of slots (a power of two) */
+  unsigned int nentries;   /**< Number of packed keys stored */
+  uint64_t *keys;          /**< Packed keys, nwords per slot */
+  int *vals;               /**< Value of each slot; -1 if empty */
+  Hashtable *overflow;     /**< Tuples that cannot be packed, stored
+                              as strings (NULL until needed) */
+} TupleHash;
+
+/** Create a new tuple hash table.
+    @param msa Alignment defining the alphabet and missing-data
+    characters
+    @param key_len Expected maximum length of column tuple strings
+    (msa->nseqs * tuple_size); keys are widened as needed
+    @param expected_size Expected number of distinct tuples (a hint
+    only)
+    @result New, empty table
+*/
+TupleHash *tuple_hash_new(MSA *msa, int key_len, int expected_size);
+
+/** Free a tuple hash table.
+    @param th Table to free
+*/
+void tuple_hash_free(TupleHash *th);
+
+/** Look up a column tuple given as a string (see col_to_string).
+    Does not modify the table, so concurrent lookups are safe.
+    @param th Table
+    @param coltuple_str Column tuple
+    @param nseqs Number of sequences represented in coltuple_str
+    @param tuple_size Tuple size
+    @result Value stored for the tuple, or -1 if not found
+*/
+int tuple_hash_lookup(TupleHash *th, char *coltuple_str, int nseqs,
+                      int tuple_size);
+
+/** Add a column tuple given as a string, or replace its value if it
+    is already present.
+    @param th Table
+    @param coltuple_str Column tuple
+    @param nseqs Number of sequences represented in coltuple_str
+    @param tuple_size Tuple size
+    @param val Value to store (must be non-negative)
+*/
+void tuple_hash_add(TupleHash *th, char *coltuple_str, int nseqs,
+                    int tuple_size, int val);
+
+#endif
@@ -0,0 +1,124 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/** @file wig_writer.h
+    Buffered output of base-by-base scores in fixedStep wig format
+    (and similar tab-delimited per-base formats).  Used by phyloP,
+    phastCons, phastOdds, and phastBias, which write one line per
+    alignment column.
+
+    Output is accumulated in a large buffer and written with fwrite,
+    and numbers with a fixed number of decimal places are formatted
+    directly rather than through printf.  The result is identical to
+    that of fprintf with a "%.Nf" format; values for which the fast
+    formatting cannot guarantee this (very large values, non-finite
+    values, and values within rounding error of a tie) are passed to
+    snprintf.  A "fixedStep" header line is emitted automatically
+    whenever a line does not immediately follow the previous one.
+
+    A writer owns its buffer but not its stream.  Nothing else
+    should write to the stream until the writer has been flushed or
+    freed.
+    @ingroup feature
+*/
+
+#ifndef WIG_WRITER_H
+#define WIG_WRITER_H
+
+#include <stdio.h>
+#include <external_libs.h>
+
+/** Size of output buffer, in bytes */
+#define WW_BUFSIZE 1048576
+
+/** Maximum number of decimal places for fast formatting */
+#define WW_MAX_PREC 9
+
+/** Buffered per-base writer */
+typedef struct {
+  FILE *F;                      /**< Output stream */
+  char *chrom;                  /**< Chromosome name for headers */
+  char *buf;                    /**< Output buffer */
+  int len;                      /**< Number of bytes in buffer */
+  long long next;               /**< Coordinate expected next in
+                                   current fixedStep run; -1 if
+                                   none */
+} WigWriter;
+
+/** Create a new writer.
+    @param F Output stream
+    @param chrom Chromosome name used in fixedStep headers (copied).
+    If NULL, "(null)" is written, as with printf
+    @result New writer
+*/
+WigWriter *ww_new(FILE *F, const char *chrom);
+
+/** Write any buffered output to the stream. */
+void ww_flush(WigWriter *ww);
+
+/** Flush and free a writer (the stream is not closed). */
+void ww_free(WigWriter *ww);
+
+/** Begin the line for the given (1-based) coordinate.  A fixedStep
+    header with step=1 is written first unless the coordinate
+    immediately follows that of the previous line.
+    @param ww Writer
+    @param coord Coordinate of line, in increasing order
+*/
+void ww_start_line(WigWriter *ww, long long coord);
+
+/** Write a number with a fixed number of decimal places, as
+    fprintf(F, "%.<prec>f", val) would.
+    @param ww Writer
+    @param val Value to write
+    @param prec Number of decimal places (0 to WW_MAX_PREC)
+*/
+void ww_put_fixed(WigWriter *ww, double val, int prec);
+
+/** Write an integer.
+    @param ww Writer
+    @param i Value to write
+*/
+void ww_put_int(WigWriter *ww, long long i);
+
+/** Write a number using a printf-style format containing a single
+    floating-point conversion.  Formats of the form "%.Nf" use
+    ww_put_fixed; others are passed to snprintf.
+    @param ww Writer
+    @param fmt Format
+    @param val Value to write
+*/
+void ww_put_dbl(WigWriter *ww, const char *fmt, double val);
+
+/** Write a string.
+    @param ww Writer
+    @param s String to write
+*/
+void ww_put_str(WigWriter *ww, const char *s);
+
+/** Write a single character.
+    @param ww Writer
+    @param c Character to write
+*/
+static PHAST_INLINE
+void ww_put_char(WigWriter *ww, char c) {
+  if (ww->len == WW_BUFSIZE) ww_flush(ww);
+  ww->buf[ww->len++] = c;
+}
+
+/** Write a complete line consisting of a single value with a fixed
+    number of decimal places (the usual wig case).
+    @param ww Writer
+    @param coord Coordinate of line (see ww_start_line)
+    @param val Value to write
+    @param prec Number of decimal places
+*/
+void ww_value(WigWriter *ww, long long coord, double val, int prec);
+
+#endif
@@ -244,7 +244,7 @@ int main(int argc, char* argv[]) {
   if (msa_alph_has_lowercase(msa)) msa_toupper(msa); 
   msa_remove_N_from_alph(msa);
 
-  if (msa_format == SS && msa->ss->tuple_idx == NULL) 
+  if ((msa_format == SS || msa_format == BSS) && msa->ss->tuple_idx == NULL) 
     die("ERROR: Ordered representation of alignment required.\n");
   if (not_informative != NULL)
     msa_set_informative(msa, not_informative);
@@ -0,0 +1,306 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Self-contained radix-2 FFT and FFT-based convolution of real
+   sequences.  Two real sequences a and b are convolved by transforming
+   the single complex sequence z = a + ib, separating the spectra A and
+   B using the conjugate symmetry of real transforms, and inverting the
+   product A*B.  This needs only two complex transforms of the padded
+   length rather than three. */
+
+#include <math.h>
+#include <fft.h>
+#include <misc.h>
+
+/* relative cost of a complex butterfly compared to a direct
+   multiply-add; used to decide between direct and FFT convolution */
+#define FFT_COST_FACTOR 4.0
+
+int fft_size(int n) {
+  int size = 1;
+  while (size < n) size <<= 1;
+  return size;
+}
+
+/* fill tables of twiddle factors for transforms of length n.  Each
+   factor is computed directly (rather than by recurrence) to keep
+   round-off error as small as possible */
+static void fft_twiddles(int n, double *wr, double *wi) {
+  int k;
+  for (k = 0; k < n/2; k++) {
+    wr[k] = cos(2.0 * M_PI * k / n);
+    wi[k] = -sin(2.0 * M_PI * k / n);
+  }
+}
+
+/* iterative in-place transform using precomputed twiddle factors.
+   Inverse transform is unnormalized here */
+static void fft_run(double *re, double *im, int n, double *wr, double *wi,
+                    int inverse) {
+  int i, j, k, len, half, step;
+  double tr, ti, ur, ui, xr, xi;
+
+  /* bit-reversal permutation */
+  for (i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      tr = re[i]; re[i] = re[j]; re[j] = tr;
+      ti = im[i]; im[i] = im[j]; im[j] = ti;
+    }
+  }
+
+  for (len = 2; len <= n; len <<= 1) {
+    half = len >> 1;
+    step = n / len;
+    for (i = 0; i < n; i += len) {
+      for (k = 0; k < half; k++) {
+        ur = wr[k*step];
+        ui = inverse ? -wi[k*step] : wi[k*step];
+        j = i + k + half;
+        xr = re[j] * ur - im[j] * ui;
+        xi = re[j] * ui + im[j] * ur;
+        re[j] = re[i+k] - xr;
+        im[j] = im[i+k] - xi;
+        re[i+k] += xr;
+        im[i+k] += xi;
+      }
+    }
+  }
+}
+
+void fft_complex(double *re, double *im, int n, int inverse) {
+  double *wr, *wi;
+  int i;
+
+  if (n <= 0 || (n & (n-1)) != 0)
+    die("ERROR fft_complex: length (%i) must be a power of two\n", n);
+  if (n == 1) return;
+
+  wr = smalloc(n/2 * sizeof(double));
+  wi = smalloc(n/2 * sizeof(double));
+  fft_twiddles(n, wr, wi);
+  fft_run(re, im, n, wr, wi, inverse);
+  if (inverse) {
+    for (i = 0; i < n; i++) {
+      re[i] /= n;
+      im[i] /= n;
+    }
+  }
+  sfree(wr);
+  sfree(wi);
+}
+
+/* given transform z = Z[k] and zc = Z[-k] of sequence a + ib (a, b
+   real), compute the product of the transforms of a and b at k.
+   With A = (Z[k] + conj(Z[-k]))/2 and B = (Z[k] - conj(Z[-k]))/2i,
+   A*B = (Z[k]^2 - conj(Z[-k])^2) / 4i */
+static PHAST_INLINE
+void fft_split_product(double zr, double zi, double cr, double ci,
+                       double *pr, double *pi) {
+  double wx, wy;
+  ci = -ci;                     /* conjugate */
+  wx = (zr*zr - zi*zi) - (cr*cr - ci*ci);
+  wy = 2.0 * (zr*zi - cr*ci);
+  *pr = wy / 4.0;
+  *pi = -wx / 4.0;
+}
+
+void fft_convolve(double *a, int na, double *b, int nb, double *c, int nc) {
+  int n, k, kc;
+  double *re, *im, *pr, *pi, *wr, *wi;
+
+  if (nc <= 0) return;
+
+  /* elements beyond nc cannot contribute to the retained output */
+  if (na > nc) na = nc;
+  if (nb > nc) nb = nc;
+
+  n = fft_size(na + nb - 1);
+  if (n < 2) n = 2;
+
+  re = smalloc(n * sizeof(double));
+  im = smalloc(n * sizeof(double));
+  pr = smalloc(n * sizeof(double));
+  pi = smalloc(n * sizeof(double));
+  wr = smalloc(n/2 * sizeof(double));
+  wi = smalloc(n/2 * sizeof(double));
+  fft_twiddles(n, wr, wi);
+
+  for (k = 0; k < n; k++) {
+    re[k] = k < na ? a[k] : 0;
+    im[k] = k < nb ? b[k] : 0;
+  }
+
+  fft_run(re, im, n, wr, wi, 0);
+
+  for (k = 0; k < n; k++) {
+    kc = (n - k) & (n - 1);
+    fft_split_product(re[k], im[k], re[kc], im[kc], &pr[k], &pi[k]);
+  }
+
+  fft_run(pr, pi, n, wr, wi, 1);
+
+  for (k = 0; k < nc; k++)
+    c[k] = k < n ? pr[k] / n : 0;
+
+  sfree(re); sfree(im); sfree(pr); sfree(pi);
+  sfree(wr); sfree(wi);
+}
+
+void fft_convolve_2d(double **a, int arows, int acols,
+                     double **b, int brows, int bcols,
+                     double **c, int crows, int ccols) {
+  int n1, n2, x, y, kc1, kc2, nrows_in;
+  double *re, *im, *pr, *pi, *wr1, *wi1, *wr2, *wi2, *colr, *coli;
+
+  if (crows <= 0 || ccols <= 0) return;
+
+  if (arows > crows) arows = crows;
+  if (brows > crows) brows = crows;
+  if (acols > ccols) acols = ccols;
+  if (bcols > ccols) bcols = ccols;
+
+  n1 = fft_size(arows + brows - 1);
+  n2 = fft_size(acols + bcols - 1);
+  if (n1 < 2) n1 = 2;
+  if (n2 < 2) n2 = 2;
+  nrows_in = max(arows, brows);
+
+  re = smalloc(n1 * n2 * sizeof(double));
+  im = smalloc(n1 * n2 * sizeof(double));
+  pr = smalloc(n1 * n2 * sizeof(double));
+  pi = smalloc(n1 * n2 * sizeof(double));
+  wr1 = smalloc(n1/2 * sizeof(double));
+  wi1 = smalloc(n1/2 * sizeof(double));
+  wr2 = smalloc(n2/2 * sizeof(double));
+  wi2 = smalloc(n2/2 * sizeof(double));
+  colr = smalloc(n1 * sizeof(double));
+  coli = smalloc(n1 * sizeof(double));
+  fft_twiddles(n1, wr1, wi1);
+  fft_twiddles(n2, wr2, wi2);
+
+  /* pack a + ib and transform rows; rows beyond the input extent are
+     zero and remain zero under the row transform */
+  for (x = 0; x < n1; x++) {
+    double *rr = &re[x*n2], *ri = &im[x*n2];
+    for (y = 0; y < n2; y++) {
+      rr[y] = (x < arows && y < acols) ? a[x][y] : 0;
+      ri[y] = (x < brows && y < bcols) ? b[x][y] : 0;
+    }
+    if (x < nrows_in)
+      fft_run(rr, ri, n2, wr2, wi2, 0);
+  }
+
+  /* transform columns */
+  for (y = 0; y < n2; y++) {
+    for (x = 0; x < n1; x++) {
+      colr[x] = re[x*n2+y];
+      coli[x] = im[x*n2+y];
+    }
+    fft_run(colr, coli, n1, wr1, wi1, 0);
+    for (x = 0; x < n1; x++) {
+      re[x*n2+y] = colr[x];
+      im[x*n2+y] = coli[x];
+    }
+  }
+
+  /* product of separated spectra */
+  for (x = 0; x < n1; x++) {
+    kc1 = (n1 - x) & (n1 - 1);
+    for (y = 0; y < n2; y++) {
+      kc2 = (n2 - y) & (n2 - 1);
+      fft_split_product(re[x*n2+y], im[x*n2+y],
+                        re[kc1*n2+kc2], im[kc1*n2+kc2],
+                        &pr[x*n2+y], &pi[x*n2+y]);
+    }
+  }
+
+  /* inverse: columns first, then only the rows that are retained */
+  for (y = 0; y < n2; y++) {
+    for (x = 0; x < n1; x++) {
+      colr[x] = pr[x*n2+y];
+      coli[x] = pi[x*n2+y];
+    }
+    fft_run(colr, coli, n1, wr1, wi1, 1);
+    for (x = 0; x < n1; x++) {
+      pr[x*n2+y] = colr[x];
+      pi[x*n2+y] = coli[x];
+    }
+  }
+  for (x = 0; x < crows; x++) {
+    if (x >= n1) {
+      for (y = 0; y < ccols; y++) c[x][y] = 0;
+      continue;
+    }
+    fft_run(&pr[x*n2], &pi[x*n2], n2, wr2, wi2, 1);
+    for (y = 0; y < ccols; y++)
+      c[x][y] = y < n2 ? pr[x*n2+y] / ((double)n1 * n2) : 0;
+  }
+
+  sfree(re); sfree(im); sfree(pr); sfree(pi);
+  sfree(wr1); sfree(wi1); sfree(wr2); sfree(wi2);
+  sfree(colr); sfree(coli);
+}
+
+void fft_convolve_power(double *a, int na, int n, double *c, int nc) {
+  int size, k, e;
+  double full, *re, *im, *wr, *wi, br, bi, rr, ri, t;
+
+  if (nc <= 0) return;
+  if (na > nc) na = nc;
+
+  full = (double)n * (na - 1) + 1;
+  size = fft_size(full < 2.0 * nc ? (int)full : 2 * nc);
+  if (size < 2) size = 2;
+
+  re = smalloc(size * sizeof(double));
+  im = smalloc(size * sizeof(double));
+  wr = smalloc(size/2 * sizeof(double));
+  wi = smalloc(size/2 * sizeof(double));
+  fft_twiddles(size, wr, wi);
+
+  for (k = 0; k < size; k++) {
+    re[k] = k < na ? a[k] : 0;
+    im[k] = 0;
+  }
+
+  fft_run(re, im, size, wr, wi, 0);
+
+  /* raise each coefficient to the nth power by repeated squaring */
+  for (k = 0; k < size; k++) {
+    br = re[k]; bi = im[k];
+    rr = 1; ri = 0;
+    for (e = n; e > 0; e >>= 1) {
+      if (e & 1) {
+        t = rr * br - ri * bi;
+        ri = rr * bi + ri * br;
+        rr = t;
+      }
+      t = br * br - bi * bi;
+      bi = 2.0 * br * bi;
+      br = t;
+    }
+    re[k] = rr; im[k] = ri;
+  }
+
+  fft_run(re, im, size, wr, wi, 1);
+
+  for (k = 0; k < nc; k++)
+    c[k] = k < size ? re[k] / size : 0;
+
+  sfree(re); sfree(im); sfree(wr); sfree(wi);
+}
+
+int fft_preferred(double direct_ops, double n, double min_rel) {
+  if (direct_ops < FFT_MIN_DIRECT_OPS || min_rel < FFT_MIN_REL_VALUE)
+    return 0;
+  return (direct_ops > FFT_COST_FACTOR * n * log2(n));
+}
@@ -0,0 +1,368 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Transparent decompression of gzip and BGZF input.  See gz_input.h.
+   The decompressed stream is implemented with fopencookie; data are
+   decompressed into a buffer one batch at a time, and the stdio
+   layer reads from that buffer. */
+
+#define _GNU_SOURCE             /* for fopencookie */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <misc.h>
+#include <parallel.h>
+#include <gz_input.h>
+
+#if defined(PHAST_ZLIB) && defined(__GLIBC__)
+#define GZ_SUPPORTED
+#include <zlib.h>
+#endif
+
+/* only one character of pushback is guaranteed, so only the first
+   byte of the signature is examined here; gz_open_stream checks the
+   rest */
+int gz_is_compressed(FILE *F) {
+  int c = getc(F);
+  if (c == EOF) return 0;
+  ungetc(c, F);
+  return (c == 0x1f);
+}
+
+#ifndef GZ_SUPPORTED
+
+FILE *gz_open_stream(FILE *raw) {
+  die("ERROR: input is gzip-compressed, but PHAST was built without support for compressed input; decompress it first.\n");
+  return NULL;
+}
+
+#else
+
+/* maximum size of a BGZF block, compressed or uncompressed */
+#define GZ_BGZF_MAX 65536
+
+/* number of BGZF blocks per thread in each batch */
+#define GZ_BLOCKS_PER_THREAD 32
+
+/* amount of compressed data read at a time, and minimum amount of
+   output produced per batch, for ordinary gzip files */
+#define GZ_CHUNK 1048576
+
+/* size of fixed part of gzip member header */
+#define GZ_HDR_LEN 12
+
+typedef struct {
+  FILE *raw;                    /* compressed stream */
+  unsigned char *pending;       /* bytes already read from raw to
+                                   detect format (gzip header and
+                                   extra field) */
+  int npending, pending_pos;
+  int plain;                    /* whether raw turned out not to be
+                                   compressed; if so, its contents are
+                                   passed through unchanged */
+  int bgzf;                     /* whether format is BGZF */
+  int eof;                      /* whether all data decompressed */
+  char *out;                    /* current batch of decompressed data */
+  size_t out_len, out_pos, out_alloc;
+  long long out_start;          /* offset of out[0] in decompressed
+                                   data */
+
+  /* ordinary gzip */
+  z_stream strm;
+  unsigned char *in;
+
+  /* BGZF */
+  int max_blocks, nblocks;
+  unsigned char **blocks;       /* compressed blocks of current batch */
+  int *block_len;               /* compressed length of each */
+  size_t *block_out;            /* offset of each in out */
+  int *block_status;            /* 0 if decompressed successfully */
+} GzStream;
+
+/* read from compressed stream, taking pending bytes first */
+static size_t gz_raw_read(GzStream *gz, void *dest, size_t n) {
+  size_t k = 0;
+  while (gz->pending_pos < gz->npending && k < n)
+    ((unsigned char*)dest)[k++] = gz->pending[gz->pending_pos++];
+  if (k < n) k += fread((unsigned char*)dest + k, 1, n - k, gz->raw);
+  return k;
+}
+
+static unsigned int gz_le16(unsigned char *p) {
+  return p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned int gz_le32(unsigned char *p) {
+  return p[0] | ((unsigned int)p[1] << 8) | ((unsigned int)p[2] << 16) |
+    ((unsigned int)p[3] << 24);
+}
+
+/* given the fixed part of a gzip header and its extra field, return
+   the total size of the member if it is a BGZF block, or -1 */
+static int gz_bgzf_size(unsigned char *hdr, unsigned char *extra) {
+  unsigned int xlen = gz_le16(&hdr[10]), i, slen;
+  if (hdr[0] != 0x1f || hdr[1] != 0x8b || hdr[2] != 8 || !(hdr[3] & 4))
+    return -1;
+  for (i = 0; i + 4 <= xlen; i += 4 + slen) {
+    slen = gz_le16(&extra[i+2]);
+    if (extra[i] == 'B' && extra[i+1] == 'C' && slen == 2 && i + 6 <= xlen)
+      return (int)gz_le16(&extra[i+4]) + 1;
+  }
+  return -1;
+}
+
+/* thread function: decompress one BGZF block of the current batch */
+static void gz_inflate_block(int b, int thread, void *data) {
+  GzStream *gz = data;
+  unsigned char *block = gz->blocks[b];
+  int len = gz->block_len[b], hdrlen = GZ_HDR_LEN + gz_le16(&block[10]);
+  unsigned int isize = gz_le32(&block[len-4]);
+  z_stream s;
+
+  memset(&s, 0, sizeof(z_stream));
+  gz->block_status[b] = 1;
+  if (inflateInit2(&s, -15) != Z_OK) return;
+  s.next_in = &block[hdrlen];
+  s.avail_in = len - hdrlen - 8;
+  s.next_out = (unsigned char*)&gz->out[gz->block_out[b]];
+  s.avail_out = isize;
+  if (inflate(&s, Z_FINISH) == Z_STREAM_END && s.total_out == isize &&
+      crc32(0L, (unsigned char*)&gz->out[gz->block_out[b]], isize) ==
+      gz_le32(&block[len-8]))
+    gz->block_status[b] = 0;
+  inflateEnd(&s);
+}
+
+/* read and decompress the next batch of BGZF blocks */
+static void gz_fill_bgzf(GzStream *gz) {
+  unsigned char hdr[GZ_HDR_LEN], *block;
+  int b, size;
+  size_t n;
+
+  gz->nblocks = 0;
+  while (gz->nblocks < gz->max_blocks) {
+    if ((n = gz_raw_read(gz, hdr, GZ_HDR_LEN)) == 0) {
+      gz->eof = 1;
+      break;
+    }
+    block = gz->blocks[gz->nblocks];
+    memcpy(block, hdr, GZ_HDR_LEN);
+    if (n != GZ_HDR_LEN || gz_le16(&hdr[10]) > GZ_BGZF_MAX - GZ_HDR_LEN ||
+        gz_raw_read(gz, &block[GZ_HDR_LEN], gz_le16(&hdr[10])) !=
+        gz_le16(&hdr[10]))
+      die("ERROR gz_read: unexpected end of compressed input\n");
+    size = gz_bgzf_size(block, &block[GZ_HDR_LEN]);
+    if (size < 0)
+      die("ERROR gz_read: bad BGZF block in compressed input\n");
+    if (size < GZ_HDR_LEN + (int)gz_le16(&hdr[10]) + 8 || size > GZ_BGZF_MAX)
+      die("ERROR gz_read: bad BGZF block size in compressed input\n");
+    n = size - GZ_HDR_LEN - gz_le16(&hdr[10]);
+    if (gz_raw_read(gz, &block[GZ_HDR_LEN + gz_le16(&hdr[10])], n) != n)
+      die("ERROR gz_read: unexpected end of compressed input\n");
+    gz->block_len[gz->nblocks] = size;
+    gz->block_out[gz->nblocks] =
+      (gz->nblocks == 0 ? 0 : gz->block_out[gz->nblocks-1] +
+       gz_le32(&gz->blocks[gz->nblocks-1][gz->block_len[gz->nblocks-1]-4]));
+    if (gz_le32(&block[size-4]) > GZ_BGZF_MAX)
+      die("ERROR gz_read: bad BGZF block in compressed input\n");
+    gz->nblocks++;
+  }
+
+  if (gz->nblocks == 0) return;
+  b = gz->nblocks - 1;
+  gz->out_len = gz->block_out[b] +
+    gz_le32(&gz->blocks[b][gz->block_len[b]-4]);
+  thr_foreach(gz->nblocks, gz_inflate_block, gz);
+  for (b = 0; b < gz->nblocks; b++)
+    if (gz->block_status[b] != 0)
+      die("ERROR gz_read: corrupt BGZF block in compressed input\n");
+}
+
+/* decompress at least GZ_CHUNK bytes (or to end) of ordinary gzip */
+static void gz_fill_gzip(GzStream *gz) {
+  int status;
+  size_t n;
+  while (gz->out_len < GZ_CHUNK && !gz->eof) {
+    if (gz->strm.avail_in == 0) {
+      n = gz_raw_read(gz, gz->in, GZ_CHUNK);
+      if (n == 0)
+        die("ERROR gz_read: unexpected end of compressed input\n");
+      gz->strm.next_in = gz->in;
+      gz->strm.avail_in = (unsigned int)n;
+    }
+    gz->strm.next_out = (unsigned char*)&gz->out[gz->out_len];
+    gz->strm.avail_out = (unsigned int)(gz->out_alloc - gz->out_len);
+    status = inflate(&gz->strm, Z_NO_FLUSH);
+    gz->out_len = gz->out_alloc - gz->strm.avail_out;
+    if (status == Z_STREAM_END) {
+      /* concatenated members are allowed, as with gunzip */
+      if (gz->strm.avail_in == 0) {
+        n = gz_raw_read(gz, gz->in, GZ_CHUNK);
+        gz->strm.next_in = gz->in;
+        gz->strm.avail_in = (unsigned int)n;
+      }
+      if (gz->strm.avail_in == 0 || gz->strm.next_in[0] != 0x1f)
+        gz->eof = 1;
+      else inflateReset(&gz->strm);
+    }
+    else if (status != Z_OK && status != Z_BUF_ERROR)
+      die("ERROR gz_read: corrupt compressed input\n");
+  }
+}
+
+/* discard the current batch and decompress the next one; returns
+   number of bytes available */
+static size_t gz_fill(GzStream *gz) {
+  gz->out_start += gz->out_len;
+  gz->out_len = gz->out_pos = 0;
+  if (gz->eof) return 0;
+  if (gz->bgzf) gz_fill_bgzf(gz);
+  else gz_fill_gzip(gz);
+  return gz->out_len;
+}
+
+static ssize_t gz_read(void *cookie, char *buf, size_t size) {
+  GzStream *gz = cookie;
+  size_t n;
+  if (gz->plain) {
+    n = gz_raw_read(gz, buf, size);
+    gz->out_start += n;
+    return (ssize_t)n;
+  }
+  if (gz->out_pos == gz->out_len && gz_fill(gz) == 0) return 0;
+  n = min(size, gz->out_len - gz->out_pos);
+  memcpy(buf, &gz->out[gz->out_pos], n);
+  gz->out_pos += n;
+  return (ssize_t)n;
+}
+
+/* start over from the beginning of the compressed stream */
+static int gz_rewind(GzStream *gz) {
+  if (gz->raw == stdin || fseek(gz->raw, 0, SEEK_SET) != 0) return 1;
+  gz->npending = gz->pending_pos = 0;
+  gz->eof = 0;
+  gz->out_start = 0;
+  gz->out_len = gz->out_pos = 0;
+  if (!gz->bgzf) {
+    inflateReset(&gz->strm);
+    gz->strm.avail_in = 0;
+  }
+  return 0;
+}
+
+/* seek in uncompressed input; pending bytes are the first npending
+   bytes of raw */
+static int gz_seek_plain(GzStream *gz, long long target) {
+  if (fseek(gz->raw, (long)max(target, gz->npending), SEEK_SET) != 0)
+    return -1;
+  gz->pending_pos = (int)min(target, gz->npending);
+  gz->out_start = target;
+  return 0;
+}
+
+static int gz_seek(void *cookie, off64_t *offset, int whence) {
+  GzStream *gz = cookie;
+  long long target;
+  if (whence == SEEK_SET) target = *offset;
+  else if (whence == SEEK_CUR) target = gz->out_start + gz->out_pos + *offset;
+  else return -1;               /* size is unknown */
+  if (target < 0) return -1;
+
+  if (gz->plain) {
+    if (target != gz->out_start && gz_seek_plain(gz, target) != 0)
+      return -1;
+    *offset = target;
+    return 0;
+  }
+
+  if (target < gz->out_start && gz_rewind(gz) != 0) return -1;
+  while (target > gz->out_start + (long long)gz->out_len)
+    if (gz_fill(gz) == 0) return -1;
+  gz->out_pos = (size_t)(target - gz->out_start);
+  *offset = target;
+  return 0;
+}
+
+static int gz_close(void *cookie) {
+  GzStream *gz = cookie;
+  int b;
+  if (gz->bgzf) {
+    for (b = 0; b < gz->max_blocks; b++) sfree(gz->blocks[b]);
+    sfree(gz->blocks);
+    sfree(gz->block_len);
+    sfree(gz->block_out);
+    sfree(gz->block_status);
+  }
+  else if (!gz->plain) {
+    inflateEnd(&gz->strm);
+    sfree(gz->in);
+  }
+  if (gz->raw != stdin) fclose(gz->raw);
+  if (gz->out != NULL) sfree(gz->out);
+  sfree(gz->pending);
+  sfree(gz);
+  return 0;
+}
+
+FILE *gz_open_stream(FILE *raw) {
+  GzStream *gz = smalloc(sizeof(GzStream));
+  cookie_io_functions_t funcs;
+  int b;
+  FILE *F;
+
+  gz->raw = raw;
+  gz->pending = smalloc(GZ_HDR_LEN + GZ_BGZF_MAX);
+  gz->pending_pos = 0;
+  gz->npending = (int)fread(gz->pending, 1, GZ_HDR_LEN, raw);
+  gz->plain = !(gz->npending >= 2 && gz->pending[0] == 0x1f &&
+                gz->pending[1] == 0x8b);
+  gz->bgzf = 0;
+  if (!gz->plain && gz->npending == GZ_HDR_LEN && (gz->pending[3] & 4)) {
+    /* peek at extra field to look for BGZF subfield; the bytes read
+       are kept with the header and consumed first by gz_raw_read */
+    unsigned int xlen = gz_le16(&gz->pending[10]);
+    size_t n = fread(&gz->pending[GZ_HDR_LEN], 1, xlen, raw);
+    gz->npending += (int)n;
+    gz->bgzf = (n == xlen &&
+                gz_bgzf_size(gz->pending, &gz->pending[GZ_HDR_LEN]) > 0);
+  }
+  gz->eof = 0;
+  gz->out_start = 0;
+  gz->out_len = gz->out_pos = 0;
+  gz->out = NULL;
+
+  if (gz->bgzf) {
+    gz->max_blocks = GZ_BLOCKS_PER_THREAD * thr_get_nthreads();
+    gz->blocks = smalloc(gz->max_blocks * sizeof(unsigned char*));
+    for (b = 0; b < gz->max_blocks; b++)
+      gz->blocks[b] = smalloc(GZ_BGZF_MAX);
+    gz->block_len = smalloc(gz->max_blocks * sizeof(int));
+    gz->block_out = smalloc(gz->max_blocks * sizeof(size_t));
+    gz->block_status = smalloc(gz->max_blocks * sizeof(int));
+    gz->out_alloc = (size_t)gz->max_blocks * GZ_BGZF_MAX;
+  }
+  else if (!gz->plain) {
+    memset(&gz->strm, 0, sizeof(z_stream));
+    if (inflateInit2(&gz->strm, 15 + 32) != Z_OK) /* gzip header */
+      die("ERROR gz_open_stream: cannot initialize decompression\n");
+    gz->in = smalloc(GZ_CHUNK);
+    gz->out_alloc = 4 * GZ_CHUNK;
+  }
+  if (!gz->plain) gz->out = smalloc(gz->out_alloc);
+
+  funcs.read = gz_read;
+  funcs.write = NULL;
+  funcs.seek = gz_seek;
+  funcs.close = gz_close;
+  if ((F = fopencookie(gz, "r", funcs)) == NULL)
+    die("ERROR gz_open_stream: cannot create stream\n");
+  return F;
+}
+
+#endif
@@ -464,9 +464,7 @@ void mm_exp_higham(MarkovMatrix *P, MarkovMatrix *Q, double t, int do_mu) {
 /* general version allowing for complex eigenvalues/eigenvectors */
 void mm_exp_complex(MarkovMatrix *P, MarkovMatrix *Q, double t) {
 
-  static Zmatrix *Eexp = NULL; /* reuse these if possible */
-  static Zmatrix *tmp = NULL;
-  static int last_size = 0;
+  Zmatrix *tmp;
   int n = Q->size;
   int i, j;
 
@@ -479,19 +477,6 @@ void mm_exp_complex(MarkovMatrix *P, MarkovMatrix *Q, double t) {
     return;
   }
 
-  if (last_size != Q->size && Eexp != NULL) {
-    zmat_free(Eexp);
-    zmat_free(tmp);
-    Eexp = NULL;
-  }
-
-  if (Eexp == NULL) {
-    Eexp = zmat_new(Q->size, Q->size);
-    set_static_var((void**)&Eexp);
-    tmp = zmat_new(Q->size, Q->size);
-    last_size = Q->size;
-  }
-
   /* Diagonalize (if necessary) */
   if (Q->diagonalize_error != 1 &&
       (Q->evec_matrix_z == NULL || Q->evals_z == NULL ||
@@ -505,7 +490,10 @@ void mm_exp_complex(MarkovMatrix *P, MarkovMatrix *Q, double t) {
     return;
   }
 
-  /* Compute P(t) = S exp(Dt) S^-1.  Start by computing exp(Dt) S^-1 */
+  /* Compute P(t) = S exp(Dt) S^-1.  Start by computing exp(Dt) S^-1.
+     (Scratch space is not kept in static variables, so that
+     different matrices can be exponentiated concurrently) */
+  tmp = zmat_new(n, n);
   for (i = 0; i < n; i++) {
     Complex exp_dt_i =
       z_exp(z_mul_real(zvec_get(Q->evals_z, i), t));
@@ -515,15 +503,15 @@ void mm_exp_complex(MarkovMatrix *P, MarkovMatrix *Q, double t) {
 
   /* Now multiply by S (on the left) */
   zmat_mult_real(P->matrix, Q->evec_matrix_z, tmp);
-
+  zmat_free(tmp);
 }
 
 /* version that assumes real eigenvalues/eigenvectors */
 void mm_exp_real(MarkovMatrix *P, MarkovMatrix *Q, double t) {
-  static Vector *exp_evals = NULL; /* reuse if possible */
-  static int last_size = -1;
   int n = Q->size;
   int i;
+  double exp_evals_data[n];     /* on the stack, for thread safety */
+  Vector exp_evals;
 
  if (!(P->size == Q->size && t >= 0))
    die("ERROR mm_exp_real: got P->size=%i, Q->sizse=%i, t=%f\n",
@@ -534,15 +522,6 @@ void mm_exp_real(MarkovMatrix *P, MarkovMatrix *Q, double t) {
     return;
   }
 
-  if (exp_evals == NULL || last_size != Q->size) {
-    if (exp_evals != NULL)
-      vec_free(exp_evals);
-
-    exp_evals = vec_new(Q->size);
-    set_static_var((void**)&exp_evals);
-    last_size = Q->size;
-  }
-
   /* Diagonalize (if necessary) */
   if (Q->diagonalize_error != 1 &&
       (Q->evec_matrix_r == NULL || Q->evals_r == NULL ||
@@ -556,10 +535,12 @@ void mm_exp_real(MarkovMatrix *P, MarkovMatrix *Q, double t) {
   }
 
   /* Compute P(t) = S exp(Dt) S^-1 */
+  exp_evals.data = exp_evals_data;
+  exp_evals.size = n;
   for (i = 0; i < n; i++)
-    exp_evals->data[i] = exp(Q->evals_r->data[i] * t);
+    exp_evals.data[i] = exp(Q->evals_r->data[i] * t);
 
-  mat_mult_diag(P->matrix, Q->evec_matrix_r, exp_evals, Q->evec_matrix_inv_r);
+  mat_mult_diag(P->matrix, Q->evec_matrix_r, &exp_evals, Q->evec_matrix_inv_r);
 }
 
 /* computes discrete matrix P by the formula P = exp(Qt),
@@ -661,27 +642,13 @@ void mm_diagonalize_complex(MarkovMatrix *M) {
 void mm_diagonalize_real(MarkovMatrix *M) {
   /* use existing routines then "cast" complex matrices/vectors as real */
 
-  /* keep temp storage around -- this function will be called many
-     times repeatedly */
-  static Zmatrix *evecs_z = NULL;
-  static Zmatrix *evecs_inv_z = NULL;
-  static Zvector *evals_z = NULL;
-  static int size = -1;
-
-  if (evecs_z == NULL || size != M->size) {
-    if (evecs_z != NULL) {
-      zmat_free(evecs_z);
-      zmat_free(evecs_inv_z);
-      zvec_free(evals_z);
-      evecs_z = NULL;
-    }
-
-    evecs_z = zmat_new(M->size, M->size);
-    set_static_var((void**)&evecs_z);
-    evecs_inv_z = zmat_new(M->size, M->size);
-    evals_z = zvec_new(M->size);
-    size = M->size;
-  }
+  /* temporary storage is allocated on each call rather than kept in
+     static variables, so that different matrices can be diagonalized
+     concurrently; the cost is small relative to that of
+     diagonalization */
+  Zmatrix *evecs_z = zmat_new(M->size, M->size);
+  Zmatrix *evecs_inv_z = zmat_new(M->size, M->size);
+  Zvector *evals_z = zvec_new(M->size);
 
   if (1 == mat_diagonalize(M->matrix, evals_z, evecs_z, evecs_inv_z))
     goto mm_diagonalize_real_fail;
@@ -697,9 +664,15 @@ void mm_diagonalize_real(MarkovMatrix *M) {
       zmat_as_real(M->evec_matrix_r, evecs_z, FALSE) ||
       zmat_as_real(M->evec_matrix_inv_r, evecs_inv_z, FALSE))
     goto mm_diagonalize_real_fail;
+  zmat_free(evecs_z);
+  zmat_free(evecs_inv_z);
+  zvec_free(evals_z);
   return;
 
  mm_diagonalize_real_fail:
+  zmat_free(evecs_z);
+  zmat_free(evecs_inv_z);
+  zvec_free(evals_z);
   //by setting eigenvalues to NULL, mm_exp will call mm_exp_higham
   //instead of using eigenvalues.
   if (M->evec_matrix_r != NULL)
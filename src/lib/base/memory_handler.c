@@ -662,6 +662,8 @@ void msa_protect_ss(MSA_SS *ss) {
       if (ss->col_tuples[i] != NULL)
 	phast_mem_protect(ss->col_tuples[i]);
   }
+  if (ss->packed_tuples != NULL)
+    phast_mem_protect(ss->packed_tuples);
   if (ss->tuple_idx != NULL)
     phast_mem_protect(ss->tuple_idx);
   if (ss->counts != NULL)
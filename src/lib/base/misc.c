@@ -18,6 +18,7 @@
 #include <hashtable.h>
 #include <unistd.h>
 #include <assert.h>
+#include <gz_input.h>
 
 #define NCODONS 64
 
@@ -277,13 +278,21 @@ Matrix* read_subst_mat(FILE *F, char *alph) {
 FILE* phast_fopen_no_exit(const char *fname, const char *mode) {
   FILE *F = NULL;
   if (!strcmp(fname, "-")) {
-    if (mode[0]=='r') 
-      return stdin;
+    if (mode[0]=='r') {
+      if (!gz_is_compressed(stdin)) return stdin;
+      F = gz_open_stream(stdin);
+      register_open_file(F);
+      return F;
+    }
     else if (mode[0]=='w')
       return stdout;
     else die("ERROR: bad args to phast_fopen.\n");
   }
   F = fopen(fname, mode);
+  /* decompress gzip input transparently (see gz_input.h) */
+  if (F != NULL && mode[0] == 'r' && strchr(mode, '+') == NULL &&
+      gz_is_compressed(F))
+    F = gz_open_stream(F);
   if (F != NULL) register_open_file(F);
   return F;
 }
@@ -331,6 +340,45 @@ void set_seed(int seed) {
   } else srandom(seed);
 }
 
+/* stream selected in each thread for unif_rand, if any */
+#ifdef PHAST_PTHREADS
+static __thread RandStream *rand_cur_stream = NULL;
+#else
+static RandStream *rand_cur_stream = NULL;
+#endif
+
+#define RAND_GAMMA 0x9E3779B97F4A7C15ULL
+
+/* finalizer of the SplitMix64 generator; a bijection whose outputs
+   for consecutive inputs are statistically independent */
+static unsigned long long rand_mix64(unsigned long long z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+void rand_stream_init(RandStream *rs, unsigned int seed, unsigned int stream) {
+  rs->key = rand_mix64(rand_mix64(seed + RAND_GAMMA) + 
+                       (stream + 1ULL) * RAND_GAMMA);
+  rs->counter = 0;
+}
+
+double rand_stream_unif(RandStream *rs) {
+  unsigned long long x;
+  rs->counter++;
+  x = rand_mix64(rs->key + rs->counter * RAND_GAMMA);
+  return ((x >> 11) + 0.5) / 9007199254740992.0; /* 53 bits, in (0,1) */
+}
+
+void rand_stream_use(RandStream *rs) {
+  rand_cur_stream = rs;
+}
+
+double unif_rand() {
+  if (rand_cur_stream != NULL) return rand_stream_unif(rand_cur_stream);
+  return 1.0*random()/RAND_MAX;
+}
+
 #endif
 
 #ifdef RPHAST
@@ -543,9 +591,8 @@ int bn_draw(int N, double p) {
    externally. */
 int bn_draw_fast(int n, double pp) {
   int j;
-  static int nold = -1;
   double am, em, g, angle, p, bn1, sq, t, y;
-  static double pold = -1, pc, plog, pclog, en, oldg;
+  double pc, plog, pclog, en, oldg;
 
   if (n < 25) return bn_draw(n, pp);
 
@@ -568,17 +615,12 @@ int bn_draw_fast(int n, double pp) {
     bn1 = min(j, n);
   }
   else {                        /* use rejection method */
-    if (n != nold) {            /* compute first time only */
-      en = n;
-      oldg = lgamma(en + 1);
-      nold = n;
-    }
-    if (p != pold) {            /* compute first time only */
-      pc = 1 - p;
-      plog = log(p);
-      pclog = log(pc);
-      pold = p;
-    }
+    en = n;                     /* (not cached across calls, so that
+                                   draws can be made concurrently) */
+    oldg = lgamma(en + 1);
+    pc = 1 - p;
+    plog = log(p);
+    pclog = log(pc);
     sq = sqrt(2 * am * pc);     /* rejection method with Lorentzian
                                    comparison function */
     do {
@@ -10,6 +10,7 @@
 /* $Id: numerical_opt.c,v 1.16 2009-01-16 03:15:18 acs Exp $ */
 
 #include <stdlib.h>
+#include <string.h>
 #include <numerical_opt.h>
 #include <matrix.h>
 #include <markov_matrix.h>
@@ -18,6 +19,10 @@
 #include <sys/time.h>
 #include <vector.h>
 #include <external_libs.h>
+#include <parallel.h>
+#ifdef PHAST_PTHREADS
+#include <pthread.h>
+#endif
 
 /* Numerical optimization of one-dimensional and multi-dimensional functions */
 
@@ -106,6 +111,15 @@ opt_precision_type get_precision(const char *prec) {
 }
 
 
+opt_method_type get_opt_method(const char *name) {
+  if (strcmp(name, "BFGS")==0)
+    return OPT_BFGS;
+  if (strcmp(name, "LBFGSB")==0)
+    return OPT_LBFGSB;
+  return OPT_UNKNOWN_METHOD;
+}
+
+
 /* Numerically compute the gradient for the specified function at the
    specified parameter values.  Vector "grad" must already be
    allocated.  Will pass on to the specified function the auxiliary
@@ -155,6 +169,189 @@ void opt_gradient(Vector *grad, double (*f)(Vector*, void*),
   }
 }
 
+/* (used by opt_gradient_parallel) state shared by threads */
+typedef struct {
+  double (*f)(Vector*, void*);
+  void *data, **copies;
+  Vector *params, **thread_params;
+  int *need;                    /* whether each evaluation is needed */
+  double *vals;                 /* f(x - eps e_i) at 2i, f(x + eps e_i)
+                                   at 2i+1 */
+  double deriv_epsilon;
+} OptGradData;
+
+static void opt_gradient_thread(int j, int thread, void *data) {
+  OptGradData *d = data;
+  int i = j / 2;
+  Vector *p = d->thread_params[thread];
+  double origparm = vec_get(d->params, i);
+
+  if (!d->need[j]) return;
+  vec_set(p, i, j % 2 == 0 ? origparm - d->deriv_epsilon :
+          origparm + d->deriv_epsilon);
+  d->vals[j] = d->f(p, thread == 0 ? d->data : d->copies[thread-1]);
+  vec_set(p, i, origparm);
+}
+
+/* Same as opt_gradient, but function evaluations are divided among
+   threads (see parallel.h).  The calling thread evaluates the
+   function with "data"; thread t > 0 uses "copies[t-1]", which must
+   be independent copies of "data" (thr_get_nthreads() - 1 are
+   required).  The result is identical to that of opt_gradient,
+   provided the function depends only on its parameters and on the
+   contents of its auxiliary data. */
+void opt_gradient_parallel(Vector *grad, double (*f)(Vector*, void*),
+                           Vector *params, void *data, void **copies,
+                           opt_deriv_method method, double reference_val,
+                           Vector *lower_bounds, Vector *upper_bounds,
+                           double deriv_epsilon) {
+  int i, nthreads = thr_get_nthreads(), n = params->size;
+  double val1, val2, delta;
+  OptGradData d;
+
+  if (nthreads == 1 || copies == NULL) {
+    opt_gradient(grad, f, params, data, method, reference_val,
+                 lower_bounds, upper_bounds, deriv_epsilon);
+    return;
+  }
+
+  d.f = f;
+  d.data = data;
+  d.copies = copies;
+  d.params = params;
+  d.deriv_epsilon = deriv_epsilon;
+  d.need = smalloc(2 * n * sizeof(int));
+  d.vals = smalloc(2 * n * sizeof(double));
+  d.thread_params = smalloc(nthreads * sizeof(Vector*));
+  for (i = 0; i < nthreads; i++)
+    d.thread_params[i] = vec_create_copy(params);
+
+  /* same choice of evaluations as in opt_gradient */
+  for (i = 0; i < n; i++) {
+    double origparm = vec_get(params, i);
+    d.need[2*i] = !(method == OPT_DERIV_FORWARD ||
+                    (lower_bounds != NULL &&
+                     origparm - vec_get(lower_bounds, i) < deriv_epsilon));
+    d.need[2*i+1] = !(method == OPT_DERIV_BACKWARD ||
+                      (upper_bounds != NULL &&
+                       vec_get(upper_bounds, i) - origparm < deriv_epsilon));
+  }
+
+  thr_foreach(2 * n, opt_gradient_thread, &d);
+
+  for (i = 0; i < n; i++) {
+    delta = 2 * deriv_epsilon;
+    if (d.need[2*i]) val1 = d.vals[2*i];
+    else {
+      delta = deriv_epsilon;
+      val1 = reference_val;
+    }
+    if (d.need[2*i+1]) val2 = d.vals[2*i+1];
+    else {
+      delta = deriv_epsilon;
+      val2 = reference_val;
+    }
+    vec_set(grad, i, (val2 - val1) / delta);
+  }
+
+  for (i = 0; i < nthreads; i++)
+    vec_free(d.thread_params[i]);
+  sfree(d.thread_params);
+  sfree(d.need);
+  sfree(d.vals);
+}
+
+/* functions registered by opt_register_clone_funcs */
+typedef struct {
+  void *data;
+  void *(*clone)(void *data);
+  void (*free_clone)(void *copy);
+} OptCloneFuncs;
+
+static List *opt_clone_funcs = NULL;
+#ifdef PHAST_PTHREADS
+static pthread_mutex_t opt_clone_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void opt_lock_clone_funcs(int lock) {
+#ifdef PHAST_PTHREADS
+  if (lock) pthread_mutex_lock(&opt_clone_lock);
+  else pthread_mutex_unlock(&opt_clone_lock);
+#endif
+}
+
+/* Register functions that create and free independent copies of the
+   auxiliary data "data" of an objective function.  While they are
+   registered, opt_bfgs and opt_lbfgsb create one copy per additional
+   thread at the start of each optimization and compute numerical
+   gradients with opt_gradient_parallel.  A copy must reflect
+   everything about "data" that affects the function other than the
+   parameters passed to it. */
+void opt_register_clone_funcs(void *data, void *(*clone)(void *data),
+                              void (*free_clone)(void *copy)) {
+  OptCloneFuncs *cf = smalloc(sizeof(OptCloneFuncs));
+  cf->data = data;
+  cf->clone = clone;
+  cf->free_clone = free_clone;
+  opt_lock_clone_funcs(1);
+  if (opt_clone_funcs == NULL) {
+    opt_clone_funcs = lst_new_ptr(2);
+    set_static_var((void**)&opt_clone_funcs);
+  }
+  lst_push_ptr(opt_clone_funcs, cf);
+  opt_lock_clone_funcs(0);
+}
+
+/* Remove the functions registered for "data", if any */
+void opt_unregister_clone_funcs(void *data) {
+  int i;
+  opt_lock_clone_funcs(1);
+  for (i = 0; opt_clone_funcs != NULL && i < lst_size(opt_clone_funcs); i++) {
+    OptCloneFuncs *cf = lst_get_ptr(opt_clone_funcs, i);
+    if (cf->data == data) {
+      lst_delete_idx(opt_clone_funcs, i);
+      sfree(cf);
+      break;
+    }
+  }
+  opt_lock_clone_funcs(0);
+}
+
+/* Create copies of "data" for use by opt_gradient_parallel, if
+   functions have been registered for it and more than one thread is
+   in use; otherwise return NULL.  The function to free the copies is
+   returned in *free_clone */
+static void **opt_new_copies(void *data, int nparams,
+                             void (**free_clone)(void *copy)) {
+  int i, nthreads = thr_get_nthreads();
+  OptCloneFuncs *cf = NULL;
+  void **copies;
+
+  if (nthreads == 1 || nparams < 2) return NULL;
+  opt_lock_clone_funcs(1);
+  for (i = 0; opt_clone_funcs != NULL && i < lst_size(opt_clone_funcs); i++)
+    if (((OptCloneFuncs*)lst_get_ptr(opt_clone_funcs, i))->data == data) {
+      cf = lst_get_ptr(opt_clone_funcs, i);
+      break;
+    }
+  opt_lock_clone_funcs(0);
+  if (cf == NULL) return NULL;
+
+  copies = smalloc((nthreads - 1) * sizeof(void*));
+  for (i = 0; i < nthreads - 1; i++)
+    copies[i] = cf->clone(data);
+  *free_clone = cf->free_clone;
+  return copies;
+}
+
+static void opt_free_copies(void **copies, void (*free_clone)(void *copy)) {
+  int i;
+  if (copies == NULL) return;
+  for (i = 0; i < thr_get_nthreads() - 1; i++)
+    free_clone(copies[i]);
+  sfree(copies);
+}
+
 /* Test each parameter against specified bounds, and set "at_bounds"
    accordingly (every element will be given value "OPT_LOWER_BOUND",
    "OPT_UPPER_BOUND", or "OPT_NO_BOUND").  Either or both boundary
@@ -402,6 +599,7 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
   Matrix *H, *first_frac, *sec_frac, *bfgs_term;
   opt_deriv_method deriv_method = OPT_DERIV_FORWARD;
   struct timeval start_time, end_time;
+  void **copies = NULL, (*free_clone)(void *copy) = NULL;
 
   if (precision == OPT_UNKNOWN_PREC)
     die("unknown precision in opt_bfgs");
@@ -428,6 +626,9 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
   debugf = fopen_name("opt.debug", "w+");
 #endif
 
+  if (compute_grad == NULL)     /* for numerical gradients in parallel */
+    copies = opt_new_copies(data, n, &free_clone);
+
   fval = f(params, data);       /* Calculate starting function value
                                    and gradient, */
 
@@ -440,8 +641,8 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
                                    but prob. okay approx. */
   }
   else {
-    opt_gradient(g, f, params, data, deriv_method, fval, lower_bounds, 
-                 upper_bounds, deriv_epsilon);
+    opt_gradient_parallel(g, f, params, data, copies, deriv_method, fval,
+                          lower_bounds, upper_bounds, deriv_epsilon);
     nevals += (deriv_method == OPT_DERIV_CENTRAL ? 2 : 1)*params->size;
   }
 
@@ -585,8 +786,8 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
       nevals++;
     }
     else {
-      opt_gradient(g, f, params, data, deriv_method, fval, lower_bounds, 
-                   upper_bounds, deriv_epsilon);
+      opt_gradient_parallel(g, f, params, data, copies, deriv_method, fval,
+                            lower_bounds, upper_bounds, deriv_epsilon);
       nevals += (deriv_method == OPT_DERIV_CENTRAL ? 2 : 1)*params->size;
     }
 
@@ -789,6 +990,7 @@ int opt_bfgs(double (*f)(Vector*, void*), Vector *params,
             (end_time.tv_usec - start_time.tv_usec)/1.0e6);
   }
 
+  opt_free_copies(copies, free_clone);
   vec_free(dg);
   vec_free(g);
   vec_free(hdg);
@@ -943,6 +1145,626 @@ void opt_log(FILE *logf, int header_only, double val, Vector *params,
   fflush(logf);
 }
 
+/***************************************************************************
+ L-BFGS-B
+****************************************************************************/
+
+#define LBFGS_M 10              /* number of correction pairs retained */
+#define LBFGS_ITMAX 2000        /* maximum number of iterations */
+#define LBFGS_MAXLS 40          /* maximum function evaluations per
+                                   line search */
+#define LBFGS_NCONV 4           /* number of consecutive iterations on
+                                   which the delta-func criterion must
+                                   be met */
+#define LBFGS_PGTOL_DELTA 10    /* multiple of GTOL that the projected
+                                   gradient test must not exceed for
+                                   convergence via delta func */
+#define LBFGS_CURV 0.9          /* curvature condition: the directional
+                                   derivative must increase to this
+                                   fraction of its initial value */
+#define LBFGS_EXTRAP 4          /* factor by which the step is enlarged
+                                   when the curvature condition fails */
+#define LBFGS_CENTRAL_DELTA 1e-6 /* relative decrease in function below
+                                   which central differences are used
+                                   for numerical gradients */
+
+/* limited-memory BFGS matrix, in the compact form B = theta*I - W M
+   W', where W = [Y, theta*S] (Byrd, Nocedal & Schnabel 1994).  The
+   correction pairs are kept in circular buffers, oldest first */
+typedef struct {
+  int n, m, k, head;            /* dimension, capacity, no. of pairs
+                                   stored, index of oldest pair */
+  double *s, *y;                /* pairs, n elements each */
+  double theta;
+  double *M;                    /* 2k x 2k middle matrix */
+  double *work;                 /* 2m x 2m scratch */
+} LbfgsMatrix;
+
+#define LB_S(B, j) (&(B)->s[(size_t)(((B)->head + (j)) % (B)->m) * (B)->n])
+#define LB_Y(B, j) (&(B)->y[(size_t)(((B)->head + (j)) % (B)->m) * (B)->n])
+
+/* invert a small dense matrix in place by Gauss-Jordan elimination
+   with partial pivoting; returns 1 if singular */
+static int lb_invert(double *A, double *work, int n) {
+  int i, j, r, piv;
+  double tmp, *Ainv = work;
+  for (i = 0; i < n; i++)
+    for (j = 0; j < n; j++) Ainv[i*n+j] = (i == j);
+  for (i = 0; i < n; i++) {
+    piv = i;
+    for (r = i+1; r < n; r++)
+      if (fabs(A[r*n+i]) > fabs(A[piv*n+i])) piv = r;
+    if (A[piv*n+i] == 0) return 1;
+    if (piv != i)
+      for (j = 0; j < n; j++) {
+        tmp = A[i*n+j]; A[i*n+j] = A[piv*n+j]; A[piv*n+j] = tmp;
+        tmp = Ainv[i*n+j]; Ainv[i*n+j] = Ainv[piv*n+j]; Ainv[piv*n+j] = tmp;
+      }
+    tmp = A[i*n+i];
+    for (j = 0; j < n; j++) { A[i*n+j] /= tmp; Ainv[i*n+j] /= tmp; }
+    for (r = 0; r < n; r++) {
+      if (r == i || A[r*n+i] == 0) continue;
+      tmp = A[r*n+i];
+      for (j = 0; j < n; j++) {
+        A[r*n+j] -= tmp * A[i*n+j];
+        Ainv[r*n+j] -= tmp * Ainv[i*n+j];
+      }
+    }
+  }
+  memcpy(A, Ainv, n * n * sizeof(double));
+  return 0;
+}
+
+static double lb_dot(double *a, double *b, int n) {
+  double sum = 0;
+  int i;
+  for (i = 0; i < n; i++) sum += a[i] * b[i];
+  return sum;
+}
+
+/* row i of W */
+static PHAST_INLINE void lb_wrow(LbfgsMatrix *B, int i, double *w) {
+  int j;
+  for (j = 0; j < B->k; j++) {
+    w[j] = LB_Y(B, j)[i];
+    w[B->k + j] = B->theta * LB_S(B, j)[i];
+  }
+}
+
+/* out = M v (2k) */
+static void lb_mult_M(LbfgsMatrix *B, double *v, double *out) {
+  int i, j, k2 = 2 * B->k;
+  for (i = 0; i < k2; i++) {
+    out[i] = 0;
+    for (j = 0; j < k2; j++) out[i] += B->M[i*k2+j] * v[j];
+  }
+}
+
+/* recompute M = [-D, L'; L, theta S'S]^-1; returns 1 if singular */
+static int lb_update_M(LbfgsMatrix *B) {
+  int i, j, k = B->k, k2 = 2 * k;
+  double *A = B->M;
+  for (i = 0; i < k; i++) {
+    for (j = 0; j < k; j++) {
+      A[i*k2+j] = (i == j ? -lb_dot(LB_S(B, i), LB_Y(B, i), B->n) : 0);
+      A[(k+i)*k2+j] = (i > j ? lb_dot(LB_S(B, i), LB_Y(B, j), B->n) : 0);
+      A[i*k2+k+j] = (j > i ? lb_dot(LB_S(B, j), LB_Y(B, i), B->n) : 0);
+      A[(k+i)*k2+k+j] = B->theta * lb_dot(LB_S(B, i), LB_S(B, j), B->n);
+    }
+  }
+  return lb_invert(A, B->work, k2);
+}
+
+/* add a correction pair, discarding the oldest if necessary; the
+   pair is skipped if the curvature condition fails */
+static void lb_add_pair(LbfgsMatrix *B, double *s, double *y) {
+  double sy = lb_dot(s, y, B->n), yy = lb_dot(y, y, B->n);
+  int j;
+  if (sy <= EPS * yy) return;
+  if (B->k == B->m) B->head = (B->head + 1) % B->m;
+  else B->k++;
+  j = B->k - 1;
+  memcpy(LB_S(B, j), s, B->n * sizeof(double));
+  memcpy(LB_Y(B, j), y, B->n * sizeof(double));
+  B->theta = yy / sy;
+  if (lb_update_M(B) != 0) {    /* should not happen; start over */
+    B->k = B->head = 0;
+    B->theta = 1;
+  }
+}
+
+typedef struct {
+  double t;
+  int i;
+} LbBreakpoint;
+
+static int lb_bkpt_compare(const void *a, const void *b) {
+  double ta = ((LbBreakpoint*)a)->t, tb = ((LbBreakpoint*)b)->t;
+  return (ta > tb) - (ta < tb);
+}
+
+/* Compute the generalized Cauchy point xcp: the first local minimizer
+   of the quadratic model along the projected steepest-descent path
+   (Byrd, Lu, Nocedal & Zhu 1995, algorithm CP).  On return c = W'(xcp
+   - x) */
+static void lb_cauchy(LbfgsMatrix *B, double *x, double *g, double *l,
+                      double *u, double *xcp, double *c,
+                      LbBreakpoint *bk, double *work) {
+  int n = B->n, k2 = 2 * B->k, i, j, b, nbk = 0, idx;
+  double *d = work, *p = &work[n], *wb = &work[n+k2], *Mv = &work[n+2*k2],
+    *Mv2 = &work[n+3*k2], fp, fpp, dt, dtmin, t, told, zb;
+
+  for (i = 0; i < n; i++) {
+    xcp[i] = x[i];
+    if (g[i] < 0) t = (x[i] - u[i]) / g[i];
+    else if (g[i] > 0) t = (x[i] - l[i]) / g[i];
+    else t = INFINITY;
+    d[i] = (t == 0 ? 0 : -g[i]);
+    if (t > 0 && t < INFINITY) {
+      bk[nbk].t = t;
+      bk[nbk].i = i;
+      nbk++;
+    }
+  }
+  qsort(bk, nbk, sizeof(LbBreakpoint), lb_bkpt_compare);
+
+  for (j = 0; j < k2; j++) c[j] = p[j] = 0;
+  for (i = 0; i < n; i++) {
+    if (d[i] == 0) continue;
+    lb_wrow(B, i, wb);
+    for (j = 0; j < k2; j++) p[j] += wb[j] * d[i];
+  }
+  fp = -lb_dot(d, d, n);
+  lb_mult_M(B, p, Mv);
+  fpp = -B->theta * fp - lb_dot(p, Mv, k2);
+  if (fpp <= 0) fpp = EPS;
+  dtmin = -fp / fpp;
+  told = 0;
+
+  for (b = 0; b < nbk; b++) {
+    idx = bk[b].i;
+    dt = bk[b].t - told;
+    if (dtmin < dt) break;
+
+    /* move to breakpoint and fix variable idx at its bound */
+    xcp[idx] = (d[idx] > 0 ? u[idx] : l[idx]);
+    zb = xcp[idx] - x[idx];
+    for (j = 0; j < k2; j++) c[j] += dt * p[j];
+    lb_wrow(B, idx, wb);
+    lb_mult_M(B, c, Mv);
+    lb_mult_M(B, p, Mv2);
+    fp += dt * fpp + g[idx] * g[idx] + B->theta * g[idx] * zb -
+      g[idx] * lb_dot(wb, Mv, k2);
+    lb_mult_M(B, wb, Mv);
+    fpp += -B->theta * g[idx] * g[idx] - 2 * g[idx] * lb_dot(wb, Mv2, k2) -
+      g[idx] * g[idx] * lb_dot(wb, Mv, k2);
+    if (fpp <= EPS * B->theta) fpp = EPS * B->theta;
+    for (j = 0; j < k2; j++) p[j] += g[idx] * wb[j];
+    d[idx] = 0;
+    dtmin = -fp / fpp;
+    told = bk[b].t;
+  }
+
+  if (dtmin < 0) dtmin = 0;
+  told += dtmin;
+  for (i = 0; i < n; i++)
+    if (d[i] != 0) xcp[i] = x[i] + told * d[i];
+  for (j = 0; j < k2; j++) c[j] += dtmin * p[j];
+}
+
+/* Minimize the quadratic model over the variables that are free at
+   the Cauchy point (direct primal method of Byrd et al. 1995), then
+   back off to stay in bounds.  Result is returned in xbar */
+static void lb_subspace_min(LbfgsMatrix *B, double *x, double *g, double *l,
+                            double *u, double *xcp, double *c,
+                            double *xbar, double *work) {
+  int n = B->n, k2 = 2 * B->k, i, j, r;
+  double *du = work, *wi = &work[n], *v = &work[n+k2], *Mc = &work[n+2*k2],
+    *Mv = &work[n+3*k2], *N = &work[n+4*k2], *Nwork = &work[n+4*k2+k2*k2],
+    *WZW = &work[n+4*k2+2*k2*k2], alpha = 1, theta = B->theta;
+
+  lb_mult_M(B, c, Mc);
+  for (j = 0; j < k2; j++) v[j] = 0;
+  for (j = 0; j < k2*k2; j++) WZW[j] = 0;
+  for (i = 0; i < n; i++) {
+    xbar[i] = xcp[i];
+    if (!(xcp[i] > l[i] && xcp[i] < u[i])) {
+      du[i] = 0;
+      continue;
+    }
+    /* reduced gradient of the model at xcp */
+    lb_wrow(B, i, wi);
+    du[i] = g[i] + theta * (xcp[i] - x[i]) - lb_dot(wi, Mc, k2);
+    for (j = 0; j < k2; j++) {
+      v[j] += wi[j] * du[i];
+      for (r = 0; r < k2; r++) WZW[j*k2+r] += wi[j] * wi[r];
+    }
+  }
+
+  if (k2 > 0) {
+    /* v = (I - M W'ZZ'W / theta)^-1 M W'Z r */
+    lb_mult_M(B, v, Mv);
+    for (j = 0; j < k2; j++)
+      for (r = 0; r < k2; r++) {
+        double sum = 0;
+        int q;
+        for (q = 0; q < k2; q++) sum += B->M[j*k2+q] * WZW[q*k2+r];
+        N[j*k2+r] = (j == r) - sum / theta;
+      }
+    if (lb_invert(N, Nwork, k2) != 0) k2 = 0; /* use steepest descent */
+    else
+      for (j = 0; j < k2; j++) {
+        v[j] = 0;
+        for (r = 0; r < k2; r++) v[j] += N[j*k2+r] * Mv[r];
+      }
+  }
+
+  for (i = 0; i < n; i++) {
+    if (!(xcp[i] > l[i] && xcp[i] < u[i])) continue;
+    du[i] = -du[i] / theta;
+    if (k2 > 0) {
+      lb_wrow(B, i, wi);
+      du[i] -= lb_dot(wi, v, k2) / (theta * theta);
+    }
+    /* largest step keeping this variable in bounds */
+    if (du[i] > 0 && xcp[i] + alpha * du[i] > u[i])
+      alpha = (u[i] - xcp[i]) / du[i];
+    else if (du[i] < 0 && xcp[i] + alpha * du[i] < l[i])
+      alpha = (l[i] - xcp[i]) / du[i];
+  }
+  for (i = 0; i < n; i++)
+    if (du[i] != 0) xbar[i] = xcp[i] + alpha * du[i];
+}
+
+/* Scaled size of the projected gradient, max_i |P(x - g) - x|_i *
+   max(|x_i|, 1) / max(f, 1), where P is the projection onto the
+   bounds; this is zero at a constrained stationary point */
+static double lb_proj_grad_test(double *x, double *g, double *l, double *u,
+                                int n, double fval) {
+  double test = 0, temp, den = max(fval, 1.0);
+  int i;
+  for (i = 0; i < n; i++) {
+    temp = x[i] - g[i];
+    if (temp < l[i]) temp = l[i];
+    else if (temp > u[i]) temp = u[i];
+    temp = fabs(temp - x[i]) * max(fabs(x[i]), 1.0) / den;
+    if (temp > test) test = temp;
+  }
+  return test;
+}
+
+/* Compute the gradient at params, where the function value is fval,
+   using compute_grad if non-NULL and numerical differences otherwise.
+   Returns the (approximate) number of function evaluations used */
+static int lb_gradient(Vector *grad, double (*f)(Vector*, void*),
+                       Vector *params, void *data, void **copies,
+                       void (*compute_grad)(Vector *grad, Vector *params,
+                                            void *data, Vector *lb,
+                                            Vector *ub),
+                       opt_deriv_method deriv_method, double fval,
+                       Vector *lower_bounds, Vector *upper_bounds) {
+  if (compute_grad != NULL) {
+    compute_grad(grad, params, data, lower_bounds, upper_bounds);
+    return 1;
+  }
+  opt_gradient_parallel(grad, f, params, data, copies, deriv_method,
+                        fval, lower_bounds, upper_bounds, DERIV_EPSILON);
+  return (deriv_method == OPT_DERIV_CENTRAL ? 2 : 1) * params->size;
+}
+
+/* Find a minimum of the specified function subject to simple bounds
+   using the limited-memory BFGS-B algorithm (Byrd, Lu, Nocedal & Zhu,
+   1995).  Arguments and return value are as for opt_bfgs, but no
+   inverse Hessian is maintained: the quasi-Newton approximation is
+   represented by the last LBFGS_M pairs of parameter and gradient
+   differences, so each iteration requires O(n) memory and time
+   rather than O(n^2).  Bounds are handled directly, by minimizing
+   the quadratic model along the projected gradient path (the
+   "generalized Cauchy point") and then over the variables not at a
+   bound.  The line search finds a step satisfying the weak Wolfe
+   conditions, so correction pairs have positive curvature.
+   Convergence is normally detected by the projected gradient test;
+   a small relative change in the function counts only when it
+   persists over several iterations and the projected gradient is
+   within a small multiple of the tolerance. */
+int opt_lbfgsb(double (*f)(Vector*, void*), Vector *params,
+               void *data, double *retval, Vector *lower_bounds,
+               Vector *upper_bounds, FILE *logf,
+               void (*compute_grad)(Vector *grad, Vector *params,
+                                    void *data, Vector *lb, Vector *ub),
+               opt_precision_type precision, int *num_evals) {
+  int n = params->size, m = LBFGS_M, its, i, ls, success = 0, nevals = 0,
+    nfree, ndelta = 0;
+  double fval, fval_old, fnew, flo = 0, gd, gdnew, stp, stp0, stplo, stphi,
+    stpmax, lambda = -1, lambdalo = -1, test, pgtest, temp,
+    *x = params->data, *l, *u, *g, *xcp, *xbar, *c, *work, *sbuf, *ybuf;
+  Vector *gvec, *gnew, *glo, *params_new, *params_lo, *lbvec, *ubvec;
+  LbfgsMatrix B;
+  LbBreakpoint *bk;
+  opt_deriv_method deriv_method = OPT_DERIV_FORWARD;
+  struct timeval start_time, end_time;
+  void **copies = NULL, (*free_clone)(void *copy) = NULL;
+
+  if (precision == OPT_UNKNOWN_PREC)
+    die("unknown precision in opt_lbfgsb");
+
+  if (logf != NULL)
+    gettimeofday(&start_time, NULL);
+
+  B.n = n;
+  B.m = m;
+  B.k = B.head = 0;
+  B.theta = 1;
+  B.s = smalloc((size_t)n * m * sizeof(double));
+  B.y = smalloc((size_t)n * m * sizeof(double));
+  B.M = smalloc(4 * m * m * sizeof(double));
+  B.work = smalloc(4 * m * m * sizeof(double));
+  gvec = vec_new(n);
+  g = gvec->data;
+  gnew = vec_new(n);
+  glo = vec_new(n);
+  params_new = vec_new(n);
+  params_lo = vec_new(n);
+  lbvec = vec_new(n);
+  ubvec = vec_new(n);
+  l = lbvec->data;
+  u = ubvec->data;
+  xcp = smalloc(n * sizeof(double));
+  xbar = smalloc(n * sizeof(double));
+  c = smalloc(2 * m * sizeof(double));
+  sbuf = smalloc(n * sizeof(double));
+  ybuf = smalloc(n * sizeof(double));
+  work = smalloc((n + 8 * m + 12 * m * m) * sizeof(double));
+  bk = smalloc(n * sizeof(LbBreakpoint));
+
+  /* start from a feasible point */
+  for (i = 0; i < n; i++) {
+    l[i] = (lower_bounds == NULL ? -INFINITY : vec_get(lower_bounds, i));
+    u[i] = (upper_bounds == NULL ? INFINITY : vec_get(upper_bounds, i));
+    if (x[i] < l[i]) x[i] = l[i];
+    if (x[i] > u[i]) x[i] = u[i];
+  }
+
+  if (compute_grad == NULL)
+    copies = opt_new_copies(data, n, &free_clone);
+
+  fval = f(params, data);
+  nevals++;
+  nevals += lb_gradient(gvec, f, params, data, copies, compute_grad,
+                        deriv_method, fval, lower_bounds, upper_bounds);
+
+  if (logf != NULL) {
+    opt_log(logf, 1, 0, params, gvec, -1, -1);
+    opt_log(logf, 0, fval, params, gvec, -1, -1);
+  }
+
+  for (its = 0; its < LBFGS_ITMAX; its++) {
+    checkInterrupt();
+
+    /* test for convergence via projected gradient */
+    pgtest = lb_proj_grad_test(x, g, l, u, n, fval);
+    if (pgtest <= GTOL(precision)) {
+      if (logf != NULL) fprintf(logf, "Convergence via projected gradient tolerance (%e <= %e)\n", pgtest, GTOL(precision));
+      success = 1;
+      break;
+    }
+
+    /* search direction: from x to the minimizer of the quadratic
+       model over the free variables at the Cauchy point */
+    lb_cauchy(&B, x, g, l, u, xcp, c, bk, work);
+    lb_subspace_min(&B, x, g, l, u, xcp, c, xbar, work);
+    for (i = 0, gd = 0; i < n; i++) {
+      xbar[i] -= x[i];          /* xbar now holds direction */
+      gd += g[i] * xbar[i];
+    }
+    if (!(gd < 0)) {
+      if (B.k == 0) {
+        if (logf != NULL) fprintf(logf, "Convergence via inner product (%e) >= 0\n", gd);
+        success = 1;
+        break;
+      }
+      if (logf != NULL) fprintf(logf, "WARNING: not a descent direction; discarding history\n");
+      B.k = B.head = 0;
+      B.theta = 1;
+      its--;
+      continue;
+    }
+
+    /* largest feasible step along the direction (at least 1, because
+       xbar is feasible) */
+    stpmax = INFINITY;
+    for (i = 0; i < n; i++) {
+      if (xbar[i] > 0 && u[i] < INFINITY)
+        stpmax = min(stpmax, (u[i] - x[i]) / xbar[i]);
+      else if (xbar[i] < 0 && l[i] > -INFINITY)
+        stpmax = min(stpmax, (l[i] - x[i]) / xbar[i]);
+    }
+    if (stpmax < 1) stpmax = 1;
+    if (B.k == 0) {
+      temp = sqrt(lb_dot(xbar, xbar, n));
+      stp0 = min(1.0 / temp, 1.0);
+    }
+    else stp0 = 1;
+
+    /* line search for a step satisfying the weak Wolfe conditions:
+       backtrack until the function decreases sufficiently, then
+       extrapolate or bisect until the directional derivative has
+       increased sufficiently (curvature condition).  The latter
+       ensures s'y > 0, so that the new correction pair is usable */
+    stp = stp0;
+    stplo = 0;
+    stphi = INFINITY;
+    for (ls = 0; ls < LBFGS_MAXLS; ls++) {
+      for (i = 0; i < n; i++) {
+        temp = x[i] + stp * xbar[i];
+        if (temp < l[i]) temp = l[i]; /* guard against roundoff */
+        else if (temp > u[i]) temp = u[i];
+        vec_set(params_new, i, temp);
+      }
+      fnew = f(params_new, data);
+      nevals++;
+      if (!(isfinite(fnew) && fnew <= fval + ALPHA * stp * gd)) {
+        stphi = stp;
+        if (stplo > 0) stp = 0.5 * (stplo + stphi);
+        else {
+          if (isfinite(fnew))
+            temp = -gd * stp * stp / (2 * (fnew - fval - gd * stp));
+          else temp = 0.1 * stp;
+          stp = max(min(temp, 0.5 * stp), 0.1 * stp);
+        }
+        continue;
+      }
+
+      /* gradient at the trial point; switch to central differences
+         near the minimum.  Full steps are the rule here, so unlike
+         opt_bfgs, closeness is judged by the decrease in the
+         function */
+      lambda = stp / stp0;
+      if (deriv_method == OPT_DERIV_FORWARD && lambda == 1 && B.k > 0 &&
+          fabs((fval - fnew) / fnew) <= LBFGS_CENTRAL_DELTA)
+        deriv_method = OPT_DERIV_CENTRAL;
+      else if (deriv_method == OPT_DERIV_CENTRAL && lambda < 1)
+        deriv_method = OPT_DERIV_FORWARD;
+      nevals += lb_gradient(gnew, f, params_new, data, copies, compute_grad,
+                            deriv_method, fnew, lower_bounds, upper_bounds);
+      for (i = 0, gdnew = 0; i < n; i++)
+        gdnew += gnew->data[i] * xbar[i];
+
+      /* keep the best point satisfying sufficient decrease, in case
+         the curvature condition cannot be met */
+      if (stplo == 0 || fnew < flo) {
+        vec_copy(params_lo, params_new);
+        vec_copy(glo, gnew);
+        flo = fnew;
+        lambdalo = lambda;
+      }
+      if (gdnew >= LBFGS_CURV * gd || stp >= stpmax) break;
+      stplo = stp;
+      if (stphi < INFINITY) stp = 0.5 * (stplo + stphi);
+      else stp = min(LBFGS_EXTRAP * stp, stpmax);
+    }
+    if (ls == LBFGS_MAXLS) {
+      if (stplo == 0) {
+        if (B.k > 0) {
+          if (logf != NULL) fprintf(logf, "WARNING: line search failed; discarding history\n");
+          B.k = B.head = 0;
+          B.theta = 1;
+          continue;
+        }
+        if (logf != NULL) fprintf(logf, "Convergence via failure of line search\n");
+        success = 1;
+        break;
+      }
+      /* sufficient decrease only; the pair may be skipped below */
+      vec_copy(params_new, params_lo);
+      vec_copy(gnew, glo);
+      fnew = flo;
+      lambda = lambdalo;
+    }
+
+    /* accept step */
+    test = 0;
+    for (i = 0; i < n; i++) {
+      sbuf[i] = vec_get(params_new, i) - x[i];
+      temp = fabs(sbuf[i]) / max(fabs(vec_get(params_new, i)), 1.0);
+      if (temp > test) test = temp;
+      ybuf[i] = gnew->data[i] - g[i];
+    }
+    vec_copy(params, params_new);
+    vec_copy(gvec, gnew);
+    fval_old = fval;
+    fval = fnew;
+    if (logf != NULL) {
+      for (i = 0, nfree = 0; i < n; i++)
+        if (x[i] > l[i] && x[i] < u[i]) nfree++;
+      opt_log(logf, 0, fval, params, gvec, n - nfree, lambda);
+    }
+
+    if (test <= TOLX(precision)) {
+      if (logf != NULL) fprintf(logf, "Convergence via TOLX (%e <= %e)\n",
+                                test, TOLX(precision));
+      success = 1;
+      break;
+    }
+
+    /* a small relative change in the function alone is not sufficient
+       for convergence, because the limited-memory approximation can
+       take many small steps along a shallow valley; the projected
+       gradient must also be small */
+    if (lambda > LAMBDA_THRESHOLD &&
+        fabs((fval_old - fval) / fval) <= DELTA_FUNC(precision) &&
+        lb_proj_grad_test(x, g, l, u, n, fval) <=
+        LBFGS_PGTOL_DELTA * GTOL(precision)) {
+      if (++ndelta >= LBFGS_NCONV) {
+        if (logf != NULL) fprintf(logf, "Convergence via delta func\n");
+        success = 1;
+        break;
+      }
+    }
+    else ndelta = 0;
+
+    lb_add_pair(&B, sbuf, ybuf);
+  }
+
+  *retval = fval;
+  if (logf != NULL) {
+    opt_log(logf, 0, fval, params, gvec, -1, lambda);
+    gettimeofday(&end_time, NULL);
+    fprintf(logf, "\nNumber of iterations: %d\nNumber of function evaluations: %d\nTotal time: %.4f sec.\n",
+            its, nevals, end_time.tv_sec - start_time.tv_sec +
+            (end_time.tv_usec - start_time.tv_usec)/1.0e6);
+  }
+
+  opt_free_copies(copies, free_clone);
+  sfree(B.s);
+  sfree(B.y);
+  sfree(B.M);
+  sfree(B.work);
+  vec_free(gvec);
+  vec_free(gnew);
+  vec_free(glo);
+  vec_free(params_new);
+  vec_free(params_lo);
+  vec_free(lbvec);
+  vec_free(ubvec);
+  sfree(xcp);
+  sfree(xbar);
+  sfree(c);
+  sfree(sbuf);
+  sfree(ybuf);
+  sfree(work);
+  sfree(bk);
+  if (num_evals != NULL)
+    *num_evals = nevals;
+
+  if (success == 0) {
+    if (logf != NULL)
+      fprintf(logf,
+              "WARNING: exceeded maximum number of iterations in opt_lbfgsb.\n");
+    return 1;
+  }
+  return 0;
+}
+
+/* Minimize a function using the specified algorithm (opt_bfgs or
+   opt_lbfgsb).  Arguments are as for opt_bfgs; inv_Hessian (which may
+   be NULL) is ignored by opt_lbfgsb. */
+int opt_minimize(opt_method_type method, double (*f)(Vector*, void*),
+                 Vector *params, void *data, double *retval,
+                 Vector *lower_bounds, Vector *upper_bounds, FILE *logf,
+                 void (*compute_grad)(Vector *grad, Vector *params,
+                                      void *data, Vector *lb, Vector *ub),
+                 opt_precision_type precision, Matrix *inv_Hessian,
+                 int *num_evals) {
+  if (method == OPT_LBFGSB)
+    return opt_lbfgsb(f, params, data, retval, lower_bounds, upper_bounds,
+                      logf, compute_grad, precision, num_evals);
+  if (method != OPT_BFGS)
+    die("ERROR opt_minimize: unknown optimization method\n");
+  return opt_bfgs(f, params, data, retval, lower_bounds, upper_bounds,
+                  logf, compute_grad, precision, inv_Hessian, num_evals);
+}
+
 /***************************************************************************
  Brent's method
 ****************************************************************************/
@@ -1210,6 +2032,173 @@ int opt_newton_1d(double (*f)(double, void*), double (*x), void *data,
   return(!converged);
 }
 
+/* states of an individual problem in opt_newton_1d_batch */
+typedef enum {
+  NEWTON_INIT,                  /* awaiting initial function evaluation */
+  NEWTON_DERIV1,                /* awaiting f(x +/- eps) */
+  NEWTON_DERIV2,                /* awaiting f(x +/- 2 eps) */
+  NEWTON_LNSRCH,                /* awaiting evaluation in line search */
+  NEWTON_DONE                   /* converged or out of iterations */
+} newton_1d_phase;
+
+typedef struct {
+  newton_1d_phase phase;
+  double x, fx, xold, fxold, fxeps, deriv, direction, slope,
+    lambda, lambda_min, eval_x;
+  int its, at_ub, converged;
+} Newton1dState;
+
+/* begin a new Newton iteration for an individual problem, or retire
+   it if the maximum number of iterations has been reached */
+static void newton_1d_start_iter(Newton1dState *s, double ub) {
+  if (s->its >= ITMAX) {
+    s->phase = NEWTON_DONE;
+    return;
+  }
+  s->at_ub = (ub - s->x < BOUNDARY_EPS2);
+  s->eval_x = s->at_ub ? s->x - DERIV_EPSILON : s->x + DERIV_EPSILON;
+  s->phase = NEWTON_DERIV1;
+}
+
+/* Simultaneous Newton-Raphson optimization of many independent
+   one-dimensional functions, all with the same bounds.  Each problem
+   follows exactly the sequence of steps taken by opt_newton_1d with
+   numerical derivatives, but the problems are advanced in lockstep,
+   so that every round of function evaluations can be handed to the
+   caller as a single batch.  Problems are retired as they converge.
+   The function f must evaluate all n requested points, where idx[k]
+   identifies the problem (0 <= idx[k] < nprobs), x[k] is the
+   abscissa, and the function value is to be stored in fx[k].  On
+   input, x contains starting values; on output, x and fx contain the
+   optimized values.  Returns the number of problems that failed to
+   converge. */
+int opt_newton_1d_batch(void (*f)(int n, int *idx, double *x, double *fx,
+                                  void *data),
+                        double *x, int nprobs, void *data, double *fx,
+                        int sigfigs, double lb, double ub) {
+  Newton1dState *state = smalloc(nprobs * sizeof(Newton1dState));
+  int *req_idx = smalloc(nprobs * sizeof(int));
+  double *req_x = smalloc(nprobs * sizeof(double)),
+    *req_f = smalloc(nprobs * sizeof(double));
+  int i, k, nreq, nfail = 0, round;
+
+  for (i = 0; i < nprobs; i++) {
+    Newton1dState *s = &state[i];
+    if (!(x[i] > lb && x[i] < ub && ub > lb))
+      die("ERROR opt_newton_1d_batch: x=%e, lb=%e, ub=%e\n", x[i], lb, ub);
+    s->phase = NEWTON_INIT;
+    s->x = s->eval_x = x[i];
+    s->its = 0;
+    s->converged = FALSE;
+    s->lambda = -1;
+  }
+
+  for (round = 0; ; round++) {
+    checkInterruptN(round, 100);
+
+    /* collect requested evaluations from all active problems */
+    for (i = 0, nreq = 0; i < nprobs; i++) {
+      if (state[i].phase == NEWTON_DONE) continue;
+      req_idx[nreq] = i;
+      req_x[nreq] = state[i].eval_x;
+      nreq++;
+    }
+    if (nreq == 0) break;
+
+    f(nreq, req_idx, req_x, req_f, data);
+
+    /* advance each problem given its new function value */
+    for (k = 0; k < nreq; k++) {
+      Newton1dState *s = &state[req_idx[k]];
+      double val = req_f[k], d2;
+
+      switch (s->phase) {
+      case NEWTON_INIT:
+        s->fx = s->fxold = val;
+        s->xold = s->x;
+        newton_1d_start_iter(s, ub);
+        break;
+
+      case NEWTON_DERIV1:       /* as in opt_derivs_1d */
+        s->fxeps = val;
+        if (s->at_ub) {
+          s->deriv = (s->fx - s->fxeps) / DERIV_EPSILON;
+          s->eval_x = s->x - 2*DERIV_EPSILON;
+        }
+        else {
+          s->deriv = (s->fxeps - s->fx) / DERIV_EPSILON;
+          s->eval_x = s->x + 2*DERIV_EPSILON;
+        }
+        s->phase = NEWTON_DERIV2;
+        break;
+
+      case NEWTON_DERIV2:
+        if (s->at_ub)
+          d2 = (val + 2*s->fxeps - s->fx) / (DERIV_EPSILON * DERIV_EPSILON);
+        else
+          d2 = (val - 2*s->fxeps + s->fx) / (DERIV_EPSILON * DERIV_EPSILON);
+
+        if (d2 < 1e-4) d2 = 1;  /* reduce to gradient descent */
+        s->direction = -s->deriv / d2;
+
+        /* truncate for bounds, if necessary */
+        if (s->x + s->direction - lb < BOUNDARY_EPS2)
+          s->direction = lb + BOUNDARY_EPS2 - s->x;
+        else if (ub - (s->x + s->direction) < BOUNDARY_EPS2)
+          s->direction = ub - BOUNDARY_EPS2 - s->x;
+
+        /* set up line search, as in opt_lnsrch_1d */
+        s->lambda = 1;
+        s->slope = s->deriv * s->direction;
+        s->lambda_min = TOLX(OPT_HIGH_PREC) /
+          (fabs(s->x)/max(fabs(s->xold), 1.0));
+        s->eval_x = s->xold + s->lambda * s->direction;
+        s->phase = NEWTON_LNSRCH;
+        break;
+
+      case NEWTON_LNSRCH:
+        s->x = s->eval_x;
+        s->fx = val;
+        if (s->lambda < s->lambda_min)
+          s->x = s->xold;
+        else if (!(s->fx <= s->fxold + ALPHA * s->lambda * s->slope)) {
+          s->lambda *= RHO;     /* have to backtrack */
+          s->eval_x = s->xold + s->lambda * s->direction;
+          break;
+        }
+
+        /* step accepted; test for convergence */
+        if (opt_sigfig(s->x, s->xold) >= sigfigs &&
+            opt_sigfig(s->fx, s->fxold) >= sigfigs) {
+          s->converged = TRUE;
+          s->phase = NEWTON_DONE;
+          break;
+        }
+        s->fxold = s->fx;
+        s->xold = s->x;
+        s->its++;
+        newton_1d_start_iter(s, ub);
+        break;
+
+      default:
+        die("ERROR opt_newton_1d_batch: unexpected state\n");
+      }
+    }
+  }
+
+  for (i = 0; i < nprobs; i++) {
+    x[i] = state[i].x;
+    fx[i] = state[i].fx;
+    if (!state[i].converged) nfail++;
+  }
+
+  sfree(state);
+  sfree(req_idx);
+  sfree(req_x);
+  sfree(req_f);
+  return nfail;
+}
+
 /* compute first and (optionally) second derivative at particular
    abscissa, using numerical approximations to derivatives if
    necessary.  Allows for bounds.  For use in one-dimensional
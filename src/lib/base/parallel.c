@@ -0,0 +1,108 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Simple support for running independent computations in parallel.
+   Work is handed out in small chunks from a shared counter, so that
+   calls of uneven cost are balanced across threads. */
+
+#include <parallel.h>
+#include <misc.h>
+#ifdef PHAST_PTHREADS
+#include <pthread.h>
+#endif
+
+static int thr_nthreads = 1;
+static int thr_active = 0;      /* TRUE while threads are running;
+                                   nested calls are then serial */
+
+void thr_set_nthreads(int n) {
+  thr_nthreads = (n < 1 ? 1 : n);
+}
+
+int thr_get_nthreads() {
+#ifdef PHAST_PTHREADS
+  return thr_active ? 1 : thr_nthreads;
+#else
+  return 1;
+#endif
+}
+
+#ifdef PHAST_PTHREADS
+/* state shared by all threads in a call to thr_foreach */
+typedef struct {
+  int n, next, chunk;
+  void (*f)(int i, int thread, void *data);
+  void *data;
+  pthread_mutex_t lock;
+} ThrJob;
+
+typedef struct {
+  ThrJob *job;
+  int thread;
+} ThrArg;
+
+static void *thr_worker(void *arg) {
+  ThrArg *targ = arg;
+  ThrJob *job = targ->job;
+  int i, start, end;
+
+  while (1) {
+    pthread_mutex_lock(&job->lock);
+    start = job->next;
+    job->next += job->chunk;
+    pthread_mutex_unlock(&job->lock);
+    if (start >= job->n) break;
+    end = min(start + job->chunk, job->n);
+    for (i = start; i < end; i++)
+      job->f(i, targ->thread, job->data);
+  }
+  return NULL;
+}
+#endif
+
+void thr_foreach(int n, void (*f)(int i, int thread, void *data),
+                 void *data) {
+  int i, nthreads = min(thr_get_nthreads(), n);
+
+#ifdef PHAST_PTHREADS
+  if (nthreads > 1) {
+    ThrJob job;
+    ThrArg *args = smalloc(nthreads * sizeof(ThrArg));
+    pthread_t *threads = smalloc(nthreads * sizeof(pthread_t));
+
+    job.n = n;
+    job.next = 0;
+    job.chunk = max(1, n / (nthreads * 16));
+    job.f = f;
+    job.data = data;
+    pthread_mutex_init(&job.lock, NULL);
+
+    for (i = 0; i < nthreads; i++) {
+      args[i].job = &job;
+      args[i].thread = i;
+    }
+    thr_active = 1;
+    for (i = 1; i < nthreads; i++)
+      if (pthread_create(&threads[i], NULL, thr_worker, &args[i]) != 0)
+        die("ERROR thr_foreach: unable to create thread\n");
+    thr_worker(&args[0]);       /* calling thread does its share */
+    for (i = 1; i < nthreads; i++)
+      pthread_join(threads[i], NULL);
+    thr_active = 0;
+
+    pthread_mutex_destroy(&job.lock);
+    sfree(args);
+    sfree(threads);
+    return;
+  }
+#endif
+
+  for (i = 0; i < n; i++)
+    f(i, 0, data);
+}
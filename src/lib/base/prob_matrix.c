@@ -18,6 +18,7 @@
 
 #include <prob_matrix.h>
 #include <prob_vector.h>
+#include <fft.h>
 #include <misc.h>
 
 void pm_mean(Matrix *p, double *mean_x, double *mean_y) {
@@ -112,9 +113,47 @@ void pm_normalize(Matrix *p) {
   mat_scale(p, 1/sum);
 }
 
+/* convolve q (nonzero only in its first qrows rows and qcols columns)
+   with p, storing rows [0, orows) and columns [0, ocols) of the result
+   in out.  Uses a 2-D FFT when the direct computation would be
+   expensive and probabilities down to epsilon are within its
+   precision; otherwise the direct sum is computed exactly as it
+   always has been.  Tiny negative values due to round-off in the FFT
+   are set to zero */
+static void pm_convolve_step(Matrix *q, int qrows, int qcols, Matrix *p, 
+                             Matrix *out, int orows, int ocols,
+                             double epsilon) {
+  int j, k, x, y;
+  double direct_ops = (double)orows * ocols * min(qrows, p->nrows) * 
+    min(qcols, p->ncols);
+
+  if (fft_preferred(direct_ops, 
+                    (double)fft_size(min(qrows, orows) + 
+                                     min(p->nrows, orows) - 1) * 
+                    fft_size(min(qcols, ocols) + 
+                             min(p->ncols, ocols) - 1),
+                    epsilon)) {
+    fft_convolve_2d(q->data, qrows, qcols, p->data, p->nrows, p->ncols,
+                    out->data, orows, ocols);
+    for (x = 0; x < orows; x++)
+      for (y = 0; y < ocols; y++)
+        if (out->data[x][y] < 0) out->data[x][y] = 0;
+    return;
+  }
+
+  for (x = 0; x < orows; x++) {
+    for (y = 0; y < ocols; y++) {
+      out->data[x][y] = 0;
+      for (j = max(0, x - p->nrows + 1); j <= x && j < qrows; j++) 
+        for (k = max(0, y - p->ncols + 1); k <= y && k < qcols; k++) 
+          out->data[x][y] += q->data[j][k] * p->data[x - j][y - k];
+    }
+  }
+}
+
 /* convolve distribution n times */
 Matrix *pm_convolve(Matrix *p, int n, double epsilon) {
-  int i, j, k, x, y;
+  int i, x, y, ext_nrows, ext_ncols;
   Matrix *q_i, *q_i_1;
   double mean, var, max_nsd;
   int max_nrows = p->nrows * n, max_ncols = p->ncols * n;
@@ -148,14 +187,15 @@ Matrix *pm_convolve(Matrix *p, int n, double epsilon) {
     for (y = 0; y < p->ncols; y++)
       q_i_1->data[x][y] = p->data[x][y];
 
+  ext_nrows = min(p->nrows, max_nrows);
+  ext_ncols = min(p->ncols, max_ncols);
   for (i = 1; i < n; i++) {
     mat_zero(q_i);
-    for (x = 0; x < q_i->nrows; x++) {
-      for (y = 0; y < q_i->ncols; y++) 
-        for (j = max(0, x - p->nrows + 1); j <= x; j++) 
-          for (k = max(0, y - p->ncols + 1); k <= y; k++) 
-            q_i->data[x][y] += q_i_1->data[j][k] * p->data[x - j][y - k];
-    }
+    pm_convolve_step(q_i_1, ext_nrows, ext_ncols, p, q_i, 
+                     min(max_nrows, ext_nrows + p->nrows - 1),
+                     min(max_ncols, ext_ncols + p->ncols - 1), epsilon);
+    ext_nrows = min(max_nrows, ext_nrows + p->nrows - 1);
+    ext_ncols = min(max_ncols, ext_ncols + p->ncols - 1);
     mat_copy(q_i_1, q_i);
   }
 
@@ -181,7 +221,7 @@ Matrix *pm_convolve(Matrix *p, int n, double epsilon) {
    distributions.  Return value is an array q such that q[i] (1 <= i
    <= n) is the ith convolution of p (q[0] will be NULL) */
 Matrix **pm_convolve_save(Matrix *p, int n, double epsilon) {
-  int i, j, k, x, y;
+  int i, x, y, ext_nrows, ext_ncols;
   double mean, var, max_nsd;
   int max_nrows = p->nrows * n, max_ncols = p->ncols * n;
   Matrix **q = smalloc((n+1) * sizeof(void*));
@@ -217,14 +257,16 @@ Matrix **pm_convolve_save(Matrix *p, int n, double epsilon) {
     for (y = 0; y < p->ncols; y++)
       q[1]->data[x][y] = p->data[x][y];
 
+  ext_nrows = min(p->nrows, max_nrows);
+  ext_ncols = min(p->ncols, max_ncols);
   for (i = 2; i <= n; i++) {
     q[i] = mat_new(max_nrows, max_ncols);
     mat_zero(q[i]);
-    for (x = 0; x < q[i]->nrows; x++) 
-      for (y = 0; y < q[i]->ncols; y++) 
-        for (j = max(0, x - p->nrows + 1); j <= x; j++) 
-          for (k = max(0, y - p->ncols + 1); k <= y; k++) 
-            q[i]->data[x][y] += q[i-1]->data[j][k] * p->data[x - j][y - k];
+    pm_convolve_step(q[i-1], ext_nrows, ext_ncols, p, q[i], 
+                     min(max_nrows, ext_nrows + p->nrows - 1),
+                     min(max_ncols, ext_ncols + p->ncols - 1), epsilon);
+    ext_nrows = min(max_nrows, ext_nrows + p->nrows - 1);
+    ext_ncols = min(max_ncols, ext_ncols + p->ncols - 1);
   }
 
   /* trim dimension before returning */
@@ -248,8 +290,8 @@ Matrix **pm_convolve_save(Matrix *p, int n, double epsilon) {
 /* take convolution of a set of probability matrices.  If counts is
    NULL, then each distrib is assumed to have multiplicity 1 */
 Matrix *pm_convolve_many(Matrix **p, int *counts, int n, double epsilon) {
-  int i, j, k, l, x, y, max_nrows, max_ncols, count, tot_count = 0,
-    this_max_nrows, this_max_ncols;
+  int i, l, x, y, max_nrows, max_ncols, count, tot_count = 0,
+    this_max_nrows, this_max_ncols, ext_nrows, ext_ncols;
   Matrix *q_i, *q_i_1;
   double max_nsd;
 
@@ -298,6 +340,8 @@ Matrix *pm_convolve_many(Matrix **p, int *counts, int n, double epsilon) {
   for (x = 0; x < this_max_nrows; x++)
     for (y = 0; y < this_max_ncols; y++)
       q_i_1->data[x][y] = p[0]->data[x][y];
+  ext_nrows = this_max_nrows;
+  ext_ncols = this_max_ncols;
  
   this_max_nrows = p[0]->nrows;
   this_max_ncols = p[0]->ncols;
@@ -308,12 +352,10 @@ Matrix *pm_convolve_many(Matrix **p, int *counts, int n, double epsilon) {
     this_max_ncols = min(max_ncols, this_max_ncols + p[i]->ncols);
     for (l = 0; l < count; l++) {
       mat_zero(q_i);
-      for (x = 0; x < this_max_nrows; x++) {
-        for (y = 0; y < this_max_ncols; y++) 
-          for (j = max(0, x - p[i]->nrows + 1); j <= x; j++) 
-            for (k = max(0, y - p[i]->ncols + 1); k <= y; k++) 
-              q_i->data[x][y] += q_i_1->data[j][k] * p[i]->data[x - j][y - k];
-      }
+      pm_convolve_step(q_i_1, ext_nrows, ext_ncols, p[i], q_i,
+                       this_max_nrows, this_max_ncols, epsilon);
+      ext_nrows = this_max_nrows;
+      ext_ncols = this_max_ncols;
       mat_copy(q_i_1, q_i);
     }
   }
@@ -341,9 +383,11 @@ Matrix *pm_convolve_many(Matrix **p, int *counts, int n, double epsilon) {
 /* take convolution of a set of probability matrices, avoiding some
    overhead of function above; does not take counts, does not
    normalize, does not trim dimension, allows max size to be
-   specified */
-Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols) {
-  int i, j, k, x, y, this_max_nrows, this_max_ncols;
+   specified.  Epsilon is the smallest probability of interest; it
+   determines whether FFT convolution is accurate enough */
+Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols,
+                              double epsilon) {
+  int i, x, y, this_max_nrows, this_max_ncols, ext_nrows, ext_ncols;
   Matrix *q_i, *q_i_1;
 
   if (n == 1)
@@ -360,6 +404,8 @@ Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols) {
   for (x = 0; x < this_max_nrows; x++)
     for (y = 0; y < this_max_ncols; y++)
       q_i_1->data[x][y] = p[0]->data[x][y];
+  ext_nrows = this_max_nrows;
+  ext_ncols = this_max_ncols;
  
   this_max_nrows = p[0]->nrows;
   this_max_ncols = p[0]->ncols;
@@ -367,12 +413,10 @@ Matrix *pm_convolve_many_fast(Matrix **p, int n, int max_nrows, int max_ncols) {
     this_max_nrows = min(max_nrows, this_max_nrows + p[i]->nrows);
     this_max_ncols = min(max_ncols, this_max_ncols + p[i]->ncols);
     mat_zero(q_i);
-    for (x = 0; x < this_max_nrows; x++) {
-      for (y = 0; y < this_max_ncols; y++) 
-        for (j = max(0, x - p[i]->nrows + 1); j <= x; j++) 
-          for (k = max(0, y - p[i]->ncols + 1); k <= y; k++) 
-            q_i->data[x][y] += q_i_1->data[j][k] * p[i]->data[x - j][y - k];
-    }
+    pm_convolve_step(q_i_1, ext_nrows, ext_ncols, p[i], q_i,
+                     this_max_nrows, this_max_ncols, epsilon);
+    ext_nrows = this_max_nrows;
+    ext_ncols = this_max_ncols;
     mat_copy(q_i_1, q_i);
   }
 
@@ -429,7 +473,7 @@ Matrix *pm_convolve_fast(Matrix *p, int n, double epsilon) {
   if (n != checksum)
     die("ERROR pm_convolve_fast: n (%i) != checksum (%i)\n", n, checksum);
 
-  retval = pm_convolve_many_fast(pows, j, max_nrows, max_ncols);
+  retval = pm_convolve_many_fast(pows, j, max_nrows, max_ncols, epsilon);
 
   for (i = 1; i <= logn; i++) 
     mat_free(pow_p[i]);
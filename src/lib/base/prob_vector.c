@@ -16,6 +16,7 @@
    epsilon for y >= x_max, where epsilon is an input parameter. */
 
 #include <prob_vector.h>
+#include <fft.h>
 #include <misc.h>
 
 /* compute mean and variance */
@@ -141,9 +142,36 @@ void pv_normalize(Vector *p) {
   vec_scale(p, 1/sum);
 }
 
+/* convolve q (nonzero only in its first nq elements) with p, storing
+   the first nout elements of the result in out.  Uses the FFT when
+   the direct computation would be expensive and tail probabilities
+   down to epsilon are within its precision; otherwise the direct sum
+   is computed exactly as it always has been.  Round-off from the FFT
+   can produce tiny negative values, which are set to zero */
+static void pv_convolve_step(double *q, int nq, Vector *p, double *out, 
+                             int nout, double epsilon) {
+  int j, x;
+  double direct_ops = (double)nout * min(nq, p->size);
+
+  if (fft_preferred(direct_ops, fft_size(min(nq, nout) + 
+                                         min(p->size, nout) - 1),
+                    epsilon)) {
+    fft_convolve(q, nq, p->data, p->size, out, nout);
+    for (x = 0; x < nout; x++)
+      if (out[x] < 0) out[x] = 0;
+    return;
+  }
+
+  for (x = 0; x < nout; x++) {
+    out[x] = 0;
+    for (j = max(0, x - p->size + 1); j <= x && j < nq; j++) 
+      out[x] += q[j] * p->data[x - j];
+  }
+}
+
 /* convolve distribution n times */
 Vector *pv_convolve(Vector *p, int n, double epsilon) {
-  int i, j, x;
+  int i, x, ext;
   Vector *q_i, *q_i_1;
   double mean, var, max_nsd;
   int max_x = p->size * n;
@@ -163,23 +191,36 @@ Vector *pv_convolve(Vector *p, int n, double epsilon) {
   }
 
   q_i = vec_new(max_x);
-  q_i_1 = vec_new(max_x);
 
-  /* compute convolution recursively */
-  vec_zero(q_i_1);
-  for (x = 0; x < p->size; x++)
-    q_i_1->data[x] = p->data[x];
+  if (fft_preferred((double)(n-1) * max_x * p->size, 
+                    fft_size(min(2 * max_x, n * (p->size-1) + 1)),
+                    epsilon)) {
+    /* for large problems, raise the transform of p to the nth power
+       directly; if max_x was bounded above, the omitted mass
+       beyond 2 * max_x is negligible */
+    fft_convolve_power(p->data, p->size, n, q_i->data, max_x);
+    for (x = 0; x < max_x; x++)
+      if (q_i->data[x] < 0) q_i->data[x] = 0;
+  }
+  else {
+    q_i_1 = vec_new(max_x);
+
+    /* compute convolution recursively */
+    vec_zero(q_i_1);
+    for (x = 0; x < p->size; x++)
+      q_i_1->data[x] = p->data[x];
 
-  for (i = 1; i < n; i++) {
-    vec_zero(q_i);
-    for (x = 0; x < q_i->size; x++) {
-      for (j = max(0, x - p->size + 1); j <= x; j++) 
-        q_i->data[x] += q_i_1->data[j] * p->data[x - j];
+    ext = min(p->size, max_x);
+    for (i = 1; i < n; i++) {
+      vec_zero(q_i);
+      pv_convolve_step(q_i_1->data, ext, p, q_i->data, 
+                       min(q_i->size, ext + p->size - 1), epsilon);
+      ext = min(q_i->size, ext + p->size - 1);
+      if (i < n - 1) vec_copy(q_i_1, q_i);
     }
-    if (i < n - 1) vec_copy(q_i_1, q_i);
-  }
 
-  vec_free(q_i_1);
+    vec_free(q_i_1);
+  }
 
   /* trim very small values off tail before returning */
   for (x = q_i->size - 1; x >= 0; x--) {
@@ -197,7 +238,7 @@ Vector *pv_convolve(Vector *p, int n, double epsilon) {
    distributions.  Return value is an array q such that q[i] (1 <= i <=
    n) is the ith convolution of p (q[0] will be NULL) */
 Vector **pv_convolve_save(Vector *p, int n, double epsilon) {
-  int i, j, x;
+  int i, x, ext;
   double mean, var, max_nsd;
   int max_x = p->size * n, newsize;
   Vector **q = smalloc((n+1) * sizeof(void*));
@@ -228,12 +269,13 @@ Vector **pv_convolve_save(Vector *p, int n, double epsilon) {
   for (x = 0; x < p->size; x++)
     q[1]->data[x] = p->data[x];
 
+  ext = min(p->size, max_x);
   for (i = 2; i <= n; i++) {
     q[i] = vec_new(max_x);
     vec_zero(q[i]);
-    for (x = 0; x < q[i]->size; x++) 
-      for (j = max(0, x - p->size + 1); j <= x; j++) 
-        q[i]->data[x] += q[i-1]->data[j] * p->data[x - j];
+    pv_convolve_step(q[i-1]->data, ext, p, q[i]->data, 
+                     min(max_x, ext + p->size - 1), epsilon);
+    ext = min(max_x, ext + p->size - 1);
   }
 
   /* trim very small values off tail before returning */
@@ -252,7 +294,7 @@ Vector **pv_convolve_save(Vector *p, int n, double epsilon) {
 /* take convolution of a set of probability vectors.  If counts is
    NULL, then each distrib is assumed to have multiplicity 1 */
 Vector *pv_convolve_many(Vector **p, int *counts, int n, double epsilon) {
-  int i, j, k, x, max_x = 0, tot_count = 0, count, thismax;
+  int i, k, x, max_x = 0, tot_count = 0, count, thismax, ext;
   Vector *q_i, *q_i_1;
   double mean, var, max_nsd;
 
@@ -292,6 +334,7 @@ Vector *pv_convolve_many(Vector **p, int *counts, int n, double epsilon) {
   thismax = min(p[0]->size, max_x);
   for (x = 0; x < thismax; x++)
     q_i_1->data[x] = p[0]->data[x];
+  ext = thismax;
 
   for (i = 0; i < n; i++) {
     count = (counts == NULL ? 1 : counts[i]);
@@ -299,10 +342,9 @@ Vector *pv_convolve_many(Vector **p, int *counts, int n, double epsilon) {
     thismax = min(max_x, thismax + p[i]->size);
     for (k = 0; k < count; k++) {
       vec_zero(q_i);
-      for (x = 0; x < thismax; x++) {
-        for (j = max(0, x - p[i]->size + 1); j <= x; j++) 
-          q_i->data[x] += q_i_1->data[j] * p[i]->data[x - j];
-      }
+      pv_convolve_step(q_i_1->data, ext, p[i], q_i->data, thismax,
+                       epsilon);
+      ext = thismax;
       vec_copy(q_i_1, q_i);
     }
   }
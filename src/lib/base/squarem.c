@@ -0,0 +1,145 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* SQUAREM acceleration of EM algorithms.  See squarem.h. */
+
+#include <math.h>
+#include <squarem.h>
+#include <misc.h>
+
+static Vector *sqm_copy_bounds(Vector *bounds) {
+  return bounds == NULL ? NULL : vec_create_copy(bounds);
+}
+
+Squarem *sqm_new(int dim, Vector *lower_bounds, Vector *upper_bounds) {
+  Squarem *sq = smalloc(sizeof(Squarem));
+  sq->dim = dim;
+  sq->lower_bounds = sqm_copy_bounds(lower_bounds);
+  sq->upper_bounds = sqm_copy_bounds(upper_bounds);
+  sq->x0 = vec_new(dim);
+  sq->x1 = vec_new(dim);
+  sq->x2 = vec_new(dim);
+  sq->phase = 0;
+  sq->ll1 = NEGINFTY;
+  sq->step = 1;
+  sq->step_max = SQM_STEP_MAX0;
+  sq->nextrap = sq->nreject = 0;
+  sq->nsaved = 0;
+  return sq;
+}
+
+void sqm_free(Squarem *sq) {
+  if (sq->lower_bounds != NULL) vec_free(sq->lower_bounds);
+  if (sq->upper_bounds != NULL) vec_free(sq->upper_bounds);
+  vec_free(sq->x0);
+  vec_free(sq->x1);
+  vec_free(sq->x2);
+  sfree(sq);
+}
+
+void sqm_restart(Squarem *sq, int dim, Vector *lower_bounds,
+                 Vector *upper_bounds) {
+  if (sq->lower_bounds != NULL) vec_free(sq->lower_bounds);
+  if (sq->upper_bounds != NULL) vec_free(sq->upper_bounds);
+  sq->lower_bounds = sqm_copy_bounds(lower_bounds);
+  sq->upper_bounds = sqm_copy_bounds(upper_bounds);
+  if (dim != sq->dim) {
+    sq->dim = dim;
+    vec_realloc(sq->x0, dim);
+    vec_realloc(sq->x1, dim);
+    vec_realloc(sq->x2, dim);
+  }
+  sq->phase = -1;
+}
+
+int sqm_check(Squarem *sq, Vector *params, double logl) {
+  if (params->size != sq->dim)
+    die("ERROR sqm_check: expected %i parameters, got %i\n", sq->dim,
+        params->size);
+
+  if (sq->phase == 2) {         /* at extrapolated point */
+    sq->phase = 0;
+    if (!(logl >= sq->ll1)) {   /* (also rejects NaN) */
+      sq->nreject++;
+      if (sq->step == sq->step_max)
+        sq->step_max = max(SQM_STEP_MAX0, sq->step_max / SQM_MSTEP);
+      vec_copy(params, sq->x2);
+      return TRUE;
+    }
+    /* to first order, the extrapolated point is as far along the
+       path of EM as 2 * step ordinary updates from x0, and it is the
+       third point evaluated in the cycle */
+    sq->nextrap++;
+    sq->nsaved += 2 * (sq->step - 1);
+    if (sq->step == sq->step_max) sq->step_max *= SQM_MSTEP;
+  }
+  else if (sq->phase == -1) sq->phase = 0;
+
+  if (sq->phase == 0)
+    vec_copy(sq->x0, params);
+  else {
+    vec_copy(sq->x1, params);
+    sq->ll1 = logl;
+  }
+  return FALSE;
+}
+
+int sqm_update(Squarem *sq, Vector *params) {
+  int i;
+  double sr2 = 0, sv2 = 0, r, v, val, alpha;
+
+  if (params->size != sq->dim)
+    die("ERROR sqm_update: expected %i parameters, got %i\n", sq->dim,
+        params->size);
+
+  if (sq->phase == -1) return FALSE; /* restarted since last E step */
+
+  if (sq->phase == 0) {
+    vec_copy(sq->x1, params);
+    sq->phase = 1;
+    return FALSE;
+  }
+
+  /* end of cycle; extrapolate */
+  vec_copy(sq->x2, params);
+  sq->phase = 0;
+  for (i = 0; i < sq->dim; i++) {
+    r = vec_get(sq->x1, i) - vec_get(sq->x0, i);
+    v = vec_get(sq->x2, i) - vec_get(sq->x1, i) - r;
+    sr2 += r * r;
+    sv2 += v * v;
+  }
+  if (sr2 == 0 || sv2 == 0 || !isfinite(sr2 / sv2)) return FALSE;
+
+  alpha = sqrt(sr2 / sv2);
+  sq->step = min(sq->step_max, max(1, alpha));
+  if (sq->step == 1) {          /* extrapolated point coincides with x2 */
+    if (alpha > sq->step_max) sq->step_max *= SQM_MSTEP;
+    return FALSE;
+  }
+
+  for (i = 0; i < sq->dim; i++) {
+    r = vec_get(sq->x1, i) - vec_get(sq->x0, i);
+    v = vec_get(sq->x2, i) - vec_get(sq->x1, i) - r;
+    val = vec_get(sq->x0, i) + 2 * sq->step * r + sq->step * sq->step * v;
+    if (sq->lower_bounds != NULL && val < vec_get(sq->lower_bounds, i))
+      val = vec_get(sq->lower_bounds, i);
+    if (sq->upper_bounds != NULL && val > vec_get(sq->upper_bounds, i))
+      val = vec_get(sq->upper_bounds, i);
+    vec_set(params, i, val);
+  }
+  sq->phase = 2;
+  return TRUE;
+}
+
+void sqm_report(FILE *F, Squarem *sq) {
+  fprintf(F, "SQUAREM: %d extrapolation%s accepted, %d rejected; approx. %.0f EM iteration%s saved\n",
+          sq->nextrap, sq->nextrap == 1 ? "" : "s", sq->nreject,
+          sq->nsaved, floor(sq->nsaved + 0.5) == 1 ? "" : "s");
+}
@@ -0,0 +1,153 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Buffered per-base wig output.  See wig_writer.h. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <misc.h>
+#include <wig_writer.h>
+
+/* space reserved for a single formatted number or header */
+#define WW_MAX_ITEM 512
+
+/* largest scaled value formatted directly */
+#define WW_MAX_SCALED 1e15
+
+static const double ww_pow10[WW_MAX_PREC+1] =
+  {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+
+WigWriter *ww_new(FILE *F, const char *chrom) {
+  WigWriter *ww = smalloc(sizeof(WigWriter));
+  ww->F = F;
+  ww->chrom = copy_charstr(chrom == NULL ? "(null)" : chrom); /* as printf */
+  ww->buf = smalloc(WW_BUFSIZE * sizeof(char));
+  ww->len = 0;
+  ww->next = -1;
+  return ww;
+}
+
+void ww_flush(WigWriter *ww) {
+  if (ww->len > 0 && fwrite(ww->buf, 1, ww->len, ww->F) != (size_t)ww->len)
+    die("ERROR ww_flush: cannot write output\n");
+  ww->len = 0;
+}
+
+void ww_free(WigWriter *ww) {
+  ww_flush(ww);
+  sfree(ww->chrom);
+  sfree(ww->buf);
+  sfree(ww);
+}
+
+/* make sure there is room for n more bytes */
+static PHAST_INLINE void ww_reserve(WigWriter *ww, int n) {
+  if (ww->len + n > WW_BUFSIZE) ww_flush(ww);
+}
+
+void ww_put_str(WigWriter *ww, const char *s) {
+  int n = (int)strlen(s);
+  if (n > WW_BUFSIZE - ww->len) {
+    ww_flush(ww);
+    if (n > WW_BUFSIZE) {
+      fwrite(s, 1, n, ww->F);
+      return;
+    }
+  }
+  memcpy(&ww->buf[ww->len], s, n);
+  ww->len += n;
+}
+
+void ww_start_line(WigWriter *ww, long long coord) {
+  if (coord != ww->next) {
+    ww_put_str(ww, "fixedStep chrom=");
+    ww_put_str(ww, ww->chrom);
+    ww_reserve(ww, WW_MAX_ITEM);
+    ww->len += sprintf(&ww->buf[ww->len], " start=%lld step=1\n", coord);
+  }
+  ww->next = coord + 1;
+}
+
+/* append an unsigned integer */
+static void ww_put_uint(WigWriter *ww, unsigned long long u) {
+  char digits[24];
+  int n = 0;
+  do {
+    digits[n++] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  while (n > 0) ww->buf[ww->len++] = digits[--n];
+}
+
+void ww_put_int(WigWriter *ww, long long i) {
+  ww_reserve(ww, WW_MAX_ITEM);
+  if (i < 0) {
+    ww->buf[ww->len++] = '-';
+    ww_put_uint(ww, -(unsigned long long)i);
+  }
+  else ww_put_uint(ww, (unsigned long long)i);
+}
+
+void ww_put_fixed(WigWriter *ww, double val, int prec) {
+  double s, ip, frac;
+  unsigned long long u, scale, f;
+  int i;
+
+  ww_reserve(ww, WW_MAX_ITEM);
+  if (prec < 0 || prec > WW_MAX_PREC || !isfinite(val) ||
+      (s = fabs(val) * ww_pow10[prec]) >= WW_MAX_SCALED)
+    goto slow;
+
+  /* round to nearest; s carries a relative error of at most one
+     rounding, so values that close to a tie are left to printf, which
+     rounds the exact binary value */
+  ip = floor(s);
+  frac = s - ip;
+  if (fabs(frac - 0.5) <= s * 1e-15) goto slow;
+  u = (unsigned long long)ip + (frac > 0.5 ? 1 : 0);
+
+  if (signbit(val)) ww->buf[ww->len++] = '-'; /* as printf, incl. -0.000 */
+  scale = (unsigned long long)ww_pow10[prec];
+  ww_put_uint(ww, u / scale);
+  if (prec > 0) {
+    ww->buf[ww->len++] = '.';
+    f = u % scale;
+    for (i = prec - 1; i >= 0; i--) {
+      ww->buf[ww->len + i] = (char)('0' + f % 10);
+      f /= 10;
+    }
+    ww->len += prec;
+  }
+  return;
+
+ slow:
+  ww->len += snprintf(&ww->buf[ww->len], WW_MAX_ITEM, "%.*f", prec, val);
+}
+
+void ww_put_dbl(WigWriter *ww, const char *fmt, double val) {
+  int n;
+  /* recognize "%.Nf" */
+  if (fmt[0] == '%' && fmt[1] == '.' && fmt[2] >= '0' && fmt[2] <= '9' &&
+      fmt[3] == 'f' && fmt[4] == '\0') {
+    ww_put_fixed(ww, val, fmt[2] - '0');
+    return;
+  }
+  ww_reserve(ww, WW_MAX_ITEM);
+  n = snprintf(&ww->buf[ww->len], WW_MAX_ITEM, fmt, val);
+  if (n >= WW_MAX_ITEM)
+    die("ERROR ww_put_dbl: formatted value too long\n");
+  ww->len += n;
+}
+
+void ww_value(WigWriter *ww, long long coord, double val, int prec) {
+  ww_start_line(ww, coord);
+  ww_put_fixed(ww, val, prec);
+  ww_put_char(ww, '\n');
+}
@@ -58,6 +58,10 @@ void default_log_function(FILE *logf, double total_logl, HMM *hmm,
 /* compute_emissions simply won't be called if NULL; this may make
    sense if estimate_state_models == NULL, nsamples == 1, and
    emissions are precomputed & passed in as emissions_alloc */
+/* if squarem is non-NULL, parameters obtained by get_params are
+   extrapolated after every two M steps; extrapolated values (or
+   values that replace them, if they are rejected) are put into effect
+   by set_params */
 double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples, 
                        int *sample_lens, Matrix *pseudocounts, 
                        void (*compute_emissions)(double**, void**, int, void*, 
@@ -67,13 +71,17 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
                        void (*estimate_transitions)(HMM*, void*, double**),
                        int (*get_observation_index)(void*, int, int),
                        void (*log_function)(FILE*, double, HMM*, void*, int),
-		       double **emissions_alloc, FILE *logf) { 
+		       double **emissions_alloc, FILE *logf,
+                       Squarem *squarem,
+                       void (*get_params)(Vector*, HMM*, void*),
+                       void (*set_params)(Vector*, HMM*, void*)) { 
 
   int i, k, l, s, obsidx, nobs=0, maxlen = 0, done, it;
   double **emissions, **forward_scores, **backward_scores, **E = NULL, **A;
   double *totalA, **tempA, sum;
   double total_logl, prev_total_logl, val;
   List *val_list;
+  Vector *sqm_params = NULL;
 
   struct timeval start_time, end_time;
 
@@ -84,6 +92,12 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
   if (compute_emissions == NULL &&
       (estimate_state_models != NULL || nsamples > 1 || emissions_alloc == NULL))
     die("ERROR: (hmm_train_by_em) compute_emissions function required.\n");
+
+  if (squarem != NULL) {
+    if (get_params == NULL || set_params == NULL)
+      die("ERROR: (hmm_train_by_em) get_params and set_params required with squarem.\n");
+    sqm_params = vec_new(squarem->dim);
+  }
       
   if (logf != NULL)
     gettimeofday(&start_time, NULL);
@@ -225,6 +239,18 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
     }
     //    fprintf(stderr, "ll=%f\n", total_logl);
 
+    /* an extrapolated point that does not improve the likelihood is
+       replaced by the last ordinary EM update, which must be
+       evaluated instead */
+    if (squarem != NULL) {
+      get_params(sqm_params, hmm, data);
+      if (sqm_check(squarem, sqm_params, total_logl)) {
+        if (logf != NULL) fprintf(logf, "Rejecting SQUAREM extrapolation.\n");
+        set_params(sqm_params, hmm, data);
+        continue;
+      }
+    }
+
     if (total_logl < prev_total_logl) 
       phast_warning("WARNING: likelihood decreased during EM: it %i total_logl=%.10g, prev_total_logl=%.10g\n", it, total_logl, prev_total_logl);
 
@@ -253,6 +279,17 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
       /* re-estimate state models */
       if (estimate_state_models  != NULL)
         estimate_state_models(models, hmm->nstates, data, E, nobs, logf);
+
+      /* extrapolate, if accelerating by SQUAREM */
+      if (squarem != NULL) {
+        get_params(sqm_params, hmm, data);
+        if (sqm_update(squarem, sqm_params)) {
+          if (logf != NULL)
+            fprintf(logf, "SQUAREM extrapolation (step length %f).\n",
+                    squarem->step);
+          set_params(sqm_params, hmm, data);
+        }
+      }
     }
   }
   //  fprintf(stderr, "done it=%i ll=%f\n", it, total_logl);
@@ -261,6 +298,7 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
     fprintf(logf, "\nNumber of iterations: %d\nTotal time: %.4f sec.\n", it, 
             end_time.tv_sec - start_time.tv_sec + 
             (end_time.tv_usec - start_time.tv_usec)/1.0e6);
+    if (squarem != NULL) sqm_report(logf, squarem);
   }
 
   for (i = 0; i < hmm->nstates; i++) {
@@ -280,6 +318,7 @@ double hmm_train_by_em(HMM *hmm, void *models, void *data, int nsamples,
   if (estimate_state_models != NULL)
     sfree(E);
   lst_free(val_list);
+  if (sqm_params != NULL) vec_free(sqm_params);
 
   return total_logl;
 }
@@ -37,6 +37,8 @@ void mn_compute_emissions(double **emissions, void **models, int nmodels,
 void mn_estim_mods(void **models, int nmodels, void *data, double **E, 
                    int nobs);
 int mn_get_obs_idx(void *data, int sample, int position);
+void mn_get_params(Vector *params, void **models, int nmodels, void *data);
+void mn_set_params(Vector *params, void **models, int nmodels, void *data);
 
 /* (multi-sequences) */
 void phy_compute_emissions(double **emissions, void **models, int nmodels,
@@ -44,6 +46,11 @@ void phy_compute_emissions(double **emissions, void **models, int nmodels,
 void phy_estim_mods(void **models, int nmodels, void *data, double **E, 
                     int nobs);
 int phy_get_obs_idx(void *data, int sample, int position);
+void phy_get_params(Vector *params, void **models, int nmodels, void *data);
+void phy_set_params(Vector *params, void **models, int nmodels, void *data);
+
+/* SQUAREM acceleration of mtf_em (see below) */
+Squarem *mtf_new_squarem(Motif *m);
 
 /* function passed to opt_bfgs in discriminative training (see below) */
 double mtf_compute_conditional(Vector *params, void *data);
@@ -79,7 +86,7 @@ int score_compare(const void* ptr1, const void* ptr2) {
 List* mtf_find(void *data, int multiseq, int motif_size, int nmotifs, 
                TreeNode *tree, void *backgd, double *has_motif, double prior, 
                int nrestarts, List *init_list, int sample_parms, 
-               int npseudocounts) {
+               int npseudocounts, int squarem) {
 
   int i, j, k, cons, trial, alph_size, nparams = -1;
   double *alpha;
@@ -91,6 +98,7 @@ List* mtf_find(void *data, int multiseq, int motif_size, int nmotifs,
   PooledMSA *pmsa = multiseq ? data : NULL;
   Vector **freqs = smalloc((motif_size + 1) * sizeof(void*));
   Vector *params = NULL, *lower_bounds = NULL, *upper_bounds = NULL;
+  Squarem *sq = NULL;
   int *inv_alphabet = multiseq ? pmsa->pooled_msa->inv_alphabet :
     seqset->set->inv_alphabet;
   Hashtable *hash;
@@ -140,16 +148,19 @@ List* mtf_find(void *data, int multiseq, int motif_size, int nmotifs,
 
       /* now train */
       if (has_motif == NULL) {  /* EM training */
+        sq = squarem ? mtf_new_squarem(m) : NULL;
         if (multiseq)           
           m->score = mtf_em(m->ph_mods, pmsa, lst_size(pmsa->source_msas), 
                            pmsa->lens, m->motif_size, prior, 
                            phy_compute_emissions, phy_estim_mods, 
-                           phy_get_obs_idx, m->postprob, m->bestposition);
+                           phy_get_obs_idx, m->postprob, m->bestposition,
+                           sq, phy_get_params, phy_set_params);
         else 
           m->score = mtf_em(m->freqs, seqset, seqset->set->nseqs, seqset->lens, 
                            m->motif_size, prior, mn_compute_emissions, 
                            mn_estim_mods, mn_get_obs_idx, m->postprob,
-                           m->bestposition);
+                           m->bestposition, sq, mn_get_params, 
+                           mn_set_params);
       }
       else {                    /* discriminative training */
         double retval;
@@ -209,6 +220,11 @@ List* mtf_find(void *data, int multiseq, int motif_size, int nmotifs,
 
       mtf_get_consensus(m, cons_str);
       fprintf(stderr, "(consensus = '%s', score = %.3f)\n", cons_str, m->score);
+      if (sq != NULL) {
+        sqm_report(stderr, sq);
+        sqm_free(sq);
+        sq = NULL;
+      }
 
       mtf_predict(m, m->training_data, m->bestposition, m->samplescore, 
                   has_motif);   /* predict and score best motif */
@@ -303,6 +319,30 @@ int mn_get_obs_idx(void *data, int sample, int position) {
   return set->inv_alphabet[(int)set->seqs[sample][position]];
 }
 
+/* multinomial: SQUAREM parameters are the frequencies of the motif
+   positions, concatenated */
+void mn_get_params(Vector *params, void **models, int nmodels, 
+                   void *data) {
+  int i, k, j = 0;
+  for (k = 1; k < nmodels; k++)
+    for (i = 0; i < ((Vector*)models[k])->size; i++)
+      vec_set(params, j++, vec_get(models[k], i));
+}
+
+/* extrapolated frequencies are renormalized */
+void mn_set_params(Vector *params, void **models, int nmodels, 
+                   void *data) {
+  int i, k, j = 0;
+  for (k = 1; k < nmodels; k++) {
+    double sum = 0;
+    for (i = 0; i < ((Vector*)models[k])->size; i++) {
+      vec_set(models[k], i, vec_get(params, j++));
+      sum += vec_get(models[k], i);
+    }
+    vec_scale(models[k], 1/sum);
+  }
+}
+
 /* phylogenetic: compute emissions for all models for the given sample */
 void phy_compute_emissions(double **emissions, void **models, int nmodels,
                            void *data, int sample, int length) {
@@ -350,6 +390,41 @@ int phy_get_obs_idx(void *data, int sample, int position) {
   return pmsa->tuple_idx_map[sample][msa->ss->tuple_idx[position]];
 }
 
+/* SQUAREM: parameters are the free parameters of the tree models
+   for the motif positions, concatenated (the parameterization is the
+   same for all positions).  The parameter mappings are set up by
+   tm_fit or by tm_params_new_init_from_model */
+static int phy_nparams(TreeModel *mod) {
+  int i, npar = 0;
+  for (i = 0; i < mod->all_params->size; i++)
+    if (mod->param_map[i] >= npar) npar = mod->param_map[i] + 1;
+  return npar;
+}
+
+void phy_get_params(Vector *params, void **models, int nmodels, 
+                    void *data) {
+  int i, k, j = 0;
+  for (k = 1; k < nmodels; k++) {
+    TreeModel *tm = (TreeModel*)models[k];
+    Vector *tm_params = tm_params_new_init_from_model(tm);
+    for (i = 0; i < tm_params->size; i++)
+      if (tm->param_map[i] >= 0)
+        vec_set(params, j + tm->param_map[i], vec_get(tm_params, i));
+    j += phy_nparams(tm);
+    vec_free(tm_params);
+  }
+}
+
+void phy_set_params(Vector *params, void **models, int nmodels, 
+                    void *data) {
+  int k, j = 0;
+  for (k = 1; k < nmodels; k++) {
+    TreeModel *tm = (TreeModel*)models[k];
+    tm_unpack_params(tm, params, j);
+    j += phy_nparams(tm);
+  }
+}
+
 /* A little package of intermediate computations from
    mtf_compute_conditional that can be reused in
    mtf_compute_conditional_grad */
@@ -697,6 +772,50 @@ void mtf_estim_backgd_mn(SeqSet *s, Vector *model) {
   vec_scale(model, 1.0/count);
 }
 
+/* create a SQUAREM object for use with mtf_em and the specified
+   motif (see mn_get_params and phy_get_params); the last parameter
+   is the motif prior */
+Squarem *mtf_new_squarem(Motif *m) {
+  int i, k, npar, j = 0;
+  Vector *lower_bounds, *upper_bounds, *tm_lb, *tm_ub;
+  Squarem *sq;
+
+  if (m->multiseq) {
+    Vector *tm_params = tm_params_new_init_from_model(m->ph_mods[1]);
+                                /* (sets up parameter mapping) */
+    npar = phy_nparams(m->ph_mods[1]) * m->motif_size + 1;
+    vec_free(tm_params);
+  }
+  else npar = m->alph_size * m->motif_size + 1;
+
+  lower_bounds = vec_new(npar);
+  upper_bounds = vec_new(npar);
+  for (k = 1; k <= m->motif_size; k++) {
+    if (m->multiseq) {
+      int tm_npar = phy_nparams(m->ph_mods[1]);
+      tm_new_boundaries(&tm_lb, &tm_ub, tm_npar, m->ph_mods[k], TRUE);
+      for (i = 0; i < tm_npar; i++, j++) {
+        vec_set(lower_bounds, j, vec_get(tm_lb, i));
+        vec_set(upper_bounds, j, vec_get(tm_ub, i));
+      }
+      vec_free(tm_lb);
+      vec_free(tm_ub);
+    }
+    else 
+      for (i = 0; i < m->alph_size; i++, j++) {
+        vec_set(lower_bounds, j, MTF_EPSILON * MTF_EPSILON);
+        vec_set(upper_bounds, j, 1);
+      }
+  }
+  vec_set(lower_bounds, j, MTF_EPSILON); /* motif prior */
+  vec_set(upper_bounds, j, 1-MTF_EPSILON);
+
+  sq = sqm_new(npar, lower_bounds, upper_bounds);
+  vec_free(lower_bounds);
+  vec_free(upper_bounds);
+  return sq;
+}
+
 /* find a single motif by EM, given a pre-initialized set of models.
    Functions must be provided for computing "emission" probabilities
    under all models, for updating model parameters given posterior
@@ -721,9 +840,12 @@ double mtf_em(void *models, void *data, int nsamples,
               void (*estimate_state_models)(void**, int, void*, 
                                             double**, int),
               int (*get_observation_index)(void*, int, int),
-              double *postprob, int *bestposition) {
+              double *postprob, int *bestposition, Squarem *squarem,
+              void (*get_params)(Vector*, void**, int, void*),
+              void (*set_params)(Vector*, void**, int, void*)) {
   
   int i, j, k, s, obsidx, nobs, maxlen = 0;
+  Vector *sqm_params = NULL;
   double **emissions, **E;
   double *logpY, *postpY;
   double total_logl, prev_total_logl, expected_nmotifs, max=0, window_sum;
@@ -745,6 +867,7 @@ double mtf_em(void *models, void *data, int nsamples,
   tmplst = lst_new_dbl(maxlen);
   logpY = smalloc(maxlen * sizeof(double));
   postpY = smalloc(maxlen * sizeof(double));
+  if (squarem != NULL) sqm_params = vec_new(squarem->dim);
 
   prev_total_logl = NEGINFTY;
   while (1) {
@@ -839,6 +962,18 @@ double mtf_em(void *models, void *data, int nsamples,
       }
     }
 
+    /* a rejected SQUAREM extrapolation is replaced by the last
+       ordinary EM update, which is evaluated instead */
+    if (squarem != NULL) {
+      get_params(sqm_params, models, width+1, data);
+      vec_set(sqm_params, squarem->dim - 1, motif_prior);
+      if (sqm_check(squarem, sqm_params, total_logl)) {
+        set_params(sqm_params, models, width+1, data);
+        motif_prior = vec_get(sqm_params, squarem->dim - 1);
+        continue;
+      }
+    }
+
     /* check convergence */
 /*     fprintf(stderr, "Training likelihood: %f\n", total_logl); */
 
@@ -853,6 +988,16 @@ double mtf_em(void *models, void *data, int nsamples,
     /* update motif prior */
     motif_prior = min(1-MTF_EPSILON, expected_nmotifs/nsamples);
                                 /* don't let it go quite to 1 */
+
+    /* extrapolate, if accelerating by SQUAREM */
+    if (squarem != NULL) {
+      get_params(sqm_params, models, width+1, data);
+      vec_set(sqm_params, squarem->dim - 1, motif_prior);
+      if (sqm_update(squarem, sqm_params)) {
+        set_params(sqm_params, models, width+1, data);
+        motif_prior = vec_get(sqm_params, squarem->dim - 1);
+      }
+    }
   }
 
   for (i = 0; i <= width; i++) {
@@ -864,6 +1009,7 @@ double mtf_em(void *models, void *data, int nsamples,
   sfree(postpY);
   sfree(logpY);
   lst_free(tmplst);
+  if (sqm_params != NULL) vec_free(sqm_params);
 
   return total_logl;
 }
@@ -13,6 +13,370 @@
 #include <ctype.h>
 #include <maf_block.h>
 #include <misc.h>
+#include <parallel.h>
+
+static int maf_scan_block_names(MafScanner *scan, MSA *mini_msa, 
+                                Hashtable *name_hash, int *start_idx, 
+                                int *length, int skip_new_species);
+
+/* (used by maf_read_cats_subset) decide whether a block beginning at
+   start_idx and of the given length in the reference sequence is to
+   be used.  Blocks that are redundant with blocks already accepted
+   (unless keep_overlapping) or that are shorter than tuple_size are
+   rejected.  Accepted blocks are recorded in block_starts and
+   block_ends and *last_refseqpos is updated */
+static int maf_accept_block(int start_idx, int length, int tuple_size,
+                            int keep_overlapping, List *block_starts,
+                            List *block_ends, int *last_refseqpos) {
+  int block_list_idx, prev_end, next_start, end_idx = start_idx + length - 1;
+
+  /* ignore if redundant block: if start_idx < last_refseqpos, need to check list to
+     see if region is redundant */
+  if (!keep_overlapping && start_idx <= *last_refseqpos) {
+    block_list_idx = lst_bsearch_int(block_starts, start_idx);
+    prev_end = block_list_idx >=0 ? lst_get_int(block_ends, block_list_idx) : -1;
+    next_start = block_list_idx + 1 < lst_size(block_starts) ?
+      lst_get_int(block_starts, block_list_idx+1) : end_idx + 1;
+    if (prev_end >= start_idx || next_start <= end_idx) //redundant
+      return FALSE;
+  }
+  /* also ignore if block size is less than tuple size */
+  if (length < tuple_size) 
+    return FALSE;
+
+  /* add block to list to check for redundant blocks later */
+  lst_push_int(block_starts, start_idx);
+  lst_push_int(block_ends, end_idx);
+
+  *last_refseqpos = end_idx;
+  return TRUE;
+}
+
+/* (used by maf_read_cats_subset) strip gaps from a block and label
+   its columns by category, either using the features of gff that
+   overlap it or cyclically.  Features are extracted into mini_gff,
+   which is left empty */
+static void maf_label_block(MSA *mini_msa, int start_idx, int length,
+                            int gap_strip_mode, GFF_Set *gff, 
+                            GFF_Set *mini_gff, int *gff_idx, 
+                            CategoryMap *cm, char *reverse_groups, 
+                            int cycle_size, int tuple_size) {
+  int i;
+
+  if (gap_strip_mode != NO_STRIP) 
+    msa_strip_gaps(mini_msa, gap_strip_mode);
+
+  if (gff != NULL) {
+    /* extract subset of features in GFF corresponding to block */
+    lst_clear(mini_gff->features);
+    maf_block_sub_gff(mini_gff, gff, start_idx + 1, start_idx + length, 
+                      gff_idx, cm, reverse_groups != NULL, tuple_size); 
+                                /* coords in GFF are 1-based */
+
+    /* if we're not using a global coordinate map, we need to map the
+       mini_gff to the coords of the mini_msa */
+    /* NOTE: not necessary because automatically projecting */
+/*     if (map == NULL && lst_size(mini_gff->features) > 0)  */
+/*       msa_map_gff_coords(mini_msa, mini_gff, 1, 0, 0); */
+
+    if (reverse_groups != NULL && lst_size(mini_gff->features) > 0) {
+      gff_group(mini_gff, reverse_groups);
+      msa_reverse_compl_feats(mini_msa, mini_gff, NULL);
+    }
+
+    /* now label categories of mini_msa accordingly */
+    msa_label_categories(mini_msa, mini_gff, cm);   
+
+    /* free features and clear list */
+    for (i = 0; i < lst_size(mini_gff->features); i++)
+      gff_free_feature(lst_get_ptr(mini_gff->features, i));
+    lst_clear(mini_gff->features);
+  }
+  else if (cycle_size > 0)
+    for (i = 0; i < mini_msa->length; i++)
+      mini_msa->categories[i] = (i % cycle_size) + 1;
+}
+
+/* Parallel ingestion of a memory-mapped MAF file, used by
+   maf_read_cats_subset when more than one thread is available and no
+   coordinate map is required.  A quick sequential pass reads only
+   the header line and sequence names of each block, deciding which
+   blocks to keep exactly as in the sequential case and recording
+   where each one starts.  The kept blocks are then divided into
+   contiguous ranges of roughly equal size in bytes, and each thread
+   builds sufficient statistics for one range using its own tuple
+   table.  Finally the tables are merged in range order, so that
+   tuples are numbered by order of first appearance, as in the
+   sequential case; ordered tuple indices are remapped accordingly.
+   Species that first appear partway through the file are padded as
+   msa_add_seq_ss would pad them. */
+
+/* information about a kept block */
+typedef struct {
+  size_t offset;                /* offset of block in file */
+  int start_idx;                /* start in reference sequence */
+  int length;                   /* length in reference sequence */
+  int nseqs;                    /* number of sequences known after
+                                   reading block */
+  int gff_idx;                  /* index of first feature to consider */
+  int idx_offset;               /* offset in ordered representation,
+                                   or -1 */
+  int ncols;                    /* number of columns after gap
+                                   stripping (set by thread) */
+} MafBlockInfo;
+
+/* data shared by threads */
+typedef struct {
+  MafScanner *scan;
+  MSA *msa;                     /* global alignment */
+  char **names;                 /* all sequence names */
+  Hashtable *name_hash;
+  MafBlockInfo *blocks;
+  int *range_start;             /* ranges of blocks; range r is
+                                   blocks range_start[r] to
+                                   range_start[r+1]-1 */
+  MSA **range_msa;              /* suff stats for each range */
+  int tuple_size, store_order, gap_strip_mode, cycle_size, do_toupper,
+    skip_new_species;
+  GFF_Set *gff;
+  CategoryMap *cm;
+  List *cats_to_do;
+} MafParallelData;
+
+/* pad sequences not yet known when a block was read in sequential
+   order (indices >= nseqs_known), using a gap in columns where all
+   known sequences have gaps and missing data otherwise */
+static void maf_pad_unknown_seqs(MSA *mini_msa, int nseqs_known) {
+  int i, j;
+  char c;
+  if (nseqs_known >= mini_msa->nseqs) return;
+  for (i = 0; i < mini_msa->length; i++) {
+    for (j = 0; j < nseqs_known; j++)
+      if (mini_msa->seqs[j][i] != GAP_CHAR) break;
+    c = (j == nseqs_known ? GAP_CHAR : mini_msa->missing[0]);
+    for (j = nseqs_known; j < mini_msa->nseqs; j++)
+      mini_msa->seqs[j][i] = c;
+  }
+}
+
+/* thread function: build sufficient statistics for range r */
+static void maf_read_range(int r, int thread, void *data) {
+  MafParallelData *d = data;
+  MSA *msa = d->msa, *mini_msa, *range_msa;
+  MafScanner *scan = mafScanner_copy(d->scan);
+  TupleHash *tuple_hash = tuple_hash_new(msa, msa->nseqs * d->tuple_size,
+                                         100000);
+  GFF_Set *mini_gff = d->gff != NULL ? gff_new_set() : NULL;
+  MafBlockInfo *block;
+  int i, b, gff_idx;
+
+  mini_msa = msa_new(NULL, d->names, msa->nseqs, -1, msa->alphabet);
+  mini_msa->ncats = msa->ncats;
+  mini_msa->seqs = smalloc(mini_msa->nseqs * sizeof(char*));
+  for (i = 0; i < mini_msa->nseqs; i++) mini_msa->seqs[i] = NULL;
+
+  range_msa = msa_new(NULL, d->names, msa->nseqs, 0, msa->alphabet);
+  range_msa->ncats = msa->ncats;
+  ss_new(range_msa, d->tuple_size, 100000, msa->ncats >= 0, d->store_order);
+
+  for (b = d->range_start[r]; b < d->range_start[r+1]; b++) {
+    checkInterruptN(b, 1000);
+    block = &d->blocks[b];
+    mafScanner_seek(scan, block->offset);
+    maf_scan_block_addseq(scan, mini_msa, d->name_hash, NULL, NULL, 
+                          d->do_toupper, d->skip_new_species);
+    maf_pad_unknown_seqs(mini_msa, block->nseqs);
+    gff_idx = block->gff_idx;
+    maf_label_block(mini_msa, block->start_idx, block->length, 
+                    d->gap_strip_mode, d->gff, mini_gff, &gff_idx, d->cm, 
+                    NULL, d->cycle_size, d->tuple_size);
+    block->ncols = mini_msa->length;
+
+    ss_from_msas(range_msa, d->tuple_size, d->store_order, d->cats_to_do, 
+                 mini_msa, tuple_hash, d->store_order ? 0 : -1, 0);
+
+    /* tuple indices are relative to this range until merged */
+    if (d->store_order) {
+      if (block->idx_offset + mini_msa->length > msa->ss->alloc_len)
+        die("ERROR maf_read_range: block at %i extends beyond alignment\n",
+            block->start_idx);
+      memcpy(&msa->ss->tuple_idx[block->idx_offset], 
+             range_msa->ss->tuple_idx, mini_msa->length * sizeof(int));
+    }
+  }
+
+  d->range_msa[r] = range_msa;
+  tuple_hash_free(tuple_hash);
+  if (mini_gff != NULL) gff_free_set(mini_gff);
+  mini_msa->names = NULL;       /* shared */
+  msa_free(mini_msa);
+  mafScanner_free(scan);
+}
+
+/* read all blocks of a memory-mapped MAF file in parallel; see
+   above.  On return msa->ss and msa->length are as they would be
+   after the sequential loop in maf_read_cats_subset, and first_idx
+   and last_idx are set */
+static void maf_read_parallel(MafScanner *scan, MSA *msa, MSA *mini_msa,
+                              Hashtable *name_hash, TupleHash *tuple_hash,
+                              FILE *REFSEQF, int tuple_size, 
+                              int store_order, int gap_strip_mode, 
+                              int keep_overlapping, GFF_Set *gff, 
+                              CategoryMap *cm, int cycle_size, 
+                              List *cats_to_do, int do_toupper, 
+                              int skip_new_species, int *first_idx, 
+                              int *last_idx) {
+  MafParallelData d;
+  MafBlockInfo *block;
+  List *block_starts = lst_new_int(1000), *block_ends = lst_new_int(1000);
+  GFF_Set *scratch_gff = gff != NULL ? gff_new_set() : NULL;
+  int nblocks = 0, alloc_blocks = 1000, nranges, r, b, i, j, t, idx, 
+    start_idx = -1, length = 0, gff_idx = 0, last_refseqpos = -1, 
+    max_end = 0, do_cats = msa->ncats >= 0, *remap;
+  size_t offset, total;
+  MSA *range_msa;
+  MSA_SS *ss = msa->ss, *rss;
+
+  /* sequential pass: select blocks and find sequence names */
+  d.blocks = smalloc(alloc_blocks * sizeof(MafBlockInfo));
+  while (1) {
+    offset = mafScanner_tell(scan);
+    if (maf_scan_block_names(scan, mini_msa, name_hash, &start_idx, 
+                             &length, skip_new_species) == EOF)
+      break;
+    checkInterruptN(nblocks, 1000);
+
+    if (!maf_accept_block(start_idx, length, tuple_size, keep_overlapping,
+                          block_starts, block_ends, &last_refseqpos))
+      continue;
+
+    if (nblocks == alloc_blocks) {
+      alloc_blocks *= 2;
+      d.blocks = srealloc(d.blocks, alloc_blocks * sizeof(MafBlockInfo));
+    }
+    block = &d.blocks[nblocks++];
+    block->offset = offset;
+    block->start_idx = start_idx;
+    block->length = length;
+    block->nseqs = mini_msa->nseqs;
+    block->gff_idx = gff_idx;
+
+    if (*first_idx == -1) {
+      *first_idx = start_idx;
+      if (store_order && REFSEQF == NULL) 
+        msa->idx_offset = *first_idx < 0 ? 0 : *first_idx;
+    }
+    if (start_idx + length > *last_idx)
+      *last_idx = start_idx + length;
+
+    /* advance gff_idx as the sequential loop would */
+    if (gff != NULL) {
+      maf_block_sub_gff(scratch_gff, gff, start_idx + 1, start_idx + length,
+                        &gff_idx, cm, 0, tuple_size);
+      for (i = 0; i < lst_size(scratch_gff->features); i++)
+        gff_free_feature(lst_get_ptr(scratch_gff->features, i));
+      lst_clear(scratch_gff->features);
+    }
+  }
+  lst_free(block_starts);
+  lst_free(block_ends);
+  if (scratch_gff != NULL) gff_free_set(scratch_gff);
+
+  msa->nseqs = mini_msa->nseqs;
+  msa->names = mini_msa->names;
+  if (nblocks == 0) {
+    sfree(d.blocks);
+    return;
+  }
+
+  for (b = 0; b < nblocks; b++) {
+    block = &d.blocks[b];
+    block->idx_offset = store_order ? block->start_idx - msa->idx_offset : -1;
+    if (block->idx_offset + block->length > max_end)
+      max_end = block->idx_offset + block->length;
+  }
+  if (store_order && max_end > msa->length) {
+    msa->length = max_end;      /* allocate tuple_idx in advance */
+    ss_realloc(msa, tuple_size, ss->alloc_ntuples, do_cats, store_order);
+  }
+
+  /* divide into ranges of about equal size */
+  nranges = min(thr_get_nthreads(), nblocks);
+  d.range_start = smalloc((nranges + 1) * sizeof(int));
+  total = mafScanner_tell(scan) - d.blocks[0].offset;
+  d.range_start[0] = 0;
+  for (r = 1, b = 0; r < nranges; r++) {
+    offset = d.blocks[0].offset + (size_t)((double)total * r / nranges);
+    while (b < nblocks && d.blocks[b].offset < offset) b++;
+    if (b <= d.range_start[r-1]) b = d.range_start[r-1] + 1;
+    if (b > nblocks - (nranges - r)) b = nblocks - (nranges - r);
+    d.range_start[r] = b;
+  }
+  d.range_start[nranges] = nblocks;
+
+  get_iupac_map();              /* make sure initialized before
+                                   threads start */
+  d.scan = scan;
+  d.msa = msa;
+  d.names = mini_msa->names;
+  d.name_hash = name_hash;
+  d.range_msa = smalloc(nranges * sizeof(MSA*));
+  d.tuple_size = tuple_size;
+  d.store_order = store_order;
+  d.gap_strip_mode = gap_strip_mode;
+  d.cycle_size = cycle_size;
+  d.do_toupper = do_toupper;
+  d.skip_new_species = skip_new_species;
+  d.gff = gff;
+  d.cm = cm;
+  d.cats_to_do = cats_to_do;
+
+  thr_foreach(nranges, maf_read_range, &d);
+
+  /* merge tuple tables in order */
+  for (r = 0; r < nranges; r++) {
+    range_msa = d.range_msa[r];
+    rss = range_msa->ss;
+    remap = smalloc(max(rss->ntuples, 1) * sizeof(int));
+    for (t = 0; t < rss->ntuples; t++) {
+      if ((idx = ss_lookup_coltuple(rss->col_tuples[t], tuple_hash, msa)) == -1) {
+        idx = ss->ntuples++;
+        ss_add_coltuple(rss->col_tuples[t], int_to_ptr(idx), tuple_hash, msa);
+        if (ss->ntuples > ss->alloc_ntuples) {
+          ss_realloc(msa, tuple_size, ss->ntuples, do_cats, store_order);
+          ss = msa->ss;
+        }
+        ss->col_tuples[idx] = rss->col_tuples[t];
+        rss->col_tuples[t] = NULL;
+      }
+      remap[t] = idx;
+      ss->counts[idx] += rss->counts[t];
+      if (do_cats)
+        for (j = 0; j <= msa->ncats; j++)
+          ss->cat_counts[j][idx] += rss->cat_counts[j][t];
+    }
+    if (store_order) {
+      for (b = d.range_start[r]; b < d.range_start[r+1]; b++) {
+        block = &d.blocks[b];
+        for (i = block->idx_offset; i < block->idx_offset + block->ncols; i++)
+          if (ss->tuple_idx[i] >= 0)
+            ss->tuple_idx[i] = remap[ss->tuple_idx[i]];
+      }
+    }
+    sfree(remap);
+    range_msa->names = NULL;    /* shared */
+    msa_free(range_msa);
+  }
+
+  /* length is as set by the last call to ss_from_msas in the
+     sequential case */
+  block = &d.blocks[nblocks-1];
+  msa->length = (store_order ? block->idx_offset : 0) + block->ncols;
+
+  sfree(d.range_msa);
+  sfree(d.range_start);
+  sfree(d.blocks);
+}
 
 
 /** Read An Alignment from a MAF file.  The alignment won't be
@@ -28,7 +392,7 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
 
   int i, start_idx, length, max_tuples, block_no,  
     refseqlen = -1, do_toupper, last_refseqpos = -1;
-  Hashtable *tuple_hash;
+  TupleHash *tuple_hash;
   Hashtable *name_hash = hsh_new(25);
   MSA *msa, *mini_msa;
   GFF_Set *mini_gff = NULL;
@@ -36,9 +400,9 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
   msa_coord_map *map = NULL;
   List *block_starts = lst_new_int(1000), *block_ends = lst_new_int(1000);
   int last_gap_start = -1;
-  int idx_offset, end_idx, gap_sum=0;
-  int block_list_idx, prev_end, next_start;
+  int idx_offset, gap_sum=0;
   int first_idx=-1, last_idx=-1, free_cm=0;
+  MafScanner *scan;
 
   if (gff != NULL) gap_strip_mode = 1; /* for now, automatically
                                           project if GFF (see comment
@@ -147,7 +511,7 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
   if (max_tuples > 10000000 || max_tuples < 0) max_tuples = 10000000;
   if (max_tuples < 1000000) max_tuples = 1000000;
 
-  tuple_hash = hsh_new(max_tuples); 
+  tuple_hash = tuple_hash_new(msa, msa->nseqs * tuple_size, max_tuples);
   ss_new(msa, tuple_size, max_tuples, gff != NULL || cycle_size > 0 ? 1 : 0, 
          store_order); 
 
@@ -156,9 +520,17 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
       msa->ss->tuple_idx[i] = -1;
   }
 
-  /* process MAF one block at a time */
+  /* process MAF one block at a time, or in parallel if possible */
   block_no = 0;
-  while (maf_read_block_addseq(F, mini_msa, name_hash, &start_idx,
+  scan = mafScanner_new(F);
+  if (thr_get_nthreads() > 1 && scan->mapped && map == NULL && 
+      reverse_groups == NULL)
+    maf_read_parallel(scan, msa, mini_msa, name_hash, tuple_hash, REFSEQF,
+                      tuple_size, store_order, gap_strip_mode, 
+                      keep_overlapping, gff, cm, cycle_size, cats_to_do, 
+                      do_toupper, seqnames != NULL && seq_keep, 
+                      &first_idx, &last_idx);
+  else while (maf_scan_block_addseq(scan, mini_msa, name_hash, &start_idx,
 			       &length, do_toupper, seqnames != NULL && seq_keep) != EOF) {
     checkInterruptN(block_no++, 1000);
 
@@ -168,7 +540,6 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
       msa_add_seq_ss(msa, mini_msa->nseqs);
       msa->nseqs = mini_msa->nseqs;
     }
-    end_idx = start_idx + length - 1;
 
     /* if creating a map, require MAF to be sorted wrt reference sequence, otherwise skip block */
     if (map != NULL && start_idx <= last_refseqpos) {
@@ -180,21 +551,10 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
       }
       continue;
     }
-    /* ignore if redundant block: if start_idx < last_refseqpos, need to check list to
-       see if region is redundant */
-    if (!keep_overlapping && start_idx <= last_refseqpos) {
-       block_list_idx = lst_bsearch_int(block_starts, start_idx);
-       prev_end = block_list_idx >=0 ? lst_get_int(block_ends, block_list_idx) : -1;
-       next_start = block_list_idx + 1 < lst_size(block_starts) ?
-	lst_get_int(block_starts, block_list_idx+1) : end_idx + 1;
-       if (prev_end >= start_idx || next_start <= end_idx)  { //redundant
-	 continue;
-       }
-    }
-    /* also ignore if block size is less than tuple size */
-    if (length < tuple_size)  {
-      continue; 
-    }
+    /* ignore redundant blocks and blocks smaller than tuple size */
+    if (!maf_accept_block(start_idx, length, tuple_size, keep_overlapping,
+                          block_starts, block_ends, &last_refseqpos))
+      continue;
 
     if (first_idx == -1) {
       first_idx = start_idx;
@@ -208,12 +568,6 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
     if (start_idx + length > last_idx)
       last_idx = start_idx + length;
 
-    /* add block to list to check for redundant blocks later */
-    lst_push_int(block_starts, start_idx);
-    lst_push_int(block_ends, end_idx);
-
-    last_refseqpos = end_idx;
-
     /* collect info on gaps for coordinate map */
     if (map != NULL) {
       int idx = start_idx, gaplen = 0, gapsum_block=0;
@@ -259,33 +613,9 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
 		    }*/
     } /* end coordinate map section */
     
-    if (gap_strip_mode != NO_STRIP) 
-      msa_strip_gaps(mini_msa, gap_strip_mode);
-
-    if (gff != NULL) {
-      /* extract subset of features in GFF corresponding to block */
-      lst_clear(mini_gff->features);
-      maf_block_sub_gff(mini_gff, gff, start_idx + 1, start_idx + length, 
-                        &gff_idx, cm, reverse_groups != NULL, tuple_size); 
-                                /* coords in GFF are 1-based */
-
-      /* if we're not using a global coordinate map, we need to map the
-         mini_gff to the coords of the mini_msa */
-      /* NOTE: not necessary because automatically projecting */
-/*       if (map == NULL && lst_size(mini_gff->features) > 0)  */
-/*         msa_map_gff_coords(mini_msa, mini_gff, 1, 0, 0); */
-
-      if (reverse_groups != NULL && lst_size(mini_gff->features) > 0) {
-	gff_group(mini_gff, reverse_groups);
-	msa_reverse_compl_feats(mini_msa, mini_gff, NULL);
-      }
-
-      /* now label categories of mini_msa accordingly */
-      msa_label_categories(mini_msa, mini_gff, cm);   
-    }
-    else if (cycle_size > 0)
-      for (i = 0; i < mini_msa->length; i++)
-        mini_msa->categories[i] = (i % cycle_size) + 1;
+    maf_label_block(mini_msa, start_idx, length, gap_strip_mode, gff, 
+                    mini_gff, &gff_idx, cm, reverse_groups, cycle_size,
+                    tuple_size);
 
     /* fold new block into aggregate representation */
     /* first map starting coordinate */
@@ -311,13 +641,8 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
        into the new msa */
     ss_from_msas(msa, tuple_size, store_order, cats_to_do, mini_msa, 
                  tuple_hash, idx_offset, 0);
-
-    if (gff != NULL) {          /* free features and clear list */
-      for (i = 0; i < lst_size(mini_gff->features); i++)
-        gff_free_feature(lst_get_ptr(mini_gff->features, i));
-      lst_clear(mini_gff->features);
-    }
   }
+  mafScanner_free(scan);
   if (map != NULL)
     map->msa_len = map->seq_len + gap_sum;
 
@@ -473,7 +798,7 @@ MSA *maf_read_cats_subset(FILE *F, FILE *REFSEQF, int tuple_size,
   msa_free(mini_msa);
   if (mini_gff != NULL) gff_free_set(mini_gff);
 
-  hsh_free(tuple_hash);
+  tuple_hash_free(tuple_hash);
   hsh_free(name_hash);
   lst_free(block_starts);
   lst_free(block_ends);
@@ -524,7 +849,7 @@ MSA *maf_read_unsorted(FILE *F, FILE *REFSEQF, int tuple_size, char *alphabet,
 
   int i, start_idx, length, max_tuples, block_no, rbl_idx, 
     refseqlen = -1, do_toupper;
-  Hashtable *tuple_hash;
+  TupleHash *tuple_hash;
   Hashtable *name_hash = hsh_new(25);
   MSA *msa, *mini_msa;
   GFF_Set *mini_gff = NULL;
@@ -604,7 +929,7 @@ MSA *maf_read_unsorted(FILE *F, FILE *REFSEQF, int tuple_size, char *alphabet,
     if (max_tuples < 0) max_tuples = 50000;
   }
 
-  tuple_hash = hsh_new(max_tuples); 
+  tuple_hash = tuple_hash_new(msa, msa->nseqs * tuple_size, max_tuples);
   ss_new(msa, tuple_size, max_tuples, gff != NULL || cycle_size > 0 ? 1 : 0, 
          store_order); 
 
@@ -825,7 +1150,7 @@ MSA *maf_read_unsorted(FILE *F, FILE *REFSEQF, int tuple_size, char *alphabet,
   msa_free(mini_msa);
   if (mini_gff != NULL) gff_free_set(mini_gff);
 
-  hsh_free(tuple_hash);
+  tuple_hash_free(tuple_hash);
   hsh_free(name_hash);
   lst_free(redundant_blocks);
   if (map != NULL) msa_map_free(map);
@@ -842,83 +1167,105 @@ MSA *maf_read_old(FILE *f, FILE *REFSEQF, int tuple_size, char *alphabet,
 }
 
 
-/* Read a block from an MAF file and store it as a "mini-msa" using
-   the provided object.  Allocates memory for sequences if they are
-   NULL (as with first block).  Reads to next "a" line or EOF.
-   Returns EOF when no more alignments are available.  Sets start
-   coord and length of reference sequence if non-NULL
-   pointers are provided.  Uses provided hash to map sequence names to
-   sequence indices (prefix of name wrt '.' character); sequences not
-   present in a block will be represented by missing-data characters. */
-int maf_read_block_addseq(FILE *F, MSA *mini_msa, Hashtable *name_hash, 
-			  int *start_idx, int *length, int do_toupper,
-			  int skip_new_species) {
+/* source of lines for maf_block_addseq: either a stream read line by
+   line, or a MafScanner */
+typedef struct {
+  FILE *F;
+  String *linebuffer;
+  MafScanner *scan;
+} MafLineSource;
+
+static char *maf_next_line(MafLineSource *src, int *len) {
+  if (src->scan != NULL) 
+    return mafScanner_next_line(src->scan, len);
+  if (str_readline(src->linebuffer, src->F) == EOF) 
+    return NULL;
+  *len = src->linebuffer->length;
+  return src->linebuffer->chars;
+}
 
-  int seqidx, more_blocks = 0, i, j;
-  String *this_seq, *linebuffer = str_new(STR_VERY_LONG_LEN);
-  List *l = lst_new_ptr(7);
+/* (used by maf_read_block_addseq and maf_scan_block_addseq) read
+   lines of a block from the given source; see maf_read_block_addseq
+   below.  Sequence lines are tokenized in place and sequence
+   characters are validated and translated using a lookup table.  If
+   names_only == TRUE, only the reference coordinates, block length,
+   and sequence names are processed; sequences are not stored */
+static int maf_block_addseq(MafLineSource *src, MSA *mini_msa, 
+                            Hashtable *name_hash, int *start_idx, 
+                            int *length, int do_toupper, 
+                            int skip_new_species, int names_only) {
+
+  int seqidx, more_blocks = 0, i, j, len, nfields, seqlen;
+  long start, size;
+  char *line, *seq, c;
+  char char_table[256];
+  MafField f[MAF_MAX_FIELDS];
   String *this_name = str_new(STR_SHORT_LEN);
   int *mark;
 
+  maf_seq_char_table(mini_msa, do_toupper, char_table);
+
   mini_msa->length = -1;
   mark = smalloc(mini_msa->nseqs*sizeof(int));
   for (i = 0; i < mini_msa->nseqs; i++) mark[i] = 0;
-  while (str_readline(linebuffer, F) != EOF) {
-    if (str_starts_with_charstr(linebuffer, "#") ||
-        str_starts_with_charstr(linebuffer, "i ") ||
-        str_starts_with_charstr(linebuffer, "e ") ||
-        str_starts_with_charstr(linebuffer, "q ")) 
+  while ((line = maf_next_line(src, &len)) != NULL) {
+    if (len > 0 && (line[0] == '#' ||
+                    (len > 1 && line[1] == ' ' && 
+                     (line[0] == 'i' || line[0] == 'e' || line[0] == 'q'))))
       continue;                 /* ignore i, e, and q lines for now */
-    else if (str_starts_with_charstr(linebuffer, "a")) {
+    else if (len > 0 && line[0] == 'a') {
       if (mini_msa->length == -1) continue;   /* assume first block (?) */
       more_blocks = 1;          /* want to distinguish a new block
                                    from an EOF */
       break;
     }
-    str_trim(linebuffer);
-    if (linebuffer->length == 0) continue;
+    if ((nfields = maf_split_fields(line, len, f)) == 0) continue;
 
-    /* if we get here, linebuffer should contain a sequence line */
-    str_split(linebuffer, NULL, l);    
-    if (lst_size(l) != 7 || !str_equals_charstr(lst_get_ptr(l, 0), "s")) 
-      die("ERROR: bad sequence line in MAF file --\n\t\"%s\"\n", linebuffer->chars);
-    str_cpy(this_name, lst_get_ptr(l, 1));
-    str_shortest_root(this_name, '.');
-    this_seq = lst_get_ptr(l, 6);
+    /* if we get here, line should contain a sequence line */
+    if (nfields != 7 || f[0].len != 1 || f[0].s[0] != 's') 
+      die("ERROR: bad sequence line in MAF file --\n\t\"%.*s\"\n", len, line);
+    for (j = 0; j < f[1].len && f[1].s[j] != '.'; j++);
+    str_clear(this_name);
+    str_nappend_charstr(this_name, f[1].s, j);
+    seq = f[6].s;
+    seqlen = f[6].len;
 
     /* if this is the reference sequence, also grab start_idx and
        length and check strand */
-    if (mini_msa->length == -1 && 
-        ((start_idx != NULL && str_as_int(lst_get_ptr(l, 2), start_idx) != 0) ||
-        (length != NULL && str_as_int(lst_get_ptr(l, 3), length) != 0) ||
-        ((String*)lst_get_ptr(l, 4))->chars[0] != '+')) {
-      die("ERROR: bad integers or strand in MAF (strand must be + for reference sequence) --\n\t\"%s\"\n", linebuffer->chars);
+    if (mini_msa->length == -1) {
+      if (maf_field_as_int(&f[2], &start) != 0 ||
+          maf_field_as_int(&f[3], &size) != 0 || f[4].s[0] != '+')
+        die("ERROR: bad integers or strand in MAF (strand must be + for reference sequence) --\n\t\"%.*s\"\n", len, line);
+      if (start_idx != NULL) *start_idx = (int)start;
+      if (length != NULL) *length = (int)size;
     }
 
     /* ensure lengths of all seqs are consistent */
     if (mini_msa->length == -1) 
-      mini_msa->length = this_seq->length;
-    else if (this_seq->length != mini_msa->length) {
-      die("ERROR: sequence lengths do not match in MAF block -- \n\tsee line \"%s\"\n", linebuffer->chars);
+      mini_msa->length = seqlen;
+    else if (seqlen != mini_msa->length) {
+      die("ERROR: sequence lengths do not match in MAF block -- \n\tsee line \"%.*s\"\n", len, line);
     }
 
     /* obtain index of seq */
     seqidx = hsh_get_int(name_hash, this_name->chars);
     if (seqidx == -2 || (seqidx == -1 && !skip_new_species)) {
       seqidx = msa_add_seq(mini_msa, this_name->chars);
+      if (mini_msa->alloc_len <= 0 && mini_msa->seqs != NULL) 
+        mini_msa->seqs[seqidx] = NULL; /* not allocated by msa_add_seq */
       hsh_put_int(name_hash, this_name->chars, seqidx);
       mark = srealloc(mark, mini_msa->nseqs*sizeof(int));
-    } else if (seqidx == -1) {
-      goto msa_read_block_addseq_free_loop;
-    }
+    } else if (seqidx == -1) 
+      continue;
     if (!(str_equals_charstr(this_name, mini_msa->names[seqidx])))
       die("ERROR: maf_read_block_addseq: %s != %s\n",
 	  this_name->chars, mini_msa->names[seqidx]);
 
+    if (names_only) continue;
 
     /* enlarge allocated sequence lengths as necessary */
-    if (this_seq->length > mini_msa->alloc_len) {
-      mini_msa->alloc_len = this_seq->length;
+    if (seqlen > mini_msa->alloc_len) {
+      mini_msa->alloc_len = seqlen;
       for (i = 0; i < mini_msa->nseqs; i++)
         mini_msa->seqs[i] = 
           srealloc(mini_msa->seqs[i], (mini_msa->alloc_len+1) * sizeof(char));
@@ -927,31 +1274,16 @@ int maf_read_block_addseq(FILE *F, MSA *mini_msa, Hashtable *name_hash,
           srealloc(mini_msa->categories, mini_msa->alloc_len * sizeof(int)); 
     }
 
-    for (i = 0; i < this_seq->length; i++) {
-      mini_msa->seqs[seqidx][i] = do_toupper ? (char)toupper(this_seq->chars[i]) : 
-        this_seq->chars[i];
-      if (mini_msa->seqs[seqidx][i] == '.' && mini_msa->inv_alphabet[(int)'.'] == -1) 
-        mini_msa->seqs[seqidx][i] = mini_msa->missing[0];
-      if (mini_msa->seqs[seqidx][i] != GAP_CHAR && 
-          !mini_msa->is_missing[(int)mini_msa->seqs[seqidx][i]] &&
-          mini_msa->inv_alphabet[(int)mini_msa->seqs[seqidx][i]] == -1 &&
-	  get_iupac_map()[(int)mini_msa->seqs[seqidx][i]] == NULL) {
-        if (isalpha(mini_msa->seqs[seqidx][i]))
-          mini_msa->seqs[seqidx][i] = 'N';
-        else 
-          die("ERROR: unrecognized character in sequence in MAF block ('%c')\n",
-              mini_msa->seqs[seqidx][i]);
-      }
+    for (i = 0; i < seqlen; i++) {
+      if ((c = char_table[(unsigned char)seq[i]]) == 0)
+        die("ERROR: unrecognized character in sequence in MAF block ('%c')\n",
+            seq[i]);
+      mini_msa->seqs[seqidx][i] = c;
     }
-    fflush(stdout);
-    mini_msa->seqs[seqidx][this_seq->length] = '\0';
+    mini_msa->seqs[seqidx][seqlen] = '\0';
     mark[seqidx] = 1;
-  msa_read_block_addseq_free_loop:
-    for (i = 0; i < lst_size(l); i++) str_free(lst_get_ptr(l, i));
   }
 
-  lst_free(l);
-  str_free(linebuffer);
   str_free(this_name);
 
   if (mini_msa->length == -1 && !more_blocks) {
@@ -960,7 +1292,7 @@ int maf_read_block_addseq(FILE *F, MSA *mini_msa, Hashtable *name_hash,
                                    encountered before any alignment
                                    blocks were found */
   /* pad unmarked seqs with missing-data characters */
-  for (i = 0; i < mini_msa->nseqs; i++) {
+  for (i = 0; i < mini_msa->nseqs && !names_only; i++) {
     if (!mark[i]) {
       for (j = 0; j < mini_msa->length; j++) 
         mini_msa->seqs[i][j] = mini_msa->missing[0];
@@ -971,6 +1303,53 @@ int maf_read_block_addseq(FILE *F, MSA *mini_msa, Hashtable *name_hash,
   return 0;
 }
 
+/* Read a block from an MAF file and store it as a "mini-msa" using
+   the provided object.  Allocates memory for sequences if they are
+   NULL (as with first block).  Reads to next "a" line or EOF.
+   Returns EOF when no more alignments are available.  Sets start
+   coord and length of reference sequence if non-NULL
+   pointers are provided.  Uses provided hash to map sequence names to
+   sequence indices (prefix of name wrt '.' character); sequences not
+   present in a block will be represented by missing-data characters. */
+int maf_read_block_addseq(FILE *F, MSA *mini_msa, Hashtable *name_hash, 
+			  int *start_idx, int *length, int do_toupper,
+			  int skip_new_species) {
+  MafLineSource src;
+  int retval;
+  src.F = F;
+  src.scan = NULL;
+  src.linebuffer = str_new(STR_VERY_LONG_LEN);
+  retval = maf_block_addseq(&src, mini_msa, name_hash, start_idx, length,
+                            do_toupper, skip_new_species, FALSE);
+  str_free(src.linebuffer);
+  return retval;
+}
+
+/* Same as above, but read from a MafScanner */
+int maf_scan_block_addseq(MafScanner *scan, MSA *mini_msa, 
+                          Hashtable *name_hash, int *start_idx, int *length,
+                          int do_toupper, int skip_new_species) {
+  MafLineSource src;
+  src.F = NULL;
+  src.scan = scan;
+  src.linebuffer = NULL;
+  return maf_block_addseq(&src, mini_msa, name_hash, start_idx, length,
+                          do_toupper, skip_new_species, FALSE);
+}
+
+/* (used by maf_read_parallel) like maf_scan_block_addseq, but reads
+   only reference coordinates and sequence names */
+static int maf_scan_block_names(MafScanner *scan, MSA *mini_msa, 
+                                Hashtable *name_hash, int *start_idx, 
+                                int *length, int skip_new_species) {
+  MafLineSource src;
+  src.F = NULL;
+  src.scan = scan;
+  src.linebuffer = NULL;
+  return maf_block_addseq(&src, mini_msa, name_hash, start_idx, length,
+                          FALSE, skip_new_species, TRUE);
+}
+
 
 
 
@@ -87,63 +87,66 @@ MafBlock* mafBlock_copy(MafBlock *src) {
   return block;
 }
 
-//parses a line from maf block starting with 'e' or 's' and returns a new MafSubBlock 
-//object. 
-MafSubBlock *mafBlock_get_subBlock(String *line) {
-  int i;
-  List *l = lst_new_ptr(7);
-  String *str;
+//returns a new String containing the characters of a field
+static String *mafBlock_field_str(MafField *f) {
+  String *str = str_new(f->len);
+  str_nappend_charstr(str, f->s, f->len);
+  return str;
+}
+
+//returns 1 if field is equal to the single character c
+static int mafBlock_field_is(MafField *f, char c) {
+  return (f->len == 1 && f->s[0] == c);
+}
+
+//parses the fields of a line from maf block starting with 'e' or 's'
+//and returns a new MafSubBlock object.
+static MafSubBlock *mafBlock_subBlock_from_fields(MafField *f, int nfields) {
   MafSubBlock *sub;
+  long val;
 
-  if (7 != str_split(line, NULL, l)) 
+  if (nfields != 7) 
     die("Error: mafBlock_get_subBlock expected seven fields in MAF line starting "
-	"with %s\n",
-	((String*)lst_get_ptr(l, 0))->chars);
+	"with %.*s\n", f[0].len, f[0].s);
   
   sub = mafBlock_new_subBlock();
   
   //field 0: should be 's' or 'e'
-  str = (String*)lst_get_ptr(l, 0);
-  if (str_compare_charstr(str, "s")==0)
+  if (mafBlock_field_is(&f[0], 's'))
     sub->lineType[0]='s';
-  else if (str_compare_charstr(str, "e")==0)
+  else if (mafBlock_field_is(&f[0], 'e'))
     sub->lineType[0]='e';
-  else die("ERROR: mafBlock_get_subBlock expected first field 's' or 'e' (got %s)\n",
-	   str->chars);
+  else die("ERROR: mafBlock_get_subBlock expected first field 's' or 'e' (got %.*s)\n",
+	   f[0].len, f[0].s);
 
   //field 1: should be src.  Also set specName
-  sub->src = (String*)lst_get_ptr(l, 1);
+  sub->src = mafBlock_field_str(&f[1]);
   sub->specName = str_new_charstr(sub->src->chars);
   str_shortest_root(sub->specName, '.');
 
   //field 2: should be start
-  sub->start = atol(((String*)lst_get_ptr(l, 2))->chars);
+  sub->start = maf_field_as_int(&f[2], &val) == 0 ? val : 0;
   
   //field 3: should be length
-  sub->size = atoi(((String*)lst_get_ptr(l, 3))->chars);
+  sub->size = maf_field_as_int(&f[3], &val) == 0 ? (int)val : 0;
 
   //field 4: should be strand
-  str = (String*)lst_get_ptr(l, 4);
-  if (str_compare_charstr(str, "+")==0)
+  if (mafBlock_field_is(&f[4], '+'))
     sub->strand = '+';
-  else if (str_compare_charstr(str, "-")==0)
+  else if (mafBlock_field_is(&f[4], '-'))
     sub->strand = '-';
-  else die("ERROR: got strand %s\n", str->chars);
+  else die("ERROR: got strand %.*s\n", f[4].len, f[4].s);
   
   //field 5: should be srcSize
-  sub->srcSize = atol(((String*)lst_get_ptr(l, 5))->chars);
+  sub->srcSize = maf_field_as_int(&f[5], &val) == 0 ? val : 0;
 
   //field 6: sequence if sLine, eStatus if eLine.
-  str = (String*)lst_get_ptr(l, 6);
   if (sub->lineType[0]=='s')
-    sub->seq = str;
+    sub->seq = mafBlock_field_str(&f[6]);
   else {
-    if (sub->lineType[0] != 'e')
-      die("ERROR mafBlock_get_subBlock: bad lineType (expected 'e', got %c)\n",
-	  sub->lineType[0]);
-    if (str->length != 1)
-      die("ERROR: e-Line with status %s in MAF block\n", str->chars);
-    sub->eStatus = str->chars[0];
+    if (f[6].len != 1)
+      die("ERROR: e-Line with status %.*s in MAF block\n", f[6].len, f[6].s);
+    sub->eStatus = f[6].s[0];
     //note: don't know what status 'T' means (it's not in MAF documentation), but
     //it is in the 44-way MAFs
     if (sub->eStatus != 'C' && sub->eStatus != 'I' && sub->eStatus != 'M' &&
@@ -151,43 +154,43 @@ MafSubBlock *mafBlock_get_subBlock(String *line) {
       die("ERROR: e-Line has illegal status %c\n", sub->eStatus);
   }
   sub->numLine = 1;
-  //free all strings except field 1 and field 6 when lineType=='s'
-  for (i=0; i<7; i++)
-    if (i!=1 && (i!=6 || sub->lineType[0]!='s')) 
-      str_free((String*)lst_get_ptr(l, i));
-  lst_free(l);
   return sub;
 }
 
-void mafBlock_add_iLine(String *line, MafSubBlock *sub) {
-  List *l = lst_new_ptr(6);
-  String *str;
+//checks that field is equal to the src of sub
+static void mafBlock_check_src(MafField *f, MafSubBlock *sub) {
+  if (f->len != sub->src->length || strncmp(f->s, sub->src->chars, f->len) != 0)
+    die("iLine sourceName does not match preceding s-Line (%.*s, %s)\n", 
+	f->len, f->s, sub->src->chars);
+}
+
+static void mafBlock_add_iLine_fields(MafField *f, int nfields, 
+                                      MafSubBlock *sub) {
   int i;
 
-  if (sub->numLine<1 || sub->lineType[0]!='s') 
+  if (sub == NULL || sub->numLine<1 || sub->lineType[0]!='s') 
     die("ERROR: got i-Line without preceding s-Line in MAF block\n");
   
-  if (6 != str_split(line, NULL, l))
+  if (6 != nfields)
     die("ERROR: expected six fields in MAF line starting with 'i' (got %i)\n",
-	lst_size(l));
+	nfields);
 
   //field[0] should be 'i'
-  if (!(str_compare_charstr((String*)lst_get_ptr(l, 0), "i")==0))
-    die("ERROR: mafBlock_add_iLine: field[0] should be 'i', got %s\n",
-	((String*)lst_get_ptr(l, 0))->chars);
+  if (!mafBlock_field_is(&f[0], 'i'))
+    die("ERROR: mafBlock_add_iLine: field[0] should be 'i', got %.*s\n",
+	f[0].len, f[0].s);
 
   //field[1] should be src, and should match src already set in sub
-  if (str_compare((String*)lst_get_ptr(l, 1), sub->src) != 0)
-    die("iLine sourceName does not match preceding s-Line (%s, %s)\n", 
-	((String*)lst_get_ptr(l, 1))->chars, sub->src->chars);
+  mafBlock_check_src(&f[1], sub);
 
   for (i=0; i<2; i++) {
+    long val;
 
     //field[2,4] should be leftStatus, rightStauts
-    str = (String*)lst_get_ptr(l, i*2+2);
-    if (str->length != 1) die("ERROR: i-Line got illegal %sStatus = %s\n",
-			      i==0 ? "left": "right", str->chars);
-    sub->iStatus[i] = str->chars[0];
+    if (f[i*2+2].len != 1) die("ERROR: i-Line got illegal %sStatus = %.*s\n",
+                               i==0 ? "left": "right", 
+                               f[i*2+2].len, f[i*2+2].s);
+    sub->iStatus[i] = f[i*2+2].s[0];
     if (sub->iStatus[i] != 'C' && sub->iStatus[i] != 'I' &&
 	sub->iStatus[i] != 'N' && sub->iStatus[i] != 'n' &&
 	sub->iStatus[i] != 'M' && sub->iStatus[i] != 'T')
@@ -195,47 +198,36 @@ void mafBlock_add_iLine(String *line, MafSubBlock *sub) {
 	  i==0 ? "left" : "right", sub->iStatus[i]);
 
     //field 3,5 should be leftCount, rightCount
-    str = (String*)lst_get_ptr(l, i*2+3);
-    sub->iCount[i] = atoi(str->chars);
+    sub->iCount[i] = maf_field_as_int(&f[i*2+3], &val) == 0 ? (int)val : 0;
   }
   
-  for (i=0; i<6; i++) str_free((String*)lst_get_ptr(l, i));
-  lst_free(l);
   if (sub->numLine >= 4) die("Error: bad MAF file");
   sub->lineType[sub->numLine++] = 'i';
-
-
 }
 
-
-void mafBlock_add_qLine(String *line, MafSubBlock *sub) {
-  List *l = lst_new_ptr(3);
-  String *str;
+static void mafBlock_add_qLine_fields(MafField *f, int nfields, 
+                                      MafSubBlock *sub) {
   int i;
 
-  if (sub->numLine<1 || sub->lineType[0]!='s') 
+  if (sub == NULL || sub->numLine<1 || sub->lineType[0]!='s') 
     die("ERROR: got q-Line without preceding s-Line in MAF block\n");
 
-  if (3 != str_split(line, NULL, l))
-    die("ERROR: expected three fields in q-Line of maf file, got %i\n", lst_size(l));
+  if (3 != nfields)
+    die("ERROR: expected three fields in q-Line of maf file, got %i\n", nfields);
   
   //field[0] should be 'q'
-  if (!(str_compare_charstr((String*)lst_get_ptr(l, 0), "q")==0))
-    die("ERROR mafBlock_add_qLine expected 'q' got %s\n",
-	((String*)lst_get_ptr(l, 0))->chars);
+  if (!mafBlock_field_is(&f[0], 'q'))
+    die("ERROR mafBlock_add_qLine expected 'q' got %.*s\n", f[0].len, f[0].s);
   
   //field[1] should be src, and should match src already set in sub
-  if (str_compare((String*)lst_get_ptr(l, 1), sub->src) != 0)
-    die("iLine sourceName does not match preceding s-Line (%s, %s)\n", 
-	((String*)lst_get_ptr(l, 1))->chars, sub->src->chars);
+  mafBlock_check_src(&f[1], sub);
 
   //field[2] should be quality
   if (sub->seq == NULL)
     die("ERROR mafBlock_add_qLine: sub->seq is NULL\n");
-  str = (String*)lst_get_ptr(l, 2);
-  if (sub->seq->length != str->length) 
+  if (sub->seq->length != f[2].len) 
     die("ERROR: length of q-line does not match sequence length\n");
-  sub->quality = str;
+  sub->quality = mafBlock_field_str(&f[2]);
   for (i=0; i<sub->quality->length; i++) {
     if (sub->seq->chars[i] == '-') {
       if (sub->quality->chars[i] != '-') 
@@ -248,13 +240,105 @@ void mafBlock_add_qLine(String *line, MafSubBlock *sub) {
     }
   }
    
-  for (i=0; i<2; i++) str_free((String*)lst_get_ptr(l, i));
-  lst_free(l);
   if (sub->numLine >= 4) die("Error: bad MAF file");
   sub->lineType[sub->numLine++] = 'q';
+}
+
+//parses a line from maf block starting with 'e' or 's' and returns a new MafSubBlock 
+//object. 
+MafSubBlock *mafBlock_get_subBlock(String *line) {
+  MafField f[MAF_MAX_FIELDS];
+  int nfields = maf_split_fields(line->chars, line->length, f);
+  if (nfields == 0)
+    die("Error: mafBlock_get_subBlock got empty MAF line\n");
+  return mafBlock_subBlock_from_fields(f, nfields);
+}
+
+void mafBlock_add_iLine(String *line, MafSubBlock *sub) {
+  MafField f[MAF_MAX_FIELDS];
+  int nfields = maf_split_fields(line->chars, line->length, f);
+  mafBlock_add_iLine_fields(f, nfields, sub);
+}
+
 
+void mafBlock_add_qLine(String *line, MafSubBlock *sub) {
+  MafField f[MAF_MAX_FIELDS];
+  int nfields = maf_split_fields(line->chars, line->length, f);
+  mafBlock_add_qLine_fields(f, nfields, sub);
+}
+
+//(used by mafBlock_read_next and mafBlock_scan_next) parse one line of
+//a MAF file, creating *block if necessary and adding data to it.
+//Returns 1 if the line ends the current block, 0 otherwise.
+static int mafBlock_parse_line(char *line, int len, MafBlock **block, 
+                               MafSubBlock **sub, Hashtable *specHash, 
+                               int *numSpec) {
+  MafField f[MAF_MAX_FIELDS];
+  int nfields;
+  char firstchar;
+
+  //trim leading and trailing whitespace
+  while (len > 0 && isspace((unsigned char)line[0])) {
+    line++;
+    len--;
+  }
+  while (len > 0 && isspace((unsigned char)line[len-1])) len--;
+
+  if (len==0)  //if blank line, it is either first or last line
+    return (*block != NULL);
+  firstchar = line[0];
+  if (firstchar == '#') return 0;  //ignore comments
+  if (*block == NULL) {
+    if (firstchar != 'a') 
+      die("ERROR: first line of MAF block should start with 'a'\n");
+    *block = mafBlock_new();
+    (*block)->aLine = str_new(len);
+    str_nappend_charstr((*block)->aLine, line, len);
+    return 0;
+  }
+
+  nfields = maf_split_fields(line, len, f);
+  //if 's' or 'e', then this is first line of data for this species
+  if (firstchar == 's' || firstchar == 'e') {
+    *sub = mafBlock_subBlock_from_fields(f, nfields);
+    if (hsh_get_int((*block)->specMap, (*sub)->src->chars) != -1) 
+      die("ERROR: mafBlock has two alignments with same srcName (%s)\n", 
+          (*sub)->src->chars);
+    hsh_put_int((*block)->specMap, (*sub)->src->chars, 
+                lst_size((*block)->data));
+    hsh_put_int((*block)->specMap, (*sub)->specName->chars, 
+                lst_size((*block)->data));
+    lst_push_ptr((*block)->data, (void*)*sub);
+    if (specHash != NULL) {
+      if (-1 == hsh_get_int(specHash, (*sub)->specName->chars)) {
+        hsh_put_int(specHash, (*sub)->specName->chars, *numSpec);
+        (*numSpec)++;
+      }
+    }
+  }
+  else if (firstchar == 'i')
+    mafBlock_add_iLine_fields(f, nfields, *sub);
+  else if (firstchar == 'q')
+    mafBlock_add_qLine_fields(f, nfields, *sub);
+  else die("ERROR: found line in MAF block starting with '%c'\n", firstchar);
+  return 0;
 }
 
+//(used by mafBlock_read_next and mafBlock_scan_next) set seqlen and
+//make sure all seq arrays agree
+static void mafBlock_finish(MafBlock *block) {
+  MafSubBlock *sub;
+  int i;
+  for (i=0; i<lst_size(block->data); i++) {
+    sub = (MafSubBlock*)lst_get_ptr(block->data, i);
+    if (sub->lineType[0]=='e') continue;
+    if (block->seqlen == -1) block->seqlen = sub->seq->length;
+    else if (sub->seq->length != block->seqlen) {
+      die("ERROR: lengths of sequences in MAF block do not agree (%i, %i)\n",
+	  block->seqlen, sub->seq->length);
+    }
+  }
+}
 
 //read next block in mfile and return MafBlock object or NULL if EOF.
 //specHash and numSpec are not used, but if specHash is not NULL,
@@ -262,8 +346,6 @@ void mafBlock_add_qLine(String *line, MafSubBlock *sub) {
 //to the hash, with numSpec increased accordingly.  If specHash is NULL,
 //numSpec will not be used or modified.
 MafBlock *mafBlock_read_next(FILE *mfile, Hashtable *specHash, int *numSpec) {
-  int i;
-  char firstchar;
   String *currLine = str_new(1000);
   MafBlock *block=NULL;
   MafSubBlock *sub=NULL;
@@ -273,56 +355,34 @@ MafBlock *mafBlock_read_next(FILE *mfile, Hashtable *specHash, int *numSpec) {
 	"if specHash is not NULL\n");
 
   while (EOF != str_readline(currLine, mfile)) {
-    str_trim(currLine);
-    if (currLine->length==0) {  //if blank line, it is either first or last line
-      if (block == NULL) continue;
-      else break;
-    }
-    firstchar = currLine->chars[0];
-    if (firstchar == '#') continue;  //ignore comments
-    if (block == NULL) {
-      if (firstchar != 'a') 
-	die("ERROR: first line of MAF block should start with 'a'\n");
-      block = mafBlock_new();
-      block->aLine = str_new_charstr(currLine->chars);
-    }
-    //if 's' or 'e', then this is first line of data for this species
-    else if (firstchar == 's' || firstchar == 'e') {
-      sub = mafBlock_get_subBlock(currLine);
-      if (hsh_get_int(block->specMap, sub->src->chars) != -1) 
-	die("ERROR: mafBlock has two alignments with same srcName (%s)\n", 
-	    sub->src->chars);
-      hsh_put_int(block->specMap, sub->src->chars, lst_size(block->data));
-      hsh_put_int(block->specMap, sub->specName->chars, lst_size(block->data));
-      lst_push_ptr(block->data, (void*)sub);
-      if (specHash != NULL) {
-	if (-1 == hsh_get_int(specHash, sub->specName->chars)) {
-	  hsh_put_int(specHash, sub->specName->chars, *numSpec);
-	  (*numSpec)++;
-	}
-      }
-    }
-    else {
-      if (firstchar == 'i')
-	mafBlock_add_iLine(currLine, sub);
-      else if (firstchar == 'q')
-	mafBlock_add_qLine(currLine, sub);
-      else die("ERROR: found line in MAF block starting with '%c'\n", firstchar);
-    }
+    if (mafBlock_parse_line(currLine->chars, currLine->length, &block, &sub,
+                            specHash, numSpec))
+      break;
   }
   str_free(currLine);
   if (block == NULL) return NULL;
+  mafBlock_finish(block);
+  return block;
+}
 
-  //set seqlen and make sure all seq arrays agree
-  for (i=0; i<lst_size(block->data); i++) {
-    sub = (MafSubBlock*)lst_get_ptr(block->data, i);
-    if (sub->lineType[0]=='e') continue;
-    if (block->seqlen == -1) block->seqlen = sub->seq->length;
-    else if (sub->seq->length != block->seqlen) {
-      die("ERROR: lengths of sequences in MAF block do not agree (%i, %i)\n",
-	  block->seqlen, sub->seq->length);
-    }
+//same as mafBlock_read_next, but read from a MafScanner
+MafBlock *mafBlock_scan_next(MafScanner *scan, Hashtable *specHash, 
+                             int *numSpec) {
+  MafBlock *block=NULL;
+  MafSubBlock *sub=NULL;
+  char *line;
+  int len;
+
+  if (specHash != NULL && numSpec==NULL) 
+    die("ERROR: mafBlock_scan_next: numSpec cannot be NULL "
+	"if specHash is not NULL\n");
+
+  while ((line = mafScanner_next_line(scan, &len)) != NULL) {
+    if (mafBlock_parse_line(line, len, &block, &sub, specHash, numSpec))
+      break;
   }
+  if (block == NULL) return NULL;
+  mafBlock_finish(block);
   return block;
 }
 
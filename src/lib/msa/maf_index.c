@@ -0,0 +1,331 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Coordinate indexes for MAF files.  See maf_index.h for a
+   description of the sidecar format. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <misc.h>
+#include <maf_scan.h>
+#include <maf_index.h>
+
+static MafIndex *maf_index_new(int alloc) {
+  MafIndex *idx = smalloc(sizeof(MafIndex));
+  idx->refseq = NULL;
+  idx->sorted = 1;
+  idx->file_size = idx->file_mtime = -1;
+  idx->nblocks = 0;
+  idx->start = smalloc(alloc * sizeof(int));
+  idx->size = smalloc(alloc * sizeof(int));
+  idx->offset = smalloc(alloc * sizeof(long));
+  idx->max_end = NULL;
+  return idx;
+}
+
+static void maf_index_realloc(MafIndex *idx, int alloc) {
+  idx->start = srealloc(idx->start, alloc * sizeof(int));
+  idx->size = srealloc(idx->size, alloc * sizeof(int));
+  idx->offset = srealloc(idx->offset, alloc * sizeof(long));
+}
+
+/* compute max_end and check sortedness of starts */
+static void maf_index_finish(MafIndex *idx) {
+  int i;
+  idx->max_end = smalloc(max(idx->nblocks, 1) * sizeof(int));
+  for (i = 0; i < idx->nblocks; i++) {
+    idx->max_end[i] = idx->start[i] + idx->size[i];
+    if (i > 0) {
+      if (idx->max_end[i-1] > idx->max_end[i])
+        idx->max_end[i] = idx->max_end[i-1];
+      if (idx->start[i] < idx->start[i-1]) idx->sorted = 0;
+    }
+  }
+}
+
+/* obtain size and modification time of an open file */
+static int maf_index_file_stats(FILE *F, long *size, long *mtime) {
+  struct stat st;
+  if (fstat(fileno(F), &st) != 0 || !S_ISREG(st.st_mode)) return 1;
+  *size = (long)st.st_size;
+  *mtime = (long)st.st_mtime;
+  return 0;
+}
+
+MafIndex *maf_index_build(FILE *F) {
+  MafScanner *scan;
+  MafIndex *idx;
+  MafField f[4];
+  char *line;
+  int len, i, nfields, alloc = 10000, need_ref = 0;
+  long base, pos, val;
+
+  if ((base = ftell(F)) < 0)
+    die("ERROR maf_index_build: MAF input must be seekable\n");
+  idx = maf_index_new(alloc);
+  if (maf_index_file_stats(F, &idx->file_size, &idx->file_mtime) != 0)
+    die("ERROR maf_index_build: MAF input must be a regular file\n");
+
+  scan = mafScanner_new(F);
+  if (scan->mapped) base = 0;   /* offsets are already absolute */
+  while (1) {
+    pos = base + (long)mafScanner_tell(scan);
+    if ((line = mafScanner_next_line(scan, &len)) == NULL) break;
+    if (len == 0) continue;
+    if (line[0] == 'a') {
+      if (need_ref) idx->sorted = 0; /* block without reference */
+      if (idx->nblocks == alloc) {
+        alloc *= 2;
+        maf_index_realloc(idx, alloc);
+      }
+      idx->start[idx->nblocks] = 0;
+      idx->size[idx->nblocks] = 0;
+      idx->offset[idx->nblocks] = pos;
+      idx->nblocks++;
+      need_ref = 1;
+    }
+    else if (line[0] == 's' && need_ref) {
+      /* split only the fields needed, not the sequence itself */
+      for (nfields = 0, i = 0; nfields < 4; nfields++) {
+        while (i < len && isspace((unsigned char)line[i])) i++;
+        if (i == len) break;
+        f[nfields].s = &line[i];
+        while (i < len && !isspace((unsigned char)line[i])) i++;
+        f[nfields].len = (int)(&line[i] - f[nfields].s);
+      }
+      if (nfields < 4 || maf_field_as_int(&f[2], &val) != 0)
+        die("ERROR maf_index_build: bad sequence line in MAF file --\n\t\"%.*s\"\n",
+            len, line);
+      idx->start[idx->nblocks-1] = (int)val;
+      if (maf_field_as_int(&f[3], &val) != 0)
+        die("ERROR maf_index_build: bad sequence line in MAF file --\n\t\"%.*s\"\n",
+            len, line);
+      idx->size[idx->nblocks-1] = (int)val;
+
+      if (idx->refseq == NULL) {
+        idx->refseq = smalloc((f[1].len + 1) * sizeof(char));
+        strncpy(idx->refseq, f[1].s, f[1].len);
+        idx->refseq[f[1].len] = '\0';
+      }
+      else if ((int)strlen(idx->refseq) != f[1].len ||
+               strncmp(idx->refseq, f[1].s, f[1].len) != 0)
+        idx->sorted = 0;
+      need_ref = 0;
+    }
+    else if (line[0] == 'e' && need_ref) {
+      idx->sorted = 0;          /* block without reference */
+      need_ref = 0;
+    }
+  }
+  if (need_ref) idx->sorted = 0;
+  mafScanner_free(scan);
+
+  if (idx->refseq == NULL) idx->refseq = copy_charstr("");
+  maf_index_finish(idx);
+  return idx;
+}
+
+void maf_index_write(FILE *F, MafIndex *idx) {
+  int i;
+  fprintf(F, "##maf-index version=%i\n", MAF_INDEX_VERSION);
+  fprintf(F, "#size=%ld mtime=%ld sorted=%i nblocks=%i refseq=%s\n",
+          idx->file_size, idx->file_mtime, idx->sorted, idx->nblocks,
+          idx->refseq);
+  for (i = 0; i < idx->nblocks; i++)
+    fprintf(F, "%i %i %ld\n", idx->start[i], idx->size[i], idx->offset[i]);
+  fprintf(F, "##end\n");
+}
+
+/* read an index, returning NULL if it is malformed, truncated, or
+   of an unsupported version */
+static MafIndex *maf_index_read_no_die(FILE *F) {
+  MafIndex *idx = NULL;
+  String *line = str_new(STR_MED_LEN);
+  int alloc = 10000, start, size, version, nblocks, ok = 0;
+  long offset;
+  char *ref;
+
+  if (str_readline(line, F) == EOF ||
+      sscanf(line->chars, "##maf-index version=%i", &version) != 1 ||
+      version != MAF_INDEX_VERSION ||
+      str_readline(line, F) == EOF)
+    goto done;
+  idx = maf_index_new(alloc);
+  str_trim(line);
+  if (sscanf(line->chars, "#size=%ld mtime=%ld sorted=%i nblocks=%i",
+             &idx->file_size, &idx->file_mtime, &idx->sorted,
+             &nblocks) != 4 || nblocks < 0 ||
+      (ref = strstr(line->chars, "refseq=")) == NULL)
+    goto done;
+  idx->refseq = copy_charstr(ref + strlen("refseq="));
+
+  while (str_readline(line, F) != EOF) {
+    str_trim(line);
+    if (str_equals_charstr(line, "##end")) {
+      /* nothing may follow the trailer */
+      ok = (idx->nblocks == nblocks && str_readline(line, F) == EOF);
+      break;
+    }
+    if (sscanf(line->chars, "%i %i %ld", &start, &size, &offset) != 3 ||
+        offset < 0 || offset >= idx->file_size)
+      break;
+    if (idx->nblocks == alloc) {
+      alloc *= 2;
+      maf_index_realloc(idx, alloc);
+    }
+    idx->start[idx->nblocks] = start;
+    idx->size[idx->nblocks] = size;
+    idx->offset[idx->nblocks] = offset;
+    idx->nblocks++;
+  }
+
+ done:
+  str_free(line);
+  if (!ok) {
+    if (idx != NULL) maf_index_free(idx);
+    return NULL;
+  }
+  maf_index_finish(idx);
+  return idx;
+}
+
+MafIndex *maf_index_read(FILE *F) {
+  MafIndex *idx = maf_index_read_no_die(F);
+  if (idx == NULL)
+    die("ERROR maf_index_read: MAF index is malformed, truncated, or not version %i\n",
+        MAF_INDEX_VERSION);
+  return idx;
+}
+
+char *maf_index_fname(char *maf_fname) {
+  char *fname = smalloc((strlen(maf_fname) + strlen(MAF_INDEX_SUFFIX) + 1) *
+                        sizeof(char));
+  sprintf(fname, "%s%s", maf_fname, MAF_INDEX_SUFFIX);
+  return fname;
+}
+
+/* save an index to its sidecar file.  The index is written to a
+   temporary file which is then renamed, so that readers never see a
+   partially written index.  Returns 0 on success, 1 on failure (in
+   which case no file is left behind) */
+static int maf_index_save(char *idx_fname, MafIndex *idx) {
+  FILE *F;
+  char *tmpfname = smalloc((strlen(idx_fname) + 50) * sizeof(char));
+  int ok;
+  sprintf(tmpfname, "%s.tmp.%d", idx_fname, (int)getpid());
+  if ((F = phast_fopen_no_exit(tmpfname, "w")) == NULL) {
+    sfree(tmpfname);
+    return 1;
+  }
+  maf_index_write(F, idx);
+  ok = (fflush(F) == 0 && !ferror(F));
+  phast_fclose(F);
+  if (!ok || rename(tmpfname, idx_fname) != 0) {
+    remove(tmpfname);
+    ok = 0;
+  }
+  sfree(tmpfname);
+  return ok ? 0 : 1;
+}
+
+MafIndex *maf_index_load(char *maf_fname, int build) {
+  FILE *F, *IDXF;
+  MafIndex *idx = NULL;
+  char *idx_fname;
+  long size, mtime;
+
+  if (strcmp(maf_fname, "-") == 0 ||
+      (F = phast_fopen_no_exit(maf_fname, "r")) == NULL)
+    return NULL;
+  if (maf_index_file_stats(F, &size, &mtime) != 0) {
+    phast_fclose(F);
+    return NULL;
+  }
+
+  idx_fname = maf_index_fname(maf_fname);
+  if ((IDXF = phast_fopen_no_exit(idx_fname, "r")) != NULL) {
+    /* a malformed or truncated index is treated like a missing one */
+    idx = maf_index_read_no_die(IDXF);
+    phast_fclose(IDXF);
+    if (idx != NULL && (idx->file_size != size || idx->file_mtime != mtime)) {
+      maf_index_free(idx);      /* stale */
+      idx = NULL;
+    }
+  }
+
+  if (idx == NULL && build) {
+    idx = maf_index_build(F);
+    maf_index_save(idx_fname, idx); /* failure to save is not an error */
+  }
+
+  sfree(idx_fname);
+  phast_fclose(F);
+  return idx;
+}
+
+MafIndex *maf_index_create(char *maf_fname) {
+  FILE *F = phast_fopen(maf_fname, "r");
+  char *idx_fname = maf_index_fname(maf_fname);
+  MafIndex *idx = maf_index_build(F);
+  phast_fclose(F);
+  if (maf_index_save(idx_fname, idx) != 0)
+    die("ERROR maf_index_create: cannot write MAF index %s\n", idx_fname);
+  sfree(idx_fname);
+  return idx;
+}
+
+int maf_index_first_block(MafIndex *idx, int start) {
+  int lo = 0, hi = idx->nblocks, mid;
+  if (!idx->sorted)
+    die("ERROR maf_index_first_block: MAF index is not sorted\n");
+  /* max_end is nondecreasing; find first element > start */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (idx->max_end[mid] > start) hi = mid;
+    else lo = mid + 1;
+  }
+  return lo;
+}
+
+int maf_index_last_block(MafIndex *idx, int end) {
+  int lo = 0, hi = idx->nblocks, mid;
+  if (!idx->sorted)
+    die("ERROR maf_index_last_block: MAF index is not sorted\n");
+  /* starts are nondecreasing; find first element > end */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (idx->start[mid] > end) hi = mid;
+    else lo = mid + 1;
+  }
+  return lo;
+}
+
+int maf_index_seek(FILE *F, MafIndex *idx, int start) {
+  int b = maf_index_first_block(idx, start);
+  if (b < idx->nblocks) {
+    if (fseek(F, idx->offset[b], SEEK_SET) != 0)
+      die("ERROR maf_index_seek: cannot seek in MAF file\n");
+  }
+  else if (fseek(F, 0, SEEK_END) != 0)
+    die("ERROR maf_index_seek: cannot seek in MAF file\n");
+  return b;
+}
+
+void maf_index_free(MafIndex *idx) {
+  sfree(idx->refseq);
+  sfree(idx->start);
+  sfree(idx->size);
+  sfree(idx->offset);
+  if (idx->max_end != NULL) sfree(idx->max_end);
+  sfree(idx);
+}
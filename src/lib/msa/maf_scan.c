@@ -0,0 +1,227 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Line-oriented scanning of MAF files.  Regular files are mapped
+   into memory in their entirety and scanned in place; other streams
+   are read through a buffer that always holds at least one complete
+   line, growing if a line is longer than the buffer. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if !defined(__MINGW32__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <misc.h>
+#include <maf_scan.h>
+
+/* size of each read when the stream is not mapped */
+#define MAF_SCAN_CHUNK 1048576
+
+/* (mapped case) amount of scanned data to accumulate before releasing
+   the corresponding pages */
+#define MAF_SCAN_RELEASE 16777216
+
+/* try to map the stream from the beginning of the file, positioning
+   the scanner at the current offset.  Returns 1 on success, 0 if the
+   stream is not a regular file or cannot be mapped */
+static int mafScanner_map(MafScanner *scan) {
+#if defined(__MINGW32__)
+  return 0;
+#else
+  struct stat st;
+  long offset;
+  void *base;
+
+  if (fstat(fileno(scan->F), &st) != 0 || !S_ISREG(st.st_mode) ||
+      st.st_size == 0)
+    return 0;
+  if ((offset = ftell(scan->F)) < 0 || offset > st.st_size)
+    return 0;
+  base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+              fileno(scan->F), 0);
+  if (base == MAP_FAILED) return 0;
+#ifdef MADV_SEQUENTIAL
+  madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+  scan->buf = base;
+  scan->len = (size_t)st.st_size;
+  scan->pos = (size_t)offset;
+  scan->mapped = 1;
+  scan->eof = 1;
+  return 1;
+#endif
+}
+
+MafScanner *mafScanner_new(FILE *F) {
+  MafScanner *scan = smalloc(sizeof(MafScanner));
+  scan->F = F;
+  scan->buf = NULL;
+  scan->len = scan->pos = scan->alloc = scan->consumed = scan->released = 0;
+  scan->mapped = 0;
+  scan->shared = 0;
+  scan->eof = 0;
+  if (!mafScanner_map(scan)) {
+    scan->alloc = MAF_SCAN_CHUNK;
+    scan->buf = smalloc(scan->alloc);
+  }
+  return scan;
+}
+
+MafScanner *mafScanner_copy(MafScanner *scan) {
+  MafScanner *copy;
+  if (!scan->mapped)
+    die("ERROR mafScanner_copy: scanner is not memory-mapped\n");
+  copy = smalloc(sizeof(MafScanner));
+  *copy = *scan;
+  copy->shared = 1;
+  return copy;
+}
+
+size_t mafScanner_tell(MafScanner *scan) {
+  return scan->mapped ? scan->pos : scan->consumed + scan->pos;
+}
+
+void mafScanner_seek(MafScanner *scan, size_t offset) {
+  if (!scan->mapped)
+    die("ERROR mafScanner_seek: scanner is not memory-mapped\n");
+  if (offset > scan->len)
+    die("ERROR mafScanner_seek: offset %lu beyond end of file\n", 
+        (unsigned long)offset);
+  scan->pos = offset;
+#if !defined(__MINGW32__)
+  /* unless seeking a short distance forward, releases start over
+     from here, so that scanners sharing the mapping release only
+     what they have scanned themselves */
+  if (offset < scan->released || offset > scan->released + MAF_SCAN_RELEASE)
+    scan->released = offset / (size_t)sysconf(_SC_PAGESIZE) * 
+      (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void mafScanner_free(MafScanner *scan) {
+  if (scan->shared) {
+    sfree(scan);
+    return;
+  }
+#if !defined(__MINGW32__)
+  if (scan->mapped) {
+    munmap(scan->buf, scan->len);
+    fseek(scan->F, (long)scan->pos, SEEK_SET);
+  }
+  else
+#endif
+    sfree(scan->buf);
+  sfree(scan);
+}
+
+/* (unmapped case) discard consumed data and read more, enlarging
+   the buffer if it is already full.  Returns number of bytes read */
+static size_t mafScanner_refill(MafScanner *scan) {
+  size_t nread;
+  if (scan->pos > 0) {
+    scan->consumed += scan->pos;
+    memmove(scan->buf, &scan->buf[scan->pos], scan->len - scan->pos);
+    scan->len -= scan->pos;
+    scan->pos = 0;
+  }
+  if (scan->len == scan->alloc) {
+    scan->alloc *= 2;
+    scan->buf = srealloc(scan->buf, scan->alloc);
+  }
+  nread = fread(&scan->buf[scan->len], 1, scan->alloc - scan->len, scan->F);
+  if (nread == 0) scan->eof = 1;
+  scan->len += nread;
+  return nread;
+}
+
+/* (mapped case) release pages preceding the given offset.  The
+   mapping is private and read-only, so released pages are simply
+   read from the file again if they are accessed later; the point is
+   to keep memory use from growing with the size of the file when it
+   is scanned sequentially.  Scanners sharing a mapping may release
+   pages concurrently */
+static void mafScanner_release(MafScanner *scan, size_t offset) {
+#if !defined(__MINGW32__) && defined(MADV_DONTNEED)
+  size_t pagesize = (size_t)sysconf(_SC_PAGESIZE),
+    end = offset / pagesize * pagesize;
+  if (end > scan->released &&
+      madvise(scan->buf + scan->released, end - scan->released, 
+              MADV_DONTNEED) == 0)
+    scan->released = end;
+#endif
+}
+
+char *mafScanner_next_line(MafScanner *scan, int *len) {
+  char *start, *nl;
+  size_t searched = 0;
+
+  while (1) {
+    start = &scan->buf[scan->pos];
+    nl = memchr(start + searched, '\n', scan->len - scan->pos - searched);
+    if (nl != NULL || scan->eof) break;
+    searched = scan->len - scan->pos;
+    mafScanner_refill(scan);
+  }
+
+  if (nl == NULL) {             /* final line lacks terminator */
+    if (scan->pos == scan->len) return NULL;
+    nl = &scan->buf[scan->len];
+    scan->pos = scan->len;
+  }
+  else scan->pos = (size_t)(nl - scan->buf) + 1;
+
+  *len = (int)(nl - start);
+  if (*len > 0 && start[*len-1] == '\r') (*len)--;
+  if (scan->mapped && 
+      (size_t)(start - scan->buf) >= scan->released + MAF_SCAN_RELEASE)
+    mafScanner_release(scan, (size_t)(start - scan->buf));
+  return start;
+}
+
+int maf_split_fields(char *line, int len, MafField *fields) {
+  int i = 0, nfields = 0, start;
+  while (1) {
+    while (i < len && isspace((unsigned char)line[i])) i++;
+    if (i == len) break;
+    start = i;
+    while (i < len && !isspace((unsigned char)line[i])) i++;
+    if (nfields < MAF_MAX_FIELDS) {
+      fields[nfields].s = &line[start];
+      fields[nfields].len = i - start;
+    }
+    nfields++;
+  }
+  return nfields;
+}
+
+int maf_field_as_int(MafField *f, long *val) {
+  char tmp[32], *endptr;
+  if (f->len <= 0 || f->len >= 32) return 1;
+  memcpy(tmp, f->s, f->len);
+  tmp[f->len] = '\0';
+  *val = strtol(tmp, &endptr, 10);
+  return (endptr - tmp == f->len ? 0 : 1);
+}
+
+void maf_seq_char_table(MSA *msa, int do_toupper, char *table) {
+  int c, d;
+  for (c = 0; c < 256; c++) {
+    d = do_toupper ? toupper(c) : c;
+    if (d == '.' && msa->inv_alphabet['.'] == -1)
+      d = msa->missing[0];
+    if (d != GAP_CHAR && !msa->is_missing[d] && msa->inv_alphabet[d] == -1 &&
+        get_iupac_map()[d] == NULL)
+      d = isalpha(d) ? 'N' : 0;
+    table[c] = (char)d;
+  }
+}
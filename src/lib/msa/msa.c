@@ -114,7 +114,7 @@ MSA *msa_new_from_file_define_format(FILE *F, msa_format_type format, char *alph
     return (msa_read_fasta(F, alphabet));
   else if (format == LAV)
     return la_to_msa(la_read_lav(F, 1), 0);
-  else if (format == SS) 
+  else if (format == SS || format == BSS) 
     return ss_read(F, alphabet);
 
   //format must be PHYLIP or MPM
@@ -348,17 +348,28 @@ MSA *msa_read_fasta(FILE *F, char *alphabet) {
 /* Prints MSA to file, using specified format.  The "pretty_print"
    option causes periods ('.') to be printed in place of characters
    that are identical to corresponding characters in the first
-   sequence. */
+   sequence.  If the alignment is represented by ordered sufficient
+   statistics, sequences are extracted and printed one at a time,
+   without creating an explicit alignment. */
 void msa_print(FILE *F, MSA *msa, msa_format_type format, int pretty_print) {
-  int i, j, k;
+  int i, j, k, from_ss;
+  char *seq, *first = NULL, line[OUTPUT_LINE_LEN + 1];
   if (format == SS) {
     if (msa->ss == NULL) ss_from_msas(msa, 1, 1, NULL, NULL, NULL, -1, 0);
     ss_write(msa, F, 1);
     return;
   }
+  if (format == BSS) {
+    if (msa->ss == NULL) ss_from_msas(msa, 1, 1, NULL, NULL, NULL, -1, 0);
+    ss_write_binary(msa, F, 1);
+    return;
+  }
 
-  /* otherwise, require explicit representation of alignment */
-  if (msa->seqs == NULL && msa->ss != NULL) ss_to_msa(msa);
+  /* otherwise, require explicit representation of alignment, or at
+     least of each sequence in turn */
+  if (msa->seqs == NULL && msa->ss != NULL && msa->ss->tuple_idx == NULL) 
+    ss_to_msa(msa);
+  from_ss = (msa->seqs == NULL);
 
   if (format == PHYLIP || format == MPM)
     fprintf(F, "  %d %d\n", msa->nseqs, msa->length);
@@ -367,6 +378,8 @@ void msa_print(FILE *F, MSA *msa, msa_format_type format, int pretty_print) {
       fprintf(F, "%s\n", msa->names[i]);
   for (i = 0; i < msa->nseqs; i++) {
     checkInterrupt();
+    seq = from_ss ? ss_get_one_seq(msa, i) : msa->seqs[i];
+    if (i == 0) first = seq;
     if (format == PHYLIP)
       fprintf(F, "%-10s\n", msa->names[i]);
     else if (format == FASTA)
@@ -374,14 +387,15 @@ void msa_print(FILE *F, MSA *msa, msa_format_type format, int pretty_print) {
     for (j = 0; j < msa->length; j += OUTPUT_LINE_LEN) {
       checkInterruptN(j, 100);
       for (k = 0; k < OUTPUT_LINE_LEN && j + k < msa->length; k++) 
-        if (pretty_print && i > 0 && msa->seqs[i][j+k] == msa->seqs[0][j+k])
-          fprintf(F, ".");
-        else
-	  fprintf(F, "%c", msa->seqs[i][j+k]);
-      if (format == PHYLIP || format == FASTA) fprintf(F, "\n");
+        line[k] = (pretty_print && i > 0 && seq[j+k] == first[j+k] ? 
+                   '.' : seq[j+k]);
+      if (format == PHYLIP || format == FASTA) line[k++] = '\n';
+      fwrite(line, sizeof(char), k, F);
     }
     if (format == MPM) fprintf(F, "\n");
+    if (from_ss && (i > 0 || !pretty_print)) sfree(seq);
   }
+  if (from_ss && pretty_print && first != NULL) sfree(first);
 }
 
 void msa_print_to_file(const char *filename, MSA *msa, msa_format_type format, 
@@ -446,7 +460,8 @@ void reduce_to_4d(MSA *msa, CategoryMap *cm) {
   int i, j, k, is_4d, tuple_size = 3, idx;
   char **seq, codon[3], key[msa->nseqs * 3 + 1];
   MSA *temp_msa, *new_msa;
-  Hashtable *tuple_hash = hsh_new(msa->length);
+  TupleHash *tuple_hash = tuple_hash_new(msa, msa->nseqs * tuple_size,
+                                         msa->length);
 
   if (msa->categories == NULL)
     die("ERROR reduce_to_4d got msa->categories==NULL\n");
@@ -463,7 +478,9 @@ void reduce_to_4d(MSA *msa, CategoryMap *cm) {
     seq[i] = smalloc(3*sizeof(char));
   temp_msa = msa_new(seq, msa->names, msa->nseqs, 3, msa->alphabet);
   new_msa = msa_new(NULL, msa->names, msa->nseqs, 0, msa->alphabet);
-  ss_new(new_msa, tuple_size, msa->length, 0, 0);
+  ss_new(new_msa, tuple_size, max(min((int)msa->length, 100000), 1), 0, 0);
+                                /* grows as needed; usually far fewer
+                                   distinct tuples than columns */
 
   for (i=0; i<msa->length; i++) {
     checkInterruptN(i, 10000);
@@ -517,6 +534,8 @@ void reduce_to_4d(MSA *msa, CategoryMap *cm) {
     col_to_string(key, temp_msa, 2, 3);
     if ((idx = ss_lookup_coltuple(key, tuple_hash, new_msa)) == -1) {
       idx = new_msa->ss->ntuples++;
+      if (new_msa->ss->ntuples > new_msa->ss->alloc_ntuples)
+        ss_realloc(new_msa, tuple_size, new_msa->ss->ntuples, 0, 0);
       ss_add_coltuple(key, int_to_ptr(idx), tuple_hash, new_msa);
       new_msa->ss->col_tuples[idx] = (char*)smalloc((tuple_size * msa->nseqs + 1)*sizeof(char));
       strncpy(new_msa->ss->col_tuples[idx], key, (msa->nseqs*tuple_size+1));
@@ -542,7 +561,7 @@ void reduce_to_4d(MSA *msa, CategoryMap *cm) {
   temp_msa->names = NULL;
   msa_free(new_msa);
   msa_free(temp_msa);
-  hsh_free(tuple_hash);
+  tuple_hash_free(tuple_hash);
 }
 
 
@@ -1166,6 +1185,7 @@ void msa_add_seq_ss(MSA *msa, int new_nseqs) {
   char newchar;
   if (new_nseqs <= msa->nseqs) 
     die("ERROR: new numseq must be >= than old in ss_add_seq\n");
+  ss_unpack_tuples(msa);
   newlen = new_nseqs*msa->ss->tuple_size + 1;
   for (i=0; i<msa->ss->ntuples; i++) {
     checkInterruptN(i, 1000);
@@ -1540,6 +1560,24 @@ Vector *msa_get_base_counts(MSA *msa, int start, int end) {
     }
   }
 
+  else if (msa->seqs != NULL) { /* scan each sequence sequentially,
+                                   tallying all characters */
+    int rowcounts[NCHARS], c;
+    for (j = 0; j < msa->nseqs; j++) {
+      for (c = 0; c < NCHARS; c++) rowcounts[c] = 0;
+      for (i = s; i < e; i++) rowcounts[(unsigned char)msa->seqs[j][i]]++;
+      for (c = 0; c < NCHARS; c++) {
+        if (rowcounts[c] == 0 || c == GAP_CHAR || msa->is_missing[c]) 
+          continue;
+        if (msa->inv_alphabet[c] == -1)
+          die("ERROR: unrecognized character in alignment ('%c').\n", c);
+        vec_set(base_freqs, msa->inv_alphabet[c], 
+                vec_get(base_freqs, msa->inv_alphabet[c]) + rowcounts[c]);
+        sum += rowcounts[c];
+      }
+    }
+  }
+
   else {
     for (i = s; i < e; i++) {
       for (j = 0; j < msa->nseqs; j++) {
@@ -1690,7 +1728,7 @@ void msa_get_backgd_3x4(Vector *backgd, MSA *msa) {
     for (i=0; i < msa->ss->ntuples; i++) {
       for (spec=0; spec < msa->nseqs; spec++) {
 	for (j=0; j < 3; j++) {
-	  cod[j] = col_string_to_char(msa, msa->ss->col_tuples[i], spec, msa->ss->tuple_size, j-2);
+	  cod[j] = ss_get_char_tuple(msa, i, spec, j-2);
 	  if (msa->is_missing[(int)cod[j]] || cod[j]==GAP_CHAR) break;
 	}
 	if (j == 3 && 
@@ -1769,6 +1807,25 @@ int msa_num_gapped_cols(MSA *msa, int gap_strip_mode, int start, int end) {
     }
   }
 
+  else if (msa->seqs != NULL) { /* visit blocks of columns, scanning
+                                   each sequence sequentially */
+    char gapped[4096];
+    int bs, be;
+    for (bs = s; bs < e; bs = be) {
+      be = min(bs + 4096, e);
+      for (i = bs; i < be; i++) 
+        gapped[i-bs] = (gap_strip_mode == STRIP_ALL_GAPS ? 1 : 0);
+      for (j = 0; j < msa->nseqs; j++) {
+        char *seq = msa->seqs[j];
+        if (gap_strip_mode == STRIP_ANY_GAPS)
+          for (i = bs; i < be; i++) gapped[i-bs] |= (seq[i] == GAP_CHAR);
+        else
+          for (i = bs; i < be; i++) gapped[i-bs] &= (seq[i] == GAP_CHAR);
+      }
+      for (i = bs; i < be; i++) k += gapped[i-bs];
+    }
+  }
+
   else {
     for (i = s; i < e; i++) {
       has_gap = (gap_strip_mode == STRIP_ALL_GAPS ? 1 : 0);
@@ -2536,11 +2593,54 @@ char msa_get_char(MSA *msa, int seq, int pos) {
   else return ss_get_char_pos(msa, pos, seq, 0);
 }
 
+MSA_ColBlock *msa_colblock_new(MSA *msa, int ncontext, int max_cols) {
+  MSA_ColBlock *cb = smalloc(sizeof(MSA_ColBlock));
+  if (ncontext < 0)
+    die("ERROR msa_colblock_new: ncontext must be non-negative\n");
+  if (max_cols <= 0)             /* no larger than needed for msa */
+    max_cols = min(max(MSA_COLBLOCK_BYTES / max(msa->nseqs, 1), 16),
+                   max((int)msa->length, 1));
+  cb->nseqs = msa->nseqs;
+  cb->ncontext = ncontext;
+  cb->max_cols = max_cols;
+  cb->start = cb->end = 0;
+  cb->data = smalloc((size_t)(max_cols + ncontext) * max(msa->nseqs, 1) *
+                     sizeof(char));
+  return cb;
+}
+
+/* each row is read sequentially; writes are strided but confined to
+   a block small enough to remain in cache */
+void msa_colblock_load(MSA_ColBlock *cb, MSA *msa, int start) {
+  int j, col, first = start - cb->ncontext;
+  char *src, *dest;
+  if (msa->seqs == NULL)
+    die("ERROR msa_colblock_load: alignment must have explicit sequences\n");
+  if (msa->nseqs != cb->nseqs)
+    die("ERROR msa_colblock_load: wrong number of sequences\n");
+  cb->start = start;
+  cb->end = min(start + cb->max_cols, (int)msa->length);
+  for (j = 0; j < cb->nseqs; j++) {
+    src = msa->seqs[j];
+    dest = &cb->data[j];
+    for (col = first; col < 0 && col < cb->end; col++, dest += cb->nseqs)
+      *dest = GAP_CHAR;
+    for (; col < cb->end; col++, dest += cb->nseqs)
+      *dest = src[col];
+  }
+}
+
+void msa_colblock_free(MSA_ColBlock *cb) {
+  sfree(cb->data);
+  sfree(cb);
+}
+
 /* get format type indicated by string */
 msa_format_type msa_str_to_format(const char *str) {
   if (!strcmp(str, "MPM")) return MPM;
   else if (!strcmp(str, "FASTA")) return FASTA;
   else if (!strcmp(str, "SS")) return SS;
+  else if (!strcmp(str, "BSS")) return BSS;
   else if (!strcmp(str, "LAV")) return LAV;
   else if (!strcmp(str, "PHYLIP")) return PHYLIP;
   else if (!strcmp(str, "MAF")) return MAF;
@@ -2554,6 +2654,7 @@ char *msa_format_to_str(msa_format_type format) {
   if (format == PHYLIP) return "PHYLIP";
   if (format == MPM) return "MPM";
   if (format == SS) return "SS";
+  if (format == BSS) return "BSS";
   if (format == MAF) return "MAF";
   return "UNKNOWN";
 }
@@ -2567,6 +2668,7 @@ msa_format_type msa_format_for_suffix(const char *fname) {
   if (str_equals_charstr(s, "mpm")) retval = MPM;
   else if (str_equals_charstr(s, "fa")) retval = FASTA;
   else if (str_equals_charstr(s, "ss")) retval = SS;
+  else if (str_equals_charstr(s, "bss")) retval = BSS;
   else if (str_equals_charstr(s, "lav")) retval = LAV;
   else if (str_equals_charstr(s, "ph") ||
 	   str_equals_charstr(s, "phy")) retval = PHYLIP;
@@ -2593,8 +2695,10 @@ msa_format_type msa_format_for_content(FILE *F, int die_if_unknown) {
   lav_re = str_re_new("^#:lav.*");
   maf_re = str_re_new("^##maf");
 
-  //Check if file has a Sufficent Statistics header
-  if(str_re_match(line, ss_re, matches, 1) >= 0) {
+  //Check if file has a Sufficent Statistics header (text or binary;
+  //ss_read handles both)
+  if(str_re_match(line, ss_re, matches, 1) >= 0 ||
+     str_starts_with_charstr(line, SS_BINARY_MAGIC)) {
     retval = SS;
   }
   //Check if file has a PHYLIP/MPM header
@@ -2657,6 +2761,8 @@ char *msa_suffix_for_format(msa_format_type t) {
     return "mpm";
   case SS:
     return "ss";
+  case BSS:
+    return "bss";
   case MAF:
     return "maf";
   default:
@@ -2827,6 +2933,7 @@ void msa_missing_to_gaps(MSA *msa, int refseq) {
     die("ERROR msa_missing_to_gaps: msa->seqs is NULL and msa->ss is NULL\n");
 
   if (msa->ss != NULL) {
+    ss_unpack_tuples(msa);
     for (i = 0; i < msa->ss->ntuples; i++) {
       checkInterruptN(i, 10000);
       for (j = 0; j < msa->nseqs; j++) {
@@ -2900,6 +3007,7 @@ void msa_toupper(MSA *msa) {
 
   /* now replace all lowercase chars in alignment */
   if (msa->ss != NULL) {
+    ss_unpack_tuples(msa);
     for (i = 0; i < msa->ss->ntuples; i++) {
       checkInterruptN(i, 10000);
       for (j = 0; j < msa->nseqs; j++) 
@@ -69,15 +69,16 @@
 
 void ss_from_msas(MSA *msa, int tuple_size, int store_order, 
                   List *cats_to_do, MSA *source_msa, 
-                  Hashtable *existing_hash,
+                  TupleHash *existing_hash,
                   int idx_offset, int non_overlapping) {
   int i, j, do_cats, idx, upper_bound;
   int max_tuples;
   MSA_SS *main_ss, *source_ss = NULL;
-  Hashtable *tuple_hash = NULL;
+  TupleHash *tuple_hash = NULL;
   int *do_cat_number = NULL;
   char key[msa->nseqs * tuple_size + 1];
   MSA *smsa;
+  MSA_ColBlock *cb = NULL;
   int effective_offset = (idx_offset < 0 ? 0 : idx_offset); 
 
   if (source_msa == NULL && 
@@ -101,7 +102,9 @@ void ss_from_msas(MSA *msa, int tuple_size, int store_order,
     if (msa->ncats >= 0 && source_msa->ncats >= 0 && 
         msa->ncats != source_msa->ncats)
       die("ERROR: (ss_from_msas) numbers of categories must be equal in source and destination alignments.\n");
+    if (source_msa->ss != NULL) ss_unpack_tuples(source_msa);
   }
+  if (msa->ss != NULL) ss_unpack_tuples(msa);
 
   do_cats = (msa->ncats >= 0);
   key[msa->nseqs * tuple_size] = '\0';
@@ -148,7 +151,8 @@ void ss_from_msas(MSA *msa, int tuple_size, int store_order,
 
 
   main_ss = msa->ss;
-  tuple_hash = existing_hash != NULL ? existing_hash : hsh_new((int)((double)max_tuples/3));
+  tuple_hash = existing_hash != NULL ? existing_hash : 
+    tuple_hash_new(msa, msa->nseqs * tuple_size, (int)((double)max_tuples/3));
 
   if (source_msa != NULL && source_msa->ss != NULL)
     source_ss = source_msa->ss;
@@ -196,13 +200,20 @@ void ss_from_msas(MSA *msa, int tuple_size, int store_order,
         continue;
       }
 
-      if (smsa->seqs != NULL)
-        col_to_string(key, smsa, i, tuple_size);
-      else                      /* NOTE: must have ordered suff stats */
+      if (smsa->seqs != NULL) { /* read columns from column-major
+                                   blocks */
+        if (cb == NULL) cb = msa_colblock_new(smsa, tuple_size - 1, -1);
+        if (i >= cb->end) msa_colblock_load(cb, smsa, i);
+        colblock_to_string(key, cb, i, tuple_size);
+        idx = tuple_hash_lookup(tuple_hash, key, msa->nseqs, tuple_size);
+      }
+      else {                    /* NOTE: must have ordered suff stats */
         strncpy(key, smsa->ss->col_tuples[smsa->ss->tuple_idx[i]], 
 		(msa->nseqs * tuple_size + 1));
+        idx = ss_lookup_coltuple(key, tuple_hash, msa);
+      }
 
-      if ((idx = ss_lookup_coltuple(key, tuple_hash, msa)) == -1) {
+      if (idx == -1) {
                                 /* column tuple has not been seen
                                    before */
         idx = main_ss->ntuples++;
@@ -231,11 +242,13 @@ void ss_from_msas(MSA *msa, int tuple_size, int store_order,
     }
   }
 
+  if (cb != NULL) msa_colblock_free(cb);
+
   if (existing_hash == NULL) {
     ss_compact(main_ss);        /* only compact if it looks like this
                                    function is not being called
                                    repeatedly */
-    hsh_free(tuple_hash);
+    tuple_hash_free(tuple_hash);
   }
 
   if (do_cats) sfree(do_cat_number);
@@ -268,6 +281,8 @@ void ss_new(MSA *msa, int tuple_size, int max_ntuples, int do_cats,
   }
   ss->col_tuples = (char**)smalloc(max_ntuples * sizeof(char*));
   for (i = 0; i < max_ntuples; i++) ss->col_tuples[i] = NULL;
+  ss->packed_tuples = NULL;
+  ss->packed_len = 0;
   ss->counts = (double*)smalloc(max_ntuples * sizeof(double));
   for (i = 0; i < max_ntuples; i++) ss->counts[i] = 0; 
   if (do_cats) {
@@ -290,6 +305,7 @@ void ss_realloc(MSA *msa, int tuple_size, int max_ntuples, int do_cats,
 
   int i, j, cat_counts_done = FALSE, old_alloc_len;
   MSA_SS *ss = msa->ss;
+  ss_unpack_tuples(msa);
   if (store_order && msa->length > ss->alloc_len) {
     old_alloc_len = ss->alloc_len;
     ss->alloc_len = max(ss->alloc_len * 2, msa->length);
@@ -342,8 +358,7 @@ PooledMSA *ss_pooled_from_msas(List *source_msas, int tuple_size, int ncats,
   int i, j;
   MSA *rep_msa;
   PooledMSA *pmsa = (PooledMSA*)smalloc(sizeof(PooledMSA));
-  Hashtable *tuple_hash = hsh_new(100000); /* wild guess on size.  Big
-                                              enough?  Preview files? */
+  TupleHash *tuple_hash;
   char *key;
 
   if (lst_size(source_msas) <= 0)
@@ -352,6 +367,8 @@ PooledMSA *ss_pooled_from_msas(List *source_msas, int tuple_size, int ncats,
   rep_msa = (MSA*)lst_get_ptr(source_msas, 0);
 
   pmsa->pooled_msa = msa_new(NULL, NULL, rep_msa->nseqs, 0, rep_msa->alphabet);
+  tuple_hash = tuple_hash_new(pmsa->pooled_msa, rep_msa->nseqs * tuple_size,
+                              100000);
   pmsa->source_msas = source_msas;
   pmsa->pooled_msa->names = (char**)smalloc(rep_msa->nseqs * sizeof(char*));
   for (i = 0; i < rep_msa->nseqs; i++) 
@@ -389,7 +406,7 @@ PooledMSA *ss_pooled_from_msas(List *source_msas, int tuple_size, int ncats,
 	    i, j, pmsa->tuple_idx_map[i][j]);
     }
   }
-  hsh_free(tuple_hash);
+  tuple_hash_free(tuple_hash);
   sfree(key);
   return pmsa;
 }
@@ -423,7 +440,7 @@ MSA *ss_aggregate_from_files(List *fnames,
                              int cycle_size) {
 
   MSA *retval;
-  Hashtable *tuple_hash = hsh_new(100000);
+  TupleHash *tuple_hash;
   int nseqs = lst_size(seqnames);
   MSA *source_msa = NULL;
   int i, j;
@@ -439,6 +456,7 @@ MSA *ss_aggregate_from_files(List *fnames,
 
   retval = msa_new(NULL, names, nseqs, 0, NULL);
   retval->ncats = cycle_size > 0 ? cycle_size : -1;
+  tuple_hash = tuple_hash_new(retval, nseqs * tuple_size, 100000);
 
   for (i = 0; i < lst_size(fnames); i++) {
     String *fname = lst_get_ptr(fnames, i);
@@ -482,7 +500,7 @@ MSA *ss_aggregate_from_files(List *fnames,
     msa_free(source_msa);
   }
 
-  hsh_free(tuple_hash);
+  tuple_hash_free(tuple_hash);
   return retval;
 }
 
@@ -497,8 +515,7 @@ char *ss_get_one_seq(MSA *msa, int spec) {
     col = 0;
     for (i=0; i<msa->ss->ntuples; i++) {
       checkInterruptN(i, 1000);
-      c = col_string_to_char(msa, msa->ss->col_tuples[i], spec,
-			     msa->ss->tuple_size, 0);
+      c = ss_get_char_tuple(msa, i, spec, 0);
       while (col + msa->ss->counts[i] > msa->length) {  
 	//this shouldn't happen, but the length isn't necessarily initialized
 	//when SS is created
@@ -513,9 +530,7 @@ char *ss_get_one_seq(MSA *msa, int spec) {
       seq = srealloc(seq, (col+1)*sizeof(char));
   } else { /* ordered sufficient stats */
     for (col = 0; col < msa->length; col++) {
-      seq[col] = col_string_to_char(msa, 
-				    msa->ss->col_tuples[msa->ss->tuple_idx[col]], 
-				    spec, msa->ss->tuple_size, 0);
+      seq[col] = ss_get_char_pos(msa, col, spec, 0);
     }
   }
   return seq;
@@ -646,6 +661,146 @@ void ss_write(MSA *msa, FILE *F, int show_order) {
   }
 }
 
+/* flags in header of binary SS files */
+#define SS_BINARY_ORDERED 1
+#define SS_BINARY_CATS 2
+#define SS_BINARY_PACKED 4
+
+/* round a section size up to a multiple of 8 bytes */
+#define SS_BINARY_PAD(n) (((n) + 7) & ~((size_t)7))
+
+/* write a section of n bytes followed by padding (data may be NULL
+   if the section has already been written) */
+static void ss_write_section(FILE *F, const void *data, size_t n) {
+  static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  if ((data != NULL && n > 0 && fwrite(data, 1, n, F) != n) ||
+      fwrite(zeros, 1, SS_BINARY_PAD(n) - n, F) != SS_BINARY_PAD(n) - n)
+    die("ERROR ss_write_binary: error writing sufficient statistics\n");
+}
+
+/* read a section of n bytes followed by padding (data may be NULL if
+   the section has already been read) */
+static void ss_read_section(FILE *F, void *data, size_t n) {
+  char pad[8];
+  if ((data != NULL && n > 0 && fread(data, 1, n, F) != n) ||
+      fread(pad, 1, SS_BINARY_PAD(n) - n, F) != SS_BINARY_PAD(n) - n)
+    die("ERROR ss_read_binary: unexpected end of file\n");
+}
+
+/* Pack column tuples at four bits per character into a newly
+   allocated array, without modifying msa.  Codes are assigned to
+   characters in order of first appearance and stored in chars.
+   Returns NULL if there are too many distinct characters */
+static unsigned char *ss_pack_tuples_copy(MSA *msa, char *chars,
+                                          int *packed_len) {
+  MSA_SS *ss = msa->ss;
+  int len = msa->nseqs * ss->tuple_size, nchars = 0, i, j;
+  int code[256];
+  unsigned char c, *packed, *retval;
+
+  for (i = 0; i < 256; i++) code[i] = -1;
+  for (i = 0; i < ss->ntuples; i++) {
+    for (j = 0; j < len; j++) {
+      c = (unsigned char)ss->col_tuples[i][j];
+      if (code[c] == -1) {
+        if (nchars == SS_PACKED_NCHARS) return NULL;
+        code[c] = nchars;
+        chars[nchars++] = (char)c;
+      }
+    }
+  }
+  for (i = nchars; i < SS_PACKED_NCHARS; i++) chars[i] = '\0';
+
+  *packed_len = (len + 1) / 2;
+  retval = smalloc(max(1, (size_t)ss->ntuples * *packed_len));
+  for (i = 0; i < ss->ntuples; i++) {
+    checkInterruptN(i, 10000);
+    packed = &retval[(size_t)i * *packed_len];
+    for (j = 0; j < *packed_len; j++) packed[j] = 0;
+    for (j = 0; j < len; j++)
+      packed[j >> 1] |= 
+        code[(unsigned char)ss->col_tuples[i][j]] << ((j & 1) ? 4 : 0);
+  }
+  return retval;
+}
+
+void ss_write_binary(MSA *msa, FILE *F, int show_order) {
+  MSA_SS *ss = msa->ss;
+  int hdr[SS_BINARY_NFIELDS], i, len = msa->nseqs * ss->tuple_size, 
+    packed, packed_len, do_cats, ordered, names_len = 0;
+  char magic[SS_BINARY_MAGIC_LEN], packed_chars[SS_PACKED_NCHARS], 
+    *names, *p;
+  unsigned char *packed_tuples = NULL;
+  size_t tuple_bytes;
+
+  /* write tuples packed if possible, but leave msa as it is; if they
+     are not already packed, pack them into a temporary copy */
+  if (ss->packed_tuples != NULL) {
+    memcpy(packed_chars, ss->packed_chars, SS_PACKED_NCHARS);
+    packed_len = ss->packed_len;
+  }
+  else 
+    packed_tuples = ss_pack_tuples_copy(msa, packed_chars, &packed_len);
+  packed = (ss->packed_tuples != NULL || packed_tuples != NULL);
+  do_cats = (msa->ncats > 0 && ss->cat_counts != NULL);
+  ordered = (show_order && ss->tuple_idx != NULL);
+  tuple_bytes = packed ? packed_len : len;
+
+  for (i = 0; i < msa->nseqs; i++) names_len += strlen(msa->names[i]) + 1;
+  names = smalloc(names_len * sizeof(char));
+  for (i = 0, p = names; i < msa->nseqs; i++) {
+    strcpy(p, msa->names[i]);
+    p += strlen(msa->names[i]) + 1;
+  }
+
+  hdr[0] = SS_BINARY_BYTE_ORDER;
+  hdr[1] = msa->nseqs;
+  hdr[2] = ss->tuple_size;
+  hdr[3] = ss->ntuples;
+  hdr[4] = (int)msa->length;
+  hdr[5] = msa->ncats;
+  hdr[6] = msa->idx_offset;
+  hdr[7] = (ordered ? SS_BINARY_ORDERED : 0) | (do_cats ? SS_BINARY_CATS : 0) |
+    (packed ? SS_BINARY_PACKED : 0);
+  hdr[8] = names_len;
+  hdr[9] = strlen(msa->alphabet) + 1;
+  hdr[10] = (int)tuple_bytes;
+  hdr[11] = 0;
+
+  memset(magic, 0, SS_BINARY_MAGIC_LEN);
+  strcpy(magic, SS_BINARY_MAGIC);
+  ss_write_section(F, magic, SS_BINARY_MAGIC_LEN);
+  ss_write_section(F, hdr, sizeof(hdr));
+  if (packed) ss_write_section(F, packed_chars, SS_PACKED_NCHARS);
+  else {
+    char nochars[SS_PACKED_NCHARS];
+    memset(nochars, 0, SS_PACKED_NCHARS);
+    ss_write_section(F, nochars, SS_PACKED_NCHARS);
+  }
+  ss_write_section(F, names, names_len);
+  ss_write_section(F, msa->alphabet, hdr[9]);
+
+  if (packed)
+    ss_write_section(F, packed_tuples != NULL ? packed_tuples : 
+                     ss->packed_tuples, ss->ntuples * tuple_bytes);
+  else {
+    for (i = 0; i < ss->ntuples; i++) {
+      checkInterruptN(i, 10000);
+      if (fwrite(ss->col_tuples[i], 1, len, F) != (size_t)len)
+        die("ERROR ss_write_binary: error writing sufficient statistics\n");
+    }
+    ss_write_section(F, NULL, ss->ntuples * tuple_bytes);
+  }
+  ss_write_section(F, ss->counts, ss->ntuples * sizeof(double));
+  if (do_cats)
+    for (i = 0; i <= msa->ncats; i++)
+      ss_write_section(F, ss->cat_counts[i], ss->ntuples * sizeof(double));
+  if (ordered)
+    ss_write_section(F, ss->tuple_idx, msa->length * sizeof(int));
+  sfree(names);
+  if (packed_tuples != NULL) sfree(packed_tuples);
+}
+
 /* make reading order optional?  alphabet argument overrides alphabet
    in file (use NULL to use version in file) */
 MSA* ss_read(FILE *F, char *alphabet) {
@@ -658,6 +813,13 @@ MSA* ss_read(FILE *F, char *alphabet) {
   List *matches;
   char **names = NULL;
 
+  line = str_new(STR_MED_LEN);
+  if (str_peek_next_line(line, F) != EOF && 
+      str_starts_with_charstr(line, SS_BINARY_MAGIC)) {
+    str_free(line);
+    return ss_read_binary(F, alphabet);
+  }
+
   nseqs_re = str_re_new("NSEQS[[:space:]]*=[[:space:]]*([0-9]+)");
   length_re = str_re_new("LENGTH[[:space:]]*=[[:space:]]*([0-9]+)");
   tuple_size_re = str_re_new("TUPLE_SIZE[[:space:]]*=[[:space:]]*([0-9]+)");
@@ -669,7 +831,6 @@ MSA* ss_read(FILE *F, char *alphabet) {
   tuple_re = str_re_new("^([0-9]+)[[:space:]]+([-.^A-Za-z ]+)[[:space:]]+([0-9.[:space:]]+)");
   order_re = str_re_new("TUPLE_IDX_ORDER:");
 
-  line = str_new(STR_MED_LEN);
   matches = lst_new_ptr(3);
   nseqs = length = tuple_size = ntuples = -1;
 
@@ -812,6 +973,92 @@ MSA* ss_read(FILE *F, char *alphabet) {
   return msa;
 }
 
+MSA* ss_read_binary(FILE *F, char *alphabet) {
+  int hdr[SS_BINARY_NFIELDS], i, nseqs, tuple_size, ntuples, ncats, flags, 
+    len;
+  char magic[SS_BINARY_MAGIC_LEN], packed_chars[SS_PACKED_NCHARS], 
+    *namebuf, *alph, **names, *p;
+  size_t tuple_bytes;
+  MSA *msa;
+  MSA_SS *ss;
+
+  ss_read_section(F, magic, SS_BINARY_MAGIC_LEN);
+  if (strncmp(magic, SS_BINARY_MAGIC, strlen(SS_BINARY_MAGIC)) != 0)
+    die("ERROR ss_read_binary: not a binary sufficient statistics file\n");
+  ss_read_section(F, hdr, sizeof(hdr));
+  if (hdr[0] != SS_BINARY_BYTE_ORDER)
+    die("ERROR ss_read_binary: file was written on a machine with a different byte order\n");
+  nseqs = hdr[1];
+  tuple_size = hdr[2];
+  ntuples = hdr[3];
+  ncats = hdr[5];
+  flags = hdr[7];
+  tuple_bytes = (size_t)hdr[10];
+  len = nseqs * tuple_size;
+  if (nseqs <= 0 || tuple_size <= 0 || ntuples < 0 || hdr[8] <= 0 || 
+      hdr[9] <= 0 || tuple_bytes != (size_t)((flags & SS_BINARY_PACKED) ? 
+                                             (len + 1) / 2 : len))
+    die("ERROR ss_read_binary: bad header in binary sufficient statistics file\n");
+  ss_read_section(F, packed_chars, SS_PACKED_NCHARS);
+
+  namebuf = smalloc(hdr[8] * sizeof(char));
+  ss_read_section(F, namebuf, hdr[8]);
+  alph = smalloc(hdr[9] * sizeof(char));
+  ss_read_section(F, alph, hdr[9]);
+  if (namebuf[hdr[8]-1] != '\0' || alph[hdr[9]-1] != '\0')
+    die("ERROR ss_read_binary: bad header in binary sufficient statistics file\n");
+  names = smalloc(nseqs * sizeof(char*));
+  for (i = 0, p = namebuf; i < nseqs; i++) {
+    if (p >= namebuf + hdr[8])
+      die("ERROR ss_read_binary: too few sequence names\n");
+    names[i] = copy_charstr(p);
+    p += strlen(p) + 1;
+  }
+  sfree(namebuf);
+
+  msa = msa_new(NULL, names, nseqs, (unsigned int)hdr[4], 
+                alphabet != NULL ? alphabet : alph);
+                                /* allow alphabet from file to be overridden */
+  sfree(alph);
+  if (ncats > 0) msa->ncats = ncats;
+  msa->idx_offset = hdr[6];
+  ss_new(msa, tuple_size, max(ntuples, 1), (flags & SS_BINARY_CATS) ? 1 : 0, 0);
+  ss = msa->ss;
+  ss->ntuples = ntuples;
+
+  if (flags & SS_BINARY_PACKED) {
+    sfree(ss->col_tuples);
+    ss->col_tuples = NULL;
+    ss->packed_len = (int)tuple_bytes;
+    memcpy(ss->packed_chars, packed_chars, SS_PACKED_NCHARS);
+    ss->packed_tuples = smalloc(max(1, ntuples * tuple_bytes));
+    ss_read_section(F, ss->packed_tuples, ntuples * tuple_bytes);
+  }
+  else {
+    for (i = 0; i < ntuples; i++) {
+      checkInterruptN(i, 10000);
+      ss->col_tuples[i] = smalloc((len + 1) * sizeof(char));
+      if (fread(ss->col_tuples[i], 1, len, F) != (size_t)len)
+        die("ERROR ss_read_binary: unexpected end of file\n");
+      ss->col_tuples[i][len] = '\0';
+    }
+    ss_read_section(F, NULL, ntuples * tuple_bytes);
+  }
+  ss_read_section(F, ss->counts, ntuples * sizeof(double));
+  if (flags & SS_BINARY_CATS)
+    for (i = 0; i <= msa->ncats; i++)
+      ss_read_section(F, ss->cat_counts[i], ntuples * sizeof(double));
+  if (flags & SS_BINARY_ORDERED) {
+    ss->tuple_idx = smalloc(ss->alloc_len * sizeof(int));
+    ss_read_section(F, ss->tuple_idx, msa->length * sizeof(int));
+    for (i = 0; i < msa->length; i++)
+      if (ss->tuple_idx[i] < 0 || ss->tuple_idx[i] >= ntuples)
+        die("ERROR ss_read_binary: tuple index out of bounds\n");
+    for (; i < ss->alloc_len; i++) ss->tuple_idx[i] = -1;
+  }
+  return msa;
+}
+
 void ss_free_categories(MSA_SS *ss) {
   int j;
   if (ss->cat_counts != NULL) {
@@ -826,9 +1073,12 @@ void ss_free_categories(MSA_SS *ss) {
 /* free all memory associated with a sufficient stats object */
 void ss_free(MSA_SS *ss) {
   int j;
-  for (j = 0; j < ss->alloc_ntuples; j++)
-    sfree(ss->col_tuples[j]);
-  sfree(ss->col_tuples);
+  if (ss->packed_tuples != NULL) sfree(ss->packed_tuples);
+  else {
+    for (j = 0; j < ss->alloc_ntuples; j++)
+      sfree(ss->col_tuples[j]);
+    sfree(ss->col_tuples);
+  }
   ss_free_categories(ss);
   if (ss->counts != NULL) sfree(ss->counts);
   if (ss->tuple_idx != NULL) sfree(ss->tuple_idx);
@@ -864,8 +1114,9 @@ void ss_update_categories(MSA *msa) {
 /* Shrinks arrays to size ss->ntuples. */
 void ss_compact(MSA_SS *ss) {
   int j;
-  ss->col_tuples = (char**)srealloc(ss->col_tuples, 
-                                    ss->ntuples*sizeof(char*));
+  if (ss->packed_tuples == NULL) /* packed tuples are already compact */
+    ss->col_tuples = (char**)srealloc(ss->col_tuples, 
+                                      ss->ntuples*sizeof(char*));
   ss->counts = (double*)srealloc(ss->counts, 
                                 ss->ntuples*sizeof(double));
   for (j = 0; ss->cat_counts != NULL && j <= ss->msa->ncats; j++)
@@ -874,6 +1125,52 @@ void ss_compact(MSA_SS *ss) {
   ss->alloc_ntuples = ss->ntuples;
 }
 
+int ss_pack_tuples(MSA *msa) {
+  MSA_SS *ss = msa->ss;
+  unsigned char *packed;
+  int i;
+
+  if (ss->packed_tuples != NULL) return 0;
+  if ((packed = ss_pack_tuples_copy(msa, ss->packed_chars, 
+                                    &ss->packed_len)) == NULL) {
+    ss->packed_len = 0;
+    return 1;
+  }
+  ss->packed_tuples = packed;
+
+  for (i = 0; i < ss->alloc_ntuples; i++)
+    if (ss->col_tuples[i] != NULL) sfree(ss->col_tuples[i]);
+  sfree(ss->col_tuples);
+  ss->col_tuples = NULL;
+  return 0;
+}
+
+void ss_unpack_tuples(MSA *msa) {
+  MSA_SS *ss = msa->ss;
+  int len = msa->nseqs * ss->tuple_size, i, j;
+  unsigned char *packed;
+
+  if (ss->packed_tuples == NULL) return;
+
+  ss->col_tuples = smalloc(max(1, ss->alloc_ntuples) * sizeof(char*));
+  for (i = 0; i < ss->alloc_ntuples; i++) {
+    if (i >= ss->ntuples) {
+      ss->col_tuples[i] = NULL;
+      continue;
+    }
+    checkInterruptN(i, 10000);
+    packed = &ss->packed_tuples[(size_t)i * ss->packed_len];
+    ss->col_tuples[i] = smalloc((len + 1) * sizeof(char));
+    for (j = 0; j < len; j++)
+      ss->col_tuples[i][j] = 
+        ss->packed_chars[(j & 1) ? (packed[j >> 1] >> 4) : (packed[j >> 1] & 0xf)];
+    ss->col_tuples[i][len] = '\0';
+  }
+  sfree(ss->packed_tuples);
+  ss->packed_tuples = NULL;
+  ss->packed_len = 0;
+}
+
 /* given an MSA (with or without suff stats), create an alternative
    representation with sufficient statistics of a different tuple
    size.  The new alignment will share the seqs and names of the old
@@ -984,7 +1281,7 @@ MSA *ss_sub_alignment(MSA *msa, char **new_names, List *include_list,
       for (i = 0; i < lst_size(include_list); i++) {
         seqidx = lst_get_int(include_list, i);
 	ss->col_tuples[sub_tupidx][ss->tuple_size*i + ss->tuple_size-1 + offset] =
-	  msa->ss->col_tuples[tupidx][msa->ss->tuple_size*seqidx + msa->ss->tuple_size-1 + offset];
+	  ss_get_char_tuple(msa, tupidx, seqidx, offset);
       }
     }
     full_to_sub[tupidx] = sub_tupidx++;
@@ -1031,6 +1328,151 @@ MSA *ss_sub_alignment(MSA *msa, char **new_names, List *include_list,
 }
 
 
+/* create object for sliding a window along an alignment with ordered
+   sufficient statistics.  See header file for details */
+SS_Window *ss_window_new(MSA *msa, List *cats_to_do) {
+  SS_Window *w;
+  int i, cat;
+
+  if (msa->ss == NULL || msa->ss->tuple_idx == NULL)
+    die("ERROR: ordered sufficient statistics required in ss_window_new.\n");
+  ss_unpack_tuples(msa);
+
+  w = (SS_Window*)smalloc(sizeof(SS_Window));
+  w->msa = msa;
+  w->beg = w->end = 0;
+  w->counts = (double*)smalloc(msa->ss->ntuples * sizeof(double));
+  w->full_to_sub = (int*)smalloc(msa->ss->ntuples * sizeof(int));
+  for (i = 0; i < msa->ss->ntuples; i++) {
+    w->counts[i] = 0;
+    w->full_to_sub[i] = -1;
+  }
+  w->cat_counts = NULL;
+  w->do_cat = NULL;
+  if (msa->ncats >= 0 && msa->categories != NULL) {
+    w->cat_counts = (double**)smalloc((msa->ncats+1) * sizeof(double*));
+    for (cat = 0; cat <= msa->ncats; cat++) {
+      w->cat_counts[cat] = (double*)smalloc(msa->ss->ntuples * sizeof(double));
+      for (i = 0; i < msa->ss->ntuples; i++) w->cat_counts[cat][i] = 0;
+    }
+    if (cats_to_do != NULL) {
+      w->do_cat = (int*)smalloc((msa->ncats+1) * sizeof(int));
+      for (cat = 0; cat <= msa->ncats; cat++) w->do_cat[cat] = FALSE;
+      for (i = 0; i < lst_size(cats_to_do); i++) {
+        cat = lst_get_int(cats_to_do, i);
+        if (cat >= 0 && cat <= msa->ncats) w->do_cat[cat] = TRUE;
+      }
+    }
+  }
+  return w;
+}
+
+void ss_window_free(SS_Window *w) {
+  int cat;
+  if (w->cat_counts != NULL) {
+    for (cat = 0; cat <= w->msa->ncats; cat++)
+      sfree(w->cat_counts[cat]);
+    sfree(w->cat_counts);
+  }
+  if (w->do_cat != NULL) sfree(w->do_cat);
+  sfree(w->counts);
+  sfree(w->full_to_sub);
+  sfree(w);
+}
+
+/* add (incr = 1) or remove (incr = -1) a column of the full alignment
+   to or from the window counts */
+static void ss_window_count(SS_Window *w, int col, double incr) {
+  int tup = w->msa->ss->tuple_idx[col];
+  if (tup < 0) return;          /* column excluded from suff stats */
+  w->counts[tup] += incr;
+  if (w->cat_counts != NULL)
+    w->cat_counts[w->msa->categories[col]][tup] += incr;
+}
+
+void ss_window_set(SS_Window *w, int start_col, int end_col) {
+  int i;
+
+  if (start_col < 0 || end_col > w->msa->length || start_col >= end_col)
+    die("ERROR ss_window_set: bad window [%i, %i) (alignment length %i)\n",
+        start_col, end_col, w->msa->length);
+
+  /* columns leaving on the left and right, then entering on the left
+     and right; if the old and new windows do not overlap, this
+     amounts to starting over */
+  for (i = w->beg; i < min(w->end, start_col); i++)
+    ss_window_count(w, i, -1);
+  for (i = max(w->beg, end_col); i < w->end; i++)
+    ss_window_count(w, i, -1);
+  for (i = start_col; i < min(end_col, w->beg); i++)
+    ss_window_count(w, i, 1);
+  for (i = max(start_col, w->end); i < end_col; i++)
+    ss_window_count(w, i, 1);
+
+  w->beg = start_col;
+  w->end = end_col;
+}
+
+MSA *ss_window_msa(SS_Window *w) {
+  MSA *msa = w->msa, *retval;
+  MSA_SS *ss;
+  int i, col, tup, pass, cat, ntuples = 0, len = w->end - w->beg,
+    tuple_len = msa->nseqs * msa->ss->tuple_size,
+    do_cats = (w->cat_counts != NULL);
+  char **names = (char**)smalloc(msa->nseqs * sizeof(char*));
+  int *sub_to_full = (int*)smalloc(len * sizeof(int));
+
+  for (i = 0; i < msa->nseqs; i++)
+    names[i] = copy_charstr(msa->names[i]);
+  retval = msa_new(NULL, names, msa->nseqs, len, msa->alphabet);
+  if (do_cats) {
+    retval->ncats = msa->ncats;
+    retval->categories = (int*)smalloc(len * sizeof(int));
+    for (i = 0; i < len; i++)
+      retval->categories[i] = msa->categories[w->beg + i];
+  }
+
+  /* number the tuples present in the window, in order of first
+     appearance, first in columns of interest and then in any
+     others (the ordering matters only in that it determines the
+     order in which terms are summed in computing likelihoods) */
+  for (pass = 0; pass < (w->do_cat == NULL ? 1 : 2); pass++) {
+    for (col = w->beg; col < w->end; col++) {
+      checkInterruptN(col, 10000);
+      tup = msa->ss->tuple_idx[col];
+      if (tup < 0 || w->full_to_sub[tup] >= 0) continue;
+      if (w->do_cat != NULL && w->do_cat[msa->categories[col]] != (pass == 0))
+        continue;
+      w->full_to_sub[tup] = ntuples;
+      sub_to_full[ntuples++] = tup;
+    }
+  }
+
+  ss_new(retval, msa->ss->tuple_size, max(ntuples, 1), do_cats, TRUE);
+  ss = retval->ss;
+  ss->ntuples = ntuples;
+  for (i = 0; i < ntuples; i++) {
+    tup = sub_to_full[i];
+    ss->col_tuples[i] = (char*)smalloc((tuple_len + 1) * sizeof(char));
+    strncpy(ss->col_tuples[i], msa->ss->col_tuples[tup], tuple_len);
+    ss->col_tuples[i][tuple_len] = '\0';
+    ss->counts[i] = w->counts[tup];
+    if (do_cats)
+      for (cat = 0; cat <= msa->ncats; cat++)
+        ss->cat_counts[cat][i] = w->cat_counts[cat][tup];
+  }
+  for (i = 0; i < len; i++) {
+    tup = msa->ss->tuple_idx[w->beg + i];
+    ss->tuple_idx[i] = (tup < 0 ? -1 : w->full_to_sub[tup]);
+  }
+
+  for (i = 0; i < ntuples; i++)  /* reset scratch space */
+    w->full_to_sub[sub_to_full[i]] = -1;
+  sfree(sub_to_full);
+  return retval;
+}
+
+
 /* adjust sufficient statistics to reflect the reverse complement of
    an alignment.  Refer to msa_reverse_compl */
 void ss_reverse_compl(MSA *msa) {
@@ -1043,6 +1485,7 @@ void ss_reverse_compl(MSA *msa) {
 
   if (msa->ss == NULL || msa->ss->tuple_idx == NULL)
     die("ERROR ss_reverse_compl: Need ordered sufficient statistics\n");
+  ss_unpack_tuples(msa);
   ss = msa->ss;
 
   if (msa->categories == NULL && ss->cat_counts != NULL)
@@ -1152,6 +1595,7 @@ void ss_reorder_rows(MSA *msa, int *new_to_old, int new_nseqs) {
   int ts = msa->ss->tuple_size;
   char tmp[msa->nseqs * ts];
   int col_offset, j, tup;
+  ss_unpack_tuples(msa);
   for (tup = 0; tup < msa->ss->ntuples; tup++) {
     checkInterruptN(tup, 10000);
     strncpy(tmp, msa->ss->col_tuples[tup], msa->nseqs * ts);
@@ -1177,6 +1621,7 @@ void ss_remove_zero_counts(MSA *msa) {
   int i, cat, new_ntuples = 0;
   int *old_to_new = smalloc(msa->ss->ntuples * sizeof(int));
 
+  ss_unpack_tuples(msa);
   for (i = 0; i < msa->ss->ntuples; i++) {
     checkInterruptN(i, 10000);
     if (msa->ss->counts[i] > 0) {
@@ -1213,6 +1658,7 @@ void ss_unique(MSA *msa) {
   int i, idx, cat;
   int *old_to_new = smalloc(msa->ss->ntuples * sizeof(int));
   key[msa->nseqs * msa->ss->tuple_size] = '\0';
+  ss_unpack_tuples(msa);
 
   for (i = 0; i < msa->ss->ntuples; i++) {
     checkInterruptN(i, 10000);
@@ -1246,6 +1692,7 @@ void ss_unique(MSA *msa) {
 void ss_collapse_missing(MSA *msa, int do_gaps) {
   int i, j, len = msa->nseqs * msa->ss->tuple_size;
   int changed_missing = FALSE, changed_gaps = FALSE, exists_missing = FALSE;
+  ss_unpack_tuples(msa);
   for (i = 0; i < msa->ss->ntuples; i++) {
     checkInterruptN(i, 10000);
     for (j = 0; j < len; j++) {
@@ -1421,6 +1868,7 @@ void ss_reduce_tuple_size(MSA *msa, int new_tuple_size) {
   int i, j, k, newlen;
   if (new_tuple_size >= msa->ss->tuple_size)
     die("ERROR: new tuple size must be smaller than old in ss_reduce_tuple_size.\n");
+  ss_unpack_tuples(msa);
   newlen = msa->nseqs * new_tuple_size;
   for (i = 0; i < msa->ss->ntuples; i++)  {
     checkInterruptN(i, 10000);
@@ -1436,59 +1884,15 @@ void ss_reduce_tuple_size(MSA *msa, int new_tuple_size) {
   ss_unique(msa);
 }
 
-int ss_lookup_coltuple(char *coltuple_str, Hashtable *tuple_hash, MSA *msa) {
-  int allgap[msa->ss->tuple_size], i, j, rv, tuple_size, len;
-  char tempchar;
-  tuple_size = msa->ss->tuple_size;
-  len = tuple_size * msa->nseqs;
-  for (i=0; i < tuple_size; i++) {
-    for (j=0; j<msa->nseqs; j++)
-      if (coltuple_str[j*tuple_size + i]!=GAP_CHAR &&
-	  coltuple_str[j*tuple_size + i]!=msa->missing[0]) break;
-    allgap[i] = (j == msa->nseqs);
-  }
-  for (i=len-1; i>=0; i--) {
-/*     fprintf(stderr, "i %d, coltuple_str %s, coltuple_str[i] %c, msa->missing[0] %c, allgap[i tuple_size] %d\n", */
-/* 	    i, coltuple_str, coltuple_str[i], msa->missing[0], */
-/* 	    allgap[i%tuple_size]); */
-    if (coltuple_str[i] != msa->missing[0] && allgap[i%tuple_size]==0)
-      break;
-  }
-  i++;
-  while (i%msa->ss->tuple_size != 0) i++;
-  tempchar = coltuple_str[i];
-  coltuple_str[i] = '\0';
-  rv = hsh_get_int(tuple_hash, coltuple_str);
-  coltuple_str[i] = tempchar;
-  return rv;
+int ss_lookup_coltuple(char *coltuple_str, TupleHash *tuple_hash, MSA *msa) {
+  return tuple_hash_lookup(tuple_hash, coltuple_str, msa->nseqs, 
+                           msa->ss->tuple_size);
 }
 
-void ss_add_coltuple(char *coltuple_str, void *val, Hashtable *tuple_hash, 
+void ss_add_coltuple(char *coltuple_str, void *val, TupleHash *tuple_hash, 
 		     MSA *msa) {
-  int allgap[msa->ss->tuple_size], i, j, tuple_size, len;
-  char tempchar;
-  tuple_size = msa->ss->tuple_size;
-  len = tuple_size * msa->nseqs;
-
-  for (i=0; i < tuple_size; i++) {
-    for (j=0; j<msa->nseqs; j++)
-      if (coltuple_str[j*tuple_size + i]!=GAP_CHAR &&
-	  coltuple_str[j*tuple_size + i]!=msa->missing[0]) break;
-    allgap[i] = (j==msa->nseqs);
-  }
-
-  for (i=len-1; i>=0; i--)
-    if (coltuple_str[i] != msa->missing[0] && allgap[i%tuple_size]==0)
-      break;
-  i++;
-
-  while (i%msa->ss->tuple_size != 0) i++;
-  /* Until 1-27-2009, tempchar was not being stored! This bug took three months
-     to find and wreaked havoc with dmsample! --agd27 */
-  tempchar = coltuple_str[i];
-  coltuple_str[i] = '\0';
-  hsh_put(tuple_hash, coltuple_str, val);
-  coltuple_str[i] = tempchar;
+  tuple_hash_add(tuple_hash, coltuple_str, msa->nseqs, msa->ss->tuple_size,
+                 ptr_to_int(val));
 }
 
 
@@ -0,0 +1,214 @@
+/***************************************************************************
+ * PHAST: PHylogenetic Analysis with Space/Time models
+ * Copyright (c) 2002-2005 University of California, 2006-2010 Cornell
+ * University.  All rights reserved.
+ *
+ * This source code is distributed under a BSD-style license.  See the
+ * file LICENSE.txt for details.
+ ***************************************************************************/
+
+/* Hash tables of packed column tuples.  See tuple_hash.h. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <misc.h>
+#include <sufficient_stats.h>
+#include <tuple_hash.h>
+
+/* largest number of entries for which space is allocated up front;
+   tables grow as needed beyond this */
+#define TH_MAX_INIT 262144
+
+/* number of words required for keys of a given length */
+#define TH_NWORDS(th, len) (((len) + (th)->chars_per_word - 1) / (th)->chars_per_word)
+
+TupleHash *tuple_hash_new(MSA *msa, int key_len, int expected_size) {
+  TupleHash *th = smalloc(sizeof(TupleHash));
+  int ncodes = 0, i, c;
+  unsigned int j;
+
+  /* code 0 is reserved for padding and unpackable characters */
+  memset(th->code, 0, 256 * sizeof(unsigned char));
+  th->code[(unsigned char)GAP_CHAR] = ++ncodes;
+  for (i = 0; msa->missing[i] != '\0'; i++) {
+    c = (unsigned char)msa->missing[i];
+    if (th->code[c] == 0) th->code[c] = ++ncodes;
+  }
+  for (i = 0; msa->alphabet[i] != '\0' && ncodes < 255; i++) {
+    c = (unsigned char)msa->alphabet[i];
+    if (th->code[c] == 0) th->code[c] = ++ncodes;
+  }
+  for (th->bits = 1; (1 << th->bits) <= ncodes; th->bits++);
+  th->chars_per_word = 64 / th->bits;
+  th->missing = msa->missing[0];
+  th->nwords = max(TH_NWORDS(th, key_len), 1);
+
+  if (expected_size > TH_MAX_INIT) expected_size = TH_MAX_INIT;
+  for (th->size = 16; th->size < 2 * (unsigned int)max(expected_size, 1);
+       th->size *= 2);
+  th->nentries = 0;
+  th->keys = smalloc((size_t)th->size * th->nwords * sizeof(uint64_t));
+  th->vals = smalloc(th->size * sizeof(int));
+  for (j = 0; j < th->size; j++) th->vals[j] = -1;
+  th->overflow = NULL;
+  return th;
+}
+
+void tuple_hash_free(TupleHash *th) {
+  sfree(th->keys);
+  sfree(th->vals);
+  if (th->overflow != NULL) hsh_free(th->overflow);
+  sfree(th);
+}
+
+static PHAST_INLINE uint64_t th_hash(uint64_t *key, int nwords) {
+  uint64_t h = 0x9e3779b97f4a7c15ULL;
+  int i;
+  for (i = 0; i < nwords; i++) {
+    h ^= key[i];
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 31;
+  }
+  h *= 0x94d049bb133111ebULL;
+  return h ^ (h >> 29);
+}
+
+/* return slot containing key, or empty slot where it belongs */
+static unsigned int th_find(TupleHash *th, uint64_t *key) {
+  unsigned int mask = th->size - 1, slot;
+  uint64_t *k;
+  int i;
+  slot = (unsigned int)th_hash(key, th->nwords) & mask;
+  while (th->vals[slot] != -1) {
+    k = &th->keys[(size_t)slot * th->nwords];
+    for (i = 0; i < th->nwords && k[i] == key[i]; i++);
+    if (i == th->nwords) break;
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/* reallocate with a new size and/or key width, reinserting all
+   packed keys (which are zero-extended if the width increases) */
+static void th_rebuild(TupleHash *th, unsigned int new_size, int new_nwords) {
+  uint64_t *old_keys = th->keys, *k, key[new_nwords];
+  int *old_vals = th->vals, old_nwords = th->nwords, i;
+  unsigned int old_size = th->size, j, slot;
+
+  th->size = new_size;
+  th->nwords = new_nwords;
+  th->keys = smalloc((size_t)new_size * new_nwords * sizeof(uint64_t));
+  th->vals = smalloc(new_size * sizeof(int));
+  for (j = 0; j < new_size; j++) th->vals[j] = -1;
+
+  for (j = 0; j < old_size; j++) {
+    if (old_vals[j] == -1) continue;
+    k = &old_keys[(size_t)j * old_nwords];
+    for (i = 0; i < new_nwords; i++) key[i] = (i < old_nwords ? k[i] : 0);
+    slot = th_find(th, key);
+    memcpy(&th->keys[(size_t)slot * new_nwords], key,
+           new_nwords * sizeof(uint64_t));
+    th->vals[slot] = old_vals[j];
+  }
+  sfree(old_keys);
+  sfree(old_vals);
+}
+
+/* length of the key for a column tuple string: trailing missing data
+   is removed, except in tuple positions consisting only of gaps and
+   missing data, and the length is rounded up to a multiple of the
+   tuple size */
+static int th_key_len(TupleHash *th, char *str, int nseqs, int tuple_size) {
+  int allgap[tuple_size], i, j, len = tuple_size * nseqs;
+  for (i = 0; i < tuple_size; i++) {
+    for (j = 0; j < nseqs; j++)
+      if (str[j*tuple_size + i] != GAP_CHAR && str[j*tuple_size + i] != th->missing)
+        break;
+    allgap[i] = (j == nseqs);
+  }
+  for (i = len-1; i >= 0; i--)
+    if (str[i] != th->missing && allgap[i%tuple_size] == 0)
+      break;
+  i++;
+  while (i % tuple_size != 0) i++;
+  return i;
+}
+
+/* pack the first len characters of str into key (of nwords words).
+   Returns 1 on success, 0 if a character cannot be packed */
+static int th_pack(TupleHash *th, char *str, int len, uint64_t *key,
+                   int nwords) {
+  int i, w = 0, shift = 0;
+  uint64_t c;
+  for (i = 0; i < nwords; i++) key[i] = 0;
+  for (i = 0; i < len; i++) {
+    if ((c = th->code[(unsigned char)str[i]]) == 0) return 0;
+    key[w] |= c << shift;
+    if ((shift += th->bits) > 64 - th->bits) {
+      shift = 0;
+      w++;
+    }
+  }
+  return 1;
+}
+
+/* look up a trimmed key string in the overflow table */
+static int th_overflow_lookup(TupleHash *th, char *str, int len) {
+  char tempchar;
+  int rv;
+  if (th->overflow == NULL) return -1;
+  tempchar = str[len];
+  str[len] = '\0';
+  rv = hsh_get_int(th->overflow, str);
+  str[len] = tempchar;
+  return rv;
+}
+
+int tuple_hash_lookup(TupleHash *th, char *coltuple_str, int nseqs,
+                      int tuple_size) {
+  int len = th_key_len(th, coltuple_str, nseqs, tuple_size),
+    nw = TH_NWORDS(th, len);
+  uint64_t key[max(nw, th->nwords)];
+  unsigned int slot;
+
+  if (!th_pack(th, coltuple_str, len, key, max(nw, th->nwords)))
+    return th_overflow_lookup(th, coltuple_str, len);
+  if (nw > th->nwords) return -1; /* wider than any key in table */
+  slot = th_find(th, key);
+  return th->vals[slot];
+}
+
+void tuple_hash_add(TupleHash *th, char *coltuple_str, int nseqs,
+                    int tuple_size, int val) {
+  int len = th_key_len(th, coltuple_str, nseqs, tuple_size),
+    nw = TH_NWORDS(th, len);
+  uint64_t key[max(nw, th->nwords)];
+  unsigned int slot;
+  char tempchar;
+
+  if (val < 0)
+    die("ERROR tuple_hash_add: val must be non-negative\n");
+
+  if (!th_pack(th, coltuple_str, len, key, max(nw, th->nwords))) {
+    if (th->overflow == NULL) th->overflow = hsh_new(1000);
+    tempchar = coltuple_str[len];
+    coltuple_str[len] = '\0';
+    if (hsh_reset_int(th->overflow, coltuple_str, val) != 0)
+      hsh_put_int(th->overflow, coltuple_str, val);
+    coltuple_str[len] = tempchar;
+    return;
+  }
+
+  if (nw > th->nwords)
+    th_rebuild(th, th->size, nw);
+  else if (2 * (th->nentries + 1) > th->size)
+    th_rebuild(th, 2 * th->size, th->nwords);
+
+  slot = th_find(th, key);
+  if (th->vals[slot] == -1) {
+    memcpy(&th->keys[(size_t)slot * th->nwords], key,
+           th->nwords * sizeof(uint64_t));
+    th->nentries++;
+  }
+  th->vals[slot] = val;
+}
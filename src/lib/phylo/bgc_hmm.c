@@ -8,6 +8,7 @@
  ***************************************************************************/
 
 #include "bgc_hmm.h"
+#include "wig_writer.h"
 
 /* 
    Like phastCons, but with two versions of each state: with and without
@@ -315,7 +316,7 @@ int bgcHmm(struct bgchmm_struct *b) {
 			     npar > 0 ? bgchmm_estimate_states : NULL, 
 			     bgchmm_estimate_transitions, 
 			     bgchmm_get_obs_idx, 
-			     NULL, emissions, NULL);
+			     NULL, emissions, NULL, NULL, NULL, NULL);
   fprintf(stderr, "Done.\n\n");
   bgchmm_get_rates(hmm, &bgc_in_rate, &bgc_out_rate, &nu, &mu);
   
@@ -439,10 +440,13 @@ int bgcHmm(struct bgchmm_struct *b) {
     /* print to post_probs_f */
     if (post_probs_f != NULL) {
       if (b->post_probs == WIG) {
-	fprintf(post_probs_f, "fixedStep chrom=%s start=%d step=1\n",
-		msa->names[0], msa->idx_offset + 1);
-	for (i=0; i < reflen; i++)
-	  fprintf(post_probs_f, "%.5g\n", prob_bgc[i]);
+	WigWriter *ww = ww_new(post_probs_f, msa->names[0]);
+	for (i=0; i < reflen; i++) {
+	  ww_start_line(ww, msa->idx_offset + 1 + i);
+	  ww_put_dbl(ww, "%.5g", prob_bgc[i]);
+	  ww_put_char(ww, '\n');
+	}
+	ww_free(ww);
       } else if (b->post_probs == FULL) {
 	if (post_probs_f != NULL) {
 	  fprintf(post_probs_f, "#coord");
@@ -29,6 +29,10 @@
 /* number of significant figures to which to estimate column scale
    parameters (currently affects 1d parameter estimation only) */
 
+#define BLOCKSIZE 64
+/* number of column tuples whose scale parameters are estimated
+   simultaneously (see col_lrts) */
+
 /* Compute and return the log likelihood of a tree model with respect
    to a single column tuple in an alignment.  This is a pared-down
    version of tl_compute_log_likelihood for use in estimation of
@@ -124,6 +128,85 @@ double col_compute_log_likelihood(TreeModel *mod, MSA *msa, int tupleidx,
 }
 
 
+/* Compute likelihoods for a block of column tuples, using the
+   current substitution matrices.  Equivalent to calling
+   col_compute_likelihood for each tuple, but partial likelihoods are
+   stored with the tuple varying fastest, so that a single pass over
+   the tree serves the whole block.  If non-NULL, scratch must have
+   room for ((nnodes+1) * nstates + 2) * ntuples doubles.  Results
+   are stored in lik. */
+void col_compute_likelihood_block(TreeModel *mod, MSA *msa, int *tuples,
+                                  int ntuples, double *scratch, double *lik) {
+  int i, j, t, nodeidx, rcat;
+  int nstates = mod->rate_matrix->size;
+  TreeNode *n;
+  List *traversal = tr_postorder(mod->tree);
+  double *pL, *totl, *totr;
+
+  if (msa->ss->tuple_size != 1)
+    die("ERROR col_compute_likelihood_block: need tuple size 1, got %i\n",
+	msa->ss->tuple_size);
+  if (mod->order != 0)
+    die("ERROR col_compute_likelihood_block: got mod->order of %i, expected 0\n",
+	mod->order);
+  if (!mod->allow_gaps)
+    die("ERROR col_compute_likelihood_block: need mod->allow_gaps to be TRUE\n");
+
+  /* partial likelihood for tuple t, state i, node id is at
+     pL[(id * nstates + i) * ntuples + t] */
+  pL = (scratch != NULL ? scratch :
+        smalloc(((mod->tree->nnodes+1) * nstates + 2) * ntuples *
+                sizeof(double)));
+  totl = &pL[(mod->tree->nnodes+1) * nstates * ntuples];
+  totr = &totl[ntuples];
+
+  for (t = 0; t < ntuples; t++) lik[t] = 0;
+
+  for (rcat = 0; rcat < mod->nratecats; rcat++) {
+    for (nodeidx = 0; nodeidx < lst_size(traversal); nodeidx++) {
+      double *nodeL;
+      n = lst_get_ptr(traversal, nodeidx);
+      nodeL = &pL[n->id * nstates * ntuples];
+      if (n->lchild == NULL) {
+        /* leaf: base case of recursion */
+        for (t = 0; t < ntuples; t++) {
+          int state = mod->rate_matrix->
+            inv_states[(int)ss_get_char_tuple(msa, tuples[t],
+                                              mod->msa_seq_idx[n->id], 0)];
+          for (i = 0; i < nstates; i++)
+            nodeL[i * ntuples + t] = (state < 0 || i == state) ? 1 : 0;
+        }
+      }
+      else {
+        /* general recursive case */
+        double **lsubst = mod->P[n->lchild->id][rcat]->matrix->data;
+        double **rsubst = mod->P[n->rchild->id][rcat]->matrix->data;
+        double *lL = &pL[n->lchild->id * nstates * ntuples];
+        double *rL = &pL[n->rchild->id * nstates * ntuples];
+        for (i = 0; i < nstates; i++) {
+          for (t = 0; t < ntuples; t++) totl[t] = totr[t] = 0;
+          for (j = 0; j < nstates; j++)
+            for (t = 0; t < ntuples; t++)
+              totl[t] += lL[j * ntuples + t] * lsubst[i][j];
+          for (j = 0; j < nstates; j++)
+            for (t = 0; t < ntuples; t++)
+              totr[t] += rL[j * ntuples + t] * rsubst[i][j];
+          for (t = 0; t < ntuples; t++)
+            nodeL[i * ntuples + t] = totl[t] * totr[t];
+        }
+      }
+    }
+
+    /* termination (for each rate cat) */
+    for (i = 0; i < nstates; i++)
+      for (t = 0; t < ntuples; t++)
+        lik[t] += vec_get(mod->backgd_freqs, i) *
+          pL[(mod->tree->id * nstates + i) * ntuples + t] * mod->freqK[rcat];
+  }
+
+  if (scratch == NULL) sfree(pL);
+}
+
 /* version of col_scale_derivs_subst that allows for the general case
    of complex eigenvalues and eigenvectors */
 void col_scale_derivs_subst_complex(ColFitData *d) {
@@ -736,6 +819,51 @@ double col_deriv2_wrapper_1d(double x, void *data, double lb, double ub) {
   return d->deriv2;
 }
 
+/* Wrapper for likelihood function for use in simultaneous
+   estimation of the scale factors of a block of column tuples;
+   version for use with opt_newton_1d_batch.  Requested evaluations
+   that share a scale factor (as is typical in the first iterations,
+   when all tuples start from the same initial value) share a single
+   computation of the substitution matrices and a single pruning
+   pass */
+void col_likelihood_wrapper_1d_batch(int n, int *idx, double *x, double *fx,
+                                     void *data) {
+  ColFitData *d = (ColFitData*)data;
+  int *grp_pos = d->block_iscratch, *grp_tuples = &d->block_iscratch[n],
+    *done = &d->block_iscratch[2*n];
+  double *grp_lik = d->block_scratch;
+  int j, k, m;
+
+  if (d->stype == SUBTREE)
+    die("ERROR col_likelihood_wrapper_1d_batch: d->stype cannot be SUBTREE\n");
+  if (n > d->block_size)
+    die("ERROR col_likelihood_wrapper_1d_batch: block too large (%i > %i)\n",
+        n, d->block_size);
+
+  for (k = 0; k < n; k++) done[k] = FALSE;
+
+  for (k = 0; k < n; k++) {
+    if (done[k]) continue;
+
+    /* gather all requests at this scale factor */
+    for (j = k, m = 0; j < n; j++) {
+      if (!done[j] && x[j] == x[k]) {
+        grp_pos[m] = j;
+        grp_tuples[m] = d->block_tuples[idx[j]];
+        done[j] = TRUE;
+        m++;
+      }
+    }
+
+    d->mod->scale = x[k];
+    tm_set_subst_matrices(d->mod);
+    col_compute_likelihood_block(d->mod, d->msa, grp_tuples, m,
+                                 &grp_lik[d->block_size], grp_lik);
+    for (j = 0; j < m; j++)
+      fx[grp_pos[j]] = -1 * log(grp_lik[j]);
+  }
+}
+
 /* Perform a likelihood ratio test for each column tuple in an
    alignment, comparing the given null model with an alternative model
    that has a free scaling parameter for all branches.  Assumes a 0th
@@ -748,13 +876,26 @@ double col_deriv2_wrapper_1d(double x, void *data, double lb, double ub) {
    (for 1 <= scale), NNEUT (0 <= scale), or CONACC (0 <= scale) */
 void col_lrts(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_pvals,
               double *tuple_scales, double *tuple_llrs, FILE *logf) {
-  int i;
+  int i, k, nblock = 0;
   ColFitData *d;
   double null_lnl, alt_lnl, delta_lnl, this_scale = 1;
+  double *delta_lnls = smalloc(msa->ss->ntuples * sizeof(double)),
+    *scales = smalloc(msa->ss->ntuples * sizeof(double)),
+    *block_null = NULL, *block_scales = NULL, *block_alt = NULL;
 
   /* init ColFitData */
   d = col_init_fit_data(mod, msa, ALL, mode, FALSE);
 
+  /* unless per-tuple logging is required, tuples with data are
+     collected into blocks and their scale factors are estimated
+     simultaneously */
+  if (logf == NULL) {
+    col_init_block(d, BLOCKSIZE);
+    block_null = smalloc(BLOCKSIZE * sizeof(double));
+    block_scales = smalloc(BLOCKSIZE * sizeof(double));
+    block_alt = smalloc(BLOCKSIZE * sizeof(double));
+  }
+
   /* iterate through column tuples */
   for (i = 0; i < msa->ss->ntuples; i++) {
     checkInterruptN(i, 100);
@@ -762,8 +903,12 @@ void col_lrts(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_pvals,
     /* first check for actual substitution data in column; if none,
        don't waste time computing likelihoods */
     if (!col_has_data(mod, msa, i)) {
-      delta_lnl = 0;
-      this_scale = 1;
+      delta_lnls[i] = 0;
+      scales[i] = 1;
+    }
+
+    else if (logf == NULL) {    /* add to current block */
+      d->block_tuples[nblock++] = i;
     }
 
     else {                      /* compute null and alt lnl */
@@ -783,14 +928,40 @@ void col_lrts(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_pvals,
          to use numerical rather than exact derivatives */
 
       alt_lnl *= -1;
-      this_scale = d->params->data[0];
-
-      delta_lnl = alt_lnl - null_lnl;
-      if (delta_lnl <= -0.01)
-	die("ERROR col_lrts: delta_lnl = %e < -0.01\n", delta_lnl);
-      if (delta_lnl < 0) delta_lnl = 0;
+      scales[i] = d->params->data[0];
+      delta_lnls[i] = alt_lnl - null_lnl;
     } /* end estimation of delta_lnl */
 
+    /* estimate scale factors for a full block (or the final, partial
+       one) */
+    if (nblock > 0 && (nblock == BLOCKSIZE || i == msa->ss->ntuples - 1)) {
+      mod->scale = 1;
+      tm_set_subst_matrices(mod);
+      col_compute_likelihood_block(mod, msa, d->block_tuples, nblock,
+                                   &d->block_scratch[d->block_size],
+                                   block_null);
+
+      for (k = 0; k < nblock; k++) block_scales[k] = d->init_scale;
+      opt_newton_1d_batch(col_likelihood_wrapper_1d_batch, block_scales,
+                          nblock, d, block_alt, SIGFIGS, d->lb->data[0],
+                          d->ub->data[0]);
+
+      for (k = 0; k < nblock; k++) {
+        int tupleidx = d->block_tuples[k];
+        scales[tupleidx] = block_scales[k];
+        delta_lnls[tupleidx] = -1 * block_alt[k] - log(block_null[k]);
+      }
+      nblock = 0;
+    }
+  }
+
+  for (i = 0; i < msa->ss->ntuples; i++) {
+    delta_lnl = delta_lnls[i];
+    this_scale = scales[i];
+    if (delta_lnl <= -0.01)
+      die("ERROR col_lrts: delta_lnl = %e < -0.01\n", delta_lnl);
+    if (delta_lnl < 0) delta_lnl = 0;
+
     /* compute p-vals via chi-sq */
     if (tuple_pvals != NULL) {
       if (mode == NNEUT || mode == CONACC)
@@ -814,6 +985,13 @@ void col_lrts(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_pvals,
   }
 
   col_free_fit_data(d);
+  sfree(delta_lnls);
+  sfree(scales);
+  if (block_null != NULL) {
+    sfree(block_null);
+    sfree(block_scales);
+    sfree(block_alt);
+  }
 }
 
 /* Subtree version of LRT */
@@ -1222,9 +1400,30 @@ ColFitData *col_init_fit_data(TreeModel *mod, MSA *msa, scale_type stype,
   d->vec_scratch2_z = zvec_new(size);
   d->vec_scratch1_r = vec_new(size);
   d->vec_scratch2_r = vec_new(size);
+  d->block_tuples = NULL;       /* allocated on demand by col_init_block */
+  d->block_size = 0;
+  d->block_scratch = NULL;
+  d->block_iscratch = NULL;
   return d;
 }
 
+/* Allocate scratch memory for simultaneous estimation of the scale
+   factors of up to block_size column tuples */
+void col_init_block(ColFitData *d, int block_size) {
+  int nstates = d->mod->rate_matrix->size;
+  if (d->block_tuples != NULL) {
+    sfree(d->block_tuples);
+    sfree(d->block_scratch);
+    sfree(d->block_iscratch);
+  }
+  d->block_size = block_size;
+  d->block_tuples = smalloc(block_size * sizeof(int));
+  /* room for likelihoods plus scratch for col_compute_likelihood_block */
+  d->block_scratch = smalloc(((d->mod->tree->nnodes+1) * nstates + 3) *
+                             block_size * sizeof(double));
+  d->block_iscratch = smalloc(3 * block_size * sizeof(int));
+}
+
 /* Free metadata and memory for fitting scale factors */
 void col_free_fit_data(ColFitData *d) {
   int nid, rcat, i, j;
@@ -1266,6 +1465,11 @@ void col_free_fit_data(ColFitData *d) {
   zvec_free(d->vec_scratch2_z);
   vec_free(d->vec_scratch1_r);
   vec_free(d->vec_scratch2_r);
+  if (d->block_tuples != NULL) {
+    sfree(d->block_tuples);
+    sfree(d->block_scratch);
+    sfree(d->block_iscratch);
+  }
 
   sfree(d);
 }
@@ -1280,14 +1484,26 @@ void col_free_fit_data(ColFitData *d) {
 void col_gerp(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_nneut,
               double *tuple_nobs, double *tuple_nrejected,
               double *tuple_nspec, FILE *logf) {
-  int i, j, nspec = 0;
+  int i, j, k, nspec = 0, nblock = 0;
   double nneut, scale, lnl;
   int *has_data = smalloc(mod->tree->nnodes * sizeof(int));
+  double *nneuts = smalloc(msa->ss->ntuples * sizeof(double)),
+    *scales = smalloc(msa->ss->ntuples * sizeof(double)),
+    *block_scales = NULL, *block_lnl = NULL;
+  int *nspecs = smalloc(msa->ss->ntuples * sizeof(int));
   ColFitData *d;
 
   /* init ColFitData */
   d = col_init_fit_data(mod, msa, ALL, NNEUT, FALSE);
 
+  /* as in col_lrts, fit blocks of tuples simultaneously unless
+     per-tuple logging is required */
+  if (logf == NULL) {
+    col_init_block(d, BLOCKSIZE);
+    block_scales = smalloc(BLOCKSIZE * sizeof(double));
+    block_lnl = smalloc(BLOCKSIZE * sizeof(double));
+  }
+
   /* iterate through column tuples */
   for (i = 0; i < msa->ss->ntuples;i++) {
     checkInterruptN(i, 1000);
@@ -1296,22 +1512,46 @@ void col_gerp(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_nneut,
     if (nspec < 3)
       nneut = scale = 0;
     else {
-      vec_set(d->params, 0, d->init_scale);
-      d->tupleidx = i;
-
-      opt_newton_1d(col_likelihood_wrapper_1d, &d->params->data[0], d,
-                    &lnl, SIGFIGS, d->lb->data[0], d->ub->data[0],
-                    logf, NULL, NULL);
-      /* turns out to be faster (roughly 15% in limited experiments)
-         to use numerical rather than exact derivatives */
-
-      scale = d->params->data[0];
       for (j = 1, nneut = 0; j < mod->tree->nnodes; j++)  /* node 0 is root */
         if (has_data[j])
           nneut += ((TreeNode*)lst_get_ptr(mod->tree->nodes, j))->dparent;
+
+      if (logf == NULL) {
+        d->block_tuples[nblock++] = i;
+        scale = 0;              /* will be set below */
+      }
+      else {
+        vec_set(d->params, 0, d->init_scale);
+        d->tupleidx = i;
+
+        opt_newton_1d(col_likelihood_wrapper_1d, &d->params->data[0], d,
+                      &lnl, SIGFIGS, d->lb->data[0], d->ub->data[0],
+                      logf, NULL, NULL);
+        /* turns out to be faster (roughly 15% in limited experiments)
+           to use numerical rather than exact derivatives */
+
+        scale = d->params->data[0];
+      }
+    }
+    nneuts[i] = nneut;
+    scales[i] = scale;
+    nspecs[i] = nspec;
+
+    if (nblock > 0 && (nblock == BLOCKSIZE || i == msa->ss->ntuples - 1)) {
+      for (k = 0; k < nblock; k++) block_scales[k] = d->init_scale;
+      opt_newton_1d_batch(col_likelihood_wrapper_1d_batch, block_scales,
+                          nblock, d, block_lnl, SIGFIGS, d->lb->data[0],
+                          d->ub->data[0]);
+      for (k = 0; k < nblock; k++)
+        scales[d->block_tuples[k]] = block_scales[k];
+      nblock = 0;
     }
+  }
 
-    if (tuple_nspec != NULL) tuple_nspec[i] = (double)nspec;
+  for (i = 0; i < msa->ss->ntuples;i++) {
+    nneut = nneuts[i];
+    scale = scales[i];
+    if (tuple_nspec != NULL) tuple_nspec[i] = (double)nspecs[i];
     if (tuple_nneut != NULL) tuple_nneut[i] = nneut;
     if (tuple_nobs != NULL) tuple_nobs[i] = scale * nneut;
     if (tuple_nrejected != NULL) {
@@ -1322,6 +1562,13 @@ void col_gerp(TreeModel *mod, MSA *msa, mode_type mode, double *tuple_nneut,
   }
   col_free_fit_data(d);
   sfree(has_data);
+  sfree(nneuts);
+  sfree(scales);
+  sfree(nspecs);
+  if (block_scales != NULL) {
+    sfree(block_scales);
+    sfree(block_lnl);
+  }
 }
 
 /* Identify branches wrt which a given column tuple is uninformative,
@@ -18,6 +18,7 @@
 #include <stringsplus.h>
 #include <ctype.h>
 #include <numerical_opt.h>
+#include <squarem.h>
 #include <tree_likelihoods.h>
 #include <subst_mods.h>
 #include <time.h>
@@ -66,6 +67,7 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
   int opt_ratevar_freqs=0;
   opt_precision_type bfgs_prec = OPT_LOW_PREC;
                                 /* will be adjusted as necessary */
+  Squarem *sq = NULL;
 
   /* obtain sufficient statistics for MSA, if necessary */
   if (msa->ss == NULL) {
@@ -160,6 +162,9 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
   H = mat_new(npar, npar);
   mat_set_identity(H);
 
+  if (mod->squarem)
+    sq = sqm_new(npar, lower_bounds, upper_bounds);
+
   if (mod->estimate_branchlens == TM_BRANCHLENS_NONE ||
       mod->alt_subst_mods != NULL ||
       mod->selection_idx >= 0)
@@ -188,7 +193,7 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
     if (logf != NULL) 
       gettimeofday(&post_prob_start, NULL);
 
-    ll = tl_compute_log_likelihood(mod, msa, NULL, NULL, cat, mod->tree_posteriors) 
+    ll = tl_compute_log_likelihood_blocked(mod, msa, cat, mod->tree_posteriors)
       * log(2); 
 
     if (logf != NULL) {
@@ -199,6 +204,14 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
       tm_log_em(logf, 0, ll, mod->all_params);
     }
 
+    /* an extrapolated point that does not improve the likelihood is
+       replaced by the last ordinary EM update, which must be
+       evaluated instead */
+    if (sq != NULL && sqm_check(sq, opt_params, ll)) {
+      if (logf != NULL) fprintf(logf, "Rejecting SQUAREM extrapolation.\n");
+      continue;
+    }
+
     improvement = fabs((lastll - ll)/ll);
     lastll = ll;
 
@@ -223,6 +236,7 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
         grad_func = compute_grad_em_exact;
         if (bfgs_prec == OPT_LOW_PREC && bfgs_prec != precision) 
           bfgs_prec = OPT_MED_PREC;
+        if (sq != NULL) sqm_restart(sq, npar, lower_bounds, upper_bounds);
       }
       else {
         home_stretch = 1;
@@ -230,6 +244,7 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
           if (logf != NULL) 
             fprintf(logf, "Switching to higher precision with BFGS.\n");
           bfgs_prec = precision;
+          if (sq != NULL) sqm_restart(sq, npar, lower_bounds, upper_bounds);
         }
       }
     }
@@ -288,7 +303,12 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
 	H = mat_new(npar, npar);
 	mat_set_identity(H);
       }
+      if (sq != NULL) sqm_restart(sq, npar, lower_bounds, upper_bounds);
     }
+
+    /* extrapolate, if accelerating by SQUAREM */
+    if (sq != NULL && sqm_update(sq, opt_params) && logf != NULL)
+      fprintf(logf, "SQUAREM extrapolation (step length %f).\n", sq->step);
   }
 
   mod->lnL = ll;
@@ -325,7 +345,9 @@ int tm_fit_em(TreeModel *mod, MSA *msa, Vector *params, int cat,
     fprintf(logf, "\nNumber of iterations: %d\nTotal time: %.4f sec.\n", it, 
             end_time.tv_sec - start_time.tv_sec + 
             (end_time.tv_usec - start_time.tv_usec)/1.0e6);
+    if (sq != NULL) sqm_report(logf, sq);
   }
+  if (sq != NULL) sqm_free(sq);
 
   vec_free(lower_bounds);
   tl_free_tree_posteriors(mod, msa, mod->tree_posteriors);
@@ -430,53 +452,24 @@ void compute_grad_em_approx(Vector *grad, Vector *params, void *data,
   List *erows = lst_new_int(4), *ecols = lst_new_int(4), 
     *distinct_rows = lst_new_int(2), *distinct_cols = lst_new_int(4);
 
-  static double **q = NULL, **q2 = NULL, **q3 = NULL, 
-    **dq = NULL, **dqq = NULL, **qdq = NULL, **dqq2 = NULL, **qdqq = NULL, 
-    **q2dq = NULL, **dqq3 = NULL, **qdqq2 = NULL, **q2dqq = NULL, 
-    **q3dq = NULL;
-  static Complex *diag = NULL;
+  /* scratch matrices are allocated on each call rather than kept in
+     statics, so that models can be fitted concurrently */
+  double **scratch[13], **q, **q2, **q3, **dq, **dqq, **qdq, **dqq2, 
+    **qdqq, **q2dq, **dqq3, **qdqq2, **q2dqq, **q3dq;
+  Complex diag[nstates];
 
   if  (Q->evals_z == NULL || Q->evec_matrix_z == NULL || Q->evec_matrix_inv_z == NULL)
     die("ERRROR: compute_grad_em_approx got NULL value in eigensystem; error diagonalizing matrix.");
 
-  if (diag == NULL) {
-    diag = (Complex*)smalloc(nstates * sizeof(Complex));
-    set_static_var((void**)&diag);
-  }
-
-  /* init memory (first time only) */
-  if (q == NULL) {
-    q = (double**)smalloc(nstates * sizeof(double*));
-    set_static_var((void**)&q);
-    q2 = (double**)smalloc(nstates * sizeof(double*));
-    q3 = (double**)smalloc(nstates * sizeof(double*));
-    dq = (double**)smalloc(nstates * sizeof(double*));
-    dqq = (double**)smalloc(nstates * sizeof(double*));
-    qdq = (double**)smalloc(nstates * sizeof(double*));
-    dqq2 = (double**)smalloc(nstates * sizeof(double*));
-    qdqq = (double**)smalloc(nstates * sizeof(double*));
-    q2dq = (double**)smalloc(nstates * sizeof(double*));
-    dqq3 = (double**)smalloc(nstates * sizeof(double*));
-    qdqq2 = (double**)smalloc(nstates * sizeof(double*));
-    q2dqq = (double**)smalloc(nstates * sizeof(double*));
-    q3dq = (double**)smalloc(nstates * sizeof(double*));
-
-    for (i = 0; i < nstates; i++) {
-      q[i] = (double*)smalloc(nstates * sizeof(double));
-      q2[i] = (double*)smalloc(nstates * sizeof(double));
-      q3[i] = (double*)smalloc(nstates * sizeof(double));
-      dq[i] = (double*)smalloc(nstates * sizeof(double));
-      dqq[i] = (double*)smalloc(nstates * sizeof(double));
-      qdq[i] = (double*)smalloc(nstates * sizeof(double));
-      dqq2[i] = (double*)smalloc(nstates * sizeof(double));
-      qdqq[i] = (double*)smalloc(nstates * sizeof(double));
-      q2dq[i] = (double*)smalloc(nstates * sizeof(double));
-      q3dq[i] = (double*)smalloc(nstates * sizeof(double));
-      q2dqq[i] = (double*)smalloc(nstates * sizeof(double));
-      qdqq2[i] = (double*)smalloc(nstates * sizeof(double));
-      dqq3[i] = (double*)smalloc(nstates * sizeof(double));
-    }
+  for (k = 0; k < 13; k++) {
+    scratch[k] = (double**)smalloc(nstates * sizeof(double*));
+    for (i = 0; i < nstates; i++)
+      scratch[k][i] = (double*)smalloc(nstates * sizeof(double));
   }
+  q = scratch[0]; q2 = scratch[1]; q3 = scratch[2]; dq = scratch[3];
+  dqq = scratch[4]; qdq = scratch[5]; dqq2 = scratch[6]; qdqq = scratch[7];
+  q2dq = scratch[8]; dqq3 = scratch[9]; qdqq2 = scratch[10]; 
+  q2dqq = scratch[11]; q3dq = scratch[12];
   
   /* set Q, zero Q^2 and Q^3 */
   for (i = 0; i < nstates; i++) {
@@ -892,6 +885,11 @@ void compute_grad_em_approx(Vector *grad, Vector *params, void *data,
   vec_scale(grad, -1);
   lst_free(erows); lst_free(ecols); lst_free(distinct_rows); 
   lst_free(distinct_cols);
+
+  for (k = 0; k < 13; k++) {
+    for (i = 0; i < nstates; i++) sfree(scratch[k][i]);
+    sfree(scratch[k]);
+  }
 }
 
 /* Like above, but using the approach outlined by Schadt and Lange for
@@ -913,34 +911,27 @@ void compute_grad_em_exact(Vector *grad, Vector *params, void *data,
   double t;
   double freqK[mod->nratecats], rK_tweak[mod->nratecats];
 
-  static double **dq = NULL;
-  static Complex **f = NULL, **tmpmat = NULL, **sinv_dq_s = NULL;
-  static Complex *diag = NULL;
-
-  if (diag == NULL) {
-    diag = (Complex*)smalloc(nstates * sizeof(Complex));
-    set_static_var((void**)&diag);
-  }
+  double **dq;
+  Complex **f, **tmpmat, **sinv_dq_s, *diag;
 
   Q = mod->rate_matrix;
   if (Q->evals_z == NULL || Q->evec_matrix_z == NULL ||
       Q->evec_matrix_inv_z == NULL)
     die("ERROR compute_grade_em_exact got NULL value in eigensystem; error diagonalizing rate matrix\n");
 
-  /* init memory (first time only) */
-  if (dq == NULL) {
-    dq = (double**)smalloc(nstates * sizeof(double*));
-    set_static_var((void**)&dq);
-    f = (Complex**)smalloc(nstates * sizeof(Complex*));
-    tmpmat = (Complex**)smalloc(nstates * sizeof(Complex*));
-    sinv_dq_s = (Complex**)smalloc(nstates * sizeof(Complex*));
-
-    for (i = 0; i < nstates; i++) {
-      dq[i] = (double*)smalloc(nstates * sizeof(double));
-      f[i] = (Complex*)smalloc(nstates * sizeof(Complex));
-      tmpmat[i] = (Complex*)smalloc(nstates * sizeof(Complex));
-      sinv_dq_s[i] = (Complex*)smalloc(nstates * sizeof(Complex));
-    }
+  /* scratch memory (allocated on each call, because the number of
+     states can differ between calls and models may be fitted
+     concurrently) */
+  diag = (Complex*)smalloc(nstates * sizeof(Complex));
+  dq = (double**)smalloc(nstates * sizeof(double*));
+  f = (Complex**)smalloc(nstates * sizeof(Complex*));
+  tmpmat = (Complex**)smalloc(nstates * sizeof(Complex*));
+  sinv_dq_s = (Complex**)smalloc(nstates * sizeof(Complex*));
+  for (i = 0; i < nstates; i++) {
+    dq[i] = (double*)smalloc(nstates * sizeof(double));
+    f[i] = (Complex*)smalloc(nstates * sizeof(Complex));
+    tmpmat[i] = (Complex*)smalloc(nstates * sizeof(Complex));
+    sinv_dq_s[i] = (Complex*)smalloc(nstates * sizeof(Complex));
   }
   
   vec_zero(grad);
@@ -1334,5 +1325,83 @@ void compute_grad_em_exact(Vector *grad, Vector *params, void *data,
   }
   vec_scale(grad, -1);
   lst_free(erows); lst_free(ecols); lst_free(distinct_rows); 
+  for (i = 0; i < nstates; i++) {
+    sfree(dq[i]);
+    sfree(f[i]);
+    sfree(tmpmat[i]);
+    sfree(sinv_dq_s[i]);
+  }
+  sfree(dq);
+  sfree(f);
+  sfree(tmpmat);
+  sfree(sinv_dq_s);
+  sfree(diag);
+}
+
+
+/* Return TRUE if tm_compute_grad_exact can be used when fitting the
+   specified model by maximum likelihood (tm_fit).  The conditions are
+   those of compute_grad_em_exact: all branch lengths and/or rate
+   matrix parameters estimated for a single diagonalizable rate
+   matrix, without rescaling of the rate matrix during optimization */
+int tm_exact_grad_supported(TreeModel *mod) {
+  return (mod->estimate_branchlens == TM_BRANCHLENS_ALL &&
+          mod->subst_mod != JC69 && mod->subst_mod != F81 &&
+          mod->subst_mod != K80 && mod->subst_mod != UNDEF_MOD &&
+          !mod->estimate_backgd && mod->alt_subst_mods == NULL &&
+          mod->selection_idx < 0 && mod->scale_during_opt == 0 &&
+          !mod->empirical_rates && !mod->site_model &&
+          mod->root_leaf_id < 0 &&
+          (mod->order == 0 || !mod->use_conditionals) &&
+          mod->rate_matrix_param_row != NULL);
+}
+
+
+/* Exact gradient of tm_likelihood_wrapper (minus the log likelihood,
+   in bits).  By Fisher's identity, the gradient of the log likelihood
+   equals that of the expected complete-data log likelihood, given the
+   expected numbers of substitutions on each branch under the current
+   parameters.  These are obtained with one inside/outside pass, after
+   which compute_grad_em_exact gives all partial derivatives with
+   respect to branch lengths and rate matrix parameters.  The model
+   must satisfy tm_exact_grad_supported, must have a complex
+   eigensystem (see mm_set_eigentype), and mod->tree_posteriors must
+   have been allocated with expected_nsubst_tot */
+void tm_compute_grad_exact(Vector *grad, Vector *params, void *data, 
+                           Vector *lb, Vector *ub) {
+  TreeModel *mod = (TreeModel*)data;
+  MarkovMatrix *Q = mod->rate_matrix;
+  double fval;
+
+  tm_unpack_params(mod, params, -1);
+  if (Q->evals_z == NULL || Q->evec_matrix_z == NULL ||
+      Q->evec_matrix_inv_z == NULL) {
+    /* diagonalization failed; fall back on numerical derivatives */
+    fval = tm_likelihood_wrapper(params, data);
+    opt_gradient(grad, tm_likelihood_wrapper, params, data, 
+                 OPT_DERIV_CENTRAL, fval, lb, ub, DERIV_EPSILON);
+    return;
+  }
+  tl_compute_log_likelihood_blocked(mod, mod->msa, mod->category,
+                                    mod->tree_posteriors);
+  compute_grad_em_exact(grad, params, data, lb, ub);
+
+  /* with a reversible model, each branch from the root has half the
+     length given by its parameter, a factor that compute_grad_em_exact
+     does not include */
+  if (tm_is_reversible(mod)) {
+    List *traversal = tr_preorder(mod->tree);
+    int j, idx, lidx = -1, ridx = -1;
+    for (j = 1; j < lst_size(traversal); j++) {
+      TreeNode *n = lst_get_ptr(traversal, j);
+      idx = mod->param_map[mod->bl_idx + j - 1];
+      if (n == mod->tree->lchild) lidx = idx;
+      else if (n == mod->tree->rchild) ridx = idx;
+    }
+    if (lidx >= 0) vec_set(grad, lidx, vec_get(grad, lidx)/2);
+    if (ridx >= 0 && ridx != lidx) vec_set(grad, ridx, vec_get(grad, ridx)/2);
+  }
+
+  vec_scale(grad, 1.0/log(2));
 }
 
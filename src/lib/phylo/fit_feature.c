@@ -131,6 +131,63 @@ void ff_grad_wrapper(Vector *grad, Vector *params, void *data,
   }
 }
 
+/* (used below) build prefix sums over alignment positions of a
+   quantity defined per column tuple.  Over a whole chromosome the
+   running sums become much larger than the sum over a typical
+   feature, so taking differences of ordinary prefix sums would cancel
+   catastrophically.  Each prefix sum is therefore kept as an
+   unevaluated sum of two doubles, P[2*i] + P[2*i+1], accumulated with
+   an error-free transformation (Knuth's TwoSum), and represents the
+   sum of tuple_vals over positions 0, ..., i-1 almost exactly.  Use
+   ff_range_sum to obtain the sum over a feature.  Return value has
+   dimension 2 * (msa->length + 1) */
+static double *ff_position_prefix_sums(MSA *msa, double *tuple_vals) {
+  double *P = smalloc(2 * (msa->length + 1) * sizeof(double));
+  double hi = 0, lo = 0, v, s, bp;
+  int i;
+  P[0] = P[1] = 0;
+  for (i = 0; i < msa->length; i++) {
+    v = tuple_vals[msa->ss->tuple_idx[i]];
+    s = hi + v;
+    bp = s - hi;
+    lo += (hi - (s - bp)) + (v - bp);
+    hi = s;
+    P[2*(i+1)] = hi;
+    P[2*(i+1)+1] = lo;
+  }
+  return P;
+}
+
+/* (used below) sum over positions start, ..., end (1-based,
+   inclusive) from prefix sums computed by ff_position_prefix_sums */
+static PHAST_INLINE double ff_range_sum(double *P, int start, int end) {
+  return (P[2*end] - P[2*(start-1)]) + (P[2*end+1] - P[2*(start-1)+1]);
+}
+
+/* (used below) mark column tuples that occur in at least one
+   feature.  Uses a difference array over positions, so cost is
+   proportional to alignment length plus number of features, however
+   much features overlap.  Returns array of dimension
+   msa->ss->ntuples */
+static int *ff_tuples_in_features(MSA *msa, GFF_Set *gff) {
+  int *covered = smalloc((msa->length + 1) * sizeof(int));
+  int *used = smalloc(msa->ss->ntuples * sizeof(int));
+  int i, depth = 0;
+  for (i = 0; i <= msa->length; i++) covered[i] = 0;
+  for (i = 0; i < msa->ss->ntuples; i++) used[i] = FALSE;
+  for (i = 0; i < lst_size(gff->features); i++) {
+    GFF_Feature *f = lst_get_ptr(gff->features, i);
+    covered[f->start-1]++;
+    covered[f->end]--;
+  }
+  for (i = 0; i < msa->length; i++) {
+    depth += covered[i];
+    if (depth > 0) used[msa->ss->tuple_idx[i]] = TRUE;
+  }
+  sfree(covered);
+  return used;
+}
+
 /* Perform a likelihood ratio test for each feature in a GFF,
    comparing the given null model with an alternative model that has a
    free scaling parameter for all branches.  Assumes a 0th order
@@ -338,13 +395,20 @@ void ff_lrts_sub(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode,
   if (outside != NULL) lst_free(outside);
 }
 
-/* Score test */
+/* Score test.  The score for a feature is the sum of per-column
+   derivatives of the log likelihood at the null scale, so these are
+   computed once per column tuple and aggregated over each feature in
+   constant time using prefix sums over alignment positions */
 void ff_score_tests(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode, 
                     double *feat_pvals, double *feat_derivs, 
                     double *feat_teststats) {
   int i;
   FeatFitData *d;
-  double first_deriv, teststat, fim;
+  double first_deriv, teststat, fim, d1, ninform;
+  double *tuple_derivs = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_inform = smalloc(msa->ss->ntuples * sizeof(double));
+  double *cum_derivs, *cum_inform;
+  int *used;
 
   /* init FeatFitData */
   d = ff_init_fit_data(mod, msa, ALL, NNEUT, FALSE);
@@ -355,21 +419,36 @@ void ff_score_tests(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode,
   if (fim < 0) 
     die("ERROR: negative fisher information in col_score_tests\n");
 
+  /* per-column derivatives, for tuples that appear in features */
+  used = ff_tuples_in_features(msa, gff);
+  for (i = 0; i < msa->ss->ntuples; i++) {
+    checkInterruptN(i, 1000);
+    tuple_derivs[i] = tuple_inform[i] = 0;
+    if (!used[i]) continue;
+    tuple_inform[i] = col_has_data(mod, msa, i);
+    d->cdata->tupleidx = i;
+    col_scale_derivs(d->cdata, &d1, NULL, d->cdata->fels_scratch);
+    tuple_derivs[i] = d1;
+  }
+  cum_derivs = ff_position_prefix_sums(msa, tuple_derivs);
+  cum_inform = ff_position_prefix_sums(msa, tuple_inform);
+
   /* iterate through features  */
   for (i = 0; i < lst_size(gff->features); i++) {
-    checkInterrupt();
+    checkInterruptN(i, 1000);
     d->feat = lst_get_ptr(gff->features, i);
+    ninform = ff_range_sum(cum_inform, d->feat->start, d->feat->end);
 
     /* first check for actual substitution data in feature; if none,
-       don't waste time computing likelihoods */
-    if (!ff_has_data(mod, msa, d->feat)) {
+       score is not meaningful */
+    if (ninform < 0.5) {
       teststat = 0;
       first_deriv = 1;
     }
 
     else {
 
-      ff_scale_derivs(d, &first_deriv, NULL, d->cdata->fels_scratch);
+      first_deriv = ff_range_sum(cum_derivs, d->feat->start, d->feat->end);
 
       teststat = first_deriv*first_deriv / 
         ((d->feat->end - d->feat->start + 1) * fim);
@@ -403,6 +482,11 @@ void ff_score_tests(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode,
   }
 
   ff_free_fit_data(d);
+  sfree(tuple_derivs);
+  sfree(tuple_inform);
+  sfree(cum_derivs);
+  sfree(cum_inform);
+  sfree(used);
 }
 
 /* Subtree version of score test */
@@ -575,6 +659,123 @@ void ff_gerp(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode,
   sfree(has_data);
 }
 
+/* Column-sum version of ff_lrts.  Rather than fitting a single scale
+   factor per feature, column-by-column LRTs are computed once for all
+   column tuples (see col_lrts), and each feature is summarized by the
+   sum of its column log likelihood ratios and the mean scale factor
+   of its informative columns.  Sums are obtained in constant time per
+   feature from prefix sums over alignment positions, so large or
+   heavily overlapping feature sets cost little more than a single
+   pass over the alignment.  The p-value treats twice the summed log
+   likelihood ratio as chi-square distributed with one degree of
+   freedom per informative column; in CON and ACC modes, where each
+   column's statistic is a 50:50 mixture of a chi-square and a point
+   mass at zero, this is conservative */
+void ff_lrts_colsum(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode, 
+                    double *feat_pvals, double *feat_scales, 
+                    double *feat_llrs, FILE *logf) {
+  int i;
+  double ninform, delta_lnl, this_scale;
+  double *tuple_scales = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_llrs = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_inform = smalloc(msa->ss->ntuples * sizeof(double));
+  double *cum_scales, *cum_llrs, *cum_inform;
+
+  col_lrts(mod, msa, mode, NULL, tuple_scales, tuple_llrs, logf);
+  for (i = 0; i < msa->ss->ntuples; i++) {
+    tuple_inform[i] = col_has_data(mod, msa, i);
+    if (!tuple_inform[i]) tuple_scales[i] = 0;
+  }
+  cum_scales = ff_position_prefix_sums(msa, tuple_scales);
+  cum_llrs = ff_position_prefix_sums(msa, tuple_llrs);
+  cum_inform = ff_position_prefix_sums(msa, tuple_inform);
+
+  for (i = 0; i < lst_size(gff->features); i++) {
+    GFF_Feature *f = lst_get_ptr(gff->features, i);
+    checkInterruptN(i, 1000);
+
+    ninform = ff_range_sum(cum_inform, f->start, f->end);
+    if (ninform < 0.5) {
+      delta_lnl = 0;
+      this_scale = 1;
+    }
+    else {
+      delta_lnl = ff_range_sum(cum_llrs, f->start, f->end);
+      if (delta_lnl < 0) delta_lnl = 0;
+      this_scale = ff_range_sum(cum_scales, f->start, f->end) / ninform;
+    }
+
+    if (feat_pvals != NULL) {
+      feat_pvals[i] = (ninform < 0.5 ? 1 : 
+                       chisq_cdf(2*delta_lnl, floor(ninform + 0.5), FALSE));
+
+      if (feat_pvals[i] < 1e-20)
+        feat_pvals[i] = 1e-20;
+      /* approx limit of eval of tail prob; pvals of 0 cause problems */
+
+      if (mode == CONACC && this_scale > 1)
+        feat_pvals[i] *= -1; /* mark as acceleration */
+    }
+
+    if (feat_scales != NULL) feat_scales[i] = this_scale;
+    if (feat_llrs != NULL) feat_llrs[i] = delta_lnl;
+  }
+
+  sfree(tuple_scales);
+  sfree(tuple_llrs);
+  sfree(tuple_inform);
+  sfree(cum_scales);
+  sfree(cum_llrs);
+  sfree(cum_inform);
+}
+
+/* Column-sum version of ff_gerp.  Column-by-column GERP statistics
+   (see col_gerp) are computed once for all column tuples; for each
+   feature, the expected numbers of substitutions under neutrality and
+   after rescaling, and the number of rejected substitutions, are
+   summed over columns, and the number of species with data is
+   averaged.  Sums are obtained in constant time per feature from
+   prefix sums over alignment positions */
+void ff_gerp_colsum(TreeModel *mod, MSA *msa, GFF_Set *gff, mode_type mode, 
+                    double *feat_nneut, double *feat_nobs, 
+                    double *feat_nrejected, double *feat_nspec, FILE *logf) {
+  int i, len;
+  double *tuple_nneut = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_nobs = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_nrejected = smalloc(msa->ss->ntuples * sizeof(double));
+  double *tuple_nspec = smalloc(msa->ss->ntuples * sizeof(double));
+  double *cum_nneut, *cum_nobs, *cum_nrejected, *cum_nspec;
+
+  col_gerp(mod, msa, mode, tuple_nneut, tuple_nobs, tuple_nrejected, 
+           tuple_nspec, logf);
+  cum_nneut = ff_position_prefix_sums(msa, tuple_nneut);
+  cum_nobs = ff_position_prefix_sums(msa, tuple_nobs);
+  cum_nrejected = ff_position_prefix_sums(msa, tuple_nrejected);
+  cum_nspec = ff_position_prefix_sums(msa, tuple_nspec);
+
+  for (i = 0; i < lst_size(gff->features); i++) {
+    GFF_Feature *f = lst_get_ptr(gff->features, i);
+    len = f->end - f->start + 1;
+    if (feat_nneut != NULL) 
+      feat_nneut[i] = ff_range_sum(cum_nneut, f->start, f->end);
+    if (feat_nobs != NULL) 
+      feat_nobs[i] = ff_range_sum(cum_nobs, f->start, f->end);
+    if (feat_nrejected != NULL) 
+      feat_nrejected[i] = ff_range_sum(cum_nrejected, f->start, f->end);
+    if (feat_nspec != NULL) 
+      feat_nspec[i] = ff_range_sum(cum_nspec, f->start, f->end) / len;
+  }
+
+  sfree(tuple_nneut);
+  sfree(tuple_nobs);
+  sfree(tuple_nrejected);
+  sfree(tuple_nspec);
+  sfree(cum_nneut);
+  sfree(cum_nobs);
+  sfree(cum_nrejected);
+  sfree(cum_nspec);
+}
+
 /* Create object with metadata and scratch memory for fitting scale
    factors */
 FeatFitData *ff_init_fit_data(TreeModel *mod,  MSA *msa, scale_type stype, 
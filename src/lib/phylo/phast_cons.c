@@ -18,6 +18,7 @@
 #include <dgamma.h>
 #include <tree_likelihoods.h>
 #include <maf.h>
+#include <wig_writer.h>
 #include "phast_cons.h"
 
 
@@ -77,6 +78,8 @@ struct phastCons_struct *phastCons_struct_new(int rphast) {
   p->results_f = rphast ? stdout : stderr;
   p->progress_f = rphast ? stdout : stderr;
   p->results = rphast ? lol_new(2) : NULL;
+  p->optimizer = OPT_BFGS;
+  p->squarem = FALSE;
   return p;
 }
 
@@ -104,7 +107,7 @@ int phastCons(struct phastCons_struct *p) {
   MSA *msa;
 
   /* other vars */
-  int i, j, last;
+  int i, j;
   double lnl = INFTY;
   PhyloHmm *phmm;
   char *newname;
@@ -410,7 +413,7 @@ int phastCons(struct phastCons_struct *p) {
 			estim_trees, estim_rho,
                         &mu, &nu, &alpha_0, &beta_0, &tau_0,
                         &alpha_1, &beta_1, &tau_1, &rho,
-                        gamma, log_f);
+                        gamma, p->optimizer, p->squarem, log_f);
     if (estim_transitions || estim_indels || estim_rho) {
       if (!quiet) {
 	fprintf(results_f, "(");
@@ -532,8 +535,10 @@ int phastCons(struct phastCons_struct *p) {
   /* posterior probs */
   if (post_probs) {
     int *coord=NULL;
+    WigWriter *ww = NULL;
 
     if (!quiet) fprintf(results_f, "Computing posterior probabilities...\n");
+    if (post_probs_f != NULL) ww = ww_new(post_probs_f, seqname);
 
     if (states == NULL) {  //this only happens if two_state==FALSE
                            //return posterior probabilites for every state
@@ -547,19 +552,16 @@ int phastCons(struct phastCons_struct *p) {
       }
 
       /* print to post_probs_f */
-      last = -INFTY;
       for (j = 0, k = 0; j < msa->length; j++) {
 	checkInterruptN(j, 1000);
 	if (refidx == 0 || msa_get_char(msa, refidx-1, j) != GAP_CHAR) {
 	  if (!msa_missing_col(msa, refidx, j)) {
-	    if (post_probs_f != NULL) {
-	      if (k > last + 1)
-		fprintf(post_probs_f, "fixedStep chrom=%s start=%d step=1\n", seqname,
-			k + msa->idx_offset + 1);
+	    if (ww != NULL) {
+	      ww_start_line(ww, k + msa->idx_offset + 1);
 	      for (l=0; l < phmm->hmm->nstates; l++) {
-		if (l != 0) fprintf(post_probs_f, "\t");
-		fprintf(post_probs_f, "%.3f%c", postprobs[l][j],
-			l==phmm->hmm->nstates-1 ? '\n' : '\t');
+		if (l != 0) ww_put_char(ww, '\t');
+		ww_put_fixed(ww, postprobs[l][j], 3);
+		ww_put_char(ww, l==phmm->hmm->nstates-1 ? '\n' : '\t');
 	      }
 	    }
 	    if (results != NULL) {
@@ -568,7 +570,6 @@ int phastCons(struct phastCons_struct *p) {
 		postprobsNoMissing[l][idx] = postprobs[l][j];
 	      idx++;
 	    }
-	    last = k;
 	  }
 	  k++;
 	}
@@ -605,22 +606,16 @@ int phastCons(struct phastCons_struct *p) {
       }
 
       /* print to post_probs_f */
-      last = -INFTY;
       for (j = 0, k = 0; j < msa->length; j++) {
 	checkInterruptN(j, 1000);
 	if (refidx == 0 || msa_get_char(msa, refidx-1, j) != GAP_CHAR) {
 	  if (!msa_missing_col(msa, refidx, j)) {
-	    if (post_probs_f != NULL) {
-	      if (k > last + 1)
-		fprintf(post_probs_f, "fixedStep chrom=%s start=%d step=1\n", seqname,
-			k + msa->idx_offset + 1);
-	      fprintf(post_probs_f, "%.3f\n", postprobs[j]);
-	    }
+	    if (ww != NULL)
+	      ww_value(ww, k + msa->idx_offset + 1, postprobs[j], 3);
 	    if (results != NULL) {
 	      coord[idx] = k + msa->idx_offset + 1;
 	      postprobsNoMissing[idx++] = postprobs[j];
 	    }
-	    last = k;
 	  }
 	  k++;
 	}
@@ -636,6 +631,7 @@ int phastCons(struct phastCons_struct *p) {
       }
       sfree(postprobs);
     }
+    if (ww != NULL) ww_free(ww);
   }
 
   if (compute_likelihood) {
@@ -699,6 +695,163 @@ void compute_emissions_estim_rho(double **emissions, void **models,
 }
 
 
+static Vector *init_tree_params(PhyloHmm *phmm, Vector **full_params);
+void unpack_params_phmm(PhyloHmm *phmm, Vector *params);
+
+/* Functions for SQUAREM acceleration of fit_two_state (see
+   hmm_train_by_em).  The parameter vector consists of the transition
+   parameters of the functional HMM, if they are estimated, followed
+   by the free parameters of the tree models (with rho last) or by rho
+   alone.  With a target coverage, only nu is included, since mu is
+   determined by it.  Indel parameters are not extrapolated */
+
+/* number of transition parameters in SQUAREM parameter vector */
+static int sqm_ntrans_params(PhyloHmm *phmm) {
+  if (phmm->em_data->fix_functional) return 0;
+  return phmm->em_data->gamma > 0 ? 1 : 2;
+}
+
+static void sqm_get_trans_params(Vector *params, PhyloHmm *phmm) {
+  MarkovMatrix *M = phmm->functional_hmm->transition_matrix;
+  if (phmm->em_data->fix_functional) return;
+  if (phmm->em_data->gamma > 0)
+    vec_set(params, 0, mm_get(M, 1, 0));
+  else {
+    vec_set(params, 0, mm_get(M, 0, 1));
+    vec_set(params, 1, mm_get(M, 1, 0));
+  }
+}
+
+/* note: does not call phmm_reset */
+static void sqm_set_trans_params(Vector *params, PhyloHmm *phmm) {
+  MarkovMatrix *M = phmm->functional_hmm->transition_matrix;
+  double mu, nu;
+  if (phmm->em_data->fix_functional) return;
+  if (phmm->em_data->gamma > 0) {
+    nu = vec_get(params, 0);
+    mu = nu * (1-phmm->em_data->gamma)/phmm->em_data->gamma;
+    /* use stationary distribution for begin transitions, as in
+       phmm_estim_trans_em_coverage */
+    vec_set(phmm->functional_hmm->begin_transitions, 0, nu/(mu+nu));
+    vec_set(phmm->functional_hmm->begin_transitions, 1, mu/(mu+nu));
+  }
+  else {
+    mu = vec_get(params, 0);
+    nu = vec_get(params, 1);
+  }
+  mm_set(M, 0, 0, 1-mu);
+  mm_set(M, 0, 1, mu);
+  mm_set(M, 1, 0, nu);
+  mm_set(M, 1, 1, 1-nu);
+}
+
+/* set bounds for transition parameters, keeping mu and nu strictly
+   between 0 and 1 */
+static void sqm_trans_bounds(PhyloHmm *phmm, Vector *lower_bounds,
+                             Vector *upper_bounds) {
+  int i, n = sqm_ntrans_params(phmm);
+  for (i = 0; i < n; i++) {
+    vec_set(lower_bounds, i, 1e-6);
+    vec_set(upper_bounds, i, 1 - 1e-6);
+  }
+  if (n == 1)                   /* mu = z * nu < 1 */
+    vec_set(upper_bounds, 0,
+            min(1, phmm->em_data->gamma/(1-phmm->em_data->gamma)) - 1e-6);
+}
+
+static void sqm_get_params_trans(Vector *params, HMM *hmm, void *data) {
+  sqm_get_trans_params(params, (PhyloHmm*)data);
+}
+
+static void sqm_set_params_trans(Vector *params, HMM *hmm, void *data) {
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  sqm_set_trans_params(params, phmm);
+  phmm_reset(phmm);
+}
+
+static void sqm_get_params_rho(Vector *params, HMM *hmm, void *data) {
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  sqm_get_trans_params(params, phmm);
+  vec_set(params, params->size - 1, phmm->em_data->rho);
+}
+
+static void sqm_set_params_rho(Vector *params, HMM *hmm, void *data) {
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  sqm_set_trans_params(params, phmm);
+  phmm->em_data->rho = vec_get(params, params->size - 1);
+  phmm->mods[0]->scale = phmm->em_data->rho;
+  tm_set_subst_matrices(phmm->mods[0]);
+  phmm_reset(phmm);
+}
+
+/* also makes the full parameter vectors of the tree models consistent
+   with their current state, as required by unpack_params_phmm */
+static void sqm_get_params_trees(Vector *params, HMM *hmm, void *data) {
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  Vector *tree_params, *full_params;
+  int i, ntrans = sqm_ntrans_params(phmm);
+
+  sqm_get_trans_params(params, phmm);
+  tree_params = init_tree_params(phmm, &full_params);
+  if (ntrans + tree_params->size != params->size)
+    die("ERROR sqm_get_params_trees: expected %i parameters, got %i\n",
+        params->size, ntrans + tree_params->size);
+  for (i = 0; i < tree_params->size; i++)
+    vec_set(params, ntrans + i, vec_get(tree_params, i));
+  vec_copy(phmm->mods[0]->all_params, full_params);
+  vec_copy(phmm->mods[1]->all_params, full_params);
+  vec_free(tree_params);
+  vec_free(full_params);
+}
+
+static void sqm_set_params_trees(Vector *params, HMM *hmm, void *data) {
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  int i, ntrans = sqm_ntrans_params(phmm);
+  Vector *tree_params = vec_new(params->size - ntrans);
+
+  sqm_set_trans_params(params, phmm);
+  for (i = 0; i < tree_params->size; i++)
+    vec_set(tree_params, i, vec_get(params, ntrans + i));
+  unpack_params_phmm(phmm, tree_params);
+  vec_free(tree_params);
+  phmm_reset(phmm);             /* (also sets branch length factors
+                                   with parametric indel model) */
+}
+
+/* Create SQUAREM object for fit_two_state, or return NULL if there
+   are no parameters to extrapolate */
+static Squarem *sqm_new_two_state(PhyloHmm *phmm, int estim_trees,
+                                  int estim_rho) {
+  int i, ntrans = sqm_ntrans_params(phmm), npar = ntrans;
+  Vector *lower_bounds, *upper_bounds, *tree_params;
+  Squarem *sq;
+
+  if (estim_trees) {
+    tree_params = init_tree_params(phmm, NULL);
+    npar += tree_params->size;
+    vec_free(tree_params);
+  }
+  else if (estim_rho) npar++;
+  if (npar == 0) return NULL;
+
+  lower_bounds = vec_new(npar);
+  upper_bounds = vec_new(npar);
+  sqm_trans_bounds(phmm, lower_bounds, upper_bounds);
+  for (i = ntrans; i < npar; i++) { /* branch lengths, etc. */
+    vec_set(lower_bounds, i, 0);
+    vec_set(upper_bounds, i, INFTY);
+  }
+  if (estim_trees || estim_rho) { /* rho */
+    vec_set(lower_bounds, npar - 1, estim_trees ? 0 : 1e-6);
+    vec_set(upper_bounds, npar - 1, 1);
+  }
+
+  sq = sqm_new(npar, lower_bounds, upper_bounds);
+  vec_free(lower_bounds);
+  vec_free(upper_bounds);
+  return sq;
+}
+
 /* Estimate parameters for the two-state model using an EM algorithm.
    Any or all of the parameters 'mu' and 'nu', the indel parameters, and
    the tree models themselves may be estimated.  Returns ln
@@ -707,9 +860,11 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
                      int estim_trees, int estim_rho, double *mu, double *nu,
                      double *alpha_0, double *beta_0, double *tau_0,
                      double *alpha_1, double *beta_1, double *tau_1,
-                     double *rho, double gamma, FILE *logf) {
+                     double *rho, double gamma, opt_method_type optimizer,
+                     int squarem, FILE *logf) {
   double retval;
   void (*compute_emissions_func)(double **, void **, int, void*, int, int);
+  Squarem *sq = NULL;
 
   mm_set(phmm->functional_hmm->transition_matrix, 0, 0, 1-*mu);
   mm_set(phmm->functional_hmm->transition_matrix, 0, 1, *mu);
@@ -725,6 +880,7 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
   phmm->em_data->rho = *rho;
   phmm->em_data->gamma = gamma;
   phmm->em_data->H = NULL;      /* will be defined as needed */
+  phmm->em_data->optimizer = optimizer;
 
   if (phmm->indel_mode == PARAMETERIC) {
     phmm->alpha[0] = *alpha_0;
@@ -752,13 +908,17 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
     compute_emissions_func = compute_emissions_estim_rho;
   else compute_emissions_func = NULL;
 
+  if (squarem)
+    sq = sqm_new_two_state(phmm, estim_trees, estim_rho);
+
   if (estim_trees) {
     retval = hmm_train_by_em(phmm->hmm, phmm->mods, phmm, 1, &phmm->alloc_len, NULL,
                              compute_emissions_func, reestimate_trees,
                              gamma > 0 ?
                              phmm_estim_trans_em_coverage : phmm_estim_trans_em,
                              phmm_get_obs_idx_em,
-                             phmm_log_em, phmm->emissions, logf) * log(2);
+                             phmm_log_em, phmm->emissions, logf, sq,
+                             sqm_get_params_trees, sqm_set_params_trees) * log(2);
 
 
     /* have to do final rescaling of tree models to get units of subst/site */
@@ -781,7 +941,8 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
                              gamma > 0 ?
                              phmm_estim_trans_em_coverage : phmm_estim_trans_em,
                              phmm_get_obs_idx_em,
-                             phmm_log_em, phmm->emissions, logf) * log(2);
+                             phmm_log_em, phmm->emissions, logf, sq,
+                             sqm_get_params_rho, sqm_set_params_rho) * log(2);
 
     /* do final rescaling of conserved tree */
     tm_scale_branchlens(phmm->mods[0], phmm->em_data->rho, FALSE);
@@ -795,9 +956,12 @@ double fit_two_state(PhyloHmm *phmm, MSA *msa, int estim_func, int estim_indels,
                              &phmm->alloc_len, NULL, NULL, NULL,
                              gamma > 0 ?
                              phmm_estim_trans_em_coverage : phmm_estim_trans_em,
-                             NULL, phmm_log_em, phmm->emissions, logf) * log(2);
+                             NULL, phmm_log_em, phmm->emissions, logf, sq,
+                             sqm_get_params_trans, sqm_set_params_trans) * log(2);
   }
 
+  if (sq != NULL) sqm_free(sq);
+
   *mu = mm_get(phmm->functional_hmm->transition_matrix, 0, 1);
   *nu = mm_get(phmm->functional_hmm->transition_matrix, 1, 0);
   *rho = phmm->em_data->rho;
@@ -903,25 +1067,16 @@ double likelihood_wrapper(Vector *params, void *data) {
                                    one cats and mods? */
 }
 
-/* Re-estimate phylogenetic model based on expected counts (M step of EM) */
-void reestimate_trees(TreeModel **models, int nmodels, void *data,
-                      double **E, int nobs, FILE *logf) {
-
-  PhyloHmm *phmm = (PhyloHmm*)data;
-  int k, obsidx, i, npar;
-  Vector *params, *lower_bounds, *upper_bounds, *opt_params;
-  double ll;
+/* Set up parameter mappings for joint re-estimation of the two tree
+   models and rho (see reestimate_trees), and return a new vector
+   containing the current values of the free parameters, with rho
+   last.  If full_params is non-NULL, *full_params is set to a new
+   vector of all parameters of the nonconserved model. */
+static Vector *init_tree_params(PhyloHmm *phmm, Vector **full_params) {
+  int i, npar;
+  Vector *params, *opt_params;
   int haveratevar, orig_nratecats[2];
 
-  /* FIXME: what about when multiple states per model?  Need to
-     collapse sufficient stats.  Could probably be done generally...
-     need to use state_to_cat, etc. in deciding which categories to
-     use */
-
-  for (k = 0; k < phmm->nmods; k++)
-    for (obsidx = 0; obsidx < nobs; obsidx++)
-      phmm->em_data->msa->ss->cat_counts[k][obsidx] = E[k][obsidx];
-
   /* This will set up params in phmm->mods[0] and phmm->mods[1].  The
      tree models should be the same at this point, since only one model
      is allowed for --estimate-trees.  Therefore the parameter setup
@@ -978,6 +1133,32 @@ void reestimate_trees(TreeModel **models, int nmodels, void *data,
   }
   vec_set(opt_params, npar - 1, phmm->em_data->rho);
 
+  if (full_params != NULL) *full_params = params;
+  else vec_free(params);
+  return opt_params;
+}
+
+/* Re-estimate phylogenetic model based on expected counts (M step of EM) */
+void reestimate_trees(TreeModel **models, int nmodels, void *data,
+                      double **E, int nobs, FILE *logf) {
+
+  PhyloHmm *phmm = (PhyloHmm*)data;
+  int k, obsidx, npar;
+  Vector *params, *lower_bounds, *upper_bounds, *opt_params;
+  double ll;
+
+  /* FIXME: what about when multiple states per model?  Need to
+     collapse sufficient stats.  Could probably be done generally...
+     need to use state_to_cat, etc. in deciding which categories to
+     use */
+
+  for (k = 0; k < phmm->nmods; k++)
+    for (obsidx = 0; obsidx < nobs; obsidx++)
+      phmm->em_data->msa->ss->cat_counts[k][obsidx] = E[k][obsidx];
+
+  opt_params = init_tree_params(phmm, &params);
+  npar = opt_params->size;
+
   lower_bounds = vec_new(npar);
   vec_zero(lower_bounds);
   upper_bounds = vec_new(npar);
@@ -988,8 +1169,8 @@ void reestimate_trees(TreeModel **models, int nmodels, void *data,
     fprintf(logf, "\nRE-ESTIMATION OF TREE MODEL:\n");
 
   /* keep Hessian arround so it can be used from one iteration to the
-     next */
-  if (phmm->em_data->H == NULL) {
+     next (BFGS only; L-BFGS-B starts afresh each time) */
+  if (phmm->em_data->H == NULL && phmm->em_data->optimizer == OPT_BFGS) {
     phmm->em_data->H = mat_new(npar,npar);
     mat_set_identity(phmm->em_data->H);
   }
@@ -997,8 +1178,13 @@ void reestimate_trees(TreeModel **models, int nmodels, void *data,
   vec_copy(phmm->mods[0]->all_params, params);
   vec_copy(phmm->mods[1]->all_params, params);
 
-  if (opt_bfgs(likelihood_wrapper, opt_params, phmm, &ll, lower_bounds,
-               NULL, logf, NULL, OPT_MED_PREC, phmm->em_data->H, NULL) != 0)
+  if (phmm->em_data->optimizer == OPT_LBFGSB) {
+    if (opt_lbfgsb(likelihood_wrapper, opt_params, phmm, &ll, lower_bounds,
+                   NULL, logf, NULL, OPT_MED_PREC, NULL) != 0)
+      die("ERROR returned by opt_lbfgsb.\n");
+  }
+  else if (opt_bfgs(likelihood_wrapper, opt_params, phmm, &ll, lower_bounds,
+                    NULL, logf, NULL, OPT_MED_PREC, phmm->em_data->H, NULL) != 0)
     die("ERROR returned by opt_bfgs.\n");
 
   if (logf != NULL)
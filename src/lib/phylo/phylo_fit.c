@@ -34,6 +34,7 @@
 #include <stacks.h>
 #include <trees.h>
 #include <misc.h>
+#include <parallel.h>
 
 /* initialize phyloFit options to defaults (slightly different
    for rphast).
@@ -58,6 +59,7 @@ struct phyloFit_struct* phyloFit_struct_new(int rphast) {
   pf->window_shift = -1;
   pf->use_conditionals = FALSE;
   pf->precision = OPT_HIGH_PREC;
+  pf->optimizer = OPT_BFGS;
   pf->likelihood_only = FALSE;
   pf->do_bases = FALSE;
   pf->do_expected_nsubst = FALSE;
@@ -97,6 +99,8 @@ struct phyloFit_struct* phyloFit_struct_new(int rphast) {
   pf->use_selection = 0;
   pf->selection = 0.0;
   pf->max_em_its = -1;
+  pf->squarem = FALSE;
+  pf->nrestarts = 0;
 
   pf->results = rphast ? lol_new(2) : NULL;
   return pf;
@@ -661,9 +665,141 @@ void print_window_summary(FILE* WINDOWF, List *window_coords, int win,
 
 
 
+/* in window mode, number of consecutive windows fitted in sequence
+   by one thread, each starting from the estimates for the previous
+   one */
+#define PF_WIN_CHUNK 8
+
+/* number of windows set up (and kept in memory) at a time */
+#define PF_WIN_BATCH (32 * PF_WIN_CHUNK)
+
+/* with --restarts, fits whose log likelihoods are within this amount
+   of the best are considered to have reached the same optimum */
+#define PF_RESTART_LNL_TOL 0.01
+
+/* data shared by calls to pf_fit_chunk */
+typedef struct {
+  struct phyloFit_struct *pf;
+  List *cats_to_do;
+  int ncats;                    /* number of categories */
+  int nwins;                    /* number of windows */
+  int chunk_size;               /* number of windows per chunk; if
+                                   zero, each category of a single
+                                   window forms a chunk */
+  int warm_start;               /* whether to start from estimates
+                                   for the previous window in chunk */
+  MSA **msas;                   /* alignment for each window */
+  TreeModel **mods;             /* model for window w and category
+                                   i is mods[w*ncats+i] (NULL if none
+                                   is to be fitted) */
+  Vector **params;              /* initial parameters for each model */
+  FILE **logf, **error_file;    /* log and error output for each chunk */
+  int parallel;                 /* whether chunks run concurrently */
+  int first_win;                /* index of first window in batch */
+  unsigned int restart_seed;    /* seed for random starting points
+                                   (with restarts) */
+  List **optima;                /* log likelihoods reached from
+                                   starting points, for each model
+                                   (with restarts) */
+} PfFitData;
+
+/* Fit the model for window w and the ith category in cats_to_do.
+   first_w is the first window in the chunk */
+static void pf_fit_model(PfFitData *cd, int w, int i, int first_w,
+                         FILE *logf, FILE *error_file) {
+  struct phyloFit_struct *pf = cd->pf;
+  int k = w * cd->ncats + i, prev, j, cat = lst_get_int(cd->cats_to_do, i);
+  TreeModel *mod = cd->mods[k];
+
+  if (mod == NULL) return;
+
+  if (cd->warm_start) {
+    /* start from the estimates (and, with BFGS, the final inverse
+       Hessian) for the nearest preceding window in the chunk */
+    for (prev = k - cd->ncats; prev >= first_w * cd->ncats &&
+           cd->mods[prev] == NULL; prev -= cd->ncats);
+    if (prev >= first_w * cd->ncats &&
+        cd->params[prev]->size == cd->params[k]->size) {
+      /* only free parameters are carried over, because tm_fit
+         rescales the final estimates, including any that are held
+         constant (e.g., with --no-rates).  Rate-variation parameters
+         also keep their usual initial values, because the likelihood
+         is nearly flat in alpha when it is large, and a fit started
+         there tends to stay there */
+      for (j = 0; j < cd->params[k]->size; j++)
+        if (mod->param_map[j] >= 0 && 
+            (j < mod->ratevar_idx ||
+             j >= mod->ratevar_idx + tm_get_nratevarparams(mod)))
+          vec_set(cd->params[k], j, vec_get(cd->params[prev], j));
+      if (cd->mods[prev]->inv_hessian != NULL)
+        mod->inv_hessian = mat_create_copy(cd->mods[prev]->inv_hessian);
+    }
+    else if (!pf->use_em && mod->optimizer == OPT_BFGS) {
+      mod->inv_hessian = mat_new(1, 1); /* placeholder; tm_fit will
+                                           pass back the final one */
+      mat_set_identity(mod->inv_hessian);
+    }
+  }
+
+  if (pf->use_em)
+    tm_fit_em(mod, cd->msas[w], cd->params[k], cat, pf->precision,
+              pf->max_em_its, logf, error_file);
+  else if (pf->nrestarts > 0) {
+#ifndef RPHAST
+    /* random starting points are drawn from a stream specific to
+       this model, so that they do not depend on the order in which
+       models are fitted */
+    RandStream rs;
+    rand_stream_init(&rs, cd->restart_seed, 
+                     (cd->first_win + w) * cd->ncats + i);
+    rand_stream_use(&rs);
+#endif
+    cd->optima[k] = lst_new_dbl(pf->nrestarts + 1);
+    tm_fit_restarts(mod, cd->msas[w], cd->params[k], cat, pf->precision,
+                    pf->nrestarts, logf, pf->quiet || cd->parallel, 
+                    error_file, cd->optima[k]);
+#ifndef RPHAST
+    rand_stream_use(NULL);
+#endif
+  }
+  else
+    tm_fit(mod, cd->msas[w], cd->params[k], cat, pf->precision,
+           logf, pf->quiet || cd->parallel, error_file);
+}
+
+/* Fit the models in the cth chunk (for use with thr_foreach).  The
+   alignments and their sufficient statistics must already be set up,
+   and are only read */
+static void pf_fit_chunk(int c, int thread, void *data) {
+  PfFitData *cd = data;
+  int w, i, first_w = c * cd->chunk_size;
+
+  if (cd->chunk_size == 0)
+    pf_fit_model(cd, 0, c, 0, cd->logf[c], cd->error_file[c]);
+  else
+    for (w = first_w; w < min(first_w + cd->chunk_size, cd->nwins); w++)
+      for (i = 0; i < cd->ncats; i++)
+        pf_fit_model(cd, w, i, first_w, cd->logf[c], cd->error_file[c]);
+}
+
+/* Append the contents of a temporary file to another file, and close
+   the temporary file */
+static void pf_append_tmpfile(FILE *dest, FILE *tmpf) {
+  char buf[BUFSIZ];
+  size_t n;
+  rewind(tmpf);
+  while ((n = fread(buf, 1, BUFSIZ, tmpf)) > 0)
+    fwrite(buf, 1, n, dest);
+  fclose(tmpf);
+}
+
 int run_phyloFit(struct phyloFit_struct *pf) {
   FILE *F, *WINDOWF=NULL;
-  int i, j, win, root_leaf_id = -1;
+  int i, j, k, w, win, root_leaf_id = -1, ncats, nfit, nchunks, nwins, 
+    batch, copy_input, chain_cats;
+  unsigned int *ninf_sites;
+  PfFitData cd;
+  SS_Window *sw = NULL;
   String *mod_fname;
   MSA *source_msa;
   String *tmpstr = str_new(STR_SHORT_LEN);
@@ -680,7 +816,7 @@ int run_phyloFit(struct phyloFit_struct *pf) {
   TreeNode *tree = pf->tree;
   GFF_Set *gff = pf->gff;
   int quiet = pf->quiet;
-  TreeModel *input_mod = pf->input_mod;
+  TreeModel *input_mod = pf->input_mod, *last_fit;
   FILE *error_file=NULL;
 
   if (pf->no_freqs)
@@ -693,6 +829,10 @@ int run_phyloFit(struct phyloFit_struct *pf) {
     die("ERROR: Cannot use --markov with --EM.    Type %s for usage.\n",
 	pf->see_for_help);
 
+  if (pf->nrestarts > 0 && pf->use_em)
+    die("ERROR: Cannot use --restarts with --EM.    Type %s for usage.\n",
+	pf->see_for_help);
+
   if (pf->likelihood_only && input_mod == NULL)
     die("ERROR: --lnl requires --init-model.  Type '%s' for usage.\n",
 	pf->see_for_help);
@@ -923,350 +1063,492 @@ int run_phyloFit(struct phyloFit_struct *pf) {
   if (pf->error_fname != NULL)
     error_file = phast_fopen(pf->error_fname, "w");
 
-  /* now estimate models (window by window, if necessary) */
+  /* now estimate models (window by window, if necessary).  Windows
+     are set up in batches.  Within a batch, runs of PF_WIN_CHUNK
+     consecutive windows are fitted concurrently, each window starting
+     from the estimates for the previous one in its run (unless
+     another initialization is requested).  Without windows, the
+     categories are fitted concurrently, except with --init-model,
+     where each category starts from the estimates for the previous
+     one and they are therefore fitted in sequence as they are set
+     up.  Either way, the division of work does not depend on the
+     number of threads, and results are output in order */
   mod_fname = str_new(STR_MED_LEN);
   source_msa = msa;
-  for (win = 0;
-       win < (pf->window_coords == NULL ? 1 : lst_size(pf->window_coords));
-       win += 2) {
-    int win_beg, win_end;
-
-    if (pf->window_coords != NULL) {
-      win_beg = lst_get_int(pf->window_coords, win);
-      win_end = lst_get_int(pf->window_coords, win+1);
-      if (win_beg < 0 || win_end < 0) continue;
-
-      /* note: msa_sub_alignment uses a funny indexing system (see docs) */
-      msa = msa_sub_alignment(source_msa, NULL, 0, win_beg-1, win_end);
+  ncats = lst_size(cats_to_do);
+  nwins = (pf->window_coords == NULL ? 1 : lst_size(pf->window_coords) / 2);
+  copy_input = (ncats > 1 || nwins > 1);
+  chain_cats = (input_mod != NULL && !pf->likelihood_only &&
+                pf->window_coords == NULL && ncats > 1);
+  if (pf->window_coords != NULL && !subst_mod_is_codon_model(subst_mod)) {
+    /* window alignments are obtained by sliding a window along the
+       sufficient statistics of the full alignment (see ss_window_new),
+       rather than by extracting and rehashing the columns of each
+       window.  (Codon models, whose tuples depend on the reading
+       frame of the window, are handled the old way) */
+    if (source_msa->ss == NULL) {
+      if (!quiet) fprintf(stderr, "Extracting sufficient statistics ...\n");
+      ss_from_msas(source_msa, tm_order(subst_mod)+1, TRUE, NULL, NULL,
+                   NULL, -1, FALSE);
+    }
+    if (!pf->likelihood_only)
+      ss_collapse_missing(source_msa, !pf->gaps_as_bases);
+    sw = ss_window_new(source_msa,
+                       pf->cats_to_do_str != NULL ? cats_to_do : NULL);
+  }
+  cd.pf = pf;
+  cd.cats_to_do = cats_to_do;
+  cd.ncats = ncats;
+  cd.chunk_size = (pf->window_coords == NULL ? 0 : PF_WIN_CHUNK);
+  cd.warm_start = (pf->window_coords != NULL && !pf->random_init &&
+                   !pf->init_parsimony);
+  cd.restart_seed = 0;
+  cd.parallel = FALSE;
+#ifndef RPHAST
+  if (pf->nrestarts > 0) cd.restart_seed = (unsigned int)random();
+#endif
+
+  for (batch = 0; batch < nwins; batch += PF_WIN_BATCH) {
+    cd.nwins = min(PF_WIN_BATCH, nwins - batch);
+    nchunks = (cd.chunk_size == 0 ? ncats :
+               (cd.nwins + cd.chunk_size - 1) / cd.chunk_size);
+    cd.msas = smalloc(cd.nwins * sizeof(MSA*));
+    cd.mods = smalloc(cd.nwins * ncats * sizeof(TreeModel*));
+    cd.params = smalloc(cd.nwins * ncats * sizeof(Vector*));
+    cd.optima = smalloc(cd.nwins * ncats * sizeof(List*));
+    cd.first_win = batch;
+    cd.logf = smalloc(nchunks * sizeof(FILE*));
+    cd.error_file = smalloc(nchunks * sizeof(FILE*));
+    ninf_sites = smalloc(cd.nwins * ncats * sizeof(unsigned int));
+    for (k = 0; k < cd.nwins * ncats; k++) {
+      cd.mods[k] = NULL;
+      cd.params[k] = NULL;
+      cd.optima[k] = NULL;
     }
+    nfit = 0;
+    last_fit = NULL;
 
-    /* process each category */
-    for (i = 0; i < lst_size(cats_to_do); i++) {
-      TreeModel *mod;
-      Vector *params = NULL;
-      List *pruned_names;
-      int old_nnodes, cat = lst_get_int(cats_to_do, i);
-      unsigned int ninf_sites;
-
-      if (input_mod == NULL)
-        mod = tm_new(tr_create_copy(tree), NULL, NULL, subst_mod,
-                     msa->alphabet, pf->nratecats == -1 ? 1 : pf->nratecats,
-		     pf->alpha, pf->rate_consts, root_leaf_id);
-      else if (pf->likelihood_only)
-        mod = input_mod;
-      else {
-	List *rate_consts, *freq;
-	double alpha;
-	int nratecats;
-
-	if (pf->nratecats != -1) {
-	  nratecats = pf->nratecats;
-	  alpha = pf->alpha;
-	  rate_consts = pf->rate_consts;
-	  freq = NULL;
-	} else {
-	  nratecats = input_mod->nratecats;
-	  alpha = input_mod->alpha;
-	  if (input_mod->rK != NULL) {
-	    rate_consts = lst_new_dbl(input_mod->nratecats);
-	    for (j=0; j < input_mod->nratecats; j++)
-	      lst_push_dbl(rate_consts, input_mod->rK[j]);
-	  } else rate_consts = NULL;
-	  if (input_mod->freqK != NULL) {
-	    freq = lst_new_dbl(input_mod->nratecats);
-	    for (j=0; j < input_mod->nratecats; j++)
-	      lst_push_dbl(freq, input_mod->freqK[j]);
-	  } else freq = NULL;
-	}
-        mod = input_mod;
-        tm_reinit(mod, subst_mod, nratecats, alpha,
-		  rate_consts, freq);
-	if (rate_consts != pf->rate_consts)
-	  lst_free(rate_consts);
-	if (freq != NULL)
-	  lst_free(freq);
+    /* set up alignment and a model for each category, for each window */
+    for (w = 0; w < cd.nwins; w++) {
+      win = 2 * (batch + w);
+      cd.msas[w] = NULL;
+      if (pf->window_coords != NULL) {
+        int win_beg = lst_get_int(pf->window_coords, win),
+          win_end = lst_get_int(pf->window_coords, win+1);
+        if (win_beg < 0 || win_end < 0) continue;
+
+        /* note: msa_sub_alignment uses a funny indexing system (see docs) */
+        if (sw != NULL) {
+          ss_window_set(sw, win_beg-1, win_end);
+          msa = ss_window_msa(sw);
+        }
+        else msa = msa_sub_alignment(source_msa, NULL, 0, win_beg-1, win_end);
       }
+      cd.msas[w] = msa;
+
+      for (i = 0; i < ncats; i++) {
+        TreeModel *mod, *init_mod;
+        Vector *params = NULL;
+        List *pruned_names;
+        int old_nnodes, cat = lst_get_int(cats_to_do, i);
+
+        k = w * ncats + i;
+        init_mod = (last_fit != NULL ? last_fit : input_mod);
+
+        if (input_mod == NULL)
+          mod = tm_new(tr_create_copy(tree), NULL, NULL, subst_mod,
+                       msa->alphabet, pf->nratecats == -1 ? 1 : pf->nratecats,
+		       pf->alpha, pf->rate_consts, root_leaf_id);
+        else if (pf->likelihood_only)
+          mod = copy_input ? tm_create_copy(input_mod) : input_mod;
+        else {
+	  List *rate_consts, *freq;
+	  double alpha;
+	  int nratecats;
+
+	  if (pf->nratecats != -1) {
+	    nratecats = pf->nratecats;
+	    alpha = pf->alpha;
+	    rate_consts = pf->rate_consts;
+	    freq = NULL;
+	  } else {
+	    nratecats = init_mod->nratecats;
+	    alpha = init_mod->alpha;
+	    if (init_mod->rK != NULL) {
+	      rate_consts = lst_new_dbl(init_mod->nratecats);
+	      for (j=0; j < init_mod->nratecats; j++)
+		lst_push_dbl(rate_consts, init_mod->rK[j]);
+	    } else rate_consts = NULL;
+	    if (init_mod->freqK != NULL) {
+	      freq = lst_new_dbl(init_mod->nratecats);
+	      for (j=0; j < init_mod->nratecats; j++)
+		lst_push_dbl(freq, init_mod->freqK[j]);
+	    } else freq = NULL;
+	  }
+          /* each category (and window) gets its own copy of the
+             model it starts from: the input model or, when categories
+             are chained, the model fitted for the previous one */
+          mod = copy_input ? tm_create_copy(init_mod) : input_mod;
+          tm_reinit(mod, subst_mod, nratecats, alpha,
+		    rate_consts, freq);
+	  if (rate_consts != pf->rate_consts)
+	    lst_free(rate_consts);
+	  if (freq != NULL)
+	    lst_free(freq);
+        }
 
-      if (pf->use_selection) {
-	mod->selection_idx = 0;
-	mod->selection = pf->selection;
-      }
+        if (pf->use_selection) {
+	  mod->selection_idx = 0;
+	  mod->selection = pf->selection;
+        }
 
-      mod->noopt_arg = pf->nooptstr == NULL ? NULL : str_new_charstr(pf->nooptstr->chars);
-      mod->eqfreq_sym = pf->symfreq || subst_mod == SSREV;
-      if (pf->bound_arg != NULL) {
-	mod->bound_arg = lst_new_ptr(lst_size(pf->bound_arg));
-	for (j=0; j < lst_size(pf->bound_arg); j++) {
-	  String *tmp = lst_get_ptr(pf->bound_arg, j);
-	  lst_push_ptr(mod->bound_arg, str_new_charstr(tmp->chars));
-	}
-      } else mod->bound_arg = NULL;
-
-      mod->use_conditionals = pf->use_conditionals;
-
-      if (pf->estimate_scale_only ||
-	  pf->estimate_backgd ||
-	  pf->no_rates ||
-	  pf->assume_clock) {
-        if (pf->estimate_scale_only) {
-          mod->estimate_branchlens = TM_SCALE_ONLY;
-
-          if (pf->subtree_name != NULL) { /* estimation of subtree scale */
-            String *s1 = str_new_charstr(pf->subtree_name),
-              *s2 = str_new_charstr(pf->subtree_name);
-            str_root(s1, ':'); str_suffix(s2, ':'); /* parse string */
-            mod->subtree_root = tr_get_node(mod->tree, s1->chars);
-            if (mod->subtree_root == NULL) {
-	      tr_name_ancestors(mod->tree);
-	      mod->subtree_root = tr_get_node(mod->tree, s1->chars);
-	      if (mod->subtree_root == NULL)
-		die("ERROR: no node named '%s'.\n", s1->chars);
-	    }
-            if (s2->length > 0) {
-              if (str_equals_charstr(s2, "loss"))
-		mod->scale_sub_bound = LB;
-              else if (str_equals_charstr(s2, "gain"))
-		mod->scale_sub_bound = UB;
-              else die("ERROR: unrecognized suffix '%s'\n", s2->chars);
+        mod->noopt_arg = pf->nooptstr == NULL ? NULL : str_new_charstr(pf->nooptstr->chars);
+        mod->eqfreq_sym = pf->symfreq || subst_mod == SSREV;
+        mod->optimizer = pf->optimizer;
+        mod->squarem = pf->squarem;
+        if (pf->bound_arg != NULL) {
+	  mod->bound_arg = lst_new_ptr(lst_size(pf->bound_arg));
+	  for (j=0; j < lst_size(pf->bound_arg); j++) {
+	    String *tmp = lst_get_ptr(pf->bound_arg, j);
+	    lst_push_ptr(mod->bound_arg, str_new_charstr(tmp->chars));
+	  }
+        } else mod->bound_arg = NULL;
+
+        mod->use_conditionals = pf->use_conditionals;
+
+        if (pf->estimate_scale_only ||
+	    pf->estimate_backgd ||
+	    pf->no_rates ||
+	    pf->assume_clock) {
+          if (pf->estimate_scale_only) {
+            mod->estimate_branchlens = TM_SCALE_ONLY;
+
+            if (pf->subtree_name != NULL) { /* estimation of subtree scale */
+              String *s1 = str_new_charstr(pf->subtree_name),
+                *s2 = str_new_charstr(pf->subtree_name);
+              str_root(s1, ':'); str_suffix(s2, ':'); /* parse string */
+              mod->subtree_root = tr_get_node(mod->tree, s1->chars);
+              if (mod->subtree_root == NULL) {
+		tr_name_ancestors(mod->tree);
+		mod->subtree_root = tr_get_node(mod->tree, s1->chars);
+		if (mod->subtree_root == NULL)
+		  die("ERROR: no node named '%s'.\n", s1->chars);
+	      }
+              if (s2->length > 0) {
+                if (str_equals_charstr(s2, "loss"))
+		  mod->scale_sub_bound = LB;
+                else if (str_equals_charstr(s2, "gain"))
+		  mod->scale_sub_bound = UB;
+                else die("ERROR: unrecognized suffix '%s'\n", s2->chars);
+              }
+              str_free(s1); str_free(s2);
             }
-            str_free(s1); str_free(s2);
           }
-        }
-
-        else if (pf->assume_clock)
-          mod->estimate_branchlens = TM_BRANCHLENS_CLOCK;
 
-        if (pf->no_rates)
-          mod->estimate_ratemat = FALSE;
+          else if (pf->assume_clock)
+            mod->estimate_branchlens = TM_BRANCHLENS_CLOCK;
 
-        mod->estimate_backgd = pf->estimate_backgd;
-      }
-
-      if (pf->no_branchlens)
-	mod->estimate_branchlens = TM_BRANCHLENS_NONE;
-
-      if (pf->ignore_branches != NULL)
-        tm_set_ignore_branches(mod, pf->ignore_branches);
-
-      old_nnodes = mod->tree->nnodes;
-      pruned_names = lst_new_ptr(msa->nseqs);
-      tm_prune(mod, msa, pruned_names);
-      if (lst_size(pruned_names) == (old_nnodes + 1) / 2)
-        die("ERROR: no match for leaves of tree in alignment (leaf names must match alignment names).\n");
-      if (!quiet && lst_size(pruned_names) > 0) {
-        fprintf(stderr, "WARNING: pruned away leaves of tree with no match in alignment (");
-        for (j = 0; j < lst_size(pruned_names); j++)
-          fprintf(stderr, "%s%s", ((String*)lst_get_ptr(pruned_names, j))->chars,
-                  j < lst_size(pruned_names) - 1 ? ", " : ").\n");
-      }
-      lst_free_strings(pruned_names);
-      lst_free(pruned_names);
+          if (pf->no_rates)
+            mod->estimate_ratemat = FALSE;
 
-      if (pf->alt_mod_str != NULL) {
-	for (j = 0 ; j < lst_size(pf->alt_mod_str); j++)
-	  tm_add_alt_mod(mod, (String*)lst_get_ptr(pf->alt_mod_str, j));
-      }
+          mod->estimate_backgd = pf->estimate_backgd;
+        }
 
-      str_clear(tmpstr);
+        if (pf->no_branchlens)
+	  mod->estimate_branchlens = TM_BRANCHLENS_NONE;
+
+        if (pf->ignore_branches != NULL)
+          tm_set_ignore_branches(mod, pf->ignore_branches);
+
+        old_nnodes = mod->tree->nnodes;
+        pruned_names = lst_new_ptr(msa->nseqs);
+        tm_prune(mod, msa, pruned_names);
+        if (lst_size(pruned_names) == (old_nnodes + 1) / 2)
+          die("ERROR: no match for leaves of tree in alignment (leaf names must match alignment names).\n");
+        if (!quiet && lst_size(pruned_names) > 0) {
+          fprintf(stderr, "WARNING: pruned away leaves of tree with no match in alignment (");
+          for (j = 0; j < lst_size(pruned_names); j++)
+            fprintf(stderr, "%s%s", ((String*)lst_get_ptr(pruned_names, j))->chars,
+                    j < lst_size(pruned_names) - 1 ? ", " : ").\n");
+        }
+        lst_free_strings(pruned_names);
+        lst_free(pruned_names);
 
-      if  (pf->msa_fname != NULL)
-	str_append_charstr(tmpstr, pf->msa_fname);
-      else str_append_charstr(tmpstr, "alignment");
+        if (pf->alt_mod_str != NULL) {
+	  for (j = 0 ; j < lst_size(pf->alt_mod_str); j++)
+	    tm_add_alt_mod(mod, (String*)lst_get_ptr(pf->alt_mod_str, j));
+        }
 
-      if (cat != -1 || pf->window_coords != NULL) {
-	str_append_charstr(tmpstr, " (");
-	if (cat != -1) {
-	  str_append_charstr(tmpstr, "category ");
-	  str_append_int(tmpstr, cat);
-	}
+        str_clear(tmpstr);
 
-	if (pf->window_coords != NULL) {
-	  if (cat != -1) str_append_charstr(tmpstr, ", ");
-	  str_append_charstr(tmpstr, "window ");
-	  str_append_int(tmpstr, win/2 + 1);
-	}
+        if  (pf->msa_fname != NULL)
+	  str_append_charstr(tmpstr, pf->msa_fname);
+        else str_append_charstr(tmpstr, "alignment");
 
-	str_append_char(tmpstr, ')');
-      }
+        if (cat != -1 || pf->window_coords != NULL) {
+	  str_append_charstr(tmpstr, " (");
+	  if (cat != -1) {
+	    str_append_charstr(tmpstr, "category ");
+	    str_append_int(tmpstr, cat);
+	  }
 
-      ninf_sites = msa_ninformative_sites(msa, cat);
-      if (ninf_sites < pf->nsites_threshold) {
-        if (input_mod == NULL) tm_free(mod);
-        fprintf(stderr, "Skipping %s; insufficient informative sites ...\n",
-                tmpstr->chars);
-        continue;
-      }
+	  if (pf->window_coords != NULL) {
+	    if (cat != -1) str_append_charstr(tmpstr, ", ");
+	    str_append_charstr(tmpstr, "window ");
+	    str_append_int(tmpstr, win/2 + 1);
+	  }
 
-      if (pf->init_parsimony) {
-	double parsimony_cost = tm_params_init_branchlens_parsimony(NULL, mod, msa, cat);
-        if (parsimony_cost_file != NULL)
-           fprintf(parsimony_cost_file, "%f\n", parsimony_cost);
-        if (pf->parsimony_only) continue;
-      }
+	  str_append_char(tmpstr, ')');
+        }
 
-      if (pf->likelihood_only) {
-        double *col_log_probs = pf->do_column_probs ?
-          smalloc(msa->length * sizeof(double)) : NULL;
-        String *colprob_fname;
-        if (!quiet)
-          fprintf(stderr, "Computing likelihood of %s ...\n", tmpstr->chars);
-        tm_set_subst_matrices(mod);
-        if (pf->do_column_probs && msa->ss != NULL && msa->ss->tuple_idx == NULL) {
-          msa->ss->tuple_idx = smalloc(msa->length * sizeof(int));
-          for (j = 0; j < msa->length; j++)
-            msa->ss->tuple_idx[j] = j;
+        ninf_sites[k] = msa_ninformative_sites(msa, cat);
+        if (ninf_sites[k] < pf->nsites_threshold) {
+          if (mod != input_mod) tm_free(mod);
+          fprintf(stderr, "Skipping %s; insufficient informative sites ...\n",
+                  tmpstr->chars);
+          continue;
         }
-        mod->lnL = tl_compute_log_likelihood(mod, msa, col_log_probs, NULL, cat, NULL) *
-          log(2);
-        if (pf->do_column_probs) {
-	  //we don't need to implement this in RPHAST because there is
-	  //already a msa.likelihood function
-	  if (pf->output_fname_root == NULL)
-	    die("ERROR: currently do_column_probs requires output file");
-          colprob_fname = str_new_charstr(pf->output_fname_root);
-          str_append_charstr(colprob_fname, ".colprobs");
-          if (!quiet)
-            fprintf(stderr, "Writing column probabilities to %s ...\n",
-                    colprob_fname->chars);
-	  if (strcmp(pf->output_fname_root, "-") != 0)
-            F = phast_fopen(colprob_fname->chars, "w+");
-	  else
-            F = stdout;
-          for (j = 0; j < msa->length; j++)
-            fprintf(F, "%d\t%.6f\n", j, col_log_probs[j]);
-	  if (strcmp(pf->output_fname_root, "-") != 0)
-	    phast_fclose(F);
-          str_free(colprob_fname);
-          sfree(col_log_probs);
+
+        if (pf->init_parsimony) {
+	  double parsimony_cost = tm_params_init_branchlens_parsimony(NULL, mod, msa, cat);
+          if (parsimony_cost_file != NULL)
+             fprintf(parsimony_cost_file, "%f\n", parsimony_cost);
+          if (pf->parsimony_only) {
+            if (mod != input_mod) tm_free(mod);
+            continue;
+          }
         }
-      }
-      else {                    /* fit model */
 
-        if (msa->ss == NULL) {    /* get sufficient stats if necessary */
+        if (pf->likelihood_only) {
+          double *col_log_probs = pf->do_column_probs ?
+            smalloc(msa->length * sizeof(double)) : NULL;
+          String *colprob_fname;
           if (!quiet)
-            fprintf(stderr, "Extracting sufficient statistics ...\n");
-          ss_from_msas(msa, mod->order+1, 0,
-                       pf->cats_to_do_str != NULL ? cats_to_do : NULL,
-                       NULL, NULL, -1, subst_mod_is_codon_model(mod->subst_mod));
-          /* (sufficient stats obtained only for categories of interest) */
-
-          if (msa->length > 1000000) { /* throw out original data if
-                                          very large */
-            for (j = 0; j < msa->nseqs; j++) sfree(msa->seqs[j]);
-            sfree(msa->seqs);
-            msa->seqs = NULL;
+            fprintf(stderr, "Computing likelihood of %s ...\n", tmpstr->chars);
+          tm_set_subst_matrices(mod);
+          if (pf->do_column_probs && msa->ss != NULL && msa->ss->tuple_idx == NULL) {
+            msa->ss->tuple_idx = smalloc(msa->length * sizeof(int));
+            for (j = 0; j < msa->length; j++)
+              msa->ss->tuple_idx[j] = j;
+          }
+          mod->lnL = tl_compute_log_likelihood(mod, msa, col_log_probs, NULL, cat, NULL) *
+            log(2);
+          if (pf->do_column_probs) {
+	    //we don't need to implement this in RPHAST because there is
+	    //already a msa.likelihood function
+	    if (pf->output_fname_root == NULL)
+	      die("ERROR: currently do_column_probs requires output file");
+            colprob_fname = str_new_charstr(pf->output_fname_root);
+            str_append_charstr(colprob_fname, ".colprobs");
+            if (!quiet)
+              fprintf(stderr, "Writing column probabilities to %s ...\n",
+                      colprob_fname->chars);
+	    if (strcmp(pf->output_fname_root, "-") != 0)
+              F = phast_fopen(colprob_fname->chars, "w+");
+	    else
+              F = stdout;
+            for (j = 0; j < msa->length; j++)
+              fprintf(F, "%d\t%.6f\n", j, col_log_probs[j]);
+	    if (strcmp(pf->output_fname_root, "-") != 0)
+	      phast_fclose(F);
+            str_free(colprob_fname);
+            sfree(col_log_probs);
           }
         }
-        if (pf->random_init)
-          params = tm_params_init_random(mod);
-        else if (input_mod != NULL)
-          params = tm_params_new_init_from_model(input_mod);
-	else
-          params = tm_params_init(mod, .1, 5, pf->alpha);
-
-	if (pf->init_parsimony)
-	  tm_params_init_branchlens_parsimony(params, mod, msa, cat);
-
-        if (input_mod != NULL && mod->backgd_freqs != NULL && !pf->no_freqs && pf->init_backgd_from_data) {
-          /* in some cases, the eq freqs are needed for
-             initialization, but now they should be re-estimated --
-             UNLESS user specifies --no-freqs */
-	  vec_free(mod->backgd_freqs);
-	  mod->backgd_freqs = NULL;
-        }
+        else {                    /* fit model */
+
+          if (msa->ss == NULL) {    /* get sufficient stats if necessary */
+            if (!quiet)
+              fprintf(stderr, "Extracting sufficient statistics ...\n");
+            ss_from_msas(msa, mod->order+1, 0,
+                         pf->cats_to_do_str != NULL ? cats_to_do : NULL,
+                         NULL, NULL, -1, subst_mod_is_codon_model(mod->subst_mod));
+            /* (sufficient stats obtained only for categories of interest) */
+
+            if (msa->length > 1000000) { /* throw out original data if
+                                            very large */
+              for (j = 0; j < msa->nseqs; j++) sfree(msa->seqs[j]);
+              sfree(msa->seqs);
+              msa->seqs = NULL;
+            }
+          }
+          if (pf->random_init)
+            params = tm_params_init_random(mod);
+          else if (input_mod != NULL)
+            params = tm_params_new_init_from_model(mod);
+	  else
+            params = tm_params_init(mod, .1, 5, pf->alpha);
 
+	  if (pf->init_parsimony)
+	    tm_params_init_branchlens_parsimony(params, mod, msa, cat);
+
+          if (input_mod != NULL && mod->backgd_freqs != NULL && !pf->no_freqs && pf->init_backgd_from_data) {
+            /* in some cases, the eq freqs are needed for
+               initialization, but now they should be re-estimated --
+               UNLESS user specifies --no-freqs */
+	    vec_free(mod->backgd_freqs);
+	    mod->backgd_freqs = NULL;
+          }
 
-        if (i == 0) {
-          if (!quiet) fprintf(stderr, "Compacting sufficient statistics ...\n");
-          ss_collapse_missing(msa, !pf->gaps_as_bases);
-                                /* reduce number of tuples as much as
-                                   possible */
-        }
 
-        if (!quiet) {
-          fprintf(stderr, "Fitting tree model to %s using %s%s ...\n",
-                  tmpstr->chars, tm_get_subst_mod_string(subst_mod),
-                  mod->nratecats > 1 ? " (with rate variation)" : "");
+          if (i == 0) {
+            if (!quiet) fprintf(stderr, "Compacting sufficient statistics ...\n");
+            ss_collapse_missing(msa, !pf->gaps_as_bases);
+                                  /* reduce number of tuples as much as
+                                     possible */
+          }
+
+          if (!quiet) {
+            fprintf(stderr, "Fitting tree model to %s using %s%s ...\n",
+                    tmpstr->chars, tm_get_subst_mod_string(subst_mod),
+                    mod->nratecats > 1 ? " (with rate variation)" : "");
+          }
+          nfit++;
         }
+        cd.mods[k] = mod;
+        cd.params[k] = params;
 
-        if (pf->use_em)
-          tm_fit_em(mod, msa, params, cat, pf->precision, pf->max_em_its, pf->logf, error_file);
-        else
-          tm_fit(mod, msa, params, cat, pf->precision, pf->logf, pf->quiet, error_file);
+        if (chain_cats && params != NULL) {
+          pf_fit_model(&cd, w, i, 0, pf->logf, error_file);
+          last_fit = mod;
+        }
       }
+    }
 
-      if (pf->output_fname_root != NULL)
-	str_cpy_charstr(mod_fname, pf->output_fname_root);
-      else str_clear(mod_fname);
-      if (pf->window_coords != NULL) {
-	if (mod_fname->length != 0)
-	  str_append_char(mod_fname, '.');
-        str_append_charstr(mod_fname, "win-");
-        str_append_int(mod_fname, win/2 + 1);
-      }
-      if (cat != -1 && pf->nonoverlapping == FALSE) {
-	if (mod_fname->length != 0)
-	  str_append_char(mod_fname, '.');
-        if (pf->cm != NULL)
-          str_append(mod_fname, cm_get_feature_unique(pf->cm, cat));
-        else
-          str_append_int(mod_fname, cat);
-      }
-      if (pf->output_fname_root != NULL)
-	str_append_charstr(mod_fname, ".mod");
-
-      if (pf->output_fname_root != NULL) {
-	if (!quiet) fprintf(stderr, "Writing model to %s ...\n",
-			    mod_fname->chars);
-	if (strcmp(pf->output_fname_root, "-") != 0)
-          F = phast_fopen(mod_fname->chars, "w+");
-        else
-          F = stdout;
-	tm_print(F, mod);
-	if (strcmp(pf->output_fname_root, "-") != 0)
-	  phast_fclose(F);
-      }
-      if (pf->results != NULL)
-	lol_push_treeModel(pf->results, mod, mod_fname->chars);
-
-      /* output posterior probabilities, if necessary */
-      if (pf->do_bases || pf->do_expected_nsubst ||
-	  pf->do_expected_nsubst_tot || pf->do_expected_nsubst_col) {
-	print_post_prob_stats(mod, msa, pf->output_fname_root,
-			      pf->do_bases, pf->do_expected_nsubst,
-			      pf->do_expected_nsubst_tot,
-			      pf->do_expected_nsubst_col, 0,
-			      cat, quiet, NULL);
-      }
+    /* fit models; when more than one chunk is fitted by multiple
+       threads, each writes its log and error output to a temporary
+       file, which is appended to the main one afterward, and progress
+       messages from the optimizer are suppressed */
+    cd.parallel = (!chain_cats && nfit > 1 && nchunks > 1 &&
+                   thr_get_nthreads() > 1);
+    for (i = 0; i < nchunks; i++) {
+      cd.logf[i] = cd.parallel && pf->logf != NULL ? tmpfile() : pf->logf;
+      cd.error_file[i] = cd.parallel && error_file != NULL ? tmpfile() :
+        error_file;
+      if (cd.logf[i] == NULL && pf->logf != NULL)
+        die("ERROR: unable to create temporary file for log.\n");
+      if (cd.error_file[i] == NULL && error_file != NULL)
+        die("ERROR: unable to create temporary file for errors.\n");
+    }
+    if (!pf->likelihood_only && !chain_cats)
+      thr_foreach(nchunks, pf_fit_chunk, &cd);
+    for (i = 0; i < nchunks; i++) {
+      if (cd.logf[i] != pf->logf)
+        pf_append_tmpfile(pf->logf, cd.logf[i]);
+      if (cd.error_file[i] != error_file)
+        pf_append_tmpfile(error_file, cd.error_file[i]);
+    }
 
-      /* print window summary, if window mode */
-      if (pf->window_coords != NULL) {
-	int i, j, total=0;
-	char c;
-	if (gc == NULL)
-	  gc = smalloc(msa->nseqs*sizeof(double));
-	for (i=0; i < msa->nseqs; i++) {
-	  total=0;
-	  gc[i]=0;
-	  for (j=0; j<msa->length; j++) {
-	    c = msa_get_char(msa, i, j);
-	    if ((!msa->is_missing[(int)c]) && c != GAP_CHAR) {
-	      total++;
-	      if (c=='C' || c=='G') gc[i]++;
+    /* output results in order of windows and categories */
+    for (w = 0; w < cd.nwins; w++) {
+      win = 2 * (batch + w);
+      msa = cd.msas[w];
+      if (msa == NULL) continue;
+      for (i = 0; i < ncats; i++) {
+        TreeModel *mod;
+        int cat = lst_get_int(cats_to_do, i);
+
+        k = w * ncats + i;
+        mod = cd.mods[k];
+        if (mod == NULL) continue;
+
+        if (pf->output_fname_root != NULL)
+	  str_cpy_charstr(mod_fname, pf->output_fname_root);
+        else str_clear(mod_fname);
+        if (pf->window_coords != NULL) {
+	  if (mod_fname->length != 0)
+	    str_append_char(mod_fname, '.');
+          str_append_charstr(mod_fname, "win-");
+          str_append_int(mod_fname, win/2 + 1);
+        }
+        if (cat != -1 && pf->nonoverlapping == FALSE) {
+	  if (mod_fname->length != 0)
+	    str_append_char(mod_fname, '.');
+          if (pf->cm != NULL)
+            str_append(mod_fname, cm_get_feature_unique(pf->cm, cat));
+          else
+            str_append_int(mod_fname, cat);
+        }
+        if (pf->output_fname_root != NULL)
+	  str_append_charstr(mod_fname, ".mod");
+
+        if (pf->output_fname_root != NULL) {
+	  if (!quiet) fprintf(stderr, "Writing model to %s ...\n",
+			      mod_fname->chars);
+	  if (strcmp(pf->output_fname_root, "-") != 0)
+            F = phast_fopen(mod_fname->chars, "w+");
+          else
+            F = stdout;
+	  tm_print(F, mod);
+	  if (strcmp(pf->output_fname_root, "-") != 0)
+	    phast_fclose(F);
+        }
+        if (pf->results != NULL)
+	  lol_push_treeModel(pf->results, mod, mod_fname->chars);
+
+        /* output posterior probabilities, if necessary */
+        if (pf->do_bases || pf->do_expected_nsubst ||
+	    pf->do_expected_nsubst_tot || pf->do_expected_nsubst_col) {
+	  print_post_prob_stats(mod, msa, pf->output_fname_root,
+				pf->do_bases, pf->do_expected_nsubst,
+				pf->do_expected_nsubst_tot,
+				pf->do_expected_nsubst_col, 0,
+				cat, quiet, NULL);
+        }
+
+        /* print window summary, if window mode */
+        if (pf->window_coords != NULL) {
+	  int s, col, total;
+	  char c;
+	  if (gc == NULL)
+	    gc = smalloc(msa->nseqs*sizeof(double));
+	  for (s=0; s < msa->nseqs; s++) {
+	    total=0;
+	    gc[s]=0;
+	    for (col=0; col<msa->length; col++) {
+	      c = msa_get_char(msa, s, col);
+	      if ((!msa->is_missing[(int)c]) && c != GAP_CHAR) {
+		total++;
+		if (c=='C' || c=='G') gc[s]++;
+	      }
 	    }
+	    gc[s] /= (double)total;
 	  }
-	  gc[i] /= (double)total;
-	}
-        print_window_summary(WINDOWF, pf->window_coords, win, cat, mod, gc,
-                             ninf_sites, msa->nseqs, FALSE);
-      }
+          print_window_summary(WINDOWF, pf->window_coords, win, cat, mod, gc,
+                               ninf_sites[k], msa->nseqs, FALSE);
+        }
 
-      if (input_mod == NULL) tm_free(mod);
-      if (params != NULL) vec_free(params);
+        if (cd.optima[k] != NULL) {
+          if (!quiet) {
+            /* summarize spread of optima from multiple starts */
+            int nopt = lst_size(cd.optima[k]), nbest = 0;
+            lst_qsort_dbl(cd.optima[k], DESCENDING);
+            for (j = 0; j < nopt; j++)
+              if (lst_get_dbl(cd.optima[k], 0) - 
+                  lst_get_dbl(cd.optima[k], j) < PF_RESTART_LNL_TOL) 
+                nbest++;
+            fprintf(stderr, "Restarts for %s: %d of %d refined starting points reached best log(likelihood) (%f); range of optima %f to %f\n",
+                    mod_fname->length > 0 ? mod_fname->chars : "model", 
+                    nbest, nopt, lst_get_dbl(cd.optima[k], 0), 
+                    lst_get_dbl(cd.optima[k], nopt-1), 
+                    lst_get_dbl(cd.optima[k], 0));
+          }
+          lst_free(cd.optima[k]);
+        }
+        if (mod != input_mod) tm_free(mod);
+        if (cd.params[k] != NULL) vec_free(cd.params[k]);
+      }
+      if (msa != source_msa) msa_free(msa);
     }
-    if (pf->window_coords != NULL)
-      msa_free(msa);
+    sfree(cd.msas);
+    sfree(cd.mods);
+    sfree(cd.params);
+    sfree(cd.optima);
+    sfree(cd.logf);
+    sfree(cd.error_file);
+    sfree(ninf_sites);
   }
+  if (sw != NULL) ss_window_free(sw);
   if (WINDOWF != NULL && strcmp(pf->output_fname_root, "-") != 0)
     phast_fclose(WINDOWF);
 
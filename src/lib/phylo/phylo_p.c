@@ -60,6 +60,8 @@ struct phyloP_struct *phyloP_struct_new(int rphast) {
   p->mod_fname = NULL;
   p->msa_fname = NULL;
   p->no_prune = FALSE;
+  p->jp_cache_fname = NULL;
+  p->column_sums = FALSE;
 
   p->results = rphast ? lol_new(20) : NULL;
   return p;
@@ -134,7 +136,7 @@ void phyloP(struct phyloP_struct *p) {
   /* variables for options that are passed through p */
   int nsites, fit_model, base_by_base, refidx;
   int prior_only, post_only, quantiles_only,
-    output_wig, output_gff;
+    output_wig, output_gff, column_sums;
   double ci, epsilon;
   char *subtree_name, *chrom;
   List *branch_name;
@@ -188,6 +190,7 @@ void phyloP(struct phyloP_struct *p) {
   quantiles_only = p->quantiles_only;
   output_wig = p->output_wig;
   output_gff = p->output_gff;
+  column_sums = p->column_sums;
 
   if (msa == NULL && !prior_only)
     die("Need either --prior-only or an alignment\n");
@@ -208,6 +211,10 @@ void phyloP(struct phyloP_struct *p) {
     die("ERROR: --features cannot be used with --null, --posterior, or --fit-model.\n");
   if (base_by_base && (ci != -1 || feats!=NULL || prior_only || post_only))
     die("ERROR: --wig-scores and --base-by-base cannot be used with --null, --posterior, --features, --quantiles, or --confidence-interval.\n");
+  if (column_sums && (feats == NULL || (method != LRT && method != GERP)))
+    die("ERROR: --column-sums can only be used with --features and --method LRT or GERP.\n");
+  if (column_sums && (subtree_name != NULL || branch_name != NULL))
+    die("ERROR: --column-sums cannot be used with --subtree or --branch.\n");
   if (method == GERP && subtree_name != NULL)
     die("ERROR: --subtree not supported with --method GERP.\n");
   if ((method == GERP || method == SPH) && branch_name != NULL) 
@@ -256,6 +263,10 @@ void phyloP(struct phyloP_struct *p) {
       str_free(warnstr);
     }
     lst_free(pruned_names);
+
+    /* column tuples are only read from here on; store them compactly
+       (has no effect if there are too many distinct characters) */
+    ss_pack_tuples(msa);
   }
 
   /* set subtree if necessary */
@@ -323,8 +334,13 @@ void phyloP(struct phyloP_struct *p) {
     if (base_by_base && epsilon < 0)
       epsilon = DEFAULT_EPSILON_BASE_BY_BASE;
     else if (epsilon < 0) epsilon = DEFAULT_EPSILON;
-    /* jump process for prior */
-    jp = sub_define_jump_process(mod, epsilon, tr_total_len(mod->tree));
+    /* jump process for prior; reuse saved version if available */
+    if (p->jp_cache_fname != NULL)
+      jp = sub_define_jump_process_cached(mod, epsilon, 
+                                          tr_total_len(mod->tree),
+                                          p->jp_cache_fname);
+    else
+      jp = sub_define_jump_process(mod, epsilon, tr_total_len(mod->tree));
 
     /* jump process for posterior -- use fitted model if necessary */
     if (mod_fitted != NULL)
@@ -525,7 +541,10 @@ void phyloP(struct phyloP_struct *p) {
         llrs = smalloc(lst_size(feats->features) * sizeof(double));
       }
       if (subtree_name == NULL && branch_name == NULL) {  /* no subtree case */
-        ff_lrts(mod, msa, feats, mode, pvals, scales, llrs, logf);
+        if (column_sums)
+          ff_lrts_colsum(mod, msa, feats, mode, pvals, scales, llrs, logf);
+        else
+          ff_lrts(mod, msa, feats, mode, pvals, scales, llrs, logf);
         msa_map_gff_coords(msa, feats, 0, p->refidx_feat, 0);
 	if (msa->idx_offset > 0)
 	  gff_add_offset(feats, msa->idx_offset, 0);
@@ -672,7 +691,11 @@ void phyloP(struct phyloP_struct *p) {
         nobs = smalloc(lst_size(feats->features) * sizeof(double));
         nspec = smalloc(lst_size(feats->features) * sizeof(double));
       }
-      ff_gerp(mod, msa, feats, mode, nneut, nobs, nrejected, nspec, logf);
+      if (column_sums)
+        ff_gerp_colsum(mod, msa, feats, mode, nneut, nobs, nrejected, nspec, 
+                       logf);
+      else
+        ff_gerp(mod, msa, feats, mode, nneut, nobs, nrejected, nspec, logf);
       msa_map_gff_coords(msa, feats, 0, p->refidx_feat, 0);
       if (msa->idx_offset > 0)
 	gff_add_offset(feats, msa->idx_offset, 0);
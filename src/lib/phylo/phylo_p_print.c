@@ -21,6 +21,7 @@
 #include <prob_matrix.h>
 #include <phylo_p_print.h>
 #include <list_of_lists.h>
+#include <wig_writer.h>
 
 void print_quantiles(FILE *outfile, Vector *distrib, ListOfLists *result) {
   int *quantiles = pv_quantiles(distrib);
@@ -585,25 +586,23 @@ void print_feats_sph_subtree(FILE *outfile, p_value_joint_stats *stats,
 
 void print_wig(FILE *outfile, MSA *msa, double *vals, char *chrom,
 	       int refidx, int log_trans, ListOfLists *result) {
-  int last, j, k;
+  int j, k;
   double val;
   List *posList=NULL, *scoreList=NULL;
+  WigWriter *ww = NULL;
 
   if (result != NULL) {
     posList = lst_new_int(msa->length);
     scoreList = lst_new_dbl(msa->length);
   }
+  if (outfile != NULL) ww = ww_new(outfile, chrom);
 
-  last = -INFTY;
   if (!(refidx >= 0 && refidx <= msa->nseqs))
     die("ERROR print_wig: bad refidx (%i)\n", refidx);
   for (j = 0, k = 0; j < msa->length; j++) {
     checkInterruptN(j, 1000);
     if (refidx == 0 || msa_get_char(msa, refidx-1, j) != GAP_CHAR) {
       if (refidx == 0 || !msa_missing_col(msa, refidx, j)) {
-        if (k > last + 1 && outfile != NULL)
-          fprintf(outfile, "fixedStep chrom=%s start=%d step=1\n", chrom,
-		  k + msa->idx_offset + 1);
         val = vals[msa->ss->tuple_idx[j]];
         if (log_trans) {
           int sign = 1;
@@ -613,16 +612,16 @@ void print_wig(FILE *outfile, MSA *msa, double *vals, char *chrom,
           }
           val = fabs(-log10(val)) * sign; /* fabs prevents -0 for val == 1 */
         }
-        if (outfile != NULL) fprintf(outfile, "%.3f\n", val);
+        if (ww != NULL) ww_value(ww, k + msa->idx_offset + 1, val, 3);
 	if (result != NULL) {
 	  lst_push_int(posList, k + msa->idx_offset + 1);
 	  lst_push_dbl(scoreList, val);
 	}
-        last = k;
       }
       k++;
     }
   }
+  if (ww != NULL) ww_free(ww);
   if (result != NULL) {
     ListOfLists *group = lol_new(2);
     lol_push(group, posList, "coord", INT_LIST);
@@ -652,11 +651,12 @@ void print_base_by_base(FILE *outfile, char *header, char *chrom, MSA *msa,
                         char **formatstr, int refidx, ListOfLists *result,
 			int log_trans_outfile, int log_trans_results,
 			int ncols, ...) {
-  int last, j, k, tup, col;
+  int j, k, tup, col;
   va_list ap;
   double *data[ncols+1];
   List **resultList=NULL;
   char **colname;
+  WigWriter *ww = NULL;
   int get_log = (log_trans_outfile && outfile != NULL) ||
     (log_trans_results && result != NULL);
 
@@ -672,12 +672,12 @@ void print_base_by_base(FILE *outfile, char *header, char *chrom, MSA *msa,
     }
   }
 
-  last = -INFTY;
   if (header != NULL && outfile != NULL) {
     fprintf(outfile, "%s", header);
     if (log_trans_outfile) fprintf(outfile, " score\n");
     else fprintf(outfile, "\n");
   }
+  if (outfile != NULL) ww = ww_new(outfile, chrom);
 
   va_start(ap, ncols);
   colname = smalloc((ncols+1)*sizeof(char*));
@@ -697,17 +697,18 @@ void print_base_by_base(FILE *outfile, char *header, char *chrom, MSA *msa,
     checkInterruptN(j, 1000);
     if (refidx == 0 || msa_get_char(msa, refidx-1, j) != GAP_CHAR) {
       if (refidx == 0 || !msa_missing_col(msa, refidx, j)) {
-        if (k > last + 1 && outfile != NULL)
-          fprintf(outfile, "fixedStep chrom=%s start=%d step=1\n", chrom,
-                 k + msa->idx_offset + 1);
         tup = msa->ss->tuple_idx[j];
-	if (outfile != NULL) {
+	if (ww != NULL) {
+	  ww_start_line(ww, k + msa->idx_offset + 1);
 	  for (col = 0; col < ncols; col++) {
-	    fprintf(outfile, (formatstr == NULL ? "%.5f" : formatstr[col]), data[col][tup]);
-	    if (col <  ncols-1) fputc('\t', outfile);
+	    ww_put_dbl(ww, (formatstr == NULL ? "%.5f" : formatstr[col]), data[col][tup]);
+	    if (col <  ncols-1) ww_put_char(ww, '\t');
 	  }
-	  if (log_trans_outfile) fprintf(outfile, "\t%.5f", data[col][tup]);
-	  fputc('\n', outfile);
+	  if (log_trans_outfile) {
+	    ww_put_char(ww, '\t');
+	    ww_put_fixed(ww, data[col][tup], 5);
+	  }
+	  ww_put_char(ww, '\n');
 	}
 	if (result != NULL) {
 	  lst_push_int(resultList[0], k + msa->idx_offset + 1);
@@ -716,12 +717,12 @@ void print_base_by_base(FILE *outfile, char *header, char *chrom, MSA *msa,
 	  if (log_trans_results)
 	    lst_push_dbl(resultList[col+1], data[col][tup]);
 	}
-        last = k;
       }
       k++;
     }
   }
   va_end(ap);
+  if (ww != NULL) ww_free(ww);
 
   if (result != NULL) {
     ListOfLists *group = lol_new(ncols+1+log_trans_results);
@@ -21,6 +21,8 @@
 #include <prob_vector.h>
 #include <prob_matrix.h>
 #include <fit_column.h>
+#include <parallel.h>
+#include <unistd.h>
 
 /* (used below) compute and return a set of matrices giving p(b, n |
    j), the probability of n substitutions and a final base b given j
@@ -187,6 +189,267 @@ void sub_recompute_conditionals(JumpProcess *jp) {
   }
 }
 
+/* identifying header and format version for saved jump processes */
+#define JP_MAGIC "PHASTJP"
+#define JP_VERSION 1
+
+/* (used below) FNV-1a hash, continued over n bytes */
+static uint64_t jp_hash_bytes(uint64_t h, void *bytes, size_t n) {
+  unsigned char *b = bytes;
+  size_t i;
+  for (i = 0; i < n; i++) {
+    h ^= b[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+/* compute a 64-bit fingerprint of everything a jump process depends
+   on: the rate matrix, background frequencies, tree topology and
+   branch lengths, precision, and maximum branch length */
+uint64_t sub_jump_process_fingerprint(TreeModel *mod, double epsilon, 
+                                      double maxbranch) {
+  uint64_t h = 14695981039346656037ULL;
+  int i, j, size = mod->rate_matrix->size, nnodes = mod->tree->nnodes, id;
+  double val;
+
+  h = jp_hash_bytes(h, &size, sizeof(int));
+  h = jp_hash_bytes(h, &nnodes, sizeof(int));
+  h = jp_hash_bytes(h, &epsilon, sizeof(double));
+  h = jp_hash_bytes(h, &maxbranch, sizeof(double));
+  for (i = 0; i < size; i++) {
+    for (j = 0; j < size; j++) {
+      val = mm_get(mod->rate_matrix, i, j);
+      h = jp_hash_bytes(h, &val, sizeof(double));
+    }
+    h = jp_hash_bytes(h, &mod->backgd_freqs->data[i], sizeof(double));
+  }
+  for (i = 0; i < nnodes; i++) {
+    TreeNode *n = lst_get_ptr(mod->tree->nodes, i);
+    id = (n == mod->tree ? -1 : n->parent->id);
+    h = jp_hash_bytes(h, &n->id, sizeof(int));
+    h = jp_hash_bytes(h, &id, sizeof(int));
+    h = jp_hash_bytes(h, &n->dparent, sizeof(double));
+  }
+  return h;
+}
+
+/* (used below) binary write/read of a matrix, preceded by its
+   dimensions */
+static void jp_write_matrix(Matrix *m, FILE *F) {
+  int i;
+  fwrite(&m->nrows, sizeof(int), 1, F);
+  fwrite(&m->ncols, sizeof(int), 1, F);
+  for (i = 0; i < m->nrows; i++)
+    fwrite(m->data[i], sizeof(double), m->ncols, F);
+}
+
+static int jp_read(void *buf, size_t size, size_t n, FILE *F) {
+  return fread(buf, size, n, F) == n;
+}
+
+/* read a matrix with nrows rows and ncols columns (if ncols < 0, any
+   positive number of columns); returns NULL if the file ends early or
+   the dimensions do not match */
+static Matrix *jp_read_matrix(FILE *F, int nrows, int ncols) {
+  int i, r, c;
+  Matrix *m;
+  if (!jp_read(&r, sizeof(int), 1, F) || !jp_read(&c, sizeof(int), 1, F) ||
+      r != nrows || (ncols >= 0 ? c != ncols : c < 1))
+    return NULL;
+  m = mat_new(r, c);
+  for (i = 0; i < r; i++)
+    if (!jp_read(m->data[i], sizeof(double), c, F)) {
+      mat_free(m);
+      return NULL;
+    }
+  return m;
+}
+
+/* free a jump process that may have been only partly read by
+   sub_read_jump_process (unread matrices are NULL) */
+static void jp_free_partial(JumpProcess *jp, int size, int nnodes) {
+  int i, j;
+  for (i = 0; jp->A != NULL && i < size; i++)
+    if (jp->A[i] != NULL) mat_free(jp->A[i]);
+  for (i = 0; jp->B != NULL && i < size; i++) {
+    for (j = 0; j < size; j++)
+      if (jp->B[i][j] != NULL) mat_free(jp->B[i][j]);
+    sfree(jp->B[i]);
+  }
+  for (i = 0; jp->branch_distrib != NULL && i < nnodes; i++) {
+    if (jp->branch_distrib[i] == NULL) continue;
+    for (j = 0; j < size; j++)
+      if (jp->branch_distrib[i][j] != NULL)
+        mat_free(jp->branch_distrib[i][j]);
+    sfree(jp->branch_distrib[i]);
+  }
+  if (jp->A != NULL) sfree(jp->A);
+  if (jp->B != NULL) sfree(jp->B);
+  if (jp->branch_distrib != NULL) sfree(jp->branch_distrib);
+  if (jp->R != NULL) mat_free(jp->R);
+  if (jp->M != NULL) mat_free(jp->M);
+  sfree(jp);
+}
+
+/* save precomputed jump process to a binary file, so that it can be
+   reloaded with sub_read_jump_process rather than recomputed.
+   'maxbranch' must be the value originally passed to
+   sub_define_jump_process; it becomes part of the fingerprint used
+   to validate the file when it is read.  Files are written in native
+   byte order and are not portable across architectures */
+void sub_write_jump_process(JumpProcess *jp, double maxbranch, FILE *F) {
+  int i, j, size = jp->R->nrows, nnodes = jp->mod->tree->nnodes, 
+    version = JP_VERSION, present;
+  uint64_t fp = sub_jump_process_fingerprint(jp->mod, jp->epsilon, 
+                                             maxbranch);
+
+  fwrite(JP_MAGIC, sizeof(char), strlen(JP_MAGIC), F);
+  fwrite(&version, sizeof(int), 1, F);
+  fwrite(&fp, sizeof(uint64_t), 1, F);
+  fwrite(&size, sizeof(int), 1, F);
+  fwrite(&nnodes, sizeof(int), 1, F);
+  fwrite(&jp->njumps_max, sizeof(int), 1, F);
+  fwrite(&jp->lambda, sizeof(double), 1, F);
+  fwrite(&jp->epsilon, sizeof(double), 1, F);
+
+  jp_write_matrix(jp->R, F);
+  jp_write_matrix(jp->M, F);
+  for (i = 0; i < size; i++)
+    jp_write_matrix(jp->A[i], F);
+  for (i = 0; i < size; i++)
+    for (j = 0; j < size; j++)
+      jp_write_matrix(jp->B[i][j], F);
+  for (i = 0; i < nnodes; i++) {
+    present = (jp->branch_distrib[i] != NULL);
+    fwrite(&present, sizeof(int), 1, F);
+    if (present)
+      for (j = 0; j < size; j++)
+        jp_write_matrix(jp->branch_distrib[i][j], F);
+  }
+}
+
+/* read a jump process saved by sub_write_jump_process.  The jump
+   process is associated with the given tree model, which together
+   with epsilon and maxbranch must produce the same fingerprint as the
+   saved version; if not (or if the file was written by a different
+   version or on an incompatible architecture), NULL is returned and
+   the caller should call sub_define_jump_process instead */
+JumpProcess *sub_read_jump_process(FILE *F, TreeModel *mod, double epsilon,
+                                   double maxbranch) {
+  char magic[sizeof(JP_MAGIC)];
+  int i, j, size, nnodes, version, present, njumps_max;
+  double lambda = 0;
+  uint64_t fp;
+  JumpProcess *jp;
+
+  if (fread(magic, sizeof(char), strlen(JP_MAGIC), F) != strlen(JP_MAGIC) ||
+      strncmp(magic, JP_MAGIC, strlen(JP_MAGIC)) != 0 ||
+      fread(&version, sizeof(int), 1, F) != 1 || version != JP_VERSION ||
+      fread(&fp, sizeof(uint64_t), 1, F) != 1 || 
+      fp != sub_jump_process_fingerprint(mod, epsilon, maxbranch))
+    return NULL;
+
+  if (!jp_read(&size, sizeof(int), 1, F) || 
+      !jp_read(&nnodes, sizeof(int), 1, F) ||
+      size != mod->rate_matrix->size || nnodes != mod->tree->nnodes)
+    return NULL;
+
+  /* the number of jumps determines the sizes of all matrices; it must
+     be as computed by sub_define_jump_process */
+  for (j = 0; j < size; j++)
+    lambda = max(lambda, -mm_get(mod->rate_matrix, j, j));
+  if (!jp_read(&njumps_max, sizeof(int), 1, F) ||
+      njumps_max != get_njumps_max(lambda, maxbranch, epsilon))
+    return NULL;
+
+  jp = smalloc(sizeof(JumpProcess));
+  jp->mod = mod;
+  jp->njumps_max = njumps_max;
+  jp->R = jp->M = NULL;
+  jp->A = smalloc(size * sizeof(void*));
+  jp->B = smalloc(size * sizeof(void*));
+  for (i = 0; i < size; i++) {
+    jp->A[i] = NULL;
+    jp->B[i] = smalloc(size * sizeof(void*));
+    for (j = 0; j < size; j++) jp->B[i][j] = NULL;
+  }
+  jp->branch_distrib = smalloc(nnodes * sizeof(void*));
+  for (i = 0; i < nnodes; i++) jp->branch_distrib[i] = NULL;
+
+  if (!jp_read(&jp->lambda, sizeof(double), 1, F) ||
+      !jp_read(&jp->epsilon, sizeof(double), 1, F) ||
+      (jp->R = jp_read_matrix(F, size, size)) == NULL ||
+      (jp->M = jp_read_matrix(F, njumps_max, njumps_max)) == NULL) {
+    jp_free_partial(jp, size, nnodes);
+    return NULL;
+  }
+  for (i = 0; i < size; i++)
+    if ((jp->A[i] = jp_read_matrix(F, njumps_max, njumps_max)) == NULL) {
+      jp_free_partial(jp, size, nnodes);
+      return NULL;
+    }
+  for (i = 0; i < size; i++)
+    for (j = 0; j < size; j++)
+      if ((jp->B[i][j] = jp_read_matrix(F, njumps_max, njumps_max)) == NULL) {
+        jp_free_partial(jp, size, nnodes);
+        return NULL;
+      }
+  for (i = 0; i < nnodes; i++) {
+    if (!jp_read(&present, sizeof(int), 1, F)) {
+      jp_free_partial(jp, size, nnodes);
+      return NULL;
+    }
+    if (!present) continue;
+    jp->branch_distrib[i] = smalloc(size * sizeof(void*));
+    for (j = 0; j < size; j++) jp->branch_distrib[i][j] = NULL;
+    for (j = 0; j < size; j++)
+      if ((jp->branch_distrib[i][j] = 
+           jp_read_matrix(F, size, -1)) == NULL) {
+        jp_free_partial(jp, size, nnodes);
+        return NULL;
+      }
+  }
+
+  return jp;
+}
+
+/* like sub_define_jump_process, but use the binary file 'fname' as a
+   cache: if it exists and holds a jump process matching the model,
+   load it; otherwise define the jump process and save it to fname.
+   The file is written under a temporary name and renamed into place,
+   so that concurrent runs never see a partly written file; if it
+   cannot be written, the jump process is simply not cached */
+JumpProcess *sub_define_jump_process_cached(TreeModel *mod, double epsilon, 
+                                            double maxbranch, char *fname) {
+  JumpProcess *jp = NULL;
+  FILE *F;
+  char *tmpfname;
+  int ok;
+
+  /* any failure to read the file is treated as a cache miss */
+  if (file_exists(fname) && (F = phast_fopen_no_exit(fname, "rb")) != NULL) {
+    jp = sub_read_jump_process(F, mod, epsilon, maxbranch);
+    phast_fclose(F);
+  }
+
+  if (jp == NULL) {
+    jp = sub_define_jump_process(mod, epsilon, maxbranch);
+    tmpfname = smalloc(strlen(fname) + 30);
+    sprintf(tmpfname, "%s.tmp.%d", fname, (int)getpid());
+    if ((F = phast_fopen_no_exit(tmpfname, "wb")) != NULL) {
+      sub_write_jump_process(jp, maxbranch, F);
+      ok = (fflush(F) == 0 && !ferror(F));
+      phast_fclose(F);
+      if (!ok || rename(tmpfname, fname) != 0)
+        remove(tmpfname);
+    }
+    sfree(tmpfname);
+  }
+
+  return jp;
+}
+
 /* compute and return a probability vector giving p(n | t), the probability
    of n substitutions given a branch of length t */
 Vector *sub_distrib_branch(JumpProcess *jp, double t) {
@@ -857,92 +1120,103 @@ void sub_posterior_joint_stats_alignment(JumpProcess *jp, MSA *msa,
   }
 }
 
-/* compute p-values and related stats for a given alignment and model
-   and each of a set of features.  Returns an array of p_value_stats
-   objects, one for each feature (dimension
-   lst_size(feat->features)) */   
-p_value_stats *sub_p_value_many(JumpProcess *jp, MSA *msa, List *feats, 
-                                double ci /* confidence interval; if
-                                             -1, posterior mean will
-                                             be used */
-                                ) {
-
-  Vector *p, *prior = NULL;
-  int maxlen = -1, len, idx, i, j, logmaxlen, loglen, checksum, lastlen = -1, 
-    prior_min, prior_max;
-  GFF_Feature *f;
-  double *post_mean, *post_var;
-  double this_min, this_max, prior_mean, prior_var;
-  p_value_stats *stats = smalloc(lst_size(feats) * 
-                                 sizeof(p_value_stats));
-  char *used = smalloc(msa->ss->ntuples * sizeof(char));
-  Vector **pow_p, **pows;
-
-  if (lst_size(feats) == 0) return NULL;
+/* (used by sub_p_value_many and sub_p_value_joint_many) sort
+   features by length, so that each distinct length can be handled
+   as a unit.  Returns an array of feature indices ordered by length
+   (ties broken by index); group_start is set to an array of
+   dimension *ngroups + 1 such that features of the gth distinct
+   length occupy positions group_start[g] to group_start[g+1]-1 */
+typedef struct {
+  int len, idx;
+} FeatLen;
+
+static int feat_len_compare(const void *a, const void *b) {
+  const FeatLen *fa = a, *fb = b;
+  if (fa->len != fb->len) return fa->len - fb->len;
+  return fa->idx - fb->idx;
+}
 
+static int *sub_feats_by_length(List *feats, int *ngroups, int **group_start) {
+  int i, nfeats = lst_size(feats);
+  FeatLen *fl = smalloc(nfeats * sizeof(FeatLen));
+  int *order = smalloc(nfeats * sizeof(int));
 
-  /* find max length of feature.  Simultaneously, figure out which
-     column tuples actually used (saves time below) */
-  for (i = 0; i < msa->ss->ntuples; i++) used[i] = 'N';
-  for (idx = 0; idx < lst_size(feats); idx++) {
-    checkInterruptN(i, 1000);
-    f = lst_get_ptr(feats, idx);
-    len = f->end - f->start + 1;
-    if (len > maxlen) maxlen = len;
-    for (i = f->start - 1; i < f->end; i++)
-      if (used[msa->ss->tuple_idx[i]] == 'N')
-        used[msa->ss->tuple_idx[i]] = 'Y';
+  for (i = 0; i < nfeats; i++) {
+    GFF_Feature *f = lst_get_ptr(feats, i);
+    fl[i].len = f->end - f->start + 1;
+    fl[i].idx = i;
   }
-
-  /* compute "powers" of prior distribution, to allow fast computation
-     of convolution of prior for any feature length */
-  logmaxlen = log2_int(maxlen);
-  pow_p = smalloc((logmaxlen+1) * sizeof(void*));
-  pow_p[0] = sub_prior_distrib_site(jp);
-  for (i = 1; i <= logmaxlen; i++) 
-    pow_p[i] = pv_convolve(pow_p[i-1], 2, jp->epsilon);
-  pows = smalloc((logmaxlen+1) * sizeof(void*)); /* for use below */
-
-  /* compute mean and variance of posterior for all column tuples */
-  post_mean = smalloc(msa->ss->ntuples * sizeof(double));
-  post_var = smalloc(msa->ss->ntuples * sizeof(double));
-  for (idx = 0; idx < msa->ss->ntuples; idx++) {
-    checkInterruptN(idx, 1000);
-    if (used[idx] == 'N') continue; /* can save fairly expensive call below */
-    p = sub_posterior_distrib_site(jp, msa, idx); 
-    pv_stats(p, &post_mean[idx], &post_var[idx]);
-    vec_free(p);
+  qsort(fl, nfeats, sizeof(FeatLen), feat_len_compare);
+
+  *group_start = smalloc((nfeats + 1) * sizeof(int));
+  *ngroups = 0;
+  for (i = 0; i < nfeats; i++) {
+    order[i] = fl[i].idx;
+    if (i == 0 || fl[i].len != fl[i-1].len)
+      (*group_start)[(*ngroups)++] = i;
   }
+  (*group_start)[*ngroups] = nfeats;
 
-  /* now obtain stats for each feature */
-  for (idx = 0; idx < lst_size(feats); idx++) {
-    checkInterruptN(idx, 100);
-    f = lst_get_ptr(feats, idx);
-    len = f->end - f->start + 1;
-    loglen = log2_int(len);
-
-    if (len != lastlen) { /* don't recompute if length doesn't change;
-                             saves time in some cases */
-      if (prior != NULL) vec_free(prior);
-
-      /* compute convolution of prior from powers */
-      j = checksum = 0;
-      for (i = 0; i <= loglen; i++) {
-        unsigned bit_i = (len >> i) & 1;
-        if (bit_i) {
-          pows[j++] = pow_p[i];
-          checksum += int_pow(2, i);
-        }
-      }
-      if (checksum != len)
-	die("ERROR sub_p_value_many: checksum (%i) != len (%i)\n",
-	    checksum, len);
-      prior = pv_convolve_many(pows, NULL, j, jp->epsilon);
+  sfree(fl);
+  return order;
+}
 
-      pv_stats(prior, &prior_mean, &prior_var);
-      pv_confidence_interval(prior, 0.95, &prior_min, &prior_max);
+/* (used by sub_p_value_many) state shared by threads */
+typedef struct {
+  JumpProcess *jp;
+  MSA *msa;
+  List *feats;
+  double ci;
+  int *tuples;                  /* column tuples in use */
+  double *post_mean, *post_var; /* memo of posterior moments, by tuple */
+  Vector **pow_p;               /* shared "powers" of prior */
+  Vector ***pows;               /* per-thread scratch */
+  int *order, *group_start;     /* features grouped by length */
+  p_value_stats *stats;
+} PValueData;
+
+/* compute posterior mean and variance for one column tuple */
+static void sub_post_moments_thread(int i, int thread, void *data) {
+  PValueData *d = data;
+  int tup = d->tuples[i];
+  Vector *p = sub_posterior_distrib_site(d->jp, d->msa, tup); 
+  pv_stats(p, &d->post_mean[tup], &d->post_var[tup]);
+  vec_free(p);
+}
 
+/* obtain stats for all features of the gth distinct length */
+static void sub_p_value_group_thread(int g, int thread, void *data) {
+  PValueData *d = data;
+  Vector *prior, **pows = d->pows[thread];
+  GFF_Feature *f = lst_get_ptr(d->feats, d->order[d->group_start[g]]);
+  int len = f->end - f->start + 1, loglen = log2_int(len);
+  int i, j, k, idx, checksum, prior_min, prior_max;
+  double this_min, this_max, prior_mean, prior_var;
+  p_value_stats *stats = d->stats;
+  int *tuple_idx = d->msa->ss->tuple_idx;
+
+  checkInterrupt();
+
+  /* compute convolution of prior from powers */
+  j = checksum = 0;
+  for (i = 0; i <= loglen; i++) {
+    unsigned bit_i = (len >> i) & 1;
+    if (bit_i) {
+      pows[j++] = d->pow_p[i];
+      checksum += int_pow(2, i);
     }
+  }
+  if (checksum != len)
+    die("ERROR sub_p_value_many: checksum (%i) != len (%i)\n",
+        checksum, len);
+  prior = pv_convolve_many(pows, NULL, j, d->jp->epsilon);
+
+  pv_stats(prior, &prior_mean, &prior_var);
+  pv_confidence_interval(prior, 0.95, &prior_min, &prior_max);
+
+  for (k = d->group_start[g]; k < d->group_start[g+1]; k++) {
+    idx = d->order[k];
+    f = lst_get_ptr(d->feats, idx);
 
     stats[idx].prior_mean = prior_mean;
     stats[idx].prior_var = prior_var;
@@ -951,13 +1225,13 @@ p_value_stats *sub_p_value_many(JumpProcess *jp, MSA *msa, List *feats,
 
     stats[idx].post_mean = stats[idx].post_var = 0;
     for (i = f->start - 1; i < f->end; i++) {
-      stats[idx].post_mean += post_mean[msa->ss->tuple_idx[i]];
-      stats[idx].post_var += post_var[msa->ss->tuple_idx[i]];
+      stats[idx].post_mean += d->post_mean[tuple_idx[i]];
+      stats[idx].post_var += d->post_var[tuple_idx[i]];
     }
     
-    if (ci != -1)
+    if (d->ci != -1)
       norm_confidence_interval(stats[idx].post_mean, sqrt(stats[idx].post_var), 
-                               ci, &this_min, &this_max);
+                               d->ci, &this_min, &this_max);
     else 
       this_min = this_max = stats[idx].post_mean;
 
@@ -966,21 +1240,109 @@ p_value_stats *sub_p_value_many(JumpProcess *jp, MSA *msa, List *feats,
 
     stats[idx].p_cons = pv_p_value(prior, stats[idx].post_max, LOWER);
     stats[idx].p_anti_cons = pv_p_value(prior, stats[idx].post_min, UPPER);    
-
-    lastlen = len;
   }
+
   vec_free(prior);
+}
+
+/* (used by sub_p_value_many and sub_p_value_joint_many) mark column
+   tuples used by features, and return them in an array of dimension
+   *ntuples; also set *maxlen to the maximum feature length.  Also
+   makes sure lazily computed parts of the tree model are initialized,
+   so that posteriors can safely be computed in parallel */
+static int *sub_feature_tuples(JumpProcess *jp, MSA *msa, List *feats, 
+                               int *ntuples, int *maxlen) {
+  char *used = smalloc(msa->ss->ntuples * sizeof(char));
+  int *tuples = smalloc(msa->ss->ntuples * sizeof(int));
+  int i, idx, len;
+  GFF_Feature *f;
 
-  for (idx = 0; idx <= logmaxlen; idx++)
-    vec_free(pow_p[idx]);
-  sfree(pow_p);
-  sfree(pows);
+  *maxlen = -1;
+  for (i = 0; i < msa->ss->ntuples; i++) used[i] = 'N';
+  for (idx = 0; idx < lst_size(feats); idx++) {
+    checkInterruptN(idx, 1000);
+    f = lst_get_ptr(feats, idx);
+    len = f->end - f->start + 1;
+    if (len > *maxlen) *maxlen = len;
+    for (i = f->start - 1; i < f->end; i++)
+      if (used[msa->ss->tuple_idx[i]] == 'N')
+        used[msa->ss->tuple_idx[i]] = 'Y';
+  }
 
-  sfree(post_mean);
-  sfree(post_var);
+  *ntuples = 0;
+  for (i = 0; i < msa->ss->ntuples; i++)
+    if (used[i] == 'Y') tuples[(*ntuples)++] = i;
   sfree(used);
 
-  return stats;
+  tr_postorder(jp->mod->tree);
+  if (jp->mod->msa_seq_idx == NULL)
+    tm_build_seq_idx(jp->mod, msa);
+
+  return tuples;
+}
+
+/* compute p-values and related stats for a given alignment and model
+   and each of a set of features.  Returns an array of p_value_stats
+   objects, one for each feature (dimension
+   lst_size(feat->features)).  Posterior moments are computed once per
+   column tuple, and the prior once per distinct feature length; both
+   steps are carried out in parallel if multiple threads are enabled
+   (see parallel.h) */   
+p_value_stats *sub_p_value_many(JumpProcess *jp, MSA *msa, List *feats, 
+                                double ci /* confidence interval; if
+                                             -1, posterior mean will
+                                             be used */
+                                ) {
+
+  int maxlen, i, logmaxlen, ntuples, ngroups, nthreads = thr_get_nthreads();
+  PValueData d;
+
+  if (lst_size(feats) == 0) return NULL;
+
+  d.jp = jp;
+  d.msa = msa;
+  d.feats = feats;
+  d.ci = ci;
+  d.stats = smalloc(lst_size(feats) * sizeof(p_value_stats));
+
+  /* find max length of feature.  Simultaneously, figure out which
+     column tuples actually used (saves time below) */
+  d.tuples = sub_feature_tuples(jp, msa, feats, &ntuples, &maxlen);
+
+  /* compute "powers" of prior distribution, to allow fast computation
+     of convolution of prior for any feature length */
+  logmaxlen = log2_int(maxlen);
+  d.pow_p = smalloc((logmaxlen+1) * sizeof(void*));
+  d.pow_p[0] = sub_prior_distrib_site(jp);
+  for (i = 1; i <= logmaxlen; i++) 
+    d.pow_p[i] = pv_convolve(d.pow_p[i-1], 2, jp->epsilon);
+  d.pows = smalloc(nthreads * sizeof(void*)); /* for use below */
+  for (i = 0; i < nthreads; i++)
+    d.pows[i] = smalloc((logmaxlen+1) * sizeof(void*));
+
+  /* compute mean and variance of posterior for all column tuples */
+  d.post_mean = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_var = smalloc(msa->ss->ntuples * sizeof(double));
+  thr_foreach(ntuples, sub_post_moments_thread, &d);
+
+  /* now obtain stats for each feature, one distinct length at a time */
+  d.order = sub_feats_by_length(feats, &ngroups, &d.group_start);
+  thr_foreach(ngroups, sub_p_value_group_thread, &d);
+
+  for (i = 0; i <= logmaxlen; i++)
+    vec_free(d.pow_p[i]);
+  sfree(d.pow_p);
+  for (i = 0; i < nthreads; i++)
+    sfree(d.pows[i]);
+  sfree(d.pows);
+
+  sfree(d.post_mean);
+  sfree(d.post_var);
+  sfree(d.tuples);
+  sfree(d.order);
+  sfree(d.group_start);
+
+  return d.stats;
 }
 
 /* (used by sub_p_value_joint_many) compute maximum length of element
@@ -1007,189 +1369,126 @@ int max_convolve_len(int max_convolve_size, double max_nsd,
   return l-1;
 }
 
-/* left/right subtree version of above: compute p-values and related
-   stats for a given alignment and model and each of a set of
-   features.  Returns an array of p_value_joint_stats objects, one for
-   each feature (dimension lst_size(feat->features)).  Tree model is
-   assumed to have already been rerooted by tr_reroot */   
-p_value_joint_stats*
-sub_p_value_joint_many(JumpProcess *jp, MSA *msa, List *feats, 
-                       double ci, /* confidence interval; if
-                                     -1, posterior mean will
-                                     be used */
-                       int max_convolve_size, 
-                                /* maximum matrix size (rows*cols) for
-                                   exact computation of prior
-                                   convolution; beyond this size, an
-                                   approximation is used  */
-                       FILE *timing_f /* log file for timing info */
-                       ) {
+/* (used by sub_p_value_joint_many) state shared by threads */
+typedef struct {
+  JumpProcess *jp;
+  MSA *msa;
+  List *feats;
+  double ci;
+  int max_conv_len;
+  double max_nsd;
+  double prior_site_mean_left, prior_site_var_left, 
+    prior_site_mean_right, prior_site_var_right;
+  Vector *prior_site_marg_left, *prior_site_marg_right;
+  int *tuples;                  /* column tuples in use */
+  double *post_mean_left, *post_mean_right, *post_mean_tot, 
+    *post_var_left, *post_var_right, *post_var_tot;
+                                /* memo of posterior moments, by tuple */
+  Matrix **pow_p;               /* shared "powers" of prior */
+  Matrix ***pows;               /* per-thread scratch */
+  int *order, *group_start;     /* features grouped by length */
+  p_value_joint_stats *stats;
+  FILE *timing_f;
+} PValueJointData;
+
+/* compute moments of posterior marginals for one column tuple */
+static void sub_post_joint_moments_thread(int i, int thread, void *data) {
+  PValueJointData *d = data;
+  int tup = d->tuples[i];
+  Matrix *p = sub_joint_distrib_site(d->jp, d->msa, tup); 
+  Vector *marg = pm_marg_x(p);
+  pv_stats(marg, &d->post_mean_left[tup], &d->post_var_left[tup]);
+  vec_free(marg);
+  marg = pm_marg_y(p);
+  pv_stats(marg, &d->post_mean_right[tup], &d->post_var_right[tup]);
+  vec_free(marg);
+  marg = pm_marg_tot(p);
+  pv_stats(marg, &d->post_mean_tot[tup], &d->post_var_tot[tup]);
+  vec_free(marg);
+  mat_free(p);
+}
 
-  Matrix *p, *prior = NULL, *prior_site;
-  int maxlen = -1, len, idx, i, j, logmaxlen, loglen, max_nrows=-1, max_ncols=-1,
-    max_conv_len, checksum, lastlen = -1;
-  GFF_Feature *f;
-  double *post_mean_left, *post_mean_right, *post_mean_tot, *post_var_left,
-    *post_var_right, *post_var_tot;
-  double this_min_left, this_min_right, this_max_left, this_max_right, 
-    this_min_tot, this_max_tot, prior_site_mean_left, prior_site_var_left,
-    prior_site_mean_right, prior_site_var_right, rho;
-  double  prior_mean_left, prior_var_left, prior_mean_right, prior_var_right;
+/* obtain stats for all features of the gth distinct length */
+static void sub_p_value_joint_group_thread(int g, int thread, void *data) {
+  PValueJointData *d = data;
+  Matrix *prior = NULL, **pows = d->pows[thread];
+  Vector *prior_marg_left, *prior_marg_right, *cond;
+  GFF_Feature *f = lst_get_ptr(d->feats, d->order[d->group_start[g]]);
+  int len = f->end - f->start + 1, loglen = log2_int(len);
+  int i, j, k, idx, checksum, max_nrows = -1, max_ncols = -1;
+  double this_min_left, this_max_left, this_min_right, this_max_right,
+    this_min_tot, this_max_tot;
+  double prior_mean_left, prior_var_left, prior_mean_right, prior_var_right;
   int prior_min_left, prior_max_left, prior_min_right, prior_max_right;
-  p_value_joint_stats *stats = smalloc(lst_size(feats) * 
-                                       sizeof(p_value_joint_stats));
-  Vector *prior_site_marg_left, *prior_site_marg_right,
-    *prior_marg_left = NULL, *prior_marg_right = NULL, *marg, *cond;
-  char *used = smalloc(msa->ss->ntuples * sizeof(char));
-  Matrix **pow_p, **pows;
+  p_value_joint_stats *stats = d->stats;
+  int *tuple_idx = d->msa->ss->tuple_idx;
   struct timeval marker_time;
-  double max_nsd = -inv_cum_norm(jp->epsilon) + 1; /* for use in CLT
-                                                      approximations */
-
-  /* find max length of feature.  Simultaneously, figure out which
-     column tuples actually used (saves time below)  */
-  for (i = 0; i < msa->ss->ntuples; i++) used[i] = 'N';
-  for (idx = 0; idx < lst_size(feats); idx++) {
-    f = lst_get_ptr(feats, idx);
-    len = f->end - f->start + 1;
-    if (len > maxlen) maxlen = len;
-    for (i = f->start - 1; i < f->end; i++)
-      if (used[msa->ss->tuple_idx[i]] == 'N')
-        used[msa->ss->tuple_idx[i]] = 'Y';
-  }
 
-  /* compute per-site prior distribution and left/right marginals */
-  prior_site = sub_joint_distrib_site(jp, NULL, -1);
-  pm_stats(prior_site, &prior_site_mean_left, &prior_site_mean_right,
-           &prior_site_var_left, &prior_site_var_right, &rho);
-  rho /= (sqrt(prior_site_var_left * prior_site_var_right));
-                                /* (convert covariance to corr. coef.) */
-  prior_site_marg_left = pm_marg_x(prior_site);
-  prior_site_marg_right = pm_marg_y(prior_site);
+  checkInterrupt();
 
-  /* compute maximum length for explicit computation of joint prior
-     via convolution */
-  max_conv_len = 
-    max_convolve_len(max_convolve_size, max_nsd,
-                     prior_site_mean_left, sqrt(prior_site_var_left), 
-                     prior_site_mean_right, sqrt(prior_site_var_right));
-  if (maxlen > max_conv_len)
-    maxlen = max_conv_len;
+  if (len <= d->max_conv_len) {
 
-  /* compute "powers" of prior distribution, to allow fast computation
-     of convolution of prior */
-  logmaxlen = log2_int(maxlen);
-  pow_p = smalloc((logmaxlen+1) * sizeof(void*));
-  pow_p[0] = prior_site;
-  for (i = 1; i <= logmaxlen; i++) {
-    if (timing_f != NULL) gettimeofday(&marker_time, NULL);
-    pow_p[i] = pm_convolve(pow_p[i-1], 2, jp->epsilon);
-    if (timing_f != NULL) 
-      fprintf(timing_f, "pow_p[%d] (%d x %d): %f sec\n", i, 
-              pow_p[i]->nrows, pow_p[i]->ncols, get_elapsed_time(&marker_time));
+    /* compute convolution of prior from powers */
+    j = checksum = 0;
+    for (i = 0; i <= loglen; i++) {
+      unsigned bit_i = (len >> i) & 1;
+      if (bit_i) {
+        pows[j++] = d->pow_p[i];
+        checksum += int_pow(2, i);
+      }
+    }
+    if (checksum != len)
+      die("ERROR sub_p_value_joint_many: checksum (%i) != len (%i)\n",
+          checksum, len);
+
+    if (len > 25) {
+      /* use central limit theorem to limit size of matrix to keep
+         track of */
+      max_nrows = (int)ceil(len * d->prior_site_mean_left + 
+                            d->max_nsd * sqrt(len * d->prior_site_var_left));
+      max_ncols = (int)ceil(len * d->prior_site_mean_right + 
+                            d->max_nsd * sqrt(len * d->prior_site_var_right));
+    }
+    else {
+      max_nrows = d->pow_p[0]->nrows * len;
+      max_ncols = d->pow_p[0]->ncols * len;
+    }
+        
+    if (d->timing_f != NULL) gettimeofday(&marker_time, NULL);
+    prior = pm_convolve_many_fast(pows, j, max_nrows, max_ncols,
+                                  d->jp->epsilon);
+    if (d->timing_f != NULL)
+      fprintf(d->timing_f, "len = %d (%d x %d): %f sec\n", len, max_nrows, 
+              max_ncols, get_elapsed_time(&marker_time));
+
+    prior_marg_left = pm_marg_x(prior);
+    prior_marg_right = pm_marg_y(prior);
   }
-  pows = smalloc((logmaxlen+1) * sizeof(void*)); /* for use below */
-
-  /* compute mean and variance of (marginals of) posterior for all
-     column tuples */
-  post_mean_left = smalloc(msa->ss->ntuples * sizeof(double));
-  post_mean_right = smalloc(msa->ss->ntuples * sizeof(double));
-  post_mean_tot = smalloc(msa->ss->ntuples * sizeof(double));
-  post_var_left = smalloc(msa->ss->ntuples * sizeof(double));
-  post_var_right = smalloc(msa->ss->ntuples * sizeof(double));
-  post_var_tot = smalloc(msa->ss->ntuples * sizeof(double));
-  for (idx = 0; idx < msa->ss->ntuples; idx++) {
-    checkInterruptN(idx, 100);
-    if (used[idx] == 'N') continue; /* can save fairly expensive call below */
-    p = sub_joint_distrib_site(jp, msa, idx); 
-    marg = pm_marg_x(p);
-    pv_stats(marg, &post_mean_left[idx], &post_var_left[idx]);
-    vec_free(marg);
-    marg = pm_marg_y(p);
-    pv_stats(marg, &post_mean_right[idx], &post_var_right[idx]);
-    vec_free(marg);
-    marg = pm_marg_tot(p);
-    pv_stats(marg, &post_mean_tot[idx], &post_var_tot[idx]);
-    vec_free(marg);
-    mat_free(p);
+  else {
+    prior = NULL;             /* won't be used explicitly */
+    prior_marg_left = pv_convolve(d->prior_site_marg_left, len, 
+                                  d->jp->epsilon);
+    prior_marg_right = pv_convolve(d->prior_site_marg_right, len, 
+                                   d->jp->epsilon);
+    if (d->timing_f != NULL)
+      fprintf(d->timing_f, "len = %d (%d x %d): [skipping joint convolution]\n",
+              len, max_nrows, max_ncols);
   }
 
-  /* now obtain stats for each feature */
-  for (idx = 0; idx < lst_size(feats); idx++) {
-    checkInterruptN(idx, 100);
-    f = lst_get_ptr(feats, idx);
-    len = f->end - f->start + 1;
-    loglen = log2_int(len);
-
-    if (len == lastlen) {
-      if (timing_f != NULL)
-        fprintf(timing_f, "len = %d (%d x %d): [using cached convolution]\n",
-                len, max_nrows, max_ncols);
-    }
-
-    else {                /* don't recompute if length doesn't change;
-                             saves time in some cases */
+  pv_stats(prior_marg_left, &prior_mean_left, &prior_var_left);
+  pv_confidence_interval(prior_marg_left, 0.95, &prior_min_left,
+                         &prior_max_left);
+  pv_stats(prior_marg_right, &prior_mean_right, &prior_var_right);
+  pv_confidence_interval(prior_marg_right, 0.95, &prior_min_right,
+                         &prior_max_right);
 
-      if (prior_marg_left != NULL) { 
-        if (prior != NULL) mat_free(prior);
-        vec_free(prior_marg_left);
-        vec_free(prior_marg_right);
-      }
-
-      if (len <= max_conv_len) {
-
-        /* compute convolution of prior from powers */
-        j = checksum = 0;
-        for (i = 0; i <= loglen; i++) {
-          unsigned bit_i = (len >> i) & 1;
-          if (bit_i) {
-            pows[j++] = pow_p[i];
-            checksum += int_pow(2, i);
-          }
-        }
-	if (checksum != len)
-	  die("ERROR sub_p_value_joint_many: checksum (%i) != len (%i)\n",
-	      checksum, len);
-
-        if (len > 25) {
-          /* use central limit theorem to limit size of matrix to keep
-             track of */
-          max_nrows = (int)ceil(len * prior_site_mean_left + 
-                           max_nsd * sqrt(len * prior_site_var_left));
-          max_ncols = (int)ceil(len * prior_site_mean_right + 
-                           max_nsd * sqrt(len * prior_site_var_right));
-        }
-        else {
-          max_nrows = pow_p[0]->nrows * len;
-          max_ncols = pow_p[0]->ncols * len;
-        }
-        
-        if (timing_f != NULL) gettimeofday(&marker_time, NULL);
-        prior = pm_convolve_many_fast(pows, j, max_nrows, max_ncols);
-        if (timing_f != NULL)
-          fprintf(timing_f, "len = %d (%d x %d): %f sec\n", len, max_nrows, 
-                  max_ncols, get_elapsed_time(&marker_time));
-
-        prior_marg_left = pm_marg_x(prior);
-        prior_marg_right = pm_marg_y(prior);
-      }
-      else {
-        prior = NULL;             /* won't be used explicitly */
-        prior_marg_left = pv_convolve(prior_site_marg_left, len, jp->epsilon);
-        prior_marg_right = pv_convolve(prior_site_marg_right, len, jp->epsilon);
-        if (timing_f != NULL)
-          fprintf(timing_f, "len = %d (%d x %d): [skipping joint convolution]\n",
-                  len, max_nrows, max_ncols);
-      }
+  for (k = d->group_start[g]; k < d->group_start[g+1]; k++) {
+    idx = d->order[k];
+    f = lst_get_ptr(d->feats, idx);
 
-      pv_stats(prior_marg_left, &prior_mean_left, &prior_var_left);
-      pv_confidence_interval(prior_marg_left, 0.95, &prior_min_left,
-                             &prior_max_left);
-      pv_stats(prior_marg_right, &prior_mean_right, &prior_var_right);
-      pv_confidence_interval(prior_marg_right, 0.95, &prior_min_right,
-                             &prior_max_right);
-      
-    }
+    if (k > d->group_start[g] && d->timing_f != NULL)
+      fprintf(d->timing_f, "len = %d (%d x %d): [using cached convolution]\n",
+              len, max_nrows, max_ncols);
 
     stats[idx].prior_mean_left = prior_mean_left;
     stats[idx].prior_var_left = prior_var_left;
@@ -1204,24 +1503,24 @@ sub_p_value_joint_many(JumpProcess *jp, MSA *msa, List *feats,
       stats[idx].post_var_left = stats[idx].post_var_right = 
       stats[idx].post_mean_tot = stats[idx].post_var_tot = 0;
     for (i = f->start - 1; i < f->end; i++) {
-      stats[idx].post_mean_left += post_mean_left[msa->ss->tuple_idx[i]];
-      stats[idx].post_mean_right += post_mean_right[msa->ss->tuple_idx[i]];
-      stats[idx].post_mean_tot += post_mean_tot[msa->ss->tuple_idx[i]];
-      stats[idx].post_var_left += post_var_left[msa->ss->tuple_idx[i]];
-      stats[idx].post_var_right += post_var_right[msa->ss->tuple_idx[i]];
-      stats[idx].post_var_tot += post_var_tot[msa->ss->tuple_idx[i]];
+      stats[idx].post_mean_left += d->post_mean_left[tuple_idx[i]];
+      stats[idx].post_mean_right += d->post_mean_right[tuple_idx[i]];
+      stats[idx].post_mean_tot += d->post_mean_tot[tuple_idx[i]];
+      stats[idx].post_var_left += d->post_var_left[tuple_idx[i]];
+      stats[idx].post_var_right += d->post_var_right[tuple_idx[i]];
+      stats[idx].post_var_tot += d->post_var_tot[tuple_idx[i]];
     }
     
-    if (ci != -1) {
+    if (d->ci != -1) {
       norm_confidence_interval(stats[idx].post_mean_left, 
                                sqrt(stats[idx].post_var_left), 
-                               ci, &this_min_left, &this_max_left);
+                               d->ci, &this_min_left, &this_max_left);
       norm_confidence_interval(stats[idx].post_mean_right, 
                                sqrt(stats[idx].post_var_right), 
-                               ci, &this_min_right, &this_max_right);
+                               d->ci, &this_min_right, &this_max_right);
       norm_confidence_interval(stats[idx].post_mean_tot, 
                                sqrt(stats[idx].post_var_tot), 
-                               ci, &this_min_tot, &this_max_tot);
+                               d->ci, &this_min_tot, &this_max_tot);
     }
     else {
       this_min_left = this_max_left = stats[idx].post_mean_left;
@@ -1274,28 +1573,119 @@ sub_p_value_joint_many(JumpProcess *jp, MSA *msa, List *feats,
                                          stats[idx].post_max_right, LOWER);
     stats[idx].p_anti_cons_right = pv_p_value(prior_marg_right, 
                                               stats[idx].post_min_right, UPPER);
-
-    lastlen = len;
   }
+
   if (prior != NULL) mat_free(prior);
   vec_free(prior_marg_left);
   vec_free(prior_marg_right);
+}
 
-  for (idx = 0; idx <= logmaxlen; idx++)
-    mat_free(pow_p[idx]);       /* this will also free prior_site */
-  sfree(pow_p);
-  sfree(pows);
-  vec_free(prior_site_marg_left);
-  vec_free(prior_site_marg_right);
-  sfree(post_mean_left);
-  sfree(post_mean_right);
-  sfree(post_mean_tot);
-  sfree(post_var_left);
-  sfree(post_var_right);
-  sfree(post_var_tot);
-  sfree(used);
+/* left/right subtree version of above: compute p-values and related
+   stats for a given alignment and model and each of a set of
+   features.  Returns an array of p_value_joint_stats objects, one for
+   each feature (dimension lst_size(feat->features)).  Tree model is
+   assumed to have already been rerooted by tr_reroot.  As with
+   sub_p_value_many, posteriors are computed once per column tuple and
+   the prior once per distinct feature length, in parallel if multiple
+   threads are enabled */   
+p_value_joint_stats*
+sub_p_value_joint_many(JumpProcess *jp, MSA *msa, List *feats, 
+                       double ci, /* confidence interval; if
+                                     -1, posterior mean will
+                                     be used */
+                       int max_convolve_size, 
+                                /* maximum matrix size (rows*cols) for
+                                   exact computation of prior
+                                   convolution; beyond this size, an
+                                   approximation is used  */
+                       FILE *timing_f /* log file for timing info */
+                       ) {
+
+  Matrix *prior_site;
+  int maxlen, i, logmaxlen, ntuples, ngroups, nthreads = thr_get_nthreads();
+  double rho;
+  PValueJointData d;
+  struct timeval marker_time;
+
+  d.jp = jp;
+  d.msa = msa;
+  d.feats = feats;
+  d.ci = ci;
+  d.timing_f = timing_f;
+  d.max_nsd = -inv_cum_norm(jp->epsilon) + 1; /* for use in CLT
+                                                  approximations */
+  d.stats = smalloc(lst_size(feats) * sizeof(p_value_joint_stats));
+
+  /* find max length of feature.  Simultaneously, figure out which
+     column tuples actually used (saves time below)  */
+  d.tuples = sub_feature_tuples(jp, msa, feats, &ntuples, &maxlen);
+
+  /* compute per-site prior distribution and left/right marginals */
+  prior_site = sub_joint_distrib_site(jp, NULL, -1);
+  pm_stats(prior_site, &d.prior_site_mean_left, &d.prior_site_mean_right,
+           &d.prior_site_var_left, &d.prior_site_var_right, &rho);
+  d.prior_site_marg_left = pm_marg_x(prior_site);
+  d.prior_site_marg_right = pm_marg_y(prior_site);
+
+  /* compute maximum length for explicit computation of joint prior
+     via convolution */
+  d.max_conv_len = 
+    max_convolve_len(max_convolve_size, d.max_nsd,
+                     d.prior_site_mean_left, sqrt(d.prior_site_var_left), 
+                     d.prior_site_mean_right, sqrt(d.prior_site_var_right));
+  if (maxlen > d.max_conv_len)
+    maxlen = d.max_conv_len;
+
+  /* compute "powers" of prior distribution, to allow fast computation
+     of convolution of prior */
+  logmaxlen = log2_int(maxlen);
+  d.pow_p = smalloc((logmaxlen+1) * sizeof(void*));
+  d.pow_p[0] = prior_site;
+  for (i = 1; i <= logmaxlen; i++) {
+    if (timing_f != NULL) gettimeofday(&marker_time, NULL);
+    d.pow_p[i] = pm_convolve(d.pow_p[i-1], 2, jp->epsilon);
+    if (timing_f != NULL) 
+      fprintf(timing_f, "pow_p[%d] (%d x %d): %f sec\n", i, 
+              d.pow_p[i]->nrows, d.pow_p[i]->ncols, 
+              get_elapsed_time(&marker_time));
+  }
+  d.pows = smalloc(nthreads * sizeof(void*)); /* for use below */
+  for (i = 0; i < nthreads; i++)
+    d.pows[i] = smalloc((logmaxlen+1) * sizeof(void*));
 
-  return stats;
+  /* compute mean and variance of (marginals of) posterior for all
+     column tuples */
+  d.post_mean_left = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_mean_right = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_mean_tot = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_var_left = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_var_right = smalloc(msa->ss->ntuples * sizeof(double));
+  d.post_var_tot = smalloc(msa->ss->ntuples * sizeof(double));
+  thr_foreach(ntuples, sub_post_joint_moments_thread, &d);
+
+  /* now obtain stats for each feature, one distinct length at a time */
+  d.order = sub_feats_by_length(feats, &ngroups, &d.group_start);
+  thr_foreach(ngroups, sub_p_value_joint_group_thread, &d);
+
+  for (i = 0; i <= logmaxlen; i++)
+    mat_free(d.pow_p[i]);       /* this will also free prior_site */
+  sfree(d.pow_p);
+  for (i = 0; i < nthreads; i++)
+    sfree(d.pows[i]);
+  sfree(d.pows);
+  vec_free(d.prior_site_marg_left);
+  vec_free(d.prior_site_marg_right);
+  sfree(d.post_mean_left);
+  sfree(d.post_mean_right);
+  sfree(d.post_mean_tot);
+  sfree(d.post_var_left);
+  sfree(d.post_var_right);
+  sfree(d.post_var_tot);
+  sfree(d.tuples);
+  sfree(d.order);
+  sfree(d.group_start);
+
+  return d.stats;
 }
 
 /* reroot tree at specified subtree root; use before computing joint
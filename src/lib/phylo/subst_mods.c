@@ -1483,33 +1483,19 @@ void tm_set_REV_CODON_matrix(TreeModel *mod, Vector *params, int start_idx) {
   int setup_mapping = (mod->rate_matrix_param_row != NULL &&
 		       lst_size(mod->rate_matrix_param_row[start_idx]) == 0);
   double val;
-  static char *states;
-  static int alph_size=-1;
-  static int **revmat = NULL;
+  /* mapping from pairs of nucleotides to parameters; rebuilt on each
+     call (rather than cached in statics) so that models can be
+     handled concurrently */
+  int alph_size = (int)strlen(mod->rate_matrix->states), idx = 0;
+  int revmat[alph_size][alph_size];
 
   if (mod->backgd_freqs == NULL)
     die("tm_set_REV_CODON_matrix: mod->backgd_freqs is NULL\n");
 
-  if (revmat != NULL && strcmp(states, mod->rate_matrix->states)!=0) {
-    for (i=0; i < alph_size; i++)
-      sfree(revmat[i]);
-    sfree(revmat);
-    revmat = NULL;
-    sfree(states);
-  }
-  if (revmat == NULL) {
-    int idx=0;
-    states = copy_charstr(mod->rate_matrix->states);
-    alph_size = (int)strlen(states);
-    revmat = smalloc(alph_size*sizeof(double*));
-    set_static_var((void**)&revmat);
-    for (i=0; i < alph_size; i++)
-      revmat[i] = smalloc(alph_size*sizeof(double));
-    for (i=0; i < alph_size; i++)
-      for (j=i+1; j < alph_size; j++) {
-	revmat[i][j] = revmat[j][i] = start_idx + idx++;
-      }
-  }
+  for (i=0; i < alph_size; i++)
+    for (j=i+1; j < alph_size; j++) {
+      revmat[i][j] = revmat[j][i] = start_idx + idx++;
+    }
 
   mat_zero(mod->rate_matrix->matrix);
 
@@ -1554,40 +1540,24 @@ void tm_set_SSREV_CODON_matrix(TreeModel *mod, Vector *params, int start_idx) {
   int setup_mapping = (mod->rate_matrix_param_row != NULL &&
 		       lst_size(mod->rate_matrix_param_row[start_idx]) == 0);
   double val;
-  static char *states;
-  static int alph_size=-1;
-  static int **revmat = NULL;
+  /* see tm_set_REV_CODON_matrix */
+  int alph_size = (int)strlen(mod->rate_matrix->states), idx = 0;
+  int revmat[alph_size][alph_size];
 
   if (mod->backgd_freqs == NULL)
     die("tm_set_SSREV_CODON_matrix: mod->backgd_freqs is NULL\n");
 
-  if (revmat != NULL && strcmp(states, mod->rate_matrix->states) != 0) {
-    for (i=0; i < alph_size; i++)
-      sfree(revmat[i]);
-    sfree(revmat);
-    sfree(states);
-    revmat = NULL;
-  }
-  if (revmat == NULL) {
-    int idx=0;
-    states = copy_charstr(mod->rate_matrix->states);
-    alph_size = (int)strlen(states);
-    revmat = smalloc(alph_size*sizeof(double*));
-    set_static_var((void**)&revmat);
-    for (i=0; i < alph_size; i++)
-      revmat[i] = smalloc(alph_size*sizeof(double));
-    for (i=0; i < alph_size; i++)  {
-      compi = mod->rate_matrix->inv_states[(int)msa_compl_char(mod->rate_matrix->states[i])];
-      for (j=i+1; j < alph_size; j++) {
-	compj = mod->rate_matrix->inv_states[(int)msa_compl_char(mod->rate_matrix->states[j])];
-	if ((compi < compj && compi < i) ||
-	    (compj < compi && compj < i)) continue;
-	revmat[i][j] = start_idx + idx++;
-	revmat[j][i] = revmat[i][j];
-	if (compi != j) {
-	  revmat[compi][compj] = revmat[i][j];
-	  revmat[compj][compi] = revmat[i][j];
-	}
+  for (i=0; i < alph_size; i++)  {
+    compi = mod->rate_matrix->inv_states[(int)msa_compl_char(mod->rate_matrix->states[i])];
+    for (j=i+1; j < alph_size; j++) {
+      compj = mod->rate_matrix->inv_states[(int)msa_compl_char(mod->rate_matrix->states[j])];
+      if ((compi < compj && compi < i) ||
+          (compj < compi && compj < i)) continue;
+      revmat[i][j] = start_idx + idx++;
+      revmat[j][i] = revmat[i][j];
+      if (compi != j) {
+        revmat[compi][compj] = revmat[i][j];
+        revmat[compj][compi] = revmat[i][j];
       }
     }
   }
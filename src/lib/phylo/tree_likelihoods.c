@@ -15,6 +15,7 @@
 #include <subst_mods.h>
 #include <dgamma.h>
 #include <sufficient_stats.h>
+#include <parallel.h>
 
 /* Computation of likelihoods for columns of a given multiple
    alignment, according to a given tree model.  */
@@ -31,22 +32,70 @@ int tuple_index_missing_data(char *tuple, int *inv_alph, int *is_missing,
 
 
 
+/* Set up everything a tree model computes on demand when its
+   likelihood is first evaluated: sufficient statistics (ordered if
+   col-by-col scores are needed), the leaf to sequence mapping, the
+   substitution matrices, the IUPAC mapping, and the tree
+   traversals */
+static void tl_init_model(TreeModel *mod, MSA *msa, int store_order) {
+  int i, j, defined;
+
+  if (mod->iupac_inv_map == NULL)
+    mod->iupac_inv_map = build_iupac_inv_map(mod->rate_matrix->inv_states,
+                                             (int)strlen(mod->rate_matrix->states));
+
+  /* obtain sufficient statistics, if necessary */
+  if (msa->ss != NULL){
+    if (msa->ss->tuple_size <= mod->order)
+      die("ERROR tl_compute_log_likelihood: tuple_size (%i) must be greater than mod->order (%i)\n",
+	  msa->ss->tuple_size, mod->order);
+  }
+  else
+    ss_from_msas(msa, mod->order+1, store_order,
+                 NULL, NULL, NULL, -1, subst_mod_is_codon_model(mod->subst_mod));
+
+  /* set up leaf to sequence mapping, if necessary */
+  if (mod->msa_seq_idx == NULL)
+    tm_build_seq_idx(mod, msa);
+
+  /* set up prob matrices, if any are undefined */
+  for (i = 0, defined = TRUE; defined && i < mod->tree->nnodes; i++) {
+    if (((TreeNode*)lst_get_ptr(mod->tree->nodes, i))->parent == NULL)
+      continue;  		/* skip root */
+    for (j = 0; j < mod->nratecats; j++)
+      if (mod->P[i][j] == NULL) defined = FALSE;
+  }
+  if (!defined) {
+    tm_set_subst_matrices(mod);
+  }
+
+  tr_postorder(mod->tree);
+  tr_preorder(mod->tree);
+}
+
+void tl_prepare(TreeModel *mod, MSA *msa) {
+  tl_init_model(mod, msa, FALSE);
+}
+
 /* Compute the likelihood of a tree model with respect to an
-   alignment.  Optionally retain column-by-column likelihoods,
-   optionally compute posterior probabilities.  If 'post' is NULL, no
-   posterior probabilities (or related quantities) will be computed.
-   If 'post' is non-NULL each of its attributes must either be NULL or
-   previously allocated to the required size. */
-double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
-                                 double *col_scores, double *tuple_scores,
-				 int cat, TreePosteriors *post) {
+   alignment, considering only tuples first_tuple through last_tuple
+   - 1 (all tuples if last_tuple < 0).  Optionally retain
+   column-by-column likelihoods, optionally compute posterior
+   probabilities.  If 'post' is NULL, no posterior probabilities (or
+   related quantities) will be computed.  If 'post' is non-NULL each
+   of its attributes must either be NULL or previously allocated to
+   the required size. */
+static double tl_loglik_tuples(TreeModel *mod, MSA *msa,
+                               double *col_scores, double *tuple_scores,
+                               int cat, TreePosteriors *post,
+                               int first_tuple, int last_tuple) {
 
   int i, j;
   double retval = 0;
   int nstates = mod->rate_matrix->size;
   int alph_size = (int)strlen(mod->rate_matrix->states);
   int npasses = (mod->order > 0 && mod->use_conditionals == 1 ? 2 : 1);
-  int pass, col_offset, k, nodeidx, rcat, /* colidx, */ tupleidx, defined;
+  int pass, col_offset, k, nodeidx, rcat, /* colidx, */ tupleidx;
   TreeNode *n;
   double total_prob, marg_tot;
   List *traversal;
@@ -93,11 +142,6 @@ double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
     }
   }
 
-  /* create IUPAC mapping if needed */
-  if (mod->iupac_inv_map == NULL)
-    mod->iupac_inv_map = build_iupac_inv_map(mod->rate_matrix->inv_states,
-                                             alph_size);
-
 
   if (cat > msa->ncats)
     die("ERROR tl_compute_log_likelihood: cat (%i) > msa->ncats (%i)\n", cat, msa->ncats);
@@ -108,31 +152,10 @@ double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
      scoring, then must have col-by-col
      categories */
 
-  /* obtain sufficient statistics, if necessary */
-  if (msa->ss != NULL){
-    if (msa->ss->tuple_size <= mod->order)
-      die("ERROR tl_compute_log_likelihood: tuple_size (%i) must be greater than mod->order (%i)\n",
-	  msa->ss->tuple_size, mod->order);
-  }
-  else
-    ss_from_msas(msa, mod->order+1, col_scores == NULL ? 0 : 1,
-                 NULL, NULL, NULL, -1, subst_mod_is_codon_model(mod->subst_mod));
-
-  /* set up leaf to sequence mapping, if necessary */
-  if (mod->msa_seq_idx == NULL)
-    tm_build_seq_idx(mod, msa);
+  tl_init_model(mod, msa, col_scores == NULL ? 0 : 1);
+  if (last_tuple < 0 || last_tuple > msa->ss->ntuples)
+    last_tuple = msa->ss->ntuples;
 
-  /* set up prob matrices, if any are undefined */
-  for (i = 0, defined = TRUE; defined && i < mod->tree->nnodes; i++) {
-    if (((TreeNode*)lst_get_ptr(mod->tree->nodes, i))->parent == NULL)
-      continue;  		/* skip root */
-    for (j = 0; j < mod->nratecats; j++)
-      if (mod->P[i][j] == NULL) defined = FALSE;
-  }
-/*   printf("mod %d\n", mod); */
-  if (!defined) {
-    tm_set_subst_matrices(mod);
-  }
   if (col_scores != NULL && tuple_scores == NULL)
     curr_tuple_scores = (double*)smalloc(msa->ss->ntuples * sizeof(double));
   else if (tuple_scores != NULL)
@@ -152,7 +175,7 @@ double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
     for (rcat = 0; rcat < mod->nratecats; rcat++)
       post->rcat_expected_nsites[rcat] = 0;
 
-  for (tupleidx = 0; tupleidx < msa->ss->ntuples; tupleidx++) {
+  for (tupleidx = first_tuple; tupleidx < last_tuple; tupleidx++) {
     int skip_fels = FALSE;
 
     if ((cat >= 0 && msa->ss->cat_counts[cat][tupleidx] == 0) ||
@@ -477,6 +500,121 @@ double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
   return(retval);
 }
 
+double tl_compute_log_likelihood(TreeModel *mod, MSA *msa,
+                                 double *col_scores, double *tuple_scores,
+				 int cat, TreePosteriors *post) {
+  return tl_loglik_tuples(mod, msa, col_scores, tuple_scores, cat, post,
+                          0, -1);
+}
+
+double tl_compute_log_likelihood_tuples(TreeModel *mod, MSA *msa, int cat,
+                                        TreePosteriors *post,
+                                        int first_tuple, int last_tuple) {
+  return tl_loglik_tuples(mod, msa, NULL, NULL, cat, post, first_tuple,
+                          last_tuple);
+}
+
+/* (used by tl_compute_log_likelihood_blocked) a range of tuples and
+   private accumulators for the quantities in a TreePosteriors object
+   that are summed over tuples.  The accumulators for
+   expected_nsubst_tot are stored in a single flat array (indexed by
+   rate category, original state, new state, and node, in that order)
+   followed by those for rcat_expected_nsites; post is a shallow copy
+   of the caller's object with these attributes pointed into acc */
+typedef struct {
+  TreeModel *mod;
+  MSA *msa;
+  int cat;
+  int first_tuple, last_tuple;
+  TreePosteriors post;
+  double *acc;
+  double lnl;
+} TlPostBlock;
+
+static void tl_post_block(int b, int thread, void *data) {
+  TlPostBlock *blk = &((TlPostBlock*)data)[b];
+  blk->lnl = tl_compute_log_likelihood_tuples(blk->mod, blk->msa, blk->cat,
+                                              &blk->post, blk->first_tuple,
+                                              blk->last_tuple);
+}
+
+double tl_compute_log_likelihood_blocked(TreeModel *mod, MSA *msa, int cat,
+                                         TreePosteriors *post) {
+  int nstates = mod->rate_matrix->size, nnodes = mod->tree->nnodes,
+    nrc = mod->nratecats;
+  int ntot = (post->expected_nsubst_tot == NULL ? 0 :
+              nrc * nstates * nstates * nnodes),
+    nsites = (post->rcat_expected_nsites == NULL ? 0 : nrc);
+  int b, r, i, j, k, idx, ntuples, blocksize, nblocks;
+  TlPostBlock *blk;
+  double retval = 0;
+
+  tl_prepare(mod, msa);
+  ntuples = msa->ss->ntuples;
+  blocksize = max(TM_TUPLE_BLOCK_SIZE,
+                  (ntuples + TL_MAX_POST_BLOCKS - 1) / TL_MAX_POST_BLOCKS);
+  nblocks = max(1, (ntuples + blocksize - 1) / blocksize);
+
+  blk = smalloc(nblocks * sizeof(TlPostBlock));
+  for (b = 0; b < nblocks; b++) {
+    blk[b].mod = mod;
+    blk[b].msa = msa;
+    blk[b].cat = cat;
+    blk[b].first_tuple = b * blocksize;
+    blk[b].last_tuple = min(ntuples, (b+1) * blocksize);
+    blk[b].post = *post;
+    blk[b].acc = smalloc(max(1, ntot + nsites) * sizeof(double));
+    if (ntot > 0) {
+      blk[b].post.expected_nsubst_tot = smalloc(nrc * sizeof(double***));
+      for (r = 0, idx = 0; r < nrc; r++) {
+        blk[b].post.expected_nsubst_tot[r] =
+          smalloc(nstates * sizeof(double**));
+        for (i = 0; i < nstates; i++) {
+          blk[b].post.expected_nsubst_tot[r][i] =
+            smalloc(nstates * sizeof(double*));
+          for (j = 0; j < nstates; j++, idx += nnodes)
+            blk[b].post.expected_nsubst_tot[r][i][j] = &blk[b].acc[idx];
+        }
+      }
+    }
+    if (nsites > 0)
+      blk[b].post.rcat_expected_nsites = &blk[b].acc[ntot];
+  }
+
+  thr_foreach(nblocks, tl_post_block, blk);
+
+  /* reduce in block order, so that the result does not depend on the
+     number of threads */
+  for (r = 0, idx = 0; ntot > 0 && r < nrc; r++)
+    for (i = 0; i < nstates; i++)
+      for (j = 0; j < nstates; j++)
+        for (k = 0; k < nnodes; k++, idx++) {
+          post->expected_nsubst_tot[r][i][j][k] = 0;
+          for (b = 0; b < nblocks; b++)
+            post->expected_nsubst_tot[r][i][j][k] += blk[b].acc[idx];
+        }
+  for (r = 0; r < nsites; r++) {
+    post->rcat_expected_nsites[r] = 0;
+    for (b = 0; b < nblocks; b++)
+      post->rcat_expected_nsites[r] += blk[b].acc[ntot + r];
+  }
+
+  for (b = 0; b < nblocks; b++) {
+    retval += blk[b].lnl;
+    if (ntot > 0) {
+      for (r = 0; r < nrc; r++) {
+        for (i = 0; i < nstates; i++)
+          sfree(blk[b].post.expected_nsubst_tot[r][i]);
+        sfree(blk[b].post.expected_nsubst_tot[r]);
+      }
+      sfree(blk[b].post.expected_nsubst_tot);
+    }
+    sfree(blk[b].acc);
+  }
+  sfree(blk);
+  return retval;
+}
+
 /* this is retained for possible use in the future; not using weight
    matrices for much anymore */
 void tl_compute_log_likelihood_weight_matrix(TreeModel *mod, MSA *msa,
@@ -26,6 +26,8 @@
 #include <dgamma.h>
 #include <math.h>
 #include <misc.h>
+#include <fit_em.h>
+#include <parallel.h>
 
 #define ALPHABET_TAG "ALPHABET:"
 #define BACKGROUND_TAG "BACKGROUND:"
@@ -52,6 +54,11 @@
 /* internal functions */
 double tm_likelihood_wrapper(Vector *params, void *data);
 double tm_multi_likelihood_wrapper(Vector *params, void *data);
+static void *tm_opt_clone(void *data);
+static void tm_opt_free_clone(void *copy);
+static void tm_fit_restart(int i, int thread, void *data);
+static void *tm_multi_opt_clone(void *data);
+static void tm_multi_opt_free_clone(void *copy);
 
 
 /* tree == NULL implies weight matrix (most other params ignored in
@@ -164,6 +171,9 @@ TreeModel *tm_new(TreeNode *tree, MarkovMatrix *rate_matrix,
   tm->bound_arg = NULL;
   tm->scale_during_opt = 0;
   tm->iupac_inv_map = NULL;
+  tm->optimizer = OPT_BFGS;
+  tm->squarem = FALSE;
+  tm->inv_hessian = NULL;
   return tm;
 }
 
@@ -294,6 +304,7 @@ void tm_free(TreeModel *tm) {
   if (tm->in_subtree != NULL) sfree(tm->in_subtree);
   if (tm->param_map != NULL) sfree(tm->param_map);
   if (tm->all_params != NULL) vec_free(tm->all_params);
+  if (tm->inv_hessian != NULL) mat_free(tm->inv_hessian);
   if (tm->bound_arg != NULL) {
     for (i=0; i<lst_size(tm->bound_arg); i++) 
       str_free(lst_get_ptr(tm->bound_arg, i));
@@ -702,6 +713,10 @@ TreeModel *tm_create_copy(TreeModel *src) {
   else retval->noopt_arg = NULL;
   retval->eqfreq_sym = src->eqfreq_sym;
   retval->scale_during_opt = src->scale_during_opt;
+  retval->optimizer = src->optimizer;
+  retval->squarem = src->squarem;
+  retval->inv_hessian = src->inv_hessian == NULL ? NULL :
+    mat_create_copy(src->inv_hessian);
 
   if (src->all_params != NULL) {
     retval->all_params = vec_create_copy(src->all_params);
@@ -750,9 +765,9 @@ TreeModel *tm_create_copy(TreeModel *src) {
 	}
       }
       else newmod->param_list = NULL;
-      if (newmod->noopt_arg == NULL)
-	currmod->noopt_arg = NULL;
-      else currmod->noopt_arg = str_new_charstr(newmod->noopt_arg->chars);
+      if (currmod->noopt_arg == NULL)
+	newmod->noopt_arg = NULL;
+      else newmod->noopt_arg = str_new_charstr(currmod->noopt_arg->chars);
       lst_push_ptr(retval->alt_subst_mods, (void*)newmod);
     }
   }
@@ -1944,6 +1959,9 @@ int tm_fit(TreeModel *mod, MSA *msa, Vector *params, int cat,
   double ll;
   Vector *lower_bounds, *upper_bounds, *opt_params;
   int i, retval = 0, npar, numeval;
+  void (*compute_grad)(Vector *grad, Vector *params, void *data, 
+                       Vector *lb, Vector *ub) = NULL;
+  TreePosteriors *saved_post = NULL;
 
   if (msa->ss == NULL) {
     if (msa->seqs == NULL)
@@ -2006,9 +2024,33 @@ int tm_fit(TreeModel *mod, MSA *msa, Vector *params, int cat,
   }
   
   if (!quiet) fprintf(stderr, "numpar = %i\n", opt_params->size);
-  retval = opt_bfgs(tm_likelihood_wrapper, opt_params, (void*)mod, &ll, 
-                    lower_bounds, upper_bounds, logf, NULL, precision, 
-		    NULL, &numeval);
+  /* use exact gradients when available; otherwise they are computed
+     numerically (in parallel if multiple threads are enabled) */
+  if (tm_exact_grad_supported(mod)) {
+    compute_grad = tm_compute_grad_exact;
+    mm_set_eigentype(mod->rate_matrix, COMPLEX_NUM);
+    saved_post = mod->tree_posteriors;
+    mod->tree_posteriors = tl_new_tree_posteriors(mod, msa, 0, 0, 0, 1, 
+                                                  0, 0, 0);
+  }
+  else 
+    opt_register_clone_funcs(mod, tm_opt_clone, tm_opt_free_clone);
+  /* warm-start from a previous inverse Hessian if one is given, and
+     pass back the final one */
+  if (mod->inv_hessian != NULL && mod->inv_hessian->nrows != npar) {
+    mat_free(mod->inv_hessian);
+    mod->inv_hessian = mat_new(npar, npar);
+    mat_set_identity(mod->inv_hessian);
+  }
+  retval = opt_minimize(mod->optimizer, tm_likelihood_wrapper, opt_params,
+                        (void*)mod, &ll, lower_bounds, upper_bounds, logf,
+                        compute_grad, precision, mod->inv_hessian, 
+                        &numeval);
+  if (compute_grad != NULL) {
+    tl_free_tree_posteriors(mod, msa, mod->tree_posteriors);
+    mod->tree_posteriors = saved_post;
+  }
+  else opt_unregister_clone_funcs(mod);
 
   mod->lnL = ll * -1 * log(2);  /* make negative again and convert to
                                    natural log scale */
@@ -2058,6 +2100,176 @@ int tm_fit(TreeModel *mod, MSA *msa, Vector *params, int cat,
 }
 
 
+/* (used by tm_fit_restarts) models being fitted from each starting
+   point, and the starting points to fit at the current stage */
+typedef struct {
+  TreeModel **mods;
+  Vector **params;
+  MSA *msa;
+  int cat;
+  opt_precision_type precision;
+  int *idx;
+} TmRestartData;
+
+/* set parameters that are not estimated to their values in orig */
+static void tm_restore_fixed_params(TreeModel *mod, Vector *params, 
+                                    Vector *orig) {
+  int j;
+  for (j = 0; j < params->size; j++)
+    if (mod->param_map[j] < 0)
+      vec_set(params, j, vec_get(orig, j));
+}
+
+static void tm_fit_restart(int i, int thread, void *data) {
+  TmRestartData *rd = data;
+  int s = rd->idx[i];
+  tm_fit(rd->mods[s], rd->msa, rd->params[s], rd->cat, rd->precision, 
+         NULL, TRUE, NULL);
+}
+
+int tm_fit_restarts(TreeModel *mod, MSA *msa, Vector *params, int cat, 
+                    opt_precision_type precision, int nrestarts, 
+                    FILE *logf, int quiet, FILE *error_file, List *optima) {
+  int i, j, n = nrestarts + 1, nkeep, best, retval, *refined;
+  double *crude_lnl;
+  Matrix *saved_hessian;
+  Vector *init_params;
+  TmRestartData rd;
+
+  if (nrestarts <= 0 || mod->tree == NULL)
+    return tm_fit(mod, msa, params, cat, precision, logf, quiet, error_file);
+
+  /* set up data and background frequencies as in tm_fit, so that
+     copies of the model can be made */
+  if (msa->ss == NULL) {
+    if (msa->seqs == NULL)
+      die("ERROR tm_fit_restarts: msa->ss and msa->seqs are both NULL\n");
+    ss_from_msas(msa, mod->order+1, 0, NULL, NULL, NULL, -1, 
+		 subst_mod_is_codon_model(mod->subst_mod));
+  }
+  if (mod->backgd_freqs == NULL)  {
+    tm_init_backgd(mod, msa, cat);
+    for (i=0; i<mod->backgd_freqs->size; i++)
+      vec_set(params, mod->backgd_idx+i, vec_get(mod->backgd_freqs, i));
+  }
+
+  init_params = vec_create_copy(params);
+
+  /* starting points: the given parameters, then random values for
+     the free parameters (drawn in order, so results depend only on
+     the state of the random number generator) */
+  rd.mods = smalloc(n * sizeof(TreeModel*));
+  rd.params = smalloc(n * sizeof(Vector*));
+  rd.idx = smalloc(n * sizeof(int));
+  rd.msa = msa;
+  rd.cat = cat;
+  crude_lnl = smalloc(n * sizeof(double));
+  refined = smalloc(n * sizeof(int));
+  for (i = 0; i < n; i++) {
+    if (i == 0)
+      rd.params[i] = vec_create_copy(params);
+    else {
+      rd.params[i] = tm_params_init_random(mod);
+      tm_restore_fixed_params(mod, rd.params[i], params);
+    }
+    rd.mods[i] = tm_opt_clone(mod);
+    if (i > 0 && rd.mods[i]->inv_hessian != NULL) {
+      mat_free(rd.mods[i]->inv_hessian); /* (not relevant away from the
+                                            given starting point) */
+      rd.mods[i]->inv_hessian = NULL;
+    }
+    if (rd.mods[i]->inv_hessian == NULL && mod->optimizer == OPT_BFGS) {
+      rd.mods[i]->inv_hessian = mat_new(1, 1); /* placeholder; tm_fit
+                                                  will pass back the
+                                                  final one */
+      mat_set_identity(rd.mods[i]->inv_hessian);
+    }
+    rd.idx[i] = i;
+    refined[i] = FALSE;
+  }
+
+  /* fit from all starting points at crude precision */
+  if (!quiet) 
+    fprintf(stderr, "Fitting from %d starting points at crude precision ...\n",
+            n);
+  rd.precision = OPT_CRUDE_PREC;
+  thr_foreach(n, tm_fit_restart, &rd);
+
+  /* rank starting points by likelihood (ties broken by order) and
+     refine the most promising ones at the requested precision */
+  for (i = 0; i < n; i++) crude_lnl[i] = rd.mods[i]->lnL;
+  for (i = 1; i < n; i++) {
+    int s = rd.idx[i];
+    for (j = i; j > 0 && crude_lnl[rd.idx[j-1]] < crude_lnl[s]; j--)
+      rd.idx[j] = rd.idx[j-1];
+    rd.idx[j] = s;
+  }
+  nkeep = (precision == OPT_CRUDE_PREC ? n : 
+           min(n, max(TM_RESTART_MIN_REFINE, 
+                      (n + TM_RESTART_REFINE_FRAC - 1) / 
+                      TM_RESTART_REFINE_FRAC)));
+  if (nkeep < n || precision != OPT_CRUDE_PREC) {
+    if (!quiet) 
+      fprintf(stderr, "Refining best %d of %d starting points ...\n", 
+              nkeep, n);
+    /* tm_fit rescales its final estimates, including any that are
+       held constant; restore those before fitting again */
+    for (i = 0; i < nkeep; i++)
+      tm_restore_fixed_params(mod, rd.params[rd.idx[i]], init_params);
+    rd.precision = precision;
+    thr_foreach(nkeep, tm_fit_restart, &rd);
+  }
+  best = rd.idx[0];
+  for (i = 0; i < nkeep; i++) {
+    refined[rd.idx[i]] = TRUE;
+    if (rd.mods[rd.idx[i]]->lnL > rd.mods[best]->lnL) best = rd.idx[i];
+  }
+
+  if (logf != NULL) {
+    fprintf(logf, "start\tcrude_lnL\tfinal_lnL\n");
+    for (i = 0; i < n; i++) {
+      fprintf(logf, "%d\t%f\t", i, crude_lnl[i]);
+      if (refined[i]) fprintf(logf, "%f%s\n", rd.mods[i]->lnL, 
+                              i == best ? "\t(best)" : "");
+      else fprintf(logf, "pruned\n");
+    }
+  }
+  if (optima != NULL)
+    for (i = 0; i < n; i++)
+      if (refined[i]) lst_push_dbl(optima, rd.mods[i]->lnL);
+
+  /* finish by fitting the model itself from the best optimum found,
+     so that its state, log, and error output are as with tm_fit;
+     with BFGS, the final inverse Hessian for that optimum is reused,
+     so this takes few iterations */
+  vec_copy(params, rd.params[best]);
+  tm_restore_fixed_params(mod, params, init_params);
+  saved_hessian = mod->inv_hessian;
+  if (rd.mods[best]->inv_hessian != NULL) {
+    mod->inv_hessian = rd.mods[best]->inv_hessian;
+    rd.mods[best]->inv_hessian = NULL;
+  }
+  retval = tm_fit(mod, msa, params, cat, precision, logf, quiet, error_file);
+  if (saved_hessian == NULL) {  /* caller did not ask for it */
+    if (mod->inv_hessian != NULL) mat_free(mod->inv_hessian);
+    mod->inv_hessian = NULL;
+  }
+  else if (mod->inv_hessian != saved_hessian) 
+    mat_free(saved_hessian);
+
+  for (i = 0; i < n; i++) {
+    tm_opt_free_clone(rd.mods[i]);
+    vec_free(rd.params[i]);
+  }
+  vec_free(init_params);
+  sfree(rd.mods);
+  sfree(rd.params);
+  sfree(rd.idx);
+  sfree(crude_lnl);
+  sfree(refined);
+  return retval;
+}
+
 /* Fit several tree model objects simultaneously (parameters may be shared between them).
    msa should be an array of MSA's of length nmod, 
     OR a single msa with a number of categories = nmod, in which case each category
@@ -2157,9 +2369,13 @@ int tm_fit_multi(TreeModel **mod, int nmod, MSA **msa, int nmsa,
   if (!quiet) fprintf(stderr, "numpar = %i\n", opt_params->size);
   modlist = lst_new_ptr(nmod);
   for (i=0; i < nmod; i++) lst_push_ptr(modlist, mod[i]);
-  retval = opt_bfgs(tm_multi_likelihood_wrapper, opt_params, (void*)modlist, 
-		    &ll, lower_bounds, upper_bounds, logf, NULL, precision, 
-		    NULL, &numeval);
+  opt_register_clone_funcs(modlist, tm_multi_opt_clone,
+                           tm_multi_opt_free_clone);
+  retval = opt_minimize(mod[0]->optimizer, tm_multi_likelihood_wrapper,
+                        opt_params, (void*)modlist, &ll, lower_bounds,
+                        upper_bounds, logf, NULL, precision, NULL,
+                        &numeval);
+  opt_unregister_clone_funcs(modlist);
   lst_free(modlist);
 
   for (j=0; j < nmod; j++)
@@ -2631,13 +2847,101 @@ double tm_likelihood_wrapper(Vector *params, void *data) {
   return ll;
   }*/
 
+/* (used by tm_multi_likelihood_wrapper) blocks of tuples to be
+   evaluated in parallel, each belonging to one of the models in
+   modlist (and its alignment) */
+typedef struct {
+  List *modlist;
+  int *block_mod;               /* index of model for each block */
+  int *block_start;             /* first tuple of each block */
+  double *block_lnl;            /* log likelihood of each block */
+} TmMultiBlocks;
+
+static void tm_multi_block_lnl(int b, int thread, void *data) {
+  TmMultiBlocks *d = (TmMultiBlocks*)data;
+  TreeModel *mod = lst_get_ptr(d->modlist, d->block_mod[b]);
+  d->block_lnl[b] =
+    tl_compute_log_likelihood_tuples(mod, mod->msa, mod->category, NULL,
+                                     d->block_start[b], d->block_start[b] +
+                                     TM_TUPLE_BLOCK_SIZE);
+}
+
+/* Wrapper for computation of the joint likelihood of several models,
+   each with its own alignment (or category).  The tuples of each
+   alignment are divided into blocks of TM_TUPLE_BLOCK_SIZE, which are
+   evaluated in parallel (see parallel.h), so that the work is evenly
+   distributed even if one alignment is much larger than the others.
+   The block likelihoods are summed in a fixed order, so the result
+   does not depend on the number of threads */
 double tm_multi_likelihood_wrapper(Vector *params, void *data) {
   List *modlist = (List*)data;
+  TmMultiBlocks d;
+  TreeModel *mod;
   double ll=0;
+  int i, b, start, nblocks = 0;
+
+  for (i=0; i < lst_size(modlist); i++) {
+    mod = lst_get_ptr(modlist, i);
+    tm_unpack_params(mod, params, -1);
+    tl_prepare(mod, mod->msa);  /* models are read-only from here on */
+    nblocks += (mod->msa->ss->ntuples + TM_TUPLE_BLOCK_SIZE - 1) /
+      TM_TUPLE_BLOCK_SIZE;
+  }
+
+  d.modlist = modlist;
+  d.block_mod = smalloc(nblocks * sizeof(int));
+  d.block_start = smalloc(nblocks * sizeof(int));
+  d.block_lnl = smalloc(nblocks * sizeof(double));
+  for (i=0, b=0; i < lst_size(modlist); i++) {
+    mod = lst_get_ptr(modlist, i);
+    for (start = 0; start < mod->msa->ss->ntuples;
+         start += TM_TUPLE_BLOCK_SIZE, b++) {
+      d.block_mod[b] = i;
+      d.block_start[b] = start;
+    }
+  }
+
+  thr_foreach(nblocks, tm_multi_block_lnl, &d);
+
+  for (b=0; b < nblocks; b++)
+    ll += d.block_lnl[b];
+
+  sfree(d.block_mod);
+  sfree(d.block_start);
+  sfree(d.block_lnl);
+  return -ll;
+}
+
+/* (used by tm_fit) create a copy of a model being fitted, so that
+   numerical gradients can be computed in parallel (see
+   opt_register_clone_funcs).  The alignment is shared */
+static void *tm_opt_clone(void *data) {
+  TreeModel *copy = tm_create_copy((TreeModel*)data);
+  tm_free_rmp(copy);            /* parameter indices may include
+                                   lineage-specific models */
+  tm_init_rmp(copy);
+  return copy;
+}
+
+static void tm_opt_free_clone(void *copy) {
+  tm_free((TreeModel*)copy);
+}
+
+/* (used by tm_fit_multi) as above, for a list of models */
+static void *tm_multi_opt_clone(void *data) {
+  List *modlist = (List*)data, *copy = lst_new_ptr(lst_size(modlist));
   int i;
-  for (i=0; i < lst_size(modlist); i++)  
-    ll += tm_likelihood_wrapper(params, lst_get_ptr(modlist, i));
-  return ll;
+  for (i = 0; i < lst_size(modlist); i++)
+    lst_push_ptr(copy, tm_opt_clone(lst_get_ptr(modlist, i)));
+  return copy;
+}
+
+static void tm_multi_opt_free_clone(void *copy) {
+  List *modlist = (List*)copy;
+  int i;
+  for (i = 0; i < lst_size(modlist); i++)
+    tm_opt_free_clone(lst_get_ptr(modlist, i));
+  lst_free(modlist);
 }
 
   
@@ -2658,16 +2962,10 @@ void tm_unpack_params(TreeModel *mod, Vector *params_in, int idx_offset) {
   MarkovMatrix *temp_mm;
   Vector *temp_backgd;
   double  sum;
-  static Matrix *oldMatrix=NULL;
-
-  if (oldMatrix != NULL && oldMatrix->nrows != mod->rate_matrix->size) {
-    mat_free(oldMatrix);
-    oldMatrix = NULL;
-  }
-  if (oldMatrix == NULL) {
-    oldMatrix = mat_new(mod->rate_matrix->size, mod->rate_matrix->size);
-    set_static_var((void**)&oldMatrix);
-  }
+  Matrix *oldMatrix = mat_new(mod->rate_matrix->size, mod->rate_matrix->size);
+                                /* not static, so that copies of a
+                                   model can be updated concurrently
+                                   (see tm_opt_clone) */
 
   if (idx_offset == -1) idx_offset = 0;
 
@@ -2823,6 +3121,7 @@ void tm_unpack_params(TreeModel *mod, Vector *params_in, int idx_offset) {
     if (!mat_equal(oldMatrix, mod->rate_matrix->matrix)) 
       mm_diagonalize(mod->rate_matrix);
   }
+  mat_free(oldMatrix);
 
   /* set exponentiated version at each edge */
   tm_set_subst_matrices(mod); 
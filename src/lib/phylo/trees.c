@@ -16,7 +16,12 @@
 #include "stringsplus.h"
 
 
+/* (per thread, so that trees can be built concurrently) */
+#ifdef PHAST_PTHREADS
+static __thread int idcounter = 0;
+#else
 static int idcounter = 0;
+#endif
 /* NOTE: when tree is parsed from Newick file, node ids are assigned
    sequentially in a preorder traversal.  Some useful properties
    result.  For example, if two nodes u and v are such that v->id >
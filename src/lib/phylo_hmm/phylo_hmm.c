@@ -1147,19 +1147,22 @@ double phmm_fit_em(PhyloHmm *phmm,
   phmm->em_data->fix_functional = fix_functional;
   phmm->em_data->fix_indel = fix_indel;
   phmm->em_data->H = NULL;
+  phmm->em_data->optimizer = OPT_BFGS;
 
   if (msa != NULL)              /* estimating tree models */
     retval = hmm_train_by_em(phmm->hmm, phmm->mods, phmm, 1, 
                              &phmm->alloc_len, NULL, 
                              phmm_compute_emissions_em, phmm_estim_mods_em,
                              phmm_estim_trans_em, phmm_get_obs_idx_em, 
-                             phmm_log_em, phmm->emissions, logf);
+                             phmm_log_em, phmm->emissions, logf,
+                             NULL, NULL, NULL);
 
   else                          /* not estimating tree models */
     retval = hmm_train_by_em(phmm->hmm, phmm->mods, phmm, 1, 
                              &phmm->alloc_len, NULL, NULL, NULL,
                              phmm_estim_trans_em, NULL,
-                             phmm_log_em, phmm->emissions, logf);
+                             phmm_log_em, phmm->emissions, logf,
+                             NULL, NULL, NULL);
 
   return log(2) * retval;
 }
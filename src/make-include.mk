@@ -163,3 +163,22 @@ endif
 endif
 endif
 
+# POSIX threads, used by some routines to carry out independent
+# computations in parallel (see parallel.h).  Comment out to build
+# without thread support, in which case everything runs serially.
+ifneq ($(TARGETOS), Windows)
+ifndef RPHAST
+  CFLAGS += -DPHAST_PTHREADS -pthread
+  LIBS += -lpthread
+endif
+endif
+
+# zlib, used to read gzip- and BGZF-compressed input transparently
+# (see gz_input.h).  Comment out to build without zlib, in which case
+# compressed input is rejected with an error message.
+ifneq ($(TARGETOS), Windows)
+ifndef RPHAST
+  CFLAGS += -DPHAST_ZLIB
+  LIBS += -lz
+endif
+endif
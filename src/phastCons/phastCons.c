@@ -39,6 +39,8 @@ int main(int argc, char *argv[]) {
     {"expected-lengths", 1, 0, 'E'}, /* for backward compatibility */
     {"estimate-trees", 1, 0, 'T'},
     {"estimate-rho", 1, 0, 'O'},
+    {"optimizer", 1, 0, 0},
+    {"squarem", 0, 0, 0},
     {"rho", 1, 0, 'R'},
     {"gc", 1, 0, 'G'},
     {"ignore-missing", 0, 0, 'z'},
@@ -246,6 +248,16 @@ int main(int argc, char *argv[]) {
     case 'q':
       p->results_f = NULL;
       break;
+    case 0:
+      if (strcmp(long_opts[opt_idx].name, "optimizer") == 0) {
+        p->optimizer = get_opt_method(optarg);
+        if (p->optimizer == OPT_UNKNOWN_METHOD)
+          die("ERROR: --optimizer must be BFGS or LBFGSB.\n");
+      }
+      else if (strcmp(long_opts[opt_idx].name, "squarem") == 0)
+        p->squarem = TRUE;
+      else die("Bad argument.  Try '%s -h'.\n", argv[0]);
+      break;
     case 'h':
       printf("%s", HELP);
       exit(0);
@@ -119,6 +119,11 @@ OPTIONS:\n\
               the final '+' or '-' indicating strand.\n\
 \n\
     -x        (For use with -H or -D) Suppress ordinary output to stdout.\n\
+\n\
+    -a        Accelerate EM by SQUAREM extrapolation (Varadhan and\n\
+              Roland, 2008).  Usually reduces the number of iterations\n\
+              required for convergence.  A summary of extrapolations\n\
+              is printed to stderr for each candidate.  Ignored with -d.\n\
 \n\
     -h        Print this help message.\n\n", prog, prog, DEFAULT_SIZE, 
          DEFAULT_NUMBER);
@@ -133,7 +138,7 @@ int main(int argc, char *argv[]) {
     nrestarts = 10, npseudocounts = 5, nsamples = -1, 
     nmostprevalent = -1, tuple_size = -1, nbest = -1, sample_parms = 0,
     nmotifs = DEFAULT_NUMBER, nseqs = -1, do_html = 0, do_bed = 0, 
-    suppress_stdout = 0;
+    suppress_stdout = 0, squarem = 0;
   List *msa_name_list = NULL, *pos_examples = NULL, *init_list = NULL, *tmpl;
   List *msas, *motifs;
   SeqSet *seqset = NULL;
@@ -147,7 +152,7 @@ int main(int argc, char *argv[]) {
   char c;
   GFF_Set *bedfeats = NULL;
 
-  while ((c = (char)getopt(argc, argv, "t:i:b:sk:md:pn:I:R:P:w:c:SB:o:HDxh")) != -1) {
+  while ((c = (char)getopt(argc, argv, "t:i:b:sk:md:pn:I:R:P:w:c:SB:o:HDxah")) != -1) {
     switch (c) {
     case 't':
       tree = tr_new_from_file(phast_fopen(optarg, "r"));
@@ -226,6 +231,9 @@ int main(int argc, char *argv[]) {
     case 'x':
       suppress_stdout = 1;
       break;
+    case 'a':
+      squarem = 1;
+      break;
     case 'h':
       usage(argv[0]);
     case '?':
@@ -364,7 +372,7 @@ int main(int argc, char *argv[]) {
                     !meme_mode, size, nmotifs, tree,
                     meme_mode ? (void*)backgd_mnmod : (void*)backgd_mod, 
                     has_motif, prior, nrestarts, init_list, sample_parms, 
-                    npseudocounts);
+                    npseudocounts, squarem);
      
   fprintf(stderr, "\n\n");
   if (do_bed)
@@ -19,6 +19,7 @@
 #include <gff.h>
 #include <bed.h>
 #include <tree_likelihoods.h>
+#include <wig_writer.h>
 #include "phastOdds.help"
 
 #define MIN_BLOCK_SIZE 30
@@ -408,28 +409,31 @@ int main(int argc, char *argv[]) {
   if (verbose) fprintf(stderr, "Generating output ...\n");
   
   if (winsize != -1 && windowWig == FALSE) { /* standard windows output */
+    WigWriter *ww = ww_new(stdout, NULL);
     for (i = 0, j = 0; i < msa->length; i++) {
-      if (no_alignment[i] == FALSE)
-        printf("%d\t%.3f\t%.3f\n", j + msa->idx_offset + 1, winscore_pos[i], 
-               winscore_neg[i]);
+      if (no_alignment[i] == FALSE) {
+        ww_put_int(ww, j + msa->idx_offset + 1);
+        ww_put_char(ww, '\t');
+        ww_put_fixed(ww, winscore_pos[i], 3);
+        ww_put_char(ww, '\t');
+        ww_put_fixed(ww, winscore_neg[i], 3);
+        ww_put_char(ww, '\n');
+      }
       if (ss_get_char_pos(msa, i, 0, 0) != GAP_CHAR) j++;
     }
+    ww_free(ww);
   }
   else if (windowWig == TRUE) { /* windows with wig output */
-    int last = NEGINFTY;
+    WigWriter *ww = ww_new(stdout, refidx > 0 ? msa->names[refidx-1] :
+                           "alignment");
     for (i = 0, j = 0; i < msa->length; i++) {
       if (refidx == 0 || msa_get_char(msa, refidx-1, i) != GAP_CHAR) {
-        if (no_alignment[i] == FALSE && winscore_pos[i] > NEGINFTY) {
-          if (j > last + 1) 
-            printf("fixedStep chrom=%s start=%d step=1\n", 
-                   refidx > 0 ? msa->names[refidx-1] : "alignment",
-                   j + msa->idx_offset + 1);
-          printf("%.3f\n", winscore_pos[i]);
-          last = j;
-        }
+        if (no_alignment[i] == FALSE && winscore_pos[i] > NEGINFTY)
+          ww_value(ww, j + msa->idx_offset + 1, winscore_pos[i], 3);
         j++;
       }
     }
+    ww_free(ww);
   }
   else if (features != NULL) {  /* features output */
     /* return to coord frame of reference seq (also, replace offset) */
@@ -450,15 +454,16 @@ int main(int argc, char *argv[]) {
   }
   else {           /* base-by-base scores */
     /* in this case, we can just output the difference between the emissions */
-    printf("fixedStep chrom=%s start=%d step=1\n", 
-           refidx > 0 ? msa->names[refidx-1] : "alignment",
-           msa->idx_offset + 1);
+    WigWriter *ww = ww_new(stdout, refidx > 0 ? msa->names[refidx-1] :
+                           "alignment");
     for (i = 0, j = 0; i < msa->length; i++) {
       if (refidx == 0 || msa_get_char(msa, refidx-1, i) != GAP_CHAR) {
-        printf("%.3f\n", feat_emissions[0][i] - backgd_emissions[0][i]);
+        ww_value(ww, j + msa->idx_offset + 1,
+                 feat_emissions[0][i] - backgd_emissions[0][i], 3);
         j++;
       }
     }
+    ww_free(ww);
   }
 
   if (verbose) fprintf(stderr, "\nDone.\n");
@@ -17,6 +17,7 @@
 #include <numerical_opt.h>
 #include <tree_model.h>
 #include <fit_em.h>
+#include <parallel.h>
 #include <time.h>
 #include "phyloBoot.help"
 
@@ -106,6 +107,193 @@ void set_param_descriptions(char **descriptions, TreeModel *mod) {
   free(tempstr);
 }
 
+/* settings shared by all replicates, and estimates for each */
+typedef struct {
+  int nsites, nreps, parametric, do_estimates, use_em, random_init, quiet,
+    subst_mod, nrates, precision, dump_format;
+  int use_streams;              /* draw random numbers for each
+                                   replicate from its own stream */
+  unsigned int seed;            /* seed for streams */
+  TreeModel *model, *subtreeModel, *init_mod;
+  TreeNode *tree;
+  char *subtreeName, *dump_mods_root, *dump_msas_root;
+  double subtreeScale, subtreeSwitchProb;
+  List *scaleLst, *subtreeScaleLst, *nsitesLst;
+  double *p;                    /* tuple frequencies (non-parametric) */
+  MSA **msas;                   /* per-thread copies of alignment
+                                   (non-parametric) */
+  int **counts;                 /* per-thread tuple counts */
+  Vector **params;              /* estimates for each replicate */
+  TreeModel *repmod;            /* model for first replicate */
+} BootData;
+
+/* copy the sufficient statistics of an alignment (without order or
+   categories), keeping the tuples in the same order, so that tuple
+   counts drawn for the original apply equally to the copy.
+   (msa_create_copy rebuilds the sufficient statistics, which can
+   reorder the tuples) */
+MSA *boot_copy_ss(MSA *msa) {
+  MSA_SS *ss = msa->ss, *newss;
+  MSA *retval;
+  char **names = smalloc(msa->nseqs * sizeof(char*));
+  int i, len = msa->nseqs * ss->tuple_size;
+
+  for (i = 0; i < msa->nseqs; i++) names[i] = copy_charstr(msa->names[i]);
+  retval = msa_new(NULL, names, msa->nseqs, msa->length, msa->alphabet);
+  retval->idx_offset = msa->idx_offset;
+  ss_new(retval, ss->tuple_size, max(ss->ntuples, 1), FALSE, FALSE);
+  newss = retval->ss;
+  newss->ntuples = ss->ntuples;
+  if (ss->packed_tuples != NULL) {
+    sfree(newss->col_tuples);
+    newss->col_tuples = NULL;
+    newss->packed_len = ss->packed_len;
+    memcpy(newss->packed_chars, ss->packed_chars, SS_PACKED_NCHARS);
+    newss->packed_tuples = smalloc(max(1, (size_t)ss->ntuples * ss->packed_len));
+    memcpy(newss->packed_tuples, ss->packed_tuples, 
+           (size_t)ss->ntuples * ss->packed_len);
+  }
+  else 
+    for (i = 0; i < ss->ntuples; i++) {
+      newss->col_tuples[i] = smalloc((len + 1) * sizeof(char));
+      memcpy(newss->col_tuples[i], ss->col_tuples[i], len * sizeof(char));
+      newss->col_tuples[i][len] = '\0';
+    }
+  for (i = 0; i < ss->ntuples; i++) newss->counts[i] = ss->counts[i];
+  return retval;
+}
+
+/* generate the ith replicate alignment and estimate a model from it
+   (for use with thr_foreach) */
+void boot_replicate(int i, int thread, void *data) {
+  BootData *bd = data;
+  MSA *msa = NULL;
+  TreeModel *thismod, *genmod = bd->model, *subgenmod = bd->subtreeModel;
+  Vector *params = NULL;
+  RandStream rs;
+  char fname[STR_MED_LEN];
+  FILE *F;
+  int j;
+
+  if (bd->use_streams) {
+    rand_stream_init(&rs, bd->seed, i);
+    rand_stream_use(&rs);
+  }
+
+  /* generate alignment */
+  if (bd->parametric) {
+    if (bd->use_streams) {
+      /* simulation alters the model (e.g., by rescaling its tree), so
+         give each replicate a fresh copy */
+      genmod = tm_create_copy(bd->model);
+      if (bd->subtreeModel != NULL) 
+        subgenmod = tm_create_copy(bd->subtreeModel);
+    }
+    if (bd->scaleLst != NULL)
+      msa = tm_generate_msa_scaleLst(bd->nsitesLst, bd->scaleLst, 
+                                     bd->subtreeScaleLst, genmod, 
+                                     bd->subtreeName);
+    else if (bd->subtreeName != NULL && 
+             (bd->subtreeScale != 1.0 || bd->subtreeSwitchProb != 0.0)) 
+      msa = tm_generate_msa_random_subtree(bd->nsites, genmod, subgenmod, 
+                                           bd->subtreeName, 
+                                           bd->subtreeSwitchProb);
+    else msa = tm_generate_msa(bd->nsites, NULL, &genmod, NULL);
+  }
+  else {
+    msa = bd->msas[thread];
+    mn_draw(bd->nsites, bd->p, msa->ss->ntuples, bd->counts[thread]);
+                                /* here we simply redraw numbers of
+                                   tuples from multinomial distribution
+                                   defined by orig alignment */
+    for (j = 0; j < msa->ss->ntuples; j++) 
+      msa->ss->counts[j] = bd->counts[thread][j];
+                                /* (have to convert from int to double) */
+    msa->length = bd->nsites;
+  }
+
+  if (bd->dump_msas_root != NULL) {
+    sprintf(fname, "%s.%d.%s", bd->dump_msas_root, i+1, 
+            msa_suffix_for_format(bd->dump_format));
+    if (!bd->quiet) fprintf(stderr, "Dumping alignment to %s...\n", fname);
+    F = phast_fopen(fname, "w+");
+
+    if (bd->dump_format == SS) { /* output ss */
+      if (msa->ss == NULL)   /* (only happens in parametric case) */
+        ss_from_msas(msa, tm_order(bd->subst_mod) + 1, FALSE, NULL, NULL, 
+                     NULL, -1, subst_mod_is_codon_model(bd->subst_mod));
+      ss_write(msa, F, FALSE);
+    }
+    else {                  /* output actual seqs */
+      if (!bd->parametric) {   /* only have SS; need to create seqs */
+        ss_to_msa(msa);            
+        msa_permute(msa);
+      }
+      msa_print(F, msa, bd->dump_format, FALSE);
+      if (!bd->parametric) {   /* need to get rid of seqs because msa
+                                  object reused */
+        for (j = 0; j < msa->nseqs; j++) sfree(msa->seqs[j]);
+        sfree(msa->seqs);
+        msa->seqs = NULL;
+      }
+    }
+    phast_fclose(F);
+  }
+
+  /* now estimate model parameters */
+  if (bd->do_estimates) {
+    if (bd->init_mod == NULL) 
+      thismod = tm_new(tr_create_copy(bd->tree), NULL, NULL, bd->subst_mod, 
+                       msa->alphabet, bd->nrates, 1, NULL, -1);
+    else {
+      thismod = tm_create_copy(bd->init_mod);  
+      tm_reinit(thismod, bd->subst_mod, bd->nrates, thismod->alpha, NULL, 
+                NULL);
+    }
+
+    if (bd->random_init) 
+      params = tm_params_init_random(thismod);
+    else if (bd->init_mod != NULL)
+      params = tm_params_new_init_from_model(thismod);
+    else
+      params = tm_params_init(thismod, .1, 5, 1);    
+
+    if (bd->init_mod != NULL && thismod->backgd_freqs != NULL) {
+      vec_free(thismod->backgd_freqs);
+      thismod->backgd_freqs = NULL; /* force re-estimation */
+    }
+
+    if (!bd->quiet) 
+      fprintf(stderr, "Estimating model for replicate %d of %d...\n", i+1, 
+              bd->nreps);
+
+    if (bd->use_em)
+      tm_fit_em(thismod, msa, params, -1, bd->precision, -1, NULL, NULL);
+    else
+      tm_fit(thismod, msa, params, -1, bd->precision, NULL, bd->quiet, NULL);
+
+    if (bd->dump_mods_root != NULL) {
+      sprintf(fname, "%s.%d.mod", bd->dump_mods_root, i+1);
+      if (!bd->quiet) fprintf(stderr, "Dumping model to %s...\n", fname);
+      F = phast_fopen(fname, "w+");
+      tm_print(F, thismod);
+      phast_fclose(F);
+    }
+
+    bd->params[i] = params;
+    if (i == 0) bd->repmod = thismod; /* keep around one representative
+                                         model */
+    else tm_free(thismod);
+  } 
+
+  if (bd->parametric) {
+    msa_free(msa);
+    if (genmod != bd->model) tm_free(genmod);
+    if (subgenmod != bd->subtreeModel) tm_free(subgenmod);
+  }
+  if (bd->use_streams) rand_stream_use(NULL);
+}
+
 int main(int argc, char *argv[]) {
   
   /* variables for args with default values */
@@ -120,16 +308,15 @@ int main(int argc, char *argv[]) {
   TreeModel **input_mods = NULL;
 
   /* other variables */
-  FILE *INF, *F;
+  FILE *INF;
   char c;
-  int i, j, opt_idx, nparams = -1, seed = -1;
+  int i, j, opt_idx, nparams = -1, seed = -1, nthreads = 0;
   String *tmpstr;
   List **estimates=NULL;
   double *p = NULL;
   int *tmpcounts=NULL;
   char **descriptions = NULL;
   List *tmpl;
-  char fname[STR_MED_LEN];
   char tmpchstr[STR_MED_LEN];
   TreeModel *repmod = NULL;
   double subtreeScale=1.0, subtreeSwitchProb=0.0, scale=1.0;
@@ -137,6 +324,7 @@ int main(int argc, char *argv[]) {
   TreeModel *subtreeModel=NULL;
   List *scaleLst=NULL, *subtreeScaleLst=NULL, *nsitesLst=NULL;
   FILE *scaleFile;
+  BootData bd;
 
   struct option long_opts[] = {
     {"nsites", 1, 0, 'L'},
@@ -164,10 +352,11 @@ int main(int argc, char *argv[]) {
     {"scale", 1, 0, 'P'},
     {"scale-file", 1, 0, 'F'},
     {"seed", 1, 0, 'D'},
+    {"threads", 1, 0, 'j'},
     {0, 0, 0, 0}
   };
   
-  while ((c = (char)getopt_long(argc, argv, "L:n:i:d:a:m:o:xR:qht:s:k:Ep:M:S:w:l:P:F:D:r", 
+  while ((c = (char)getopt_long(argc, argv, "L:n:i:d:a:m:o:xR:qht:s:k:Ep:M:S:w:l:P:F:D:j:r", 
                           long_opts, &opt_idx)) != -1) {
     switch (c) {
     case 'L':
@@ -272,6 +461,10 @@ int main(int argc, char *argv[]) {
     case 'D':
       seed = get_arg_int_bounds(optarg, 1, INFTY);
       break;
+    case 'j':
+      nthreads = get_arg_int_bounds(optarg, 1, INFTY);
+      thr_set_nthreads(nthreads);
+      break;
     case '?':
       die("Bad argument.  Try '%s -h'.\n", argv[0]);
     }
@@ -381,103 +574,73 @@ int main(int argc, char *argv[]) {
     }
   } /* if input_mods == NULL */
 
-  for (i = 0; i < nreps; i++) {
-    Vector *params=NULL;
-    TreeModel *thismod=NULL;
-
-    /* generate alignment */
-    if (input_mods == NULL) {   /* skip if models given */
-      if (parametric) {
-	if (scaleLst != NULL)
-	  msa = tm_generate_msa_scaleLst(nsitesLst, scaleLst, subtreeScaleLst,
-					 model, subtreeName);
-	else if (subtreeName!=NULL && (subtreeScale!=1.0 || subtreeSwitchProb!=0.0)) 
-	  msa = tm_generate_msa_random_subtree(nsites, model, subtreeModel, 
-					       subtreeName, subtreeSwitchProb);
-	else msa = tm_generate_msa(nsites, NULL, &model, NULL);
-      }
-      else {
-
-        double sum=0;
-        for (j = 0; j < msa->ss->ntuples; j++) sum+=p[j];
-
-        mn_draw(nsites, p, msa->ss->ntuples, tmpcounts);
-                                /* here we simply redraw numbers of
-                                   tuples from multinomial distribution
-                                   defined by orig alignment */
-        for (j = 0; j < msa->ss->ntuples; j++) msa->ss->counts[j] = tmpcounts[j];
-                                /* (have to convert from int to double) */
-        msa->length = nsites;
-      }
-
-      if (dump_msas_root != NULL) {
-        sprintf(fname, "%s.%d.%s", dump_msas_root, i+1, 
-                msa_suffix_for_format(dump_format));
-        if (!quiet) fprintf(stderr, "Dumping alignment to %s...\n", fname);
-        F = phast_fopen(fname, "w+");
-
-        if (dump_format == SS) { /* output ss */
-          if (msa->ss == NULL)   /* (only happens in parametric case) */
-            ss_from_msas(msa, tm_order(subst_mod) + 1, FALSE, NULL, NULL, NULL, -1, subst_mod_is_codon_model(subst_mod));
-          ss_write(msa, F, FALSE);
-        }
-        else {                  /* output actual seqs */
-          if (!parametric) {   /* only have SS; need to create seqs */
-            ss_to_msa(msa);            
-            msa_permute(msa);
-          }
-          msa_print(F, msa, dump_format, FALSE);
-          if (!parametric) {   /* need to get rid of seqs because msa
-                                   object reused */
-            for (j = 0; j < msa->nseqs; j++) sfree(msa->seqs[j]);
-            sfree(msa->seqs);
-            msa->seqs = NULL;
-          }
-        }
-        phast_fclose(F);
+  if (input_mods == NULL) {
+    int nthr;
+
+    bd.nsites = nsites;
+    bd.parametric = parametric;
+    bd.do_estimates = do_estimates;
+    bd.use_em = use_em;
+    bd.random_init = random_init;
+    bd.quiet = quiet;
+    bd.subst_mod = subst_mod;
+    bd.nrates = nrates;
+    bd.precision = precision;
+    bd.dump_format = dump_format;
+    bd.nreps = nreps;
+    bd.use_streams = (nthreads > 0);
+    bd.seed = 0;
+    if (bd.use_streams)         /* (draw a seed if none given) */
+      bd.seed = (seed > 0 ? (unsigned int)seed : (unsigned int)random());
+    bd.model = model;
+    bd.subtreeModel = subtreeModel;
+    bd.init_mod = init_mod;
+    bd.tree = tree;
+    bd.subtreeName = subtreeName;
+    bd.dump_mods_root = dump_mods_root;
+    bd.dump_msas_root = dump_msas_root;
+    bd.subtreeScale = subtreeScale;
+    bd.subtreeSwitchProb = subtreeSwitchProb;
+    bd.scaleLst = scaleLst;
+    bd.subtreeScaleLst = subtreeScaleLst;
+    bd.nsitesLst = nsitesLst;
+    bd.p = p;
+    bd.repmod = NULL;
+    bd.params = smalloc(nreps * sizeof(Vector*));
+    for (i = 0; i < nreps; i++) bd.params[i] = NULL;
+
+    /* in the non-parametric case, each thread redraws tuple counts in
+       its own copy of the alignment */
+    nthr = thr_get_nthreads();
+    bd.msas = smalloc(nthr * sizeof(MSA*));
+    bd.counts = smalloc(nthr * sizeof(int*));
+    for (i = 0; i < nthr; i++) {
+      bd.msas[i] = NULL;
+      bd.counts[i] = NULL;
+      if (!parametric) {
+        bd.msas[i] = (i == 0 ? msa : boot_copy_ss(msa));
+        bd.counts[i] = (i == 0 ? tmpcounts : 
+                        smalloc(msa->ss->ntuples * sizeof(int)));
       }
     }
 
-    /* now estimate model parameters */
-    if (input_mods == NULL && do_estimates) {
-      if (init_mod == NULL) 
-        thismod = tm_new(tr_create_copy(tree), NULL, NULL, subst_mod, 
-                         msa->alphabet, nrates, 1, NULL, -1);
-      else {
-        thismod = tm_create_copy(init_mod);  
-        tm_reinit(thismod, subst_mod, nrates, thismod->alpha, NULL, NULL);
-      }
+    thr_foreach(nreps, boot_replicate, &bd);
 
-      if (random_init) 
-        params = tm_params_init_random(thismod);
-      else if (init_mod != NULL)
-        params = tm_params_new_init_from_model(init_mod);
-      else
-        params = tm_params_init(thismod, .1, 5, 1);    
-
-      if (init_mod != NULL && thismod->backgd_freqs != NULL) {
-        vec_free(thismod->backgd_freqs);
-        thismod->backgd_freqs = NULL; /* force re-estimation */
-      }
-
-      if (!quiet) 
-        fprintf(stderr, "Estimating model for replicate %d of %d...\n", i+1, nreps);
-
-      if (use_em)
-        tm_fit_em(thismod, msa, params, -1, precision, -1, NULL, NULL);
-      else
-        tm_fit(thismod, msa, params, -1, precision, NULL, quiet, NULL);
+    for (i = 1; i < nthr; i++) {
+      if (bd.msas[i] != NULL) msa_free(bd.msas[i]);
+      if (bd.counts[i] != NULL) sfree(bd.counts[i]);
+    }
+    sfree(bd.msas);
+    sfree(bd.counts);
+    repmod = bd.repmod;
+  }
 
-      if (dump_mods_root != NULL) {
-        sprintf(fname, "%s.%d.mod", dump_mods_root, i+1);
-        if (!quiet) fprintf(stderr, "Dumping model to %s...\n", fname);
-        F = phast_fopen(fname, "w+");
-        tm_print(F, thismod);
-        phast_fclose(F);
-      }
-    } 
+  /* collect parameter estimates, in order of replicates */
+  for (i = 0; do_estimates && i < nreps; i++) {
+    Vector *params;
+    TreeModel *thismod;
 
-    else if (input_mods != NULL) { 
+    if (input_mods != NULL) { 
       /* in this case, we need to set up a parameter vector from
          the input model */
       thismod = input_mods[i];
@@ -486,35 +649,31 @@ int main(int argc, char *argv[]) {
         die("ERROR: input models have different numbers of parameters.\n");
       if (repmod == NULL) repmod = thismod; /* keep around one representative model */
     }
+    else {
+      thismod = repmod;
+      params = bd.params[i];
+    }
 
-    /* collect parameter estimates */
-    if (do_estimates) {
-      /* set up record of estimates; easiest to init here because number
-         of parameters not always known above */
-      if (nparams <= 0) {
-        nparams = params->size;
-        estimates = smalloc(nparams * sizeof(void*));
-        descriptions = smalloc(nparams * sizeof(char*));
-        for (j = 0; j < nparams; j++) {
-          estimates[j] = lst_new_dbl(nreps);
-          descriptions[j] = smalloc(STR_MED_LEN * sizeof(char));
-	  descriptions[j][0] = '\0';
-        }
-        set_param_descriptions(descriptions, thismod);
+    /* set up record of estimates; easiest to init here because number
+       of parameters not always known above */
+    if (nparams <= 0) {
+      nparams = params->size;
+      estimates = smalloc(nparams * sizeof(void*));
+      descriptions = smalloc(nparams * sizeof(char*));
+      for (j = 0; j < nparams; j++) {
+        estimates[j] = lst_new_dbl(nreps);
+        descriptions[j] = smalloc(STR_MED_LEN * sizeof(char));
+        descriptions[j][0] = '\0';
       }
-
-      /* record estimates for this replicate */
-      for (j = 0; j < nparams; j++)
-        lst_push_dbl(estimates[j], vec_get(params, j));
+      set_param_descriptions(descriptions, thismod);
     }
 
-    if (input_mods == NULL && do_estimates) {
-      if (repmod == NULL) repmod = thismod; /* keep around one representative model */
-      else tm_free(thismod);
-    }
-    if (do_estimates) vec_free(params);
-    if (parametric) msa_free(msa);
+    /* record estimates for this replicate */
+    for (j = 0; j < nparams; j++)
+      lst_push_dbl(estimates[j], vec_get(params, j));
+    vec_free(params);
   }
+  if (input_mods == NULL) sfree(bd.params);
 
   /* finally, compute and print stats */
   if (do_estimates) {
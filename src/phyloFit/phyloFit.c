@@ -27,6 +27,7 @@
 #include <sufficient_stats.h>
 #include <maf.h>
 #include <phylo_fit.h>
+#include <parallel.h>
 #include "phyloFit.help"
 
 
@@ -90,6 +91,10 @@ int main(int argc, char *argv[]) {
     {"label-branches", 1, 0, 0},
     {"label-subtree", 1, 0, 0},
     {"selection", 1, 0, 0},
+    {"optimizer", 1, 0, 0},
+    {"threads", 1, 0, 'j'},
+    {"squarem", 0, 0, 0},
+    {"restarts", 1, 0, 0},
     {"bound", 1, 0, 'u'},
     {"seed", 1, 0, 'D'},
     {0, 0, 0, 0}
@@ -99,7 +104,7 @@ int main(int argc, char *argv[]) {
 
   pf = phyloFit_struct_new(0);
 
-  while ((c = (char)getopt_long(argc, argv, "m:t:s:g:c:C:i:o:k:a:l:w:v:M:p:A:I:K:S:b:d:O:u:Y:e:D:GVENRqLPXZUBFfnrzhWyJ", long_opts, &opt_idx)) != -1) {
+  while ((c = (char)getopt_long(argc, argv, "m:t:s:g:c:C:i:o:k:a:l:w:v:M:p:A:I:K:S:b:d:O:u:Y:e:D:GVENRqLPXZUBFfnrzhWyJj:", long_opts, &opt_idx)) != -1) {
     switch(c) {
     case 'm':
       msa_fname = optarg;
@@ -216,6 +221,9 @@ int main(int argc, char *argv[]) {
     case 'J':
       pf->do_expected_nsubst_col = TRUE;
       break;
+    case 'j':
+      thr_set_nthreads(get_arg_int_bounds(optarg, 1, INFTY));
+      break;
     case 'U':
       pf->likelihood_only = TRUE;        /* force -L */
       pf->nsites_threshold = 0;        /* also force this; typical use is
@@ -294,6 +302,17 @@ int main(int argc, char *argv[]) {
 	pf->selection = get_arg_dbl(optarg);
 	pf->use_selection = TRUE;
       }
+      else if (strcmp(long_opts[opt_idx].name, "optimizer") == 0) {
+	pf->optimizer = get_opt_method(optarg);
+	if (pf->optimizer == OPT_UNKNOWN_METHOD)
+	  die("ERROR: --optimizer must be BFGS or LBFGSB.\n");
+      }
+      else if (strcmp(long_opts[opt_idx].name, "squarem") == 0) {
+	pf->squarem = TRUE;
+      }
+      else if (strcmp(long_opts[opt_idx].name, "restarts") == 0) {
+	pf->nrestarts = get_arg_int_bounds(optarg, 0, INFTY);
+      }
       else {
 	die("ERROR: unknown option.  Type 'phyloFit -h' for usage.\n");
       }
@@ -330,7 +349,8 @@ int main(int argc, char *argv[]) {
     input_format = msa_format_for_content(infile, 1);
 
   if (pf->nonoverlapping && (pf->use_conditionals || pf->gff != NULL || 
-			     pf->cats_to_do_str || input_format == SS))
+			     pf->cats_to_do_str || input_format == SS ||
+			     input_format == BSS))
     die("ERROR: cannot use --non-overlapping with --markov, --features,\n--msa-format SS, or --do-cats.\n");
 
 
@@ -10,6 +10,7 @@
 #include "phylo_p.h"
 #include "phyloP.help"
 #include <misc.h>
+#include <parallel.h>
 
 
 int main(int argc, char *argv[]) {
@@ -46,6 +47,9 @@ int main(int argc, char *argv[]) {
     {"catmap", 1, 0, 'M'},
     {"no-prune", 0, 0, 'P'},
     {"seed", 1, 0, 'd'},
+    {"threads", 1, 0, 'j'},
+    {"jump-cache", 1, 0, 'J'},
+    {"column-sums", 0, 0, 'A'},
     {"help", 0, 0, 'h'},
     {0, 0, 0, 0}
   };
@@ -56,7 +60,7 @@ int main(int argc, char *argv[]) {
   srandom((unsigned int)now.tv_usec);
 #endif
 
-  while ((c = (char)getopt_long(argc, argv, "m:o:i:n:pc:s:f:Fe:l:r:B:d:qwgbPN:h", 
+  while ((c = (char)getopt_long(argc, argv, "m:o:i:n:pc:s:f:Fe:l:r:B:d:j:J:AqwgbPN:h", 
                           long_opts, &opt_idx)) != -1) {
     switch (c) {
     case 'm':
@@ -148,6 +152,15 @@ int main(int argc, char *argv[]) {
     case 'P':
       p->no_prune = TRUE;
       break;
+    case 'j':
+      thr_set_nthreads(get_arg_int_bounds(optarg, 1, INFTY));
+      break;
+    case 'J':
+      p->jp_cache_fname = optarg;
+      break;
+    case 'A':
+      p->column_sums = TRUE;
+      break;
     case 'h':
       printf("%s", HELP);
       exit(0);
@@ -18,6 +18,7 @@
 #include <local_alignment.h>
 #include <maf.h>
 #include <maf_block.h>
+#include <maf_index.h>
 
 void print_usage() {
     printf("\n\
@@ -81,6 +82,16 @@ OPTIONS:\n\
         Do not assume first sequence in MAF is refseq.  Instead, use\n\
         coordinates  given by absolute position in alignment (starting\n\
         from 1).\n\
+\n\
+    --index, -X\n\
+        Build a coordinate index for <infile>, which must be a regular\n\
+        file, and save it in <infile>.idx; then exit.  When --start or\n\
+        --end is given in terms of the reference sequence, the index\n\
+        is used to read only the blocks in the requested region,\n\
+        provided the MAF is sorted with respect to a single reference\n\
+        sequence.  If no up-to-date index exists, one is built and\n\
+        saved (if possible) on first use.  The index is not used with\n\
+        --masked-file, which reports masked bases for all blocks.\n\
 \n\
 (Splitting into multiple MAFs by length)\n\
     --split, -S length \n\
@@ -261,6 +272,27 @@ void close_outfiles(List *outfileList, Hashtable *outfileHash) {
   hsh_free(outfileHash);
 }
 
+/* whether the reference sequence of an indexed MAF (src name refsrc)
+   remains the first sequence of each block after applying --seqs */
+static int refseq_retained(char *refsrc, List *seqlist, int include) {
+  String *spec = str_new_charstr(refsrc), *str;
+  int i, found = FALSE;
+  str_shortest_root(spec, '.');
+  for (i = 0; seqlist != NULL && i < lst_size(seqlist); i++) {
+    str = (String*)lst_get_ptr(seqlist, i);
+    if (str_equals(str, spec) || str_equals_charstr(str, refsrc))
+      found = TRUE;
+  }
+  str_free(spec);
+  return (seqlist == NULL || found == include);
+}
+
+/* read next block, unless blocks_left (if nonnegative) is exhausted */
+static MafBlock *next_block(MafScanner *mscan, int *blocks_left) {
+  if (*blocks_left == 0) return NULL;
+  if (*blocks_left > 0) (*blocks_left)--;
+  return mafBlock_scan_next(mscan, NULL, NULL);
+}
 
 int main(int argc, char* argv[]) {
   char *maf_fname = NULL, *out_root_fname = "maf_parse", *masked_fn = NULL;
@@ -270,6 +302,9 @@ int main(int argc, char* argv[]) {
   List *order_list = NULL, *seqlist_str = NULL, *cats_to_do_str=NULL, *cats_to_do=NULL;
   MafBlock *block;
   FILE *mfile, *outfile=NULL, *masked_file=NULL;
+  MafScanner *mscan;
+  MafIndex *idx;
+  int build_index = FALSE, blocks_left = -1;
   int useRefseq=TRUE, currLen=-1, blockIdx=0, currSize, sortWarned=0;
   int lastIdx = 0, currStart=0, by_category = FALSE, i, pretty_print = FALSE;
   int lastStart = -1, gffSearchIdx=0;
@@ -295,6 +330,7 @@ int main(int argc, char* argv[]) {
     {"out-root", 1, 0, 'r'},
     {"out-root-digits", 1, 0, 'd'},
     {"no-refseq", 0, 0, 'n'},
+    {"index", 0, 0, 'X'},
     {"features", 1, 0, 'g'},
     {"by-category", 0, 0, 'L'},
     {"do-cats", 1, 0, 'C'},
@@ -310,7 +346,7 @@ int main(int argc, char* argv[]) {
   };
 
 
-  while ((c = (char)getopt_long(argc, argv, "s:e:l:O:r:S:d:g:c:P:b:o:m:M:pLnxEIh", long_opts, &opt_idx)) != -1) {
+  while ((c = (char)getopt_long(argc, argv, "s:e:l:O:r:S:d:g:c:P:b:o:m:M:pLnxEIXh", long_opts, &opt_idx)) != -1) {
     switch(c) {
     case 's':
       startcol = get_arg_int(optarg);
@@ -336,6 +372,9 @@ int main(int argc, char* argv[]) {
     case 'd':
       sprintf(splitFormat, "%%s%%.%si.%%s", optarg);
       break;
+    case 'X':
+      build_index = TRUE;
+      break;
     case 'n':
       useRefseq = FALSE;
       break;
@@ -399,6 +438,11 @@ int main(int argc, char* argv[]) {
 
   set_seed(-1);
 
+  if (build_index) {
+    maf_index_free(maf_index_create(maf_fname));
+    return 0;
+  }
+
   if (startcol < 1 || (endcol != -1 && endcol < startcol))
     die("ERROR: must have 1 <= start <= end <= [msa_length]\n");
 
@@ -449,7 +493,26 @@ int main(int argc, char* argv[]) {
      If so, set output_format to SS ? or FASTA ? */
 
   mfile = phast_fopen(maf_fname, "r");
-  block = mafBlock_read_next(mfile, NULL, NULL);
+  mscan = mafScanner_new(mfile);
+
+  /* if a region of the reference sequence is requested, use a
+     coordinate index to read only the blocks that can overlap it.
+     Bases are masked before blocks are trimmed to the region, so
+     --masked-file reports masked intervals for every block; do not
+     use the index in that case, so the output is the same either way */
+  if (useRefseq && (startcol != 1 || endcol != -1) && order_list == NULL &&
+      masked_file == NULL && mscan->mapped &&
+      (idx = maf_index_load(maf_fname, TRUE)) != NULL) {
+    if (idx->sorted && refseq_retained(idx->refseq, seqlist_str, include)) {
+      i = maf_index_first_block(idx, startcol - 1);
+      blocks_left = (endcol == -1 ? idx->nblocks : 
+                     maf_index_last_block(idx, endcol)) - i;
+      if (blocks_left > 0) mafScanner_seek(mscan, idx->offset[i]);
+      else blocks_left = 0;
+    }
+    maf_index_free(idx);
+  }
+  block = next_block(mscan, &blocks_left);
 
   if (splitInterval == -1 && gff==NULL) {
     //TODO: do we want to copy header from original MAF in this case?
@@ -566,8 +629,9 @@ int main(int argc, char* argv[]) {
 
   get_next_block:
     mafBlock_free(block);
-    block = mafBlock_read_next(mfile, NULL, NULL);
+    block = next_block(mscan, &blocks_left);
   }
+  mafScanner_free(mscan);
 
   if (masked_file != NULL) fclose(masked_file);
 
@@ -636,7 +636,7 @@ int main(int argc, char* argv[]) {
   if (seqlist_str != NULL) 
     seqlist = msa_seq_indices(msa, seqlist_str);
 
-  if (input_format == SS && msa->ss->tuple_idx == NULL) 
+  if ((input_format == SS || input_format == BSS) && msa->ss->tuple_idx == NULL) 
     die("ERROR: ordered representation of alignment required.\n");
 
   split_indices_list = lst_new_int(10);
@@ -17,6 +17,7 @@
 #include <sufficient_stats.h>
 #include <local_alignment.h>
 #include <maf.h>
+#include <parallel.h>
 
 /* minimum number of codons required for -L */
 #define MIN_NCODONS 10
@@ -162,7 +163,7 @@ OPTIONS:\n\
         should both work fine).\n\
 \n\
  (File formats, gap stripping, reordering, etc.)\n\
-    --in-format, -i PHYLIP|FASTA|MPM|MAF|SS\n\
+    --in-format, -i PHYLIP|FASTA|MPM|MAF|SS|BSS\n\
         (Default is to guess format from file contents).  Input file\n\
         format.  FASTA is as usual.  PHYLIP is compatible with the formats\n\
         used in the PHYLIP and PAML packages.  MPM is the format used by the\n\
@@ -172,10 +173,20 @@ OPTIONS:\n\
         sufficient statistics for phylogenetic inference (distinct columns\n\
         or tuple of columns and their counts).  Use --out-format SS with\n\
         --in-format MAF for best efficiency (explicit alignment is\n\
-        never created).  Also, use --unordered-ss if possible.\n\
-\n\
-    --out-format, -o PHYLIP|FASTA|MPM|SS\n\
-        (Default FASTA)  Output file format.\n\
+        never created).  Also, use --unordered-ss if possible.  MAF\n\
+        input is not streamed: the whole alignment is read before\n\
+        output begins, and is held as its distinct columns plus, for\n\
+        ordered output (including FASTA, PHYLIP and MPM), 4 bytes per\n\
+        column, so memory still grows with alignment length; with\n\
+        --unordered-ss it depends only on the number of distinct\n\
+        columns.  Use maf_parse --split to process very long\n\
+        alignments in pieces.  BSS is a\n\
+        binary version of SS that is much faster to read; it is detected\n\
+        automatically wherever SS input is accepted.\n\
+\n\
+    --out-format, -o PHYLIP|FASTA|MPM|SS|BSS\n\
+        (Default FASTA)  Output file format.  Options described as\n\
+        applying to SS output also apply to BSS.\n\
 \n\
     --alphabet, -a <alphabet_string>\n\
         Use the specified alphabet (default \"ACGT\").  In addition,\n\
@@ -289,6 +300,13 @@ OPTIONS:\n\
         collection of MAF blocks (e.g., output of Jim Kent's mafFrags\n\
          program).  Cannot be used with --refseq, --features, or\n\
         --cats-cycle.\n\
+\n\
+    --threads, -j <n>\n\
+        Use up to <n> threads to read the MAF file, when it is a\n\
+        regular file (not a pipe).  Output does not depend on the\n\
+        number of threads.  Ignored with --reverse-groups, or when an\n\
+        ordered representation is produced without projecting onto\n\
+        the reference sequence.  Default is 1.\n\
 \n\
  (Site categories: all options require --out-format SS)\n\
     --features, -g <gff_fname>\n\
@@ -410,7 +428,7 @@ int main(int argc, char* argv[]) {
     rand_perm = FALSE, reverse_compl = FALSE, stats_only = FALSE, win_size = -1, 
     cycle_size = -1, maf_keep_overlapping = FALSE, collapse_missing = FALSE,
     fourD = FALSE, mark_missing_maxsize = -1, missing_as_indels = FALSE,
-    unmask = FALSE, split_all = FALSE;
+    unmask = FALSE, split_all = FALSE, binary_ss = FALSE;
   char c, *out_root=NULL, out_fname[STR_MED_LEN];
   List *cats_to_do = NULL, *aggregate_list = NULL, *msa_fname_list = NULL, 
     *order_list = NULL, *fill_N_list = NULL;
@@ -455,17 +473,19 @@ int main(int argc, char* argv[]) {
     {"clean-indels", 1, 0, 'I'},
     {"randomize", 0, 0, 'R'},
     {"keep-overlapping", 0, 0, 'k'},
+    {"threads", 1, 0, 'j'},
     {"missing-as-indels", 0, 0, 'm'},
     {"split-all", 1, 0, 'X'},
     {"help", 0, 0, 'h'},
     {0, 0, 0, 0}
   };
 
-  while ((c = (char)getopt_long(argc, argv, "i:o:s:e:l:G:r:T:a:g:c:C:L:I:A:M:O:w:N:Y:X:fuDVxPzRSk4mh", long_opts, &opt_idx)) != -1) {
+  while ((c = (char)getopt_long(argc, argv, "i:o:s:e:l:G:r:T:a:g:c:C:L:I:A:M:O:w:N:Y:X:j:fuDVxPzRSk4mh", long_opts, &opt_idx)) != -1) {
     switch(c) {
     case 'i':
       input_format = msa_str_to_format(optarg);
       if (input_format == UNKNOWN_FORMAT) die("ERROR: bad input format.  Try 'msa_view -h' for help.\n");
+      if (input_format == BSS) input_format = SS;
       break;
     case 's':
       startcol = get_arg_int(optarg);
@@ -493,6 +513,10 @@ int main(int argc, char* argv[]) {
     case 'o':
       output_format = msa_str_to_format(optarg);
       if (output_format == UNKNOWN_FORMAT) die("ERROR: bad output format.  Try 'msa_view -h' for help.\n");
+      if (output_format == BSS) {
+        binary_ss = TRUE;       /* otherwise treated as SS */
+        output_format = SS;
+      }
       break;
     case 'a':
       alphabet = optarg;
@@ -584,6 +608,9 @@ int main(int argc, char* argv[]) {
     case 'k':
       maf_keep_overlapping = TRUE;
       break;
+    case 'j':
+      thr_set_nthreads(get_arg_int_bounds(optarg, 1, INFTY));
+      break;
     case 'm':
       missing_as_indels = TRUE;
       break;
@@ -904,7 +931,8 @@ int main(int argc, char* argv[]) {
     
     else {                         /* print alignment */
       msa_update_length(sub_msa);
-      msa_print(stdout, sub_msa, output_format, pretty_print);
+      msa_print(stdout, sub_msa, binary_ss ? BSS : output_format, 
+                pretty_print);
     }
   }
 
@@ -9,6 +9,7 @@
 
 
 #include "bgc_hmm.h"
+#include "parallel.h"
 #include "phastBias.help"
 
 /* Basic idea: 
@@ -67,10 +68,11 @@ int main(int argc, char *argv[]) {
     {"output-mods", 1, 0, 'm'},
     {"informative-fn", 1, 0, 'i'},
     {"informative-only", 0, 0, 'o'},
+    {"threads", 1, 0, 'j'},
     {"help", 0, 0, 'h'},
     {0,0,0,0}};
 
-  while ((c = (char)getopt_long(argc, argv, "B:b:L:l:C:c:R:E:T:S:s:f:g:p:m:i:oWh", long_opts, &opt_idx))
+  while ((c = (char)getopt_long(argc, argv, "B:b:L:l:C:c:R:E:T:S:s:f:g:p:m:i:j:oWh", long_opts, &opt_idx))
 	 != -1) {
     switch (c) {
     case 'B':
@@ -134,6 +136,9 @@ int main(int argc, char *argv[]) {
     case 'o':
       b->informative_only=TRUE;
       break;
+    case 'j':
+      thr_set_nthreads(get_arg_int_bounds(optarg, 1, INFTY));
+      break;
     case 'h':
       printf("%s", HELP);
       exit(0);